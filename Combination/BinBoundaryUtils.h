@@ -45,7 +45,7 @@ namespace BTagCombination {
     inline bin_boundaries()
       {}
     inline bin_boundaries(const bin_boundaries &old)
-      : _axes(old._axes)
+      : _axes(old._axes), _bin_index(old._bin_index)
       {}
 
     // Save another axis in our list.
@@ -59,10 +59,21 @@ namespace BTagCombination {
 
     std::vector<double> get_axis_bins(const std::string &axis_name) const;
 
+    // Remember the grid cell of bin ibin of the analysis: the (root, 1-based) bin number
+    // along each axis, in axis_names() order. -1 for an axis the bin doesn't have.
+    void set_bin_index (size_t ibin, const std::vector<int> &axis_bins);
+
+    // The cell filled in by calcBoundaries for bin ibin of the analysis. Empty if the bin
+    // wasn't used (e.g. an ignored extrapolated bin), or the boundaries were built by hand.
+    std::vector<int> bin_index (size_t ibin) const;
+
   protected:
     // Axis names and bin boundaries
     std::map<std::string, std::vector<double> > _axes;
 
+    // Per analysis bin, the cell it is in.
+    std::vector<std::vector<int> > _bin_index;
+
     inline const std::pair<std::string, std::vector<double> > get_xaxis() const
     { return *(_axes.begin());}
     inline const std::pair<std::string, std::vector<double> > get_yaxis() const
@@ -70,11 +81,18 @@ namespace BTagCombination {
 
     int get_xaxis_bin (const std::vector<CalibrationBinBoundary> &bin_spec) const;
     int get_yaxis_bin (const std::vector<CalibrationBinBoundary> &bin_spec) const;
+
+    // Same, but use the cell remembered for bin ibin if there is one.
+    int get_xaxis_bin (size_t ibin, const std::vector<CalibrationBinBoundary> &bin_spec) const;
+    int get_yaxis_bin (size_t ibin, const std::vector<CalibrationBinBoundary> &bin_spec) const;
     int find_bin (const std::pair<std::string, std::vector<double> > &axis_info,
 		  const std::vector<CalibrationBinBoundary> &bin_spec) const;
   };
 
   // Calculate the bin boundaries for a set of bins. Error if we find inconsistencies.
+  // The result (with the cell of each bin) is remembered, keyed by the binning of the
+  // analysis, so asking again for the same bins - in this or a copy of the analysis -
+  // is cheap. Changing the bins changes the key.
   bin_boundaries calcBoundaries (const CalibrationAnalysis &ana, bool ignoreExtrap = true);
   
   // Check that this list of bin boundaries is consistent
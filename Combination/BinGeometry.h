@@ -0,0 +1,119 @@
+///
+/// BinGeometry.h
+///
+///  Geometric questions about bins - each bin is a box in the space
+/// of its axes (pt, abseta, ...). These replace the pair-by-pair
+/// comparisons that used to be done on sets of bin boundaries.
+///
+#ifndef __BTagCombination__BinGeometry__
+#define __BTagCombination__BinGeometry__
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace BTagCombination {
+
+  // A bin as an axis-aligned box. The axes are sorted by name (the same order
+  // a set<CalibrationBinBoundary> would have).
+  struct BinBox {
+    std::vector<std::string> axes;
+    std::vector<double> low;
+    std::vector<double> high;
+
+    // True if an axis appears more than once in the bin spec (such a bin overlaps nothing).
+    bool repeatedAxis;
+
+    BinBox()
+      : repeatedAxis(false)
+    {}
+    explicit BinBox (const std::vector<CalibrationBinBoundary> &binSpec);
+
+    size_t dimension() const { return axes.size(); }
+
+    // Convert back to a bin spec (in axis order).
+    std::vector<CalibrationBinBoundary> boundaries() const;
+  };
+
+  // Do two boxes on the same axes share any volume? Touching edges do not count.
+  bool BoxesOverlap (const BinBox &b1, const BinBox &b2);
+
+  // Find every pair of bins that partially overlap - they share some volume but
+  // do not have identical boundaries. Bins on different sets of axes never overlap.
+  // Returns index pairs (first < second) into the list, sorted.
+  std::vector<std::pair<size_t, size_t> > FindPartialOverlaps (const std::vector<BinBox> &bins);
+  std::vector<std::pair<size_t, size_t> > FindPartialOverlaps (const std::vector<const CalibrationBin*> &bins);
+
+  // How well a set of bins tiles an area. The regions reported are cells of the grid
+  // made from all the bin edges, so they can be printed as bins.
+  struct BinCoverage {
+    std::vector<BinBox> gaps;      // Parts of the area no bin covers
+    std::vector<BinBox> overlaps;  // Parts of the area covered by more than one bin
+
+    bool exact() const { return gaps.size() == 0 && overlaps.size() == 0; }
+  };
+
+  // Check that the pieces exactly tile the area. Only edges are compared (no areas are
+  // summed), so there are no rounding problems. The pieces must be on the same axes as
+  // the area; anything sticking outside the area is ignored.
+  BinCoverage CheckCoverage (const BinBox &area, const std::vector<BinBox> &pieces);
+
+  // Check many areas at once: area i should be tiled by pieces[groups[i][...]].
+  std::vector<BinCoverage> CheckCoverage (const std::vector<BinBox> &areas,
+					  const std::vector<BinBox> &pieces,
+					  const std::vector<std::vector<size_t> > &groups);
+
+  //
+  // Index over a fixed set of template bins for fast lookup of which template bin a bin
+  // falls in. Template bins on the same axes are mapped onto a grid made from their edges
+  // (sorted per axis), so a lookup is a binary search along each axis. If the template
+  // bins overlap each other the grid can't be used, and lookup falls back to a scan in
+  // template order.
+  //
+  // Ids are the order the template bins were given in. Where more than one template bin
+  // would match, the first one wins.
+  //
+  class BinLookupIndex {
+  public:
+    BinLookupIndex();
+    explicit BinLookupIndex (const std::set<std::set<CalibrationBinBoundary> > &templateBins);
+    explicit BinLookupIndex (const std::vector<std::vector<CalibrationBinBoundary> > &templateBins);
+
+    size_t size() const { return _bins.size(); }
+    const BinBox &bin (size_t id) const { return _bins[id]; }
+    const std::vector<CalibrationBinBoundary> &binSpec (size_t id) const { return _specs[id]; }
+
+    // Id of the template bin that fully contains this bin, or -1 if none do.
+    int find_containing (const BinBox &b) const;
+    int find_containing (const std::vector<CalibrationBinBoundary> &binSpec) const
+    { return find_containing(BinBox(binSpec)); }
+
+    // Id of the template bin with exactly these boundaries, or -1.
+    int find_exact (const BinBox &b) const;
+    int find_exact (const std::vector<CalibrationBinBoundary> &binSpec) const
+    { return find_exact(BinBox(binSpec)); }
+
+  private:
+    // All the template bins on a single set of axes.
+    struct AxesGroup {
+      std::vector<size_t> ids;
+      std::vector<std::vector<double> > edges;
+      std::vector<size_t> stride;
+      std::vector<int> owner;  // Template id for each grid cell (-1 for none)
+      bool linear;             // True if the grid couldn't be built
+    };
+
+    void build();
+    int scan_containing (const AxesGroup &g, const BinBox &b) const;
+
+    std::vector<BinBox> _bins;
+    std::vector<std::vector<CalibrationBinBoundary> > _specs;
+    std::map<std::vector<std::string>, AxesGroup> _groups;
+  };
+}
+
+#endif
@@ -0,0 +1,78 @@
+///
+/// BinKey.h
+///
+///  A compact, canonical identity for a bin. The axis names are interned
+/// to small integer ids, the edges are kept as doubles in a fixed order, and
+/// a 64 bit hash is computed once when the key is made. Two keys are equal
+/// when the bins have the same boundaries (the order the boundaries were
+/// listed in does not matter).
+///
+///  Use these as map keys when grouping bins - the OPBinName string should
+/// only be built when it is needed for display or as a RooFit name.
+///
+#ifndef __BTagCombination__BinKey__
+#define __BTagCombination__BinKey__
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace BTagCombination {
+
+  // Intern an axis name, returning its id (ids are handed out in order of first
+  // use). Safe to call from several threads.
+  unsigned int InternAxisName (const std::string &name);
+
+  // The name of an interned axis.
+  std::string AxisName (unsigned int id);
+
+  class BinKey {
+  public:
+    BinKey();
+    explicit BinKey (const std::vector<CalibrationBinBoundary> &binSpec);
+    explicit BinKey (const std::set<CalibrationBinBoundary> &binSpec);
+    explicit BinKey (const CalibrationBin &bin);
+
+    // The boundaries, in the same order a set<CalibrationBinBoundary> has them.
+    size_t dimension() const { return _axis.size(); }
+    unsigned int axis (size_t i) const { return _axis[i]; }
+    double low (size_t i) const { return _low[i]; }
+    double high (size_t i) const { return _high[i]; }
+
+    unsigned long long hash() const { return _hash; }
+
+    bool operator== (const BinKey &other) const
+    {
+      return _hash == other._hash
+	&& _axis == other._axis
+	&& _low == other._low
+	&& _high == other._high;
+    }
+    bool operator!= (const BinKey &other) const { return !(*this == other); }
+
+    // A fixed ordering for use in sorted containers. It is not the
+    // order of the bin names.
+    bool operator< (const BinKey &other) const;
+
+    // Convert back to boundaries, or to the OPBinName of the bin.
+    std::vector<CalibrationBinBoundary> binSpec() const;
+    std::string name() const;
+
+  private:
+    void init (std::vector<CalibrationBinBoundary> &spec);
+
+    std::vector<unsigned int> _axis;
+    std::vector<double> _low;
+    std::vector<double> _high;
+    unsigned long long _hash;
+  };
+
+  // So a BinKey can be used in unordered containers.
+  struct BinKeyHash {
+    size_t operator() (const BinKey &k) const { return static_cast<size_t>(k.hash()); }
+  };
+}
+
+#endif
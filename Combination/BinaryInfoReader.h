@@ -0,0 +1,130 @@
+///
+/// BinaryInfoReader.h
+///
+///  Decodes the binary calibration format (see CalibrationDataModelBinary.h) straight
+/// from memory. This is the only code that knows the layout of the records: reading a
+/// whole file (ReadBinaryInfo) and reading one in place (MappedCalibrationFile) are both
+/// built on it. Every access is checked against the end of the data, and every count
+/// against what is left, so corrupt data is an error and never a huge allocation.
+///
+///  Records are referred to by their offset in the data. Only the header and the string
+/// table are read when it is made; the data must outlive it.
+///
+#ifndef __BTagCombination__BinaryInfoReader__
+#define __BTagCombination__BinaryInfoReader__
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace BTagCombination {
+
+  class BinaryInfoReader {
+  public:
+    // Check the header, and read the string table. Throws if the data isn't in the binary
+    // format, is a version we don't know, or is cut short. source (a file name) is only
+    // used in error messages.
+    BinaryInfoReader (const char *data, size_t size, const std::string &source = "");
+
+    const std::vector<std::string> &strings() const { return _strings; }
+
+    // Everything, decoded.
+    CalibrationInfo Info() const;
+
+    //
+    // The analysis table
+    //
+
+    size_t nAnalyses() const { return _nAnalyses; }
+
+    // Where the table entry of an analysis is.
+    uint64_t AnalysisEntry (size_t index) const;
+
+    // The names in an entry, by field - see below.
+    enum NameField { kName = 0, kFlavor, kTagger, kOperatingPoint, kJetAlgorithm };
+    const std::string &EntryName (uint64_t entry, NameField field) const;
+    uint32_t EntryNameIndex (uint64_t entry, NameField field) const;
+
+    // An analysis from its table entry: the names and meta data only, or all of it.
+    CalibrationAnalysis AnalysisHeader (uint64_t entry) const;
+    CalibrationAnalysis Analysis (uint64_t entry) const;
+
+    size_t nBins (uint64_t entry) const;
+    uint64_t BinPos (uint64_t entry, size_t index) const;
+
+    //
+    // Bins. The counts are read (and checked) once, so the records after them can be found.
+    //
+
+    struct BinRecord {
+      uint64_t pos;
+      uint32_t nBoundaries, nSys, nRefSys, nMetadata;
+
+      uint64_t boundariesPos() const;
+      uint64_t sysErrorsPos() const;
+      uint64_t metadataPos() const;
+      uint64_t endPos() const;
+    };
+    BinRecord Bin (uint64_t pos) const;
+    CalibrationBin DecodeBin (const BinRecord &bin) const;
+
+    double CentralValue (const BinRecord &bin) const;
+    double StatisticalError (const BinRecord &bin) const;
+    bool IsExtended (const BinRecord &bin) const;
+
+    // A bin boundary, or a systematic error, at its offset.
+    CalibrationBinBoundary Boundary (uint64_t pos) const;
+    const std::string &SysErrorName (uint64_t pos) const;
+    double SysErrorValue (uint64_t pos) const;
+    bool SysErrorUncorrelated (uint64_t pos) const;
+    SystematicError SysError (uint64_t pos) const;
+
+    //
+    // The other sections are small, so they are only ever decoded whole.
+    //
+
+    std::vector<AnalysisCorrelation> Correlations() const;
+    std::vector<DefaultAnalysis> Defaults() const;
+    std::vector<AliasAnalysis> Aliases() const;
+
+  private:
+    void Fail (const std::string &what) const;
+
+    // Checked access.
+    const char *At (uint64_t offset, uint64_t n) const;
+    uint32_t U32At (uint64_t offset) const;
+    uint64_t U64At (uint64_t offset) const;
+    double F64At (uint64_t offset) const;
+    const std::string &Str (uint64_t offset) const;
+
+    // Could n records, of at least recordSize bytes each, start at offset? Checked before
+    // anything is sized from a count.
+    void CheckCount (uint64_t offset, uint64_t n, uint64_t recordSize) const;
+
+    template <typename T>
+    void Names (uint64_t pos, T &a) const
+    {
+      a.name = Str(pos);
+      a.flavor = Str(pos + 4);
+      a.tagger = Str(pos + 8);
+      a.operatingPoint = Str(pos + 12);
+      a.jetAlgorithm = Str(pos + 16);
+    }
+
+    // Each returns the position after what it read.
+    uint64_t Boundaries (uint64_t pos, uint32_t n, std::vector<CalibrationBinBoundary> &spec) const;
+    uint64_t SysErrors (uint64_t pos, uint32_t n, std::vector<SystematicError> &errors) const;
+
+    const char *_data;
+    size_t _size;
+    std::string _source;
+    std::vector<std::string> _strings;
+
+    uint64_t _analysisTable;
+    size_t _nAnalyses;
+  };
+}
+
+#endif
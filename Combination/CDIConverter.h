@@ -10,8 +10,11 @@
 #include "CalibrationDataInterface/CalibrationDataContainer.h"
 
 #include <string>
+#include <vector>
+#include <map>
 #include <stdexcept>
 
+class TDirectory;
 
 namespace BTagCombination {
 
@@ -19,6 +22,44 @@ namespace BTagCombination {
   Analysis::CalibrationDataContainer *ConvertToCDI (const BTagCombination::CalibrationAnalysis &eff,
 						    const std::string &name);
 
+  // A hash of everything that goes into the container ConvertToCDI makes from eff: the
+  // analysis (bins, errors, meta data and so linage) and the version of the converter.
+  // Same hash, same container - used to skip unchanged analyses when updating a file.
+  // Empty if the analysis can't be hashed (e.g. it contains a NaN).
+  std::string ConversionHash (const BTagCombination::CalibrationAnalysis &eff);
+
+  //
+  // Where the containers go in a CDI ROOT file. The directory structure is pretty specific:
+  // tagger/jet algorithm/operating point/flavor, with any '.' in a name turned into a '_'.
+  //
+
+  // The CDI's name for one of our flavors (bottom -> B, etc.).
+  std::string CDIFlavorName (const std::string &flavor);
+
+  // The directories, under the top of the file, that eff's containers go in.
+  std::vector<std::string> CDIContainerDirectories (const BTagCombination::CalibrationAnalysis &eff);
+
+  // Full path of one of eff's containers (as used to key the conversion hashes).
+  std::string CDIContainerPath (const BTagCombination::CalibrationAnalysis &eff, const std::string &name);
+
+  // The named sub-directory of parent, created if it isn't there and create is true (null
+  // if it isn't there and create is false).
+  TDirectory *CDISubDirectory (TDirectory *parent, const std::string &name, bool create = true);
+
+  // Write a container made from eff in its place in the file. With replace, any copy an
+  // earlier run left is removed, rather than a new cycle added.
+  void WriteCDIContainer (TDirectory *file, const BTagCombination::CalibrationAnalysis &eff,
+			  Analysis::CalibrationDataContainer *container, bool replace = false);
+
+  // The ConversionHash of every container in the file, by CDIContainerPath, as saved by
+  // WriteConversionHashes (empty if they were never saved). They are only saved for
+  // incremental updates, as a map at the top of the file.
+  std::map<std::string, std::string> ReadConversionHashes (TDirectory *file);
+  void WriteConversionHashes (TDirectory *file, const std::map<std::string, std::string> &hashes);
+
+  // Is this the name of the key the hashes are saved under?
+  bool IsConversionHashesKey (const std::string &name);
+
   class bad_cdi_config_exception : public std::runtime_error {
   public:
     inline bad_cdi_config_exception (const std::string &reason)
@@ -0,0 +1,141 @@
+///
+/// CalibrationColumns.h
+///
+///  A columnar (structure-of-arrays) copy of the numbers in a
+/// CalibrationAnalysis. The central values, statistical errors, and
+/// systematic errors are stored in contiguous arrays (the systematic
+/// errors as a dense bins x systematics matrix, with the names interned
+/// to small integer ids). The kernels below then work on whole calibrations
+/// with simple loops that the compiler can vectorize.
+///
+///  This is an optional view - the CalibrationAnalysis is still the master
+/// copy. Build the columns, do the number crunching, and write them back.
+///
+#ifndef __BTagCombination__CalibrationColumns__
+#define __BTagCombination__CalibrationColumns__
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace BTagCombination {
+
+  // Maps systematic error names to dense integer ids (in order of first appearance).
+  class SystematicNameTable {
+  public:
+    // Return the id for this name, adding it if it isn't already known.
+    size_t intern (const std::string &name);
+
+    // Return the id for this name, or -1 if it isn't known.
+    int find (const std::string &name) const;
+
+    const std::string &name (size_t id) const { return _names[id]; }
+    size_t size() const { return _names.size(); }
+
+    // The ids, ordered by name (the order the rest of the code sorts systematics in).
+    std::vector<size_t> sorted_ids() const;
+
+  private:
+    std::map<std::string, size_t> _lookup;
+    std::vector<std::string> _names;
+  };
+
+  // A bin can (wrongly) have two errors with the same name. Only one of them goes into
+  // the columns (the others still count towards the totals - see sysDuplicateSquares).
+  enum DuplicateErrors {
+    kFirstDuplicate, // The first of them
+    kLastDuplicate // The last of them (as a name->error map built from the bin would have)
+  };
+
+  // The numbers from a calibration analysis, laid out in columns.
+  class CalibrationColumns {
+  public:
+    CalibrationColumns();
+
+    // Copy the numbers out of an analysis. If includeExtended is false, extended
+    // bins are skipped (binIndex tracks which bin each row came from).
+    explicit CalibrationColumns (const CalibrationAnalysis &ana, bool includeExtended = true,
+				 DuplicateErrors duplicates = kFirstDuplicate);
+
+    size_t nbins() const { return centralValue.size(); }
+    size_t nsys() const { return sysNames.size(); }
+
+    // Add a new systematic column (all zero, not present in any bin), or
+    // return the existing one.
+    size_t add_systematic (const std::string &name, bool uncorrelated = false);
+
+    // Remove a systematic from every bin (the column stays, but is marked absent). Only
+    // the error of that name that is in the columns is removed (see write_back).
+    void drop_systematic (const std::string &name);
+
+    // Access to an element of the systematic error matrix.
+    double &sys (size_t bin, size_t id) { return sysValue[bin*nsys() + id]; }
+    double sys (size_t bin, size_t id) const { return sysValue[bin*nsys() + id]; }
+    bool has_sys (size_t bin, size_t id) const { return sysPresent[bin*nsys() + id] != 0; }
+    void set_sys (size_t bin, size_t id, double value);
+
+    // Write the numbers back into an analysis. The analysis must be the one
+    // (or a copy of the one) these columns were built from. Existing errors are
+    // updated in place, new ones are appended, and removed ones erased. A bin with
+    // the same error twice only has one of them in the columns (see DuplicateErrors):
+    // the others are left in place, untouched.
+    void write_back (CalibrationAnalysis &ana) const;
+
+    // The columns themselves. The systematic matrix is row-major (one row per bin), and
+    // missing errors are stored as zero so they can be summed without looking at the mask.
+    std::vector<double> centralValue;
+    std::vector<double> statError;
+    std::vector<size_t> binIndex;
+    SystematicNameTable sysNames;
+    std::vector<char> sysUncorrelated;
+    std::vector<double> sysValue;
+    std::vector<char> sysPresent;
+
+    // Per bin, the sum of the squares of the errors that aren't in the matrix because
+    // another error of the same name is. The totals below include them, as a sum over
+    // all of a bin's errors would.
+    std::vector<double> sysDuplicateSquares;
+
+  private:
+    void resize_sys (size_t newNSys);
+
+    // For each of the bin's errors, whether it is the one in the columns.
+    std::vector<char> in_columns (const CalibrationBin &b) const;
+
+    DuplicateErrors _duplicates;
+  };
+
+  //
+  // Kernels that run over the columns
+  //
+
+  // Sum of all systematic errors in quadrature, per bin (duplicates included).
+  std::vector<double> ColumnSysQuadratureSum (const CalibrationColumns &c);
+
+  // Statistical and all systematic errors in quadrature, per bin.
+  std::vector<double> ColumnTotalError (const CalibrationColumns &c);
+
+  // Errors as a percent of the central value (errors are left as is when the central value is zero).
+  void RelativeErrors (const double *errors, const double *centralValues, double *result, size_t n);
+
+  // Multiply a systematic column by a factor.
+  void ScaleSystematic (CalibrationColumns &c, size_t id, double factor);
+
+  // Set a systematic column to percent% of the central value in every bin.
+  void SetSystematicFromPercent (CalibrationColumns &c, size_t id, double percent);
+
+  // The weighted average of n values, and the sum of the weights.
+  double WeightedAverage (const double *values, const double *weights, size_t n, double &sumWeights);
+
+  // Combine groups of rows with a weighted average. The weight of each row is 1/stat^2, and
+  // the systematic errors are averaged with the same weights (they are assumed not to
+  // scale with statistics). Returns one row per group; a systematic is present in a row if
+  // it was present in any of the grouped rows, and binIndex is that of the group's first row.
+  // Duplicate errors (not in the matrix) are not carried into the averaged rows.
+  CalibrationColumns WeightedAverageRows (const CalibrationColumns &c,
+					  const std::vector<std::vector<size_t> > &groups);
+}
+
+#endif
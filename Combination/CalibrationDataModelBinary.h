@@ -0,0 +1,104 @@
+///
+/// CalibrationDataModelBinary.h
+///
+///  An exact, compact binary encoding of the calibration data model. Unlike the text
+/// format nothing is rounded, and nothing is checked or merged on the way back in, so
+/// what is read is exactly what was written. Numbers are stored little-endian whatever
+/// the machine.
+///
+#ifndef __BTagCombination__CalibrationDataModelBinary__
+#define __BTagCombination__CalibrationDataModelBinary__
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <stdint.h>
+
+namespace BTagCombination {
+
+  void WriteBinary (std::ostream &out, const CalibrationAnalysis &ana);
+
+  // Throws if the data is cut short.
+  CalibrationAnalysis ReadBinaryAnalysis (std::istream &in);
+
+  //
+  // A whole CalibrationInfo (analyses, correlations, defaults and aliases) as a file of
+  // its own. Every name is stored once, in a string table, and referred to by number;
+  // there are offset tables so a reader can go straight to any analysis or bin without
+  // reading what comes before it. The layout is below.
+  //
+
+  void WriteBinaryInfo (std::ostream &out, const CalibrationInfo &info);
+
+  // Read back a whole file's worth. Throws if the data isn't in the binary format, is
+  // a version we don't know, or is cut short.
+  CalibrationInfo ReadBinaryInfo (std::istream &in);
+  CalibrationInfo ReadBinaryInfo (const char *data, size_t size);
+
+  // Does the data (at least the first 8 bytes of a file) start with the magic number?
+  bool IsBinaryInfo (const char *data, size_t size);
+
+  // The file layout. Everything is little-endian, and every record starts on an 8 byte
+  // boundary. Strings are u32 indices into the string table.
+  //
+  //  header:       magic[8], u32 version, u32 0, u64 offsets of the string table,
+  //                analysis table, correlations, defaults and aliases, u64 file size
+  //  string table: u32 n, u32 0, u64 offset[n] -> each is u32 length, then the bytes
+  //  analyses:     u32 n, u32 0, then n entries of
+  //                  u64 offset, u32 name, flavor, tagger, operatingPoint, jetAlgorithm, nBins
+  //  analysis:     u32 nBins, nMetadata, nMetadata_s, 0, u64 binOffset[nBins],
+  //                  metadata (u32 name, u32 n, f64[n]), metadata_s (u32 name, u32 value)
+  //  bin:          u32 nBoundaries, nSys, nRefSys, nMetadata, isExtended, 0,
+  //                  f64 centralValue, f64 statisticalError,
+  //                  boundaries (u32 variable, u32 0, f64 low, f64 high),
+  //                  sys and ref sys (u32 name, u32 uncorrelated, f64 value),
+  //                  metadata (u32 name, u32 0, f64 value, f64 error)
+  //  correlations: u32 n, u32 0, then each u32 analysis1, analysis2, flavor, tagger,
+  //                  operatingPoint, jetAlgorithm, nBins, 0, and for each bin
+  //                  u32 nBoundaries, u32 hasStatCorrelation, f64 statCorrelation, boundaries
+  //  defaults:     u32 n, u32 0, then each u32 name, flavor, tagger, operatingPoint, jetAlgorithm, 0
+  //  aliases:      u32 n, u32 0, then each u32 name, flavor, tagger, operatingPoint,
+  //                  jetAlgorithm, nTargets, and the targets as for the defaults
+  //
+  namespace BinaryInfoFormat {
+    const char cMagic[8] = { 'F', 'T', 'C', 'A', 'L', 'I', 'B', '\x1a' };
+    const uint32_t cVersion = 1;
+
+    const size_t cHeaderSize = 64;
+    const size_t cStringsOffset = 16;
+    const size_t cAnalysesOffset = 24;
+    const size_t cCorrelationsOffset = 32;
+    const size_t cDefaultsOffset = 40;
+    const size_t cAliasesOffset = 48;
+    const size_t cFileSizeOffset = 56;
+
+    const size_t cAnalysisEntrySize = 32;
+    const size_t cBinHeaderSize = 40;
+    const size_t cBoundarySize = 24;
+    const size_t cSysErrorSize = 16;
+    const size_t cBinMetadataSize = 24;
+
+    inline uint32_t U32 (const char *p)
+    {
+      const unsigned char *b = reinterpret_cast<const unsigned char*>(p);
+      return uint32_t(b[0]) | (uint32_t(b[1]) << 8) | (uint32_t(b[2]) << 16) | (uint32_t(b[3]) << 24);
+    }
+
+    inline uint64_t U64 (const char *p)
+    {
+      return uint64_t(U32(p)) | (uint64_t(U32(p + 4)) << 32);
+    }
+
+    inline double F64 (const char *p)
+    {
+      uint64_t bits = U64(p);
+      double v;
+      memcpy(&v, &bits, sizeof(v));
+      return v;
+    }
+  }
+}
+
+#endif
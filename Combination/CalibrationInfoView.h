@@ -0,0 +1,108 @@
+///
+/// CalibrationInfoView.h
+///
+///  A masked view of a list of analyses (usually those in a CalibrationInfo).
+/// Instead of copying all the analyses to leave out a bin, drop a systematic
+/// error, or make a systematic error uncorrelated, the view just records the
+/// change. The combiner reads the original data through the view, so making a
+/// variation for a study costs only as much as the mask.
+///
+///  Views are cheap to copy - the masks are small, and the bin keys are built
+/// once and shared between copies. The analyses being viewed must outlive the
+/// view.
+///
+#ifndef __BTagCombination__CalibrationInfoView__
+#define __BTagCombination__CalibrationInfoView__
+
+#include "Combination/CalibrationDataModel.h"
+#include "Combination/BinKey.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace BTagCombination {
+
+  class CalibrationInfoView {
+  public:
+    // View everything in a CalibrationInfo.
+    explicit CalibrationInfoView (const CalibrationInfo &info);
+
+    // View a list of analyses (there are no correlations in this view).
+    explicit CalibrationInfoView (const std::vector<CalibrationAnalysis> &analyses);
+
+    //
+    // Change the view. These touch only the masks.
+    //
+
+    // Only look at these analyses (indices into the underlying list).
+    void selectAnalyses (const std::vector<size_t> &indices);
+
+    // Hide a bin in every analysis.
+    void removeBin (const std::set<CalibrationBinBoundary> &bin);
+
+    // Hide every bin but this one.
+    void keepOnlyBin (const std::set<CalibrationBinBoundary> &bin);
+
+    // Hide a systematic error in every bin.
+    void removeSysError (const std::string &name);
+
+    // Treat a systematic error as uncorrelated between bins.
+    void makeSysErrorUncorrelated (const std::string &name);
+
+    //
+    // Look at what is in the view.
+    //
+
+    // Indices of the analyses in the view. An analysis drops out if a bin mask has
+    // removed all of its bins.
+    std::vector<size_t> analysisIndices() const;
+    size_t nAnalyses() const { return analysisIndices().size(); }
+
+    const CalibrationAnalysis &analysis (size_t index) const { return (*_analyses)[index]; }
+    const BinKey &binKey (size_t index, size_t bin) const { return (*_binKeys)[index][bin]; }
+    bool binVisible (size_t index, size_t bin) const;
+
+    bool sysVisible (const SystematicError &e) const;
+    bool sysUncorrelated (const SystematicError &e) const;
+
+    const std::vector<AnalysisCorrelation> &correlations() const;
+    const std::string &combinationName() const;
+
+    // All the bins, and all the systematic errors, in the view.
+    std::set<std::set<CalibrationBinBoundary> > listAllBins() const;
+    std::set<std::string> listAllSysErrors() const;
+
+    // Split into one view per flavor/tagger/op/jet (like BinAnalysesByJetTagFlavOp).
+    std::map<std::string, CalibrationInfoView> splitByJetTagFlavOp() const;
+
+    //
+    // Make copies. Only do this when something really needs a copy of the data.
+    //
+
+    // The analyses in the view without their bins (name, metadata, etc.).
+    std::vector<CalibrationAnalysis> headers() const;
+
+    // The analyses in the view, with all the masks applied.
+    std::vector<CalibrationAnalysis> materialize() const;
+
+  private:
+    void init();
+    bool hasBinMask() const { return _removedBins.size() > 0 || _keepOnlyBins.size() > 0; }
+
+    const std::vector<CalibrationAnalysis> *_analyses;
+    const CalibrationInfo *_info;
+
+    std::shared_ptr<const std::vector<std::vector<BinKey> > > _binKeys;
+
+    std::vector<size_t> _selected;
+    std::vector<BinKey> _removedBins;
+    std::vector<BinKey> _keepOnlyBins;
+    std::set<std::string> _removedSys;
+    std::set<std::string> _uncorrelatedSys;
+  };
+}
+
+#endif
@@ -29,6 +29,14 @@ namespace BTagCombination {
 
     inline void SetVerbose (bool v) { _verbose = v; }
 
+    /// Also count the NLL calls of each minimization in the fit phases. This runs the
+    /// minimizer by hand instead of through fitTo (with the same settings).
+    inline void SetFitTiming (bool v) { _fitTiming = v; }
+
+    /// The minimizer settings every fit is done with (strategy, minimizer, tolerance...), as
+    /// text. Anything that caches fit results should key on it.
+    static std::string FitSettings();
+
   private:
     // How quiet should we be? Mouse like is false.
     bool _verbose;
@@ -36,6 +44,9 @@ namespace BTagCombination {
     /// Should we make plots as a diagnostic output?
     bool _doPlots;
 
+    // Count the NLL calls?
+    bool _fitTiming;
+
     // Any common measurements that are over correlated are "bad"
     void TurnOffOverCorrelations();
 
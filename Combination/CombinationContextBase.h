@@ -39,6 +39,26 @@ namespace BTagCombination {
       std::map<std::string, double> _pulls; // Pulls from the fit.
       std::map<std::string, std::pair<double, double> > _nuisance; // Nuisance from the fit, along with the error
 
+      // Where the time went during the fit. One entry per phase, in the order they were
+      // run: "build", "master", one "sys" for each frozen systematic error refit, "chi2",
+      // "stat" and "restore". The MINUIT numbers are only filled for phases that minimize.
+      struct FitPhase
+      {
+	std::string name;
+	std::string sysErrorName; // Only for the "sys" phases
+	double wallTime; // seconds
+	double cpuTime; // seconds
+
+	bool minimized;
+	int minuitStatus;
+	double edm;
+	int nllCalls; // Only counted with CombinationContext::SetFitTiming
+      };
+      std::vector<FitPhase> _phases;
+
+      int _nParameters; // Floating parameters in the fit
+      int _nMeasurements; // Measurements that went into the fit
+
       void clear();
     };
 
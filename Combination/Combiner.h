@@ -9,10 +9,14 @@
 
 #include "Combination/Parser.h"
 #include <set>
+#include <functional>
 
 namespace BTagCombination
 {
 	class CombinationContext;
+  class BinLookupIndex;
+  class CalibrationInfoView;
+  class FitResultCache;
 
   // Given a list of single bins, return a combined single bin
   // Reuses much of internal infrastructure, so good for testing, but
@@ -29,9 +33,31 @@ namespace BTagCombination
   };
 
   // Given a list of analyses (different jet algorithms, different tags, different, etc.), with bins all equal on boundaries,
-  // combine them and return the total new combined analysis.
+  // combine them and return the total new combined analysis. With fitTiming the time spent in each
+  // phase of each fit, and the MINUIT status, goes into the result's meta data (fit_time_master, etc.).
+  // With a cache, a group of analyses that has been fit before (same inputs, same settings) is
+  // not refit - the saved result is used - and new fits are saved to it.
   std::vector<CalibrationAnalysis> CombineAnalyses (const CalibrationInfo &info, bool verbose = true,
-						    CombinationType combineType = kCombineByFullAnalysis);
+						    CombinationType combineType = kCombineByFullAnalysis,
+						    bool fitTiming = false,
+						    FitResultCache *cache = 0);
+
+  // Same, but combine what is visible through a view. Use this to combine variations (a bin
+  // or a systematic error removed, etc.) without copying all the analyses for each one.
+  std::vector<CalibrationAnalysis> CombineAnalyses (const CalibrationInfoView &info, bool verbose = true,
+						    CombinationType combineType = kCombineByFullAnalysis,
+						    bool fitTiming = false,
+						    FitResultCache *cache = 0);
+
+  // Same, but each group's result is handed to done as soon as it has been fit, rather than
+  // all of them returned at the end - so the next step can start on it while the rest are
+  // fit. The results come in the same order as the vector above. done is called on this
+  // thread; if it throws, the combination stops.
+  typedef std::function<void (const CalibrationAnalysis &)> CombinedGroupSink;
+  void CombineAnalyses (const CalibrationInfoView &info, const CombinedGroupSink &done, bool verbose = true,
+			CombinationType combineType = kCombineByFullAnalysis,
+			bool fitTiming = false,
+			FitResultCache *cache = 0);
 
   // Given a set of template bins, force the analysis into those bins. Bins are combined - they can't
   // be split. Further source bins must fully cover the template bins - no gaps. runtime_error is
@@ -40,6 +66,11 @@ namespace BTagCombination
   CalibrationAnalysis RebinAnalysis (const std::set<std::set<CalibrationBinBoundary> > &templateBinning,
 				     const CalibrationAnalysis &ana);
 
+  // Same, but with the template bins already indexed (saves rebuilding the index when
+  // many analyses are rebinned to the same template).
+  CalibrationAnalysis RebinAnalysis (const BinLookupIndex &templateBinning,
+				     const CalibrationAnalysis &ana);
+
   // Populate a combination context with everything from a single analysis
   void FillContext(CombinationContext &ctx, CalibrationAnalysis &ana);
 }
@@ -7,17 +7,19 @@
 #define __CommonCommandLineUtils_H__
 
 #include "Combination/Parser.h"
+#include "Combination/MappedCalibrationFile.h"
 
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <set>
 
 namespace BTagCombination {
 
   // Given the command line arguments, return a list of the
   // operating points and the flags that we didn't know how
-  // to parse.
+  // to parse. "--trace <file>" starts tracing (see Tracing.h) before anything is loaded.
   void ParseOPInputArgs (const char **argv, int argc,
 			 CalibrationInfo &operatingPoints,
 			 std::vector<std::string> &unknownFlags);
@@ -26,6 +28,41 @@ namespace BTagCombination {
 			 CalibrationInfo &operatingPoints,
 			 std::vector<std::string> &unknownFlags);
 
+  // For the biggest inputs: if the arguments are a single binary format file, and nothing
+  // that would change what ParseOPInputArgs loads from it (no --ignore, etc.), map the file
+  // instead (see MappedCalibrationFile.h) and return the flags ParseOPInputArgs wouldn't
+  // know. Otherwise returns null, and ParseOPInputArgs should be used.
+  std::unique_ptr<MappedCalibrationFile> MapOPInputArgs (const std::vector<std::string> &args,
+							 std::vector<std::string> &unknownFlags);
+
+  // An analysis ParseOPInputArgs would have loaded from a mapped file, not yet read: its
+  // names and meta data, and the parts of the file with its bins. An alias copy has the
+  // names of the copy.
+  struct MappedInputAnalysis {
+    CalibrationAnalysis header;
+    std::vector<MappedAnalysis> parts;
+
+    // Read the bins, giving the analysis ParseOPInputArgs would have.
+    CalibrationAnalysis load() const;
+  };
+
+  // The analyses ParseOPInputArgs would have loaded from a mapped file, in the same order.
+  std::vector<MappedInputAnalysis> MappedInputAnalyses (const MappedCalibrationFile &file);
+
+  // For long-lived processes (see FTServer): keep what is parsed from each text input file
+  // in memory, so loading it again - in this process, or in one forked from it - doesn't
+  // parse it again unless it has changed on disk. Off by default. Not thread safe.
+  void KeepParsedInputs (bool keep = true);
+
+  // With KeepParsedInputs on, parse a file now if it hasn't been already. Returns false
+  // if it isn't a text input file (it isn't there, is binary, or doesn't parse). A file
+  // that doesn't parse isn't tried again until it changes.
+  bool PreloadInputFile (const std::string &fname);
+
+  // With KeepParsedInputs on, the text input files (full paths) that ParseOPInputArgs has
+  // loaded in this process - so a forked run can tell the server which files were inputs.
+  std::vector<std::string> LoadedInputFiles ();
+
   // Split a list of analyses by the bins we often use for doing the combination.
   // Useful utility. :-)
   std::map<std::string, std::vector<CalibrationAnalysis> > BinAnalysesByJetTagFlavOp (const std::vector<CalibrationAnalysis> &anas);
@@ -0,0 +1,33 @@
+///
+/// FNVHash.h
+///
+///  64 bit FNV-1a. Unlike std::hash it is the same on every machine and in
+/// every build, so it can be used for anything that is saved (file names,
+/// conversion hashes, shard assignments). Don't change it - the saved
+/// values would no longer match.
+///
+#ifndef __BTagCombination__FNVHash__
+#define __BTagCombination__FNVHash__
+
+#include <cstddef>
+
+namespace BTagCombination {
+
+  const unsigned long long kFNV1a64Offset = 14695981039346656037ULL;
+  const unsigned long long kFNV1a64Prime = 1099511628211ULL;
+
+  // Hash n bytes. To hash several pieces as one, pass the result of the last
+  // piece as the seed of the next.
+  inline unsigned long long FNV1a64 (const char *data, size_t n,
+				     unsigned long long seed = kFNV1a64Offset)
+  {
+    unsigned long long h = seed;
+    for (size_t i = 0; i < n; i++) {
+      h ^= static_cast<unsigned char>(data[i]);
+      h *= kFNV1a64Prime;
+    }
+    return h;
+  }
+}
+
+#endif
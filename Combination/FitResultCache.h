@@ -0,0 +1,89 @@
+///
+/// FitResultCache.h
+///
+///  An on-disk cache of combination results. Each entry is keyed by everything that goes
+/// into a fit - the analyses exactly as they are fit, the correlations that could apply to
+/// them, how the fit is done and with which fitter settings, and the version of the fitting
+/// code - so a rerun only refits the groups whose inputs changed.
+///
+///  Entries are files in a directory, one per result, so several processes can share a
+/// cache. A file is named by a hash of its key, but holds the whole key, and a result is
+/// only used if that matches. When the cache grows past its limits the least recently used
+/// entries are removed.
+///
+#ifndef __BTagCombination__FitResultCache__
+#define __BTagCombination__FitResultCache__
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace BTagCombination {
+
+  class FitResultCache {
+  public:
+    // Keep the cache in this directory (it is made if it isn't there). A limit of zero
+    // means no limit.
+    explicit FitResultCache (const std::string &directory,
+			     unsigned long long maxBytes = 1024ULL*1024*1024,
+			     size_t maxEntries = 0);
+
+    // The key for a fit of these analyses. Only the correlations between analyses in the
+    // list are used. settings should describe anything else that changes the result (the
+    // kind of fit, the name of the result, the fitter settings, etc.). The key is the
+    // inputs themselves (in the binary format), not a digest of them.
+    static std::string Key (const std::vector<CalibrationAnalysis> &anas,
+			    const std::vector<AnalysisCorrelation> &correlations,
+			    const std::string &settings);
+
+    // Fill result and return true if there is an entry for key.
+    bool Lookup (const std::string &key, CalibrationAnalysis &result);
+
+    // Save a result, removing old entries if the cache is now too big.
+    void Store (const std::string &key, const CalibrationAnalysis &result);
+
+    const std::string &directory() const { return _directory; }
+
+    // What the cache has done so far. The size is what was there when the cache was
+    // opened plus what has been stored since; it is brought up to date with the directory
+    // (other processes may share it) whenever entries are removed.
+    struct Stats {
+      Stats()
+	: hits(0), misses(0), stores(0), evictions(0), entries(0), bytes(0)
+      {}
+      size_t hits, misses, stores, evictions;
+      size_t entries;
+      unsigned long long bytes;
+    };
+    Stats stats() const;
+
+  private:
+    std::string Path (const std::string &key) const;
+
+    bool OverLimits () const;
+
+    // Look at what is in the directory and, if it is over the limits, remove the oldest
+    // entries until it is a tenth under them (so this isn't done on every store). _lock
+    // must be held.
+    void Evict ();
+
+    std::string _directory;
+    unsigned long long _maxBytes;
+    size_t _maxEntries;
+
+    mutable std::mutex _lock;
+    Stats _stats;
+  };
+
+  // The value of --fitCacheMB: a whole number of megabytes. Returns the size in bytes, and
+  // throws if it isn't a number (or is too big).
+  unsigned long long ParseFitCacheMB (const std::string &value);
+
+  // One line summary: hits, misses, stores, evictions and the size.
+  std::ostream &operator<< (std::ostream &out, const FitResultCache::Stats &s);
+}
+
+#endif
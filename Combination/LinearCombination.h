@@ -0,0 +1,85 @@
+///
+/// LinearCombination.h
+///
+///  The combination written as a generalised least squares problem. With every
+/// systematic error a Gaussian constrained nuisance parameter, the combiner's fit
+/// is linear, and its answer can be written down directly:
+///
+///    mu = (A' P A)^-1 A' P y,   cov(mu) = (A' P A)^-1,   chi2 = r' P r
+///
+/// y are the measurements, A maps each measurement to the bin it measures, P is the
+/// inverse of the full covariance matrix (statistical errors, their correlations,
+/// and all the systematic errors), and r = y - A mu.
+///
+///  P is worked out once. Leaving out bins is then a Schur complement of P, and
+/// leaving out a systematic error (or making it uncorrelated) is a low rank change
+/// to the covariance matrix, which the Woodbury identity turns into a low rank
+/// change to P. Each of those costs far less than filling and running a new fit.
+///
+///  The combiner also turns off measurements whose correlations make a fit
+/// impossible; this does not. Where that matters, run the full fit.
+///
+#ifndef __BTagCombination__LinearCombination__
+#define __BTagCombination__LinearCombination__
+
+#include "Combination/CalibrationInfoView.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace BTagCombination {
+
+  class LinearCombination {
+  public:
+    // Everything visible in the view is combined, all bins at once (as the
+    // combiner does with kCombineByFullAnalysis). Throws if the covariance
+    // matrix can't be inverted.
+    explicit LinearCombination (const CalibrationInfoView &info);
+
+    struct BinResult {
+      double centralValue;
+      double error; // Total - statistical and systematic.
+    };
+
+    struct Result {
+      double chi2;
+      int ndof;
+      std::map<std::set<CalibrationBinBoundary>, BinResult> bins;
+    };
+
+    // The combination of everything in the view.
+    Result Solve() const;
+
+    // The combination as if the view had these bins removed, these systematic
+    // errors removed, or these systematic errors made uncorrelated.
+    Result SolveWithoutBins (const std::set<std::set<CalibrationBinBoundary> > &bins) const;
+    Result SolveWithoutSysErrors (const std::set<std::string> &names) const;
+    Result SolveWithSysErrorsUncorrelated (const std::set<std::string> &names) const;
+
+    size_t nMeasurements() const { return _y.size(); }
+
+  private:
+    // A systematic error, as it enters the fit. An uncorrelated error is one of
+    // these for each bin (shared by all the analyses that measure the bin).
+    struct SysColumn {
+      std::string name;
+      int bin; // -1 if correlated across bins.
+      std::vector<double> values; // One for each measurement.
+    };
+
+    Result Solve (const std::vector<size_t> &rows, const std::vector<double> &P) const;
+
+    // P - P U (Cinv + U' P U)^-1 U' P; Cinv is diagonal.
+    std::vector<double> Woodbury (const std::vector<std::vector<double> > &U, const std::vector<double> &Cinv) const;
+
+    std::vector<double> _y;
+    std::vector<size_t> _bin;
+    std::vector<std::set<CalibrationBinBoundary> > _bins;
+    std::vector<SysColumn> _sys;
+    std::vector<double> _P;
+  };
+}
+
+#endif
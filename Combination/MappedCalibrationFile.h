@@ -0,0 +1,152 @@
+///
+/// MappedCalibrationFile.h
+///
+///  Read a binary format calibration file (see CalibrationDataModelBinary.h) in place,
+/// mapped into memory, rather than loading all of it. Analyses, bins and systematic
+/// errors are decoded straight from the mapping when they are asked for, so a tool that
+/// looks at a few analyses only touches the pages they are on - and processes on the same
+/// machine that map the same file share its pages.
+///
+///  Only the string table (each name once) and the analysis table are read when the file
+/// is opened. The accessors are small values that point into the file; they must not
+/// outlive it. The decoding itself is done by BinaryInfoReader, as for ReadBinaryInfo.
+///
+#ifndef __BTagCombination__MappedCalibrationFile__
+#define __BTagCombination__MappedCalibrationFile__
+
+#include "Combination/CalibrationDataModel.h"
+#include "Combination/BinaryInfoReader.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace BTagCombination {
+
+  // A systematic error in a bin.
+  class MappedSysError {
+  public:
+    const std::string &name() const;
+    double value() const;
+    bool uncorrelated() const;
+
+    SystematicError materialize() const;
+
+  private:
+    friend class MappedBin;
+    MappedSysError (const BinaryInfoReader *reader, uint64_t pos)
+      : _reader(reader), _pos(pos)
+    {}
+
+    const BinaryInfoReader *_reader;
+    uint64_t _pos;
+  };
+
+  // A bin of an analysis.
+  class MappedBin {
+  public:
+    size_t nBoundaries() const { return _bin.nBoundaries; }
+    CalibrationBinBoundary boundary (size_t index) const;
+    std::vector<CalibrationBinBoundary> binSpec() const;
+
+    double centralValue() const;
+    double statisticalError() const;
+    bool isExtended() const;
+
+    size_t nSysErrors() const { return _bin.nSys; }
+    MappedSysError sysError (size_t index) const;
+
+    size_t nReferenceSysErrors() const { return _bin.nRefSys; }
+    MappedSysError referenceSysError (size_t index) const;
+
+    CalibrationBin materialize() const;
+
+  private:
+    friend class MappedAnalysis;
+    MappedBin (const BinaryInfoReader *reader, uint64_t pos)
+      : _reader(reader), _bin(reader->Bin(pos))
+    {}
+
+    const BinaryInfoReader *_reader;
+    BinaryInfoReader::BinRecord _bin;
+  };
+
+  // An analysis, as it was stored. If an analysis was split into several parts (by
+  // giving it bins in more than one place), each part is stored separately.
+  class MappedAnalysis {
+  public:
+    const std::string &name() const;
+    const std::string &flavor() const;
+    const std::string &tagger() const;
+    const std::string &operatingPoint() const;
+    const std::string &jetAlgorithm() const;
+
+    size_t nBins() const;
+    MappedBin bin (size_t index) const;
+
+    // The names and meta data, but no bins.
+    CalibrationAnalysis header() const;
+
+    CalibrationAnalysis materialize() const;
+
+  private:
+    friend class MappedCalibrationFile;
+    MappedAnalysis (const BinaryInfoReader *reader, uint64_t entry)
+      : _reader(reader), _entry(entry)
+    {}
+
+    const BinaryInfoReader *_reader;
+    uint64_t _entry;
+  };
+
+  class MappedCalibrationFile {
+  public:
+    // Map the file. Throws if it can't be read, or isn't in the binary format.
+    explicit MappedCalibrationFile (const std::string &fileName);
+    ~MappedCalibrationFile();
+
+    // Is the file there, and in the binary format? Reads only the first few bytes.
+    static bool IsBinaryFile (const std::string &fileName);
+
+    const std::string &fileName() const { return _fileName; }
+
+    size_t nAnalyses() const { return _reader->nAnalyses(); }
+    MappedAnalysis analysis (size_t index) const;
+
+    // All the parts stored under these names, in file order (empty if there are none).
+    std::vector<MappedAnalysis> find (const std::string &name, const std::string &flavor,
+				      const std::string &tagger, const std::string &operatingPoint,
+				      const std::string &jetAlgorithm) const;
+
+    // The other sections are small, so they are just decoded.
+    std::vector<AnalysisCorrelation> correlations() const;
+    std::vector<DefaultAnalysis> defaults() const;
+    std::vector<AliasAnalysis> aliases() const;
+
+    // Everything, as ReadBinaryInfo would return it.
+    CalibrationInfo materialize() const;
+
+  private:
+    MappedCalibrationFile (const MappedCalibrationFile &);
+    MappedCalibrationFile &operator= (const MappedCalibrationFile &);
+
+    std::string _fileName;
+    const char *_data;
+    size_t _size;
+#ifdef _WIN32
+    std::string _buffer;
+#endif
+
+    std::unique_ptr<BinaryInfoReader> _reader;
+    std::unordered_map<std::string, uint32_t> _stringIndex;
+
+    // The analysis table entries for each (name, flavor, tagger, op, jet), by string number.
+    typedef std::vector<uint32_t> t_NameKey;
+    std::map<t_NameKey, std::vector<size_t> > _index;
+  };
+}
+
+#endif
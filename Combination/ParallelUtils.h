@@ -0,0 +1,243 @@
+///
+/// ParallelUtils.h
+///
+///  Run independent pieces of work on a few threads, and hand the results back
+/// on the calling thread in order. For places where the work can be done in
+/// parallel, but the output (e.g. a ROOT file) must only be touched by one
+/// thread, and in a deterministic order. And the other way around: hand work
+/// made on the calling thread to one other thread, in order.
+///
+#ifndef __BTagCombination__ParallelUtils__
+#define __BTagCombination__ParallelUtils__
+
+#include "Combination/Tracing.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace BTagCombination {
+
+  // Run work(i) for i = 0..n-1 on nThreads threads. consume(i, result) is called on the
+  // calling thread, strictly in order of i, as the results become ready. No more than
+  // maxAhead results (default 4 per thread) are waiting to be consumed at any time, so
+  // memory stays bounded when consuming is slow.
+  //
+  // If work or consume throws, the remaining work is abandoned and the exception is
+  // rethrown here (work's exceptions in turn, when its result would have been consumed).
+  // With nThreads <= 1 everything is done inline, one item at a time.
+  //
+  // Results are moved, not copied, so T can own what it holds (e.g. a unique_ptr): results
+  // made but never consumed, because the run was abandoned, are then freed on the way out.
+  template <typename T>
+  void OrderedParallelFor (size_t n, unsigned int nThreads,
+			   const std::function<T (size_t)> &work,
+			   const std::function<void (size_t, T&)> &consume,
+			   size_t maxAhead = 0)
+  {
+    if (nThreads <= 1 || n <= 1) {
+      for (size_t i = 0; i < n; i++) {
+	T r (work(i));
+	consume(i, r);
+      }
+      return;
+    }
+
+    if (maxAhead == 0)
+      maxAhead = 4*nThreads;
+    if (nThreads > n)
+      nThreads = n;
+
+    struct slot {
+      slot() : done(false) {}
+      bool done;
+      T result;
+      std::exception_ptr error;
+    };
+    std::vector<slot> slots (n);
+
+    std::mutex lock;
+    std::condition_variable changed;
+    size_t next = 0;
+    size_t consumed = 0;
+    bool abort = false;
+
+    auto worker = [&] () {
+      for (;;) {
+	size_t i;
+	{
+	  std::unique_lock<std::mutex> l (lock);
+	  changed.wait(l, [&] () { return abort || next >= n || next < consumed + maxAhead; });
+	  if (abort || next >= n)
+	    return;
+	  i = next++;
+	}
+
+	T r = T();
+	std::exception_ptr error;
+	TraceSpan span ("parallel work");
+	try {
+	  r = work(i);
+	} catch (...) {
+	  error = std::current_exception();
+	}
+	span.End();
+
+	{
+	  std::lock_guard<std::mutex> l (lock);
+	  slots[i].result = std::move(r);
+	  slots[i].error = error;
+	  slots[i].done = true;
+	}
+	changed.notify_all();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < nThreads; t++)
+      threads.push_back(std::thread(worker));
+
+    // Once a slot is done, the workers never touch it again.
+    std::exception_ptr failure;
+    for (size_t i = 0; i < n; i++) {
+      {
+	TraceSpan wait ("wait for result");
+	std::unique_lock<std::mutex> l (lock);
+	changed.wait(l, [&] () { return slots[i].done; });
+      }
+
+      if (slots[i].error) {
+	failure = slots[i].error;
+	break;
+      }
+      try {
+	consume(i, slots[i].result);
+      } catch (...) {
+	failure = std::current_exception();
+	break;
+      }
+
+      {
+	std::lock_guard<std::mutex> l (lock);
+	consumed = i + 1;
+      }
+      changed.notify_all();
+    }
+
+    if (failure) {
+      std::lock_guard<std::mutex> l (lock);
+      abort = true;
+    }
+    changed.notify_all();
+    for (size_t t = 0; t < threads.size(); t++)
+      threads[t].join();
+
+    if (failure)
+      std::rethrow_exception(failure);
+  }
+
+  // Hand items to consume(item), which runs on a single other thread, in the order they
+  // were pushed. For work that has to stay on the calling thread (e.g. the fits) feeding
+  // something slow that can go on at the same time (e.g. writing a ROOT file). Push blocks
+  // while maxQueued items are waiting to be consumed, so memory stays bounded.
+  //
+  // If consume throws, nothing more is consumed, and the exception is rethrown by the next
+  // Push, or by Finish. Call Finish to wait for everything pushed to be consumed - if the
+  // consumer is destroyed without that, whatever is still waiting is dropped.
+  template <typename T>
+  class BackgroundConsumer
+  {
+  public:
+    BackgroundConsumer (const std::function<void (T&)> &consume, size_t maxQueued = 4)
+      : _consume(consume), _maxQueued(maxQueued == 0 ? 1 : maxQueued),
+	_finished(false), _abort(false)
+    {
+      _thread = std::thread([this] () { run(); });
+    }
+
+    ~BackgroundConsumer ()
+    {
+      if (_thread.joinable()) {
+	{
+	  std::lock_guard<std::mutex> l (_lock);
+	  _abort = true;
+	}
+	_changed.notify_all();
+	_thread.join();
+      }
+    }
+
+    void Push (const T &item)
+    {
+      {
+	TraceSpan wait ("wait for consumer");
+	std::unique_lock<std::mutex> l (_lock);
+	_changed.wait(l, [&] () { return _error || _queue.size() < _maxQueued; });
+	if (_error)
+	  std::rethrow_exception(_error);
+	_queue.push_back(item);
+      }
+      _changed.notify_all();
+    }
+
+    void Finish ()
+    {
+      {
+	std::lock_guard<std::mutex> l (_lock);
+	_finished = true;
+      }
+      _changed.notify_all();
+      if (_thread.joinable())
+	_thread.join();
+      if (_error)
+	std::rethrow_exception(_error);
+    }
+
+  private:
+    void run ()
+    {
+      for (;;) {
+	T item;
+	{
+	  std::unique_lock<std::mutex> l (_lock);
+	  _changed.wait(l, [&] () { return _abort || _finished || !_queue.empty(); });
+	  if (_abort || _queue.empty())
+	    return;
+	  item = std::move(_queue.front());
+	  _queue.pop_front();
+	}
+	_changed.notify_all();
+
+	TraceSpan span ("background work");
+	try {
+	  _consume(item);
+	} catch (...) {
+	  {
+	    std::lock_guard<std::mutex> l (_lock);
+	    _error = std::current_exception();
+	    _queue.clear();
+	  }
+	  _changed.notify_all();
+	  return;
+	}
+      }
+    }
+
+    std::function<void (T&)> _consume;
+    size_t _maxQueued;
+    std::deque<T> _queue;
+    bool _finished;
+    bool _abort;
+    std::exception_ptr _error;
+    std::mutex _lock;
+    std::condition_variable _changed;
+    std::thread _thread;
+  };
+}
+
+#endif
@@ -0,0 +1,47 @@
+///
+/// Pipeline.h
+///
+///  The steps between a combination and a CDI file - extrapolating, picking out the
+/// defaults - done on analyses in memory. FTExtrapolateAnalyses, FTCopyDefaults and
+/// FTConvertToCDI each do one of them on a text file; FTPipeline runs them one after the
+/// other on each group as it comes out of the fit, without writing the results out as text
+/// and parsing them back in between (which costs time, and precision).
+///
+#ifndef __BTagCombination__Pipeline__
+#define __BTagCombination__Pipeline__
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace BTagCombination {
+
+  // Remove the analyses with any of these names from info, and return them. Used to set the
+  // extrapolation analyses aside, so they aren't combined with the rest.
+  std::vector<CalibrationAnalysis> TakeAnalyses (CalibrationInfo &info, const std::vector<std::string> &names);
+
+  // Applies extrapolation analyses (see addExtrapolation), each to the analyses of the same
+  // tagger, jet algorithm, flavor and operating point.
+  class Extrapolator
+  {
+  public:
+    Extrapolator (const std::vector<CalibrationAnalysis> &extrapolations);
+
+    // ana with its extrapolation added, or just ana if there isn't one. Throws if there is
+    // more than one.
+    CalibrationAnalysis Apply (const CalibrationAnalysis &ana) const;
+
+  private:
+    std::map<std::string, std::vector<CalibrationAnalysis> > _byGroup;
+  };
+
+  // True if ana is one of the defaults ("*" matches anything).
+  bool IsDefaultAnalysis (const std::vector<DefaultAnalysis> &defaults, const CalibrationAnalysis &ana);
+
+  // The default made from ana: a copy, called "default".
+  CalibrationAnalysis MakeDefaultAnalysis (const CalibrationAnalysis &ana);
+}
+
+#endif
@@ -0,0 +1,58 @@
+///
+/// Sharding.h
+///
+///  Split a combination across several processes (or batch jobs), each fitting some of
+/// the flavor/tagger/operating point/jet algorithm groups, and put the pieces back
+/// together. Every shard works out the whole assignment from the same inputs, so they
+/// agree on it without talking to each other.
+///
+///  A shard's output is the same text the combination would have written for its groups,
+/// each after a "# group" comment line, so it is still a valid input file. MergeShards
+/// checks that every shard of the split is there, once, and writes the groups in the
+/// order an unsharded run would have - giving exactly the same file.
+///
+#ifndef __BTagCombination__Sharding__
+#define __BTagCombination__Sharding__
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace BTagCombination {
+
+  // Shard index of count, 0 <= index < count.
+  struct ShardSpec {
+    ShardSpec() : index(0), count(1) {}
+    size_t index, count;
+  };
+
+  // Parse "i/N". Throws if it isn't that, or i is out of range.
+  ShardSpec ParseShardSpec (const std::string &spec);
+
+  // How long a group will take to fit, roughly: its measurements times the number of
+  // systematic errors they have.
+  double EstimateGroupCost (const std::vector<CalibrationAnalysis> &group);
+
+  // The shard for each group (keyed as BinAnalysesByJetTagFlavOp does). Without balance a
+  // stable hash of the group name picks it, so a group stays on the same shard when others
+  // come and go. With balance the most expensive groups are placed first, each on the
+  // shard with the least work so far.
+  std::map<std::string, size_t> AssignShards (const std::map<std::string, std::vector<CalibrationAnalysis> > &groups,
+					      size_t nShards, bool balance = false);
+
+  // Remove the analyses in groups that belong to other shards.
+  void KeepShard (CalibrationInfo &info, const ShardSpec &shard, bool balance = false);
+
+  // Write one shard's combined analyses.
+  void WriteShard (std::ostream &out, const ShardSpec &shard, const std::vector<CalibrationAnalysis> &results);
+
+  // Put the shards' outputs (the text of each file) back together. Throws if one is
+  // missing or there twice, they aren't all from the same split, or a group turns up
+  // in two of them.
+  void MergeShards (const std::vector<std::string> &shards, std::ostream &out);
+}
+
+#endif
@@ -0,0 +1,25 @@
+///
+/// SubsetUtils.h
+///
+///  Count and number the k-element subsets of n items, so a long list of them (e.g.
+/// every way of removing 2 of 60 systematic errors) can be walked one at a time
+/// without ever being built. Subsets are lists of item indices, sorted, and are
+/// numbered in lexicographic order - the same order a set<set<T> > of them would have.
+///
+#ifndef __BTagCombination__SubsetUtils__
+#define __BTagCombination__SubsetUtils__
+
+#include <vector>
+#include <cstddef>
+
+namespace BTagCombination {
+
+  // n choose k. Zero if k > n. Throws if the answer doesn't fit.
+  unsigned long long nChooseK (size_t n, size_t k);
+
+  // The k-subset of n items with number rank (0 to nChooseK(n,k)-1), in lexicographic order.
+  // Throws if rank is out of range.
+  std::vector<size_t> NthSubset (size_t n, size_t k, unsigned long long rank);
+}
+
+#endif
@@ -0,0 +1,60 @@
+///
+/// SyntheticInputs.h
+///
+///  Make up calibration inputs - as many analyses, bins and systematic errors as
+/// asked for - for scaling studies. Everything is drawn from a seeded random number
+/// generator, so the same spec always gives the same inputs.
+///
+#ifndef __BTagCombination__SyntheticInputs__
+#define __BTagCombination__SyntheticInputs__
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <string>
+#include <vector>
+
+namespace BTagCombination {
+
+  struct SyntheticInputSpec {
+    SyntheticInputSpec();
+
+    unsigned long long seed;
+
+    // Analyses for each flavor, tagger, operating point and jet algorithm.
+    size_t nAnalyses;
+    std::vector<std::string> flavors;
+    std::vector<std::string> taggers;
+    std::vector<std::string> operatingPoints;
+    std::vector<std::string> jetAlgorithms;
+
+    // The bins are pt x abseta. With no eta bins there is no abseta axis.
+    size_t nPtBins;
+    size_t nEtaBins;
+
+    // Extended (extrapolation) bins added above the last pt bin, in the first
+    // analysis of each group.
+    size_t nExtendedBins;
+
+    // Systematic errors in each analysis. sharedSysFraction of them are common to all
+    // the analyses (and so correlated between them); the rest belong to one analysis,
+    // and uncorrelatedSysFraction of those are uncorrelated between bins.
+    size_t nSys;
+    double sharedSysFraction;
+    double uncorrelatedSysFraction;
+
+    // The fraction of (analysis pair, bin)s with a statistical correlation. The
+    // correlations are small enough that the covariance matrix is always positive
+    // definite.
+    double correlationDensity;
+
+    // Make the first analysis of each group the default, and copy it to a jet
+    // algorithm called <jetAlgorithm>Copy.
+    bool defaults;
+    bool copies;
+  };
+
+  // Make the inputs. Throws if the spec doesn't make sense.
+  CalibrationInfo GenerateSyntheticInputs (const SyntheticInputSpec &spec);
+}
+
+#endif
@@ -0,0 +1,22 @@
+///
+/// ToolMains.h
+///
+///  The command line tools that FTServer can run, as functions. Each is the whole tool:
+/// it takes the tool's command line (argv[0] is the tool name), writes to cout/cerr and
+/// the files the tool writes, and returns the tool's exit code. The FT* programs are just
+/// a main that calls one of these.
+///
+#ifndef __BTagCombination__ToolMains__
+#define __BTagCombination__ToolMains__
+
+namespace BTagCombination {
+
+  int FTCombineMain (int argc, char **argv);
+  int FTCombineBinsMain (int argc, char **argv);
+  int FTExtrapolateAnalysesMain (int argc, char **argv);
+  int FTDumpMain (int argc, char **argv);
+  int FTConvertToCDIMain (int argc, char **argv);
+  int FTPipelineMain (int argc, char **argv);
+}
+
+#endif
@@ -0,0 +1,211 @@
+///
+/// ToolProtocol.h
+///
+///  How a client asks FTServer (see ToolServer.h) to run a tool, over a Unix-domain
+/// socket. Header only, so FTClient needn't link against the library - and so doesn't
+/// pay for loading ROOT, which is the point.
+///
+///  The client connects and sends a single byte with its stdin, stdout and stderr
+/// attached, then the number of strings, and each string (its length, then the bytes):
+/// the working directory, then the command line, starting with the tool name. When the
+/// tool is done the server sends back its exit code. Numbers are 32 bits, in the
+/// machine's byte order (both ends are on the same machine).
+///
+#ifndef __BTagCombination__ToolProtocol__
+#define __BTagCombination__ToolProtocol__
+
+#ifndef _WIN32
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace BTagCombination {
+
+  namespace ToolProtocol {
+
+    // No one sends command lines this long - don't trust them if they say so.
+    const uint32_t cMaxStrings = 100000;
+    const uint32_t cMaxStringLength = 1024*1024;
+
+    inline void WriteAll (int fd, const void *data, size_t n)
+    {
+      const char *p = static_cast<const char*>(data);
+      while (n > 0) {
+	ssize_t w = write(fd, p, n);
+	if (w < 0 && errno == EINTR)
+	  continue;
+	if (w <= 0)
+	  throw std::runtime_error(std::string("Unable to write to the server connection: ") + strerror(errno));
+	p += w;
+	n -= w;
+      }
+    }
+
+    // False if the other end has gone away before all n bytes came.
+    inline bool ReadAll (int fd, void *data, size_t n)
+    {
+      char *p = static_cast<char*>(data);
+      while (n > 0) {
+	ssize_t r = read(fd, p, n);
+	if (r < 0 && errno == EINTR)
+	  continue;
+	if (r <= 0)
+	  return false;
+	p += r;
+	n -= r;
+      }
+      return true;
+    }
+
+    inline void WriteStrings (int fd, const std::vector<std::string> &strings)
+    {
+      uint32_t n = strings.size();
+      WriteAll(fd, &n, sizeof(n));
+      for (size_t i = 0; i < strings.size(); i++) {
+	uint32_t len = strings[i].size();
+	WriteAll(fd, &len, sizeof(len));
+	WriteAll(fd, strings[i].data(), len);
+      }
+    }
+
+    inline std::vector<std::string> ReadStrings (int fd)
+    {
+      uint32_t n;
+      if (!ReadAll(fd, &n, sizeof(n)) || n > cMaxStrings)
+	throw std::runtime_error("Bad request on the server connection.");
+      std::vector<std::string> strings (n);
+      for (size_t i = 0; i < n; i++) {
+	uint32_t len;
+	if (!ReadAll(fd, &len, sizeof(len)) || len > cMaxStringLength)
+	  throw std::runtime_error("Bad request on the server connection.");
+	strings[i].resize(len);
+	if (len > 0 && !ReadAll(fd, &strings[i][0], len))
+	  throw std::runtime_error("Bad request on the server connection.");
+      }
+      return strings;
+    }
+
+    // Send the file descriptors (with one byte, as something has to be sent).
+    inline void SendFds (int sock, const int *fds, int n)
+    {
+      char byte = 0;
+      iovec iov;
+      iov.iov_base = &byte;
+      iov.iov_len = 1;
+
+      std::vector<char> control (CMSG_SPACE(n * sizeof(int)));
+      msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = &control[0];
+      msg.msg_controllen = control.size();
+
+      cmsghdr *c = CMSG_FIRSTHDR(&msg);
+      c->cmsg_level = SOL_SOCKET;
+      c->cmsg_type = SCM_RIGHTS;
+      c->cmsg_len = CMSG_LEN(n * sizeof(int));
+      memcpy(CMSG_DATA(c), fds, n * sizeof(int));
+
+      if (sendmsg(sock, &msg, 0) != 1)
+	throw std::runtime_error(std::string("Unable to write to the server connection: ") + strerror(errno));
+    }
+
+    // Returns how many descriptors came (at most n); the caller owns them.
+    inline int ReceiveFds (int sock, int *fds, int n)
+    {
+      char byte;
+      iovec iov;
+      iov.iov_base = &byte;
+      iov.iov_len = 1;
+
+      std::vector<char> control (CMSG_SPACE(n * sizeof(int)));
+      msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = &control[0];
+      msg.msg_controllen = control.size();
+
+      if (recvmsg(sock, &msg, 0) != 1)
+	return 0;
+      int got = 0;
+      for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c != 0; c = CMSG_NXTHDR(&msg, c)) {
+	if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+	  continue;
+	int nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+	const int *data = reinterpret_cast<const int*>(CMSG_DATA(c));
+	for (int i = 0; i < nfds; i++) {
+	  if (got < n)
+	    fds[got++] = data[i];
+	  else
+	    close(data[i]);
+	}
+      }
+      return got;
+    }
+
+    inline sockaddr_un SocketAddress (const std::string &path)
+    {
+      sockaddr_un addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      if (path.size() >= sizeof(addr.sun_path))
+	throw std::runtime_error("Socket path '" + path + "' is too long.");
+      strcpy(addr.sun_path, path.c_str());
+      return addr;
+    }
+  }
+
+  // Run a command line (tool name first) on the server listening at socketPath, with this
+  // process's working directory, stdin, stdout and stderr. Returns the tool's exit code.
+  // Throws if the server can't be reached, or goes away before the tool finishes.
+  inline int RunOnToolServer (const std::string &socketPath, const std::vector<std::string> &args)
+  {
+    using namespace ToolProtocol;
+
+    sockaddr_un addr (SocketAddress(socketPath));
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+      throw std::runtime_error(std::string("Unable to make a socket: ") + strerror(errno));
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      close(sock);
+      throw std::runtime_error("Unable to connect to the server at '" + socketPath + "': " + strerror(errno));
+    }
+
+    int32_t code;
+    try {
+      char cwd[4096];
+      if (getcwd(cwd, sizeof(cwd)) == 0)
+	throw std::runtime_error("Unable to find the working directory.");
+
+      std::vector<std::string> request;
+      request.push_back(cwd);
+      request.insert(request.end(), args.begin(), args.end());
+
+      int fds[3] = {0, 1, 2};
+      SendFds(sock, fds, 3);
+      WriteStrings(sock, request);
+
+      if (!ReadAll(sock, &code, sizeof(code)))
+	throw std::runtime_error("The server went away before '" + (args.size() > 0 ? args[0] : std::string("")) + "' finished.");
+    } catch (...) {
+      close(sock);
+      throw;
+    }
+    close(sock);
+    return code;
+  }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+///
+/// ToolServer.h
+///
+///  Run the command line tools (see ToolMains.h) from a long-lived process, so a run
+/// doesn't pay for starting up - loading ROOT and RooFit - or for parsing inputs that
+/// haven't changed since the last one. Requests come in on a Unix-domain socket (see
+/// ToolProtocol.h). Each is run in a process forked from the server, in the client's
+/// working directory and with its stdin, stdout and stderr, so a tool behaves as it does
+/// from the command line, and nothing it does is seen by the next one.
+///
+///  Each run tells the server which text input files it loaded, and the server then parses
+/// them into memory (see KeepParsedInputs), so later runs start with them already parsed.
+///
+///  Only the user running the server can use it: the socket is made readable and writable
+/// by them alone, and a connection from anyone else is dropped.
+///
+#ifndef __BTagCombination__ToolServer__
+#define __BTagCombination__ToolServer__
+
+#include <map>
+#include <string>
+
+namespace BTagCombination {
+
+  typedef int (*ToolMain) (int argc, char **argv);
+
+  // Serve requests on socketPath until a client asks the server to stop (a command line
+  // of just "--stop"). The tool is looked up by the first word of the command line. A
+  // client that hasn't sent its whole request in requestTimeout seconds is dropped. Throws
+  // if the socket can't be set up, or another server is already using it. Not available
+  // on Windows.
+  void ServeTools (const std::string &socketPath, const std::map<std::string, ToolMain> &tools,
+		   int requestTimeout = 10);
+}
+
+#endif
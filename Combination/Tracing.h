@@ -0,0 +1,82 @@
+///
+/// Tracing.h
+///
+///  Process wide tracing of where the time goes. Put a TraceSpan on the stack around
+/// anything interesting. If tracing has been started (--trace <file> on the command
+/// line of any of the tools) each span is recorded, along with the thread and process it
+/// ran in, and written out in the Chrome trace event format. Load the file into
+/// chrome://tracing or ui.perfetto.dev to see the critical path and the idle time.
+///
+///  When tracing is off a span costs a check of one flag.
+///
+#ifndef __BTagCombination__Tracing__
+#define __BTagCombination__Tracing__
+
+#include <atomic>
+#include <string>
+
+namespace BTagCombination {
+
+  // Start recording, and write the trace to fileName (which is started afresh). The
+  // spans are written out as the buffer fills and at exit. Processes forked from this one
+  // keep tracing, and add their spans to the same file.
+  void StartTracing (const std::string &fileName);
+
+  // Write out anything recorded but not yet written. A process that leaves via _exit
+  // (e.g. a forked worker) should call this first.
+  void FlushTrace ();
+
+  namespace Tracing {
+    extern std::atomic<bool> gEnabled;
+  }
+
+  inline bool TracingEnabled ()
+  {
+    return Tracing::gEnabled.load(std::memory_order_relaxed);
+  }
+
+  // A span from construction to destruction (or End). The name must outlive the
+  // program (a string literal); detail is copied, and shows up in the span's arguments.
+  class TraceSpan
+  {
+  public:
+    explicit TraceSpan (const char *name)
+      : _name (0), _start (0)
+    {
+      if (TracingEnabled())
+	Start(name, 0);
+    }
+
+    TraceSpan (const char *name, const std::string &detail)
+      : _name (0), _start (0)
+    {
+      if (TracingEnabled())
+	Start(name, &detail);
+    }
+
+    ~TraceSpan ()
+    {
+      End();
+    }
+
+    // End the span early.
+    void End ()
+    {
+      if (_name != 0)
+	Stop();
+    }
+
+  private:
+    TraceSpan (const TraceSpan &);
+    TraceSpan &operator= (const TraceSpan &);
+
+    void Start (const char *name, const std::string *detail);
+    void Stop ();
+
+    const char *_name;
+    std::string _detail;
+    long long _start;
+  };
+}
+
+#endif
@@ -6,10 +6,14 @@
 #include "Combination/BinUtils.h"
 #include "Combination/BinNameUtils.h"
 #include "Combination/CommonCommandLineUtils.h"
+#include "Combination/FNVHash.h"
 
 #include <sstream>
 #include <algorithm>
 #include <set>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 
@@ -192,63 +196,99 @@ namespace {
     }
     return false;
   }
-  
-}
 
-namespace BTagCombination {
+  //
+  // calcBoundaries is asked for the same binning over and over (merging, extrapolating,
+  // converting). Remember the answers, keyed by a hash of everything it looks at: the bin
+  // specs (in order - the cells are per bin), which bins are extrapolated, and the flag.
+  // The inputs are kept as well, so a hash collision only costs a recalculation.
+  //
+  struct boundaries_cache_entry {
+    bool ignoreExtrap;
+    vector<vector<CalibrationBinBoundary> > specs;
+    vector<bool> extended;
+    bin_boundaries result;
+  };
 
-  ///
-  /// The bin_boudnaries object
-  ///
+  mutex gBoundariesLock;
+  unordered_map<unsigned long long, boundaries_cache_entry> gBoundariesCache;
+  const size_t kMaxCachedBoundaries = 4096;
 
-  int bin_boundaries::get_xaxis_bin (const vector<CalibrationBinBoundary> &bin_spec) const
+  // FNV-1a over the bytes that matter.
+  void hash_bytes (unsigned long long &h, const void *data, size_t n)
   {
-    return find_bin (get_xaxis(), bin_spec);
+    h = FNV1a64(static_cast<const char*>(data), n, h);
   }
 
-  int bin_boundaries::get_yaxis_bin (const vector<CalibrationBinBoundary> &bin_spec) const
+  void hash_double (unsigned long long &h, double v)
   {
-    return find_bin (get_yaxis(), bin_spec);
+    if (v == 0.0)
+      v = 0.0; // -0.0 is the same bin edge
+    hash_bytes(h, &v, sizeof(v));
   }
 
-  // return a list of the axes we know about.
-  vector<string> bin_boundaries::axis_names() const
+  unsigned long long binning_hash (const CalibrationAnalysis &ana, bool ignoreExtrap)
   {
-    vector<string> result;
-    for(map<string,vector<double> >::const_iterator itr = _axes.begin(); itr != _axes.end(); itr++) {
-      result.push_back(itr->first);
+    unsigned long long h = kFNV1a64Offset;
+    hash_bytes(h, &ignoreExtrap, sizeof(ignoreExtrap));
+    for (size_t ibin = 0; ibin < ana.bins.size(); ibin++) {
+      const CalibrationBin &bin(ana.bins[ibin]);
+      hash_bytes(h, &bin.isExtended, sizeof(bin.isExtended));
+      size_t n = bin.binSpec.size();
+      hash_bytes(h, &n, sizeof(n));
+      for (size_t ib = 0; ib < n; ib++) {
+	const CalibrationBinBoundary &b(bin.binSpec[ib]);
+	hash_bytes(h, b.variable.data(), b.variable.size());
+	hash_double(h, b.lowvalue);
+	hash_double(h, b.highvalue);
+      }
     }
-    return result;
+    return h;
   }
 
-  // return bin boundaries for aparticular bin. Bomb if we can't find them.
-  vector<double> bin_boundaries::get_axis_bins(const string &axis_name) const
+  // Is the cached entry really for this binning?
+  bool same_binning (const boundaries_cache_entry &e, const CalibrationAnalysis &ana, bool ignoreExtrap)
   {
-    vector<double> result;
-    map<string,vector<double> >::const_iterator axis = _axes.find(axis_name);
-    if (axis == _axes.end())
-      throw runtime_error ((string("This analysis has no axis called '") + axis_name + "'").c_str());
-    return axis->second;
+    if (e.ignoreExtrap != ignoreExtrap || e.specs.size() != ana.bins.size())
+      return false;
+    for (size_t ibin = 0; ibin < ana.bins.size(); ibin++) {
+      if (e.extended[ibin] != ana.bins[ibin].isExtended
+	  || e.specs[ibin] != ana.bins[ibin].binSpec)
+	return false;
+    }
+    return true;
   }
 
-  int bin_boundaries::find_bin (const pair<string, vector<double> > &axis_info,
-			 const vector<CalibrationBinBoundary> &bin_spec) const
+  // Find the cell each bin falls in. Done once, when the boundaries are calculated.
+  void fill_bin_index (bin_boundaries &result, const CalibrationAnalysis &ana, bool ignoreExtrap)
   {
-    CalibrationBinBoundary spec = BinBoundaryUtils::find_spec(bin_spec, axis_info.first);
-    for (unsigned int ibin = 0; ibin < axis_info.second.size(); ibin++) {
-      if (spec.lowvalue == axis_info.second[ibin]) {
-	return ibin + 1; // Remamer, root is offset by 1 its bin numbers!!
+    vector<string> axes(result.axis_names());
+    vector<vector<double> > edges;
+    for (size_t i_a = 0; i_a < axes.size(); i_a++)
+      edges.push_back(result.get_axis_bins(axes[i_a]));
+
+    for (size_t ibin = 0; ibin < ana.bins.size(); ibin++) {
+      const CalibrationBin &bin(ana.bins[ibin]);
+      if (ignoreExtrap && bin.isExtended)
+	continue;
+
+      vector<int> cell(axes.size(), -1);
+      for (size_t ib = 0; ib < bin.binSpec.size(); ib++) {
+	size_t i_a = lower_bound(axes.begin(), axes.end(), bin.binSpec[ib].variable) - axes.begin();
+	if (i_a == axes.size() || axes[i_a] != bin.binSpec[ib].variable)
+	  continue;
+	vector<double>::const_iterator e = lower_bound(edges[i_a].begin(), edges[i_a].end(), bin.binSpec[ib].lowvalue);
+	if (e != edges[i_a].end() && *e == bin.binSpec[ib].lowvalue)
+	  cell[i_a] = int(e - edges[i_a].begin()) + 1; // root bins start at 1
       }
+      result.set_bin_index(ibin, cell);
     }
-    ostringstream error;
-    error << "Unable to find bin wiht lower boundary '" << spec.lowvalue << "' in axis '" << axis_info.first << "'.";
-    throw runtime_error (error.str().c_str());
   }
 
   // Grab the boundaries from the analysis, and put them into
   // an object that knows how to create historams, etc., for teh CDI.
   // Fail fairly resolutely if we find problems (overlaps, thin bins, etc.).
-  bin_boundaries calcBoundaries (const CalibrationAnalysis &ana, bool ignoreExtrap)
+  bin_boundaries computeBoundaries (const CalibrationAnalysis &ana, bool ignoreExtrap)
   {
     // Find all the bins that are in the analysis
     t_bin_list raw_bins = extract_bins(ana, ignoreExtrap);
@@ -291,9 +331,117 @@ namespace BTagCombination {
       throw bin_boundary_error (errmsg.str().c_str());
     }
 
+    fill_bin_index(result, ana, ignoreExtrap);
+    return result;
+  }
+}
+
+namespace BTagCombination {
+
+  ///
+  /// The bin_boudnaries object
+  ///
+
+  int bin_boundaries::get_xaxis_bin (const vector<CalibrationBinBoundary> &bin_spec) const
+  {
+    return find_bin (get_xaxis(), bin_spec);
+  }
+
+  int bin_boundaries::get_yaxis_bin (const vector<CalibrationBinBoundary> &bin_spec) const
+  {
+    return find_bin (get_yaxis(), bin_spec);
+  }
+
+  int bin_boundaries::get_xaxis_bin (size_t ibin, const vector<CalibrationBinBoundary> &bin_spec) const
+  {
+    if (ibin < _bin_index.size() && _bin_index[ibin].size() == _axes.size() && _bin_index[ibin][0] > 0)
+      return _bin_index[ibin][0];
+    return get_xaxis_bin (bin_spec);
+  }
+
+  int bin_boundaries::get_yaxis_bin (size_t ibin, const vector<CalibrationBinBoundary> &bin_spec) const
+  {
+    if (ibin < _bin_index.size() && _bin_index[ibin].size() == _axes.size() && _axes.size() > 1 && _bin_index[ibin][1] > 0)
+      return _bin_index[ibin][1];
+    return get_yaxis_bin (bin_spec);
+  }
+
+  void bin_boundaries::set_bin_index (size_t ibin, const vector<int> &axis_bins)
+  {
+    if (ibin >= _bin_index.size())
+      _bin_index.resize(ibin+1);
+    _bin_index[ibin] = axis_bins;
+  }
+
+  vector<int> bin_boundaries::bin_index (size_t ibin) const
+  {
+    if (ibin >= _bin_index.size())
+      return vector<int>();
+    return _bin_index[ibin];
+  }
+
+  // return a list of the axes we know about.
+  vector<string> bin_boundaries::axis_names() const
+  {
+    vector<string> result;
+    for(map<string,vector<double> >::const_iterator itr = _axes.begin(); itr != _axes.end(); itr++) {
+      result.push_back(itr->first);
+    }
     return result;
   }
 
+  // return bin boundaries for aparticular bin. Bomb if we can't find them.
+  vector<double> bin_boundaries::get_axis_bins(const string &axis_name) const
+  {
+    vector<double> result;
+    map<string,vector<double> >::const_iterator axis = _axes.find(axis_name);
+    if (axis == _axes.end())
+      throw runtime_error ((string("This analysis has no axis called '") + axis_name + "'").c_str());
+    return axis->second;
+  }
+
+  int bin_boundaries::find_bin (const pair<string, vector<double> > &axis_info,
+			 const vector<CalibrationBinBoundary> &bin_spec) const
+  {
+    CalibrationBinBoundary spec = BinBoundaryUtils::find_spec(bin_spec, axis_info.first);
+    for (unsigned int ibin = 0; ibin < axis_info.second.size(); ibin++) {
+      if (spec.lowvalue == axis_info.second[ibin]) {
+	return ibin + 1; // Remamer, root is offset by 1 its bin numbers!!
+      }
+    }
+    ostringstream error;
+    error << "Unable to find bin wiht lower boundary '" << spec.lowvalue << "' in axis '" << axis_info.first << "'.";
+    throw runtime_error (error.str().c_str());
+  }
+
+  // Calculate the boundaries, or reuse them if we've seen this binning before. Failures
+  // aren't remembered - they throw every time.
+  bin_boundaries calcBoundaries (const CalibrationAnalysis &ana, bool ignoreExtrap)
+  {
+    unsigned long long h = binning_hash(ana, ignoreExtrap);
+    {
+      lock_guard<mutex> lock(gBoundariesLock);
+      unordered_map<unsigned long long, boundaries_cache_entry>::const_iterator itr = gBoundariesCache.find(h);
+      if (itr != gBoundariesCache.end() && same_binning(itr->second, ana, ignoreExtrap))
+	return itr->second.result;
+    }
+
+    // Not holding the lock while calculating - two threads may both do the work, which is fine.
+    boundaries_cache_entry e;
+    e.ignoreExtrap = ignoreExtrap;
+    e.result = computeBoundaries(ana, ignoreExtrap);
+    for (size_t ibin = 0; ibin < ana.bins.size(); ibin++) {
+      e.specs.push_back(ana.bins[ibin].binSpec);
+      e.extended.push_back(ana.bins[ibin].isExtended);
+    }
+
+    lock_guard<mutex> lock(gBoundariesLock);
+    if (gBoundariesCache.size() >= kMaxCachedBoundaries)
+      gBoundariesCache.clear();
+    gBoundariesCache[h] = e;
+    return e.result;
+  }
+
   //
   // Check to see if bins from multiple analyses are consistent. If not,
   // then total failure and throw!
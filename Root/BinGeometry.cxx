@@ -0,0 +1,456 @@
+//
+// Geometry of bins - overlaps, etc.
+//
+
+#include "Combination/BinGeometry.h"
+#include "Combination/BinNameUtils.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  // Order box indices by the low edge of one axis.
+  class by_low_edge {
+  public:
+    inline by_low_edge (const vector<BinBox> &boxes, size_t axis)
+      : _boxes(boxes), _axis(axis)
+    {}
+    inline bool operator() (size_t a, size_t b) const
+    { return _boxes[a].low[_axis] < _boxes[b].low[_axis]; }
+  private:
+    const vector<BinBox> &_boxes;
+    size_t _axis;
+  };
+
+  bool SameBox (const BinBox &b1, const BinBox &b2)
+  {
+    return b1.low == b2.low && b1.high == b2.high;
+  }
+
+  //
+  // Sweep along one axis of a group of boxes that all have the same axes. The active
+  // list holds everything whose interval on that axis is still open, ordered by its upper
+  // edge, so closing intervals is a log(n) operation. Anything still active when a new box
+  // starts is a candidate on the sweep axis. If result is null the candidates are only
+  // counted; otherwise the remaining axes are checked directly and the overlaps recorded.
+  //
+  size_t SweepGroup (const vector<BinBox> &boxes, vector<size_t> &group, size_t axis,
+		     vector<pair<size_t, size_t> > *result)
+  {
+    stable_sort(group.begin(), group.end(), by_low_edge(boxes, axis));
+
+    size_t nCandidates = 0;
+    multiset<pair<double, size_t> > active;
+    for (size_t i = 0; i < group.size(); i++) {
+      const size_t idx = group[i];
+      const BinBox &b(boxes[idx]);
+
+      while (!active.empty() && active.begin()->first <= b.low[axis])
+	active.erase(active.begin());
+
+      nCandidates += active.size();
+      if (result != 0) {
+	for (multiset<pair<double, size_t> >::const_iterator itr = active.begin(); itr != active.end(); itr++) {
+	  const BinBox &other(boxes[itr->second]);
+	  if (BoxesOverlap(b, other) && !SameBox(b, other))
+	    result->push_back(make_pair(min(idx, itr->second), max(idx, itr->second)));
+	}
+      }
+
+      active.insert(make_pair(b.high[axis], idx));
+    }
+    return nCandidates;
+  }
+
+  //
+  // Every axis is swept once to count the candidate pairs it leaves (bins in the same pt
+  // bin are all candidates along pt, but few of them along eta, and the other way around).
+  // The pairs are then found with a sweep along whichever axis left the fewest.
+  //
+  void FindGroupOverlaps (const vector<BinBox> &boxes, vector<size_t> &group, vector<pair<size_t, size_t> > &result)
+  {
+    if (group.size() < 2)
+      return;
+
+    const size_t nAxes = boxes[group[0]].dimension();
+    size_t bestAxis = 0;
+    size_t bestCount = 0;
+    for (size_t axis = 0; axis < nAxes; axis++) {
+      size_t n = SweepGroup(boxes, group, axis, 0);
+      if (axis == 0 || n < bestCount) {
+	bestAxis = axis;
+	bestCount = n;
+      }
+    }
+
+    SweepGroup(boxes, group, bestAxis, &result);
+  }
+
+  // Index of the grid line at (or just above) v.
+  size_t EdgeIndex (const vector<double> &edges, double v)
+  {
+    return lower_bound(edges.begin(), edges.end(), v) - edges.begin();
+  }
+
+  // Does outer fully contain inner?
+  bool BoxContains (const BinBox &outer, const BinBox &inner)
+  {
+    if (outer.repeatedAxis || inner.repeatedAxis || outer.axes != inner.axes)
+      return false;
+    for (size_t i = 0; i < outer.dimension(); i++) {
+      if (inner.low[i] < outer.low[i] || inner.high[i] > outer.high[i])
+	return false;
+    }
+    return true;
+  }
+
+  // Past this many cells a lookup grid isn't worth the memory.
+  const size_t kMaxGridCells = 1 << 22;
+
+  // Move to the next cell in the box [low, high), last axis fastest. Returns false when done.
+  bool NextCell (vector<size_t> &cell, const vector<size_t> &low, const vector<size_t> &high)
+  {
+    for (size_t i = cell.size(); i > 0; i--) {
+      size_t ax = i - 1;
+      cell[ax]++;
+      if (cell[ax] < high[ax])
+	return true;
+      cell[ax] = low[ax];
+    }
+    return false;
+  }
+}
+
+namespace BTagCombination {
+
+  BinBox::BinBox (const vector<CalibrationBinBoundary> &binSpec)
+    : repeatedAxis(false)
+  {
+    vector<CalibrationBinBoundary> sorted(binSpec);
+    sort(sorted.begin(), sorted.end());
+    for (size_t i = 0; i < sorted.size(); i++) {
+      if (i > 0 && sorted[i].variable == sorted[i-1].variable)
+	repeatedAxis = true;
+      axes.push_back(sorted[i].variable);
+      low.push_back(sorted[i].lowvalue);
+      high.push_back(sorted[i].highvalue);
+    }
+  }
+
+  vector<CalibrationBinBoundary> BinBox::boundaries() const
+  {
+    vector<CalibrationBinBoundary> result;
+    for (size_t i = 0; i < axes.size(); i++) {
+      CalibrationBinBoundary b;
+      b.variable = axes[i];
+      b.lowvalue = low[i];
+      b.highvalue = high[i];
+      result.push_back(b);
+    }
+    return result;
+  }
+
+  bool BoxesOverlap (const BinBox &b1, const BinBox &b2)
+  {
+    if (b1.repeatedAxis || b2.repeatedAxis || b1.axes != b2.axes)
+      return false;
+
+    for (size_t i = 0; i < b1.dimension(); i++) {
+      if (b1.high[i] <= b2.low[i])
+	return false;
+      if (b1.low[i] >= b2.high[i])
+	return false;
+    }
+    return true;
+  }
+
+  vector<pair<size_t, size_t> > FindPartialOverlaps (const vector<BinBox> &bins)
+  {
+    // Only bins with the same axes can overlap, so split them up first.
+    map<vector<string>, vector<size_t> > groups;
+    for (size_t i = 0; i < bins.size(); i++) {
+      if (bins[i].repeatedAxis || bins[i].dimension() == 0)
+	continue;
+      groups[bins[i].axes].push_back(i);
+    }
+
+    vector<pair<size_t, size_t> > result;
+    for (map<vector<string>, vector<size_t> >::iterator itr = groups.begin(); itr != groups.end(); itr++) {
+      FindGroupOverlaps(bins, itr->second, result);
+    }
+
+    sort(result.begin(), result.end());
+    return result;
+  }
+
+  vector<pair<size_t, size_t> > FindPartialOverlaps (const vector<const CalibrationBin*> &bins)
+  {
+    vector<BinBox> boxes;
+    boxes.reserve(bins.size());
+    for (size_t i = 0; i < bins.size(); i++)
+      boxes.push_back(BinBox(bins[i]->binSpec));
+    return FindPartialOverlaps(boxes);
+  }
+
+  //
+  // Sort all the edges along each axis - together they cut the area up into a grid of
+  // cells, and each piece covers a block of those cells. Count how many times each
+  // cell is covered; an exact tiling covers every cell once.
+  //
+  BinCoverage CheckCoverage (const BinBox &area, const vector<BinBox> &pieces)
+  {
+    const size_t ndim = area.dimension();
+
+    vector<vector<double> > edges(ndim);
+    for (size_t ax = 0; ax < ndim; ax++) {
+      edges[ax].push_back(area.low[ax]);
+      edges[ax].push_back(area.high[ax]);
+    }
+
+    for (size_t i = 0; i < pieces.size(); i++) {
+      const BinBox &p(pieces[i]);
+      if (p.axes != area.axes || p.repeatedAxis) {
+	ostringstream err;
+	err << "Bin " << OPBinName(p.boundaries()) << " is not on the same axes as " << OPBinName(area.boundaries());
+	throw runtime_error(err.str().c_str());
+      }
+      for (size_t ax = 0; ax < ndim; ax++) {
+	if (p.low[ax] > area.low[ax] && p.low[ax] < area.high[ax])
+	  edges[ax].push_back(p.low[ax]);
+	if (p.high[ax] > area.low[ax] && p.high[ax] < area.high[ax])
+	  edges[ax].push_back(p.high[ax]);
+      }
+    }
+
+    // Cells are stored with the last axis running fastest.
+    vector<size_t> ncells(ndim), stride(ndim);
+    size_t total = 1;
+    for (size_t i = ndim; i > 0; i--) {
+      size_t ax = i - 1;
+      sort(edges[ax].begin(), edges[ax].end());
+      edges[ax].erase(unique(edges[ax].begin(), edges[ax].end()), edges[ax].end());
+      ncells[ax] = edges[ax].size() - 1;
+      stride[ax] = total;
+      total *= ncells[ax];
+    }
+
+    vector<unsigned int> count(total, 0);
+    for (size_t i = 0; i < pieces.size(); i++) {
+      const BinBox &p(pieces[i]);
+      vector<size_t> lowCell(ndim), highCell(ndim);
+      bool empty = false;
+      for (size_t ax = 0; ax < ndim; ax++) {
+	lowCell[ax] = EdgeIndex(edges[ax], max(p.low[ax], area.low[ax]));
+	highCell[ax] = EdgeIndex(edges[ax], min(p.high[ax], area.high[ax]));
+	if (lowCell[ax] >= highCell[ax])
+	  empty = true;
+      }
+      if (empty)
+	continue;
+
+      vector<size_t> cell(lowCell);
+      do {
+	size_t index = 0;
+	for (size_t ax = 0; ax < ndim; ax++)
+	  index += cell[ax]*stride[ax];
+	count[index]++;
+      } while (NextCell(cell, lowCell, highCell));
+    }
+
+    BinCoverage result;
+    vector<size_t> zero(ndim, 0);
+    vector<size_t> cell(zero);
+    for (size_t index = 0; index < total; index++) {
+      if (count[index] != 1) {
+	BinBox c;
+	c.axes = area.axes;
+	for (size_t ax = 0; ax < ndim; ax++) {
+	  c.low.push_back(edges[ax][cell[ax]]);
+	  c.high.push_back(edges[ax][cell[ax]+1]);
+	}
+	if (count[index] == 0) {
+	  result.gaps.push_back(c);
+	} else {
+	  result.overlaps.push_back(c);
+	}
+      }
+      NextCell(cell, zero, ncells);
+    }
+
+    return result;
+  }
+
+  vector<BinCoverage> CheckCoverage (const vector<BinBox> &areas,
+				     const vector<BinBox> &pieces,
+				     const vector<vector<size_t> > &groups)
+  {
+    if (areas.size() != groups.size())
+      throw runtime_error("Internal error: number of areas and groups of bins to check coverage on differ");
+
+    vector<BinCoverage> result;
+    result.reserve(areas.size());
+    vector<BinBox> groupPieces;
+    for (size_t i = 0; i < areas.size(); i++) {
+      groupPieces.clear();
+      for (size_t j = 0; j < groups[i].size(); j++)
+	groupPieces.push_back(pieces[groups[i][j]]);
+      result.push_back(CheckCoverage(areas[i], groupPieces));
+    }
+    return result;
+  }
+
+  BinLookupIndex::BinLookupIndex()
+  {}
+
+  BinLookupIndex::BinLookupIndex (const set<set<CalibrationBinBoundary> > &templateBins)
+  {
+    for (set<set<CalibrationBinBoundary> >::const_iterator itr = templateBins.begin(); itr != templateBins.end(); itr++)
+      _specs.push_back(vector<CalibrationBinBoundary>(itr->begin(), itr->end()));
+    build();
+  }
+
+  BinLookupIndex::BinLookupIndex (const vector<vector<CalibrationBinBoundary> > &templateBins)
+    : _specs(templateBins)
+  {
+    build();
+  }
+
+  void BinLookupIndex::build()
+  {
+    for (size_t id = 0; id < _specs.size(); id++) {
+      _bins.push_back(BinBox(_specs[id]));
+      if (!_bins[id].repeatedAxis)
+	_groups[_bins[id].axes].ids.push_back(id);
+    }
+
+    for (map<vector<string>, AxesGroup>::iterator itr = _groups.begin(); itr != _groups.end(); itr++) {
+      AxesGroup &g(itr->second);
+      const size_t ndim = itr->first.size();
+      g.linear = false;
+
+      g.edges.resize(ndim);
+      for (size_t i = 0; i < g.ids.size(); i++) {
+	const BinBox &b(_bins[g.ids[i]]);
+	for (size_t ax = 0; ax < ndim; ax++) {
+	  g.edges[ax].push_back(b.low[ax]);
+	  g.edges[ax].push_back(b.high[ax]);
+	}
+      }
+
+      g.stride.resize(ndim);
+      size_t total = 1;
+      for (size_t i = ndim; i > 0; i--) {
+	size_t ax = i - 1;
+	sort(g.edges[ax].begin(), g.edges[ax].end());
+	g.edges[ax].erase(unique(g.edges[ax].begin(), g.edges[ax].end()), g.edges[ax].end());
+	g.stride[ax] = total;
+	total *= g.edges[ax].size() - 1;
+	if (total > kMaxGridCells)
+	  g.linear = true;
+      }
+      if (g.linear)
+	continue;
+
+      // Each template bin claims its cells. A cell claimed twice means the template
+      // bins overlap, and a zero width bin claims nothing - either way, use a scan.
+      g.owner.assign(total, -1);
+      for (size_t i = 0; i < g.ids.size() && !g.linear; i++) {
+	const BinBox &b(_bins[g.ids[i]]);
+	vector<size_t> lowCell(ndim), highCell(ndim);
+	for (size_t ax = 0; ax < ndim; ax++) {
+	  lowCell[ax] = EdgeIndex(g.edges[ax], b.low[ax]);
+	  highCell[ax] = EdgeIndex(g.edges[ax], b.high[ax]);
+	  if (lowCell[ax] >= highCell[ax])
+	    g.linear = true;
+	}
+	if (g.linear)
+	  break;
+
+	vector<size_t> cell(lowCell);
+	do {
+	  size_t index = 0;
+	  for (size_t ax = 0; ax < ndim; ax++)
+	    index += cell[ax]*g.stride[ax];
+	  if (g.owner[index] != -1) {
+	    g.linear = true;
+	    break;
+	  }
+	  g.owner[index] = g.ids[i];
+	} while (NextCell(cell, lowCell, highCell));
+      }
+      if (g.linear)
+	g.owner.clear();
+    }
+  }
+
+  int BinLookupIndex::scan_containing (const AxesGroup &g, const BinBox &b) const
+  {
+    for (size_t i = 0; i < g.ids.size(); i++) {
+      if (BoxContains(_bins[g.ids[i]], b))
+	return g.ids[i];
+    }
+    return -1;
+  }
+
+  int BinLookupIndex::find_containing (const BinBox &b) const
+  {
+    if (b.repeatedAxis)
+      return -1;
+    map<vector<string>, AxesGroup>::const_iterator itr = _groups.find(b.axes);
+    if (itr == _groups.end())
+      return -1;
+    const AxesGroup &g(itr->second);
+
+    bool zeroWidth = false;
+    for (size_t ax = 0; ax < b.dimension(); ax++)
+      zeroWidth = zeroWidth || !(b.low[ax] < b.high[ax]);
+    if (g.linear || zeroWidth)
+      return scan_containing(g, b);
+
+    // The only template bin that can contain b is the one that owns the cell its low
+    // corner is in.
+    size_t index = 0;
+    for (size_t ax = 0; ax < b.dimension(); ax++) {
+      const vector<double> &edges(g.edges[ax]);
+      if (b.low[ax] < edges.front() || b.low[ax] >= edges.back())
+	return -1;
+      size_t cell = upper_bound(edges.begin(), edges.end(), b.low[ax]) - edges.begin() - 1;
+      index += cell*g.stride[ax];
+    }
+
+    int id = g.owner[index];
+    if (id < 0 || !BoxContains(_bins[id], b))
+      return -1;
+    return id;
+  }
+
+  int BinLookupIndex::find_exact (const BinBox &b) const
+  {
+    if (b.repeatedAxis)
+      return -1;
+    map<vector<string>, AxesGroup>::const_iterator itr = _groups.find(b.axes);
+    if (itr == _groups.end())
+      return -1;
+    const AxesGroup &g(itr->second);
+
+    if (g.linear) {
+      for (size_t i = 0; i < g.ids.size(); i++) {
+	if (SameBox(_bins[g.ids[i]], b))
+	  return g.ids[i];
+      }
+      return -1;
+    }
+
+    int id = find_containing(b);
+    if (id < 0 || !SameBox(_bins[id], b))
+      return -1;
+    return id;
+  }
+}
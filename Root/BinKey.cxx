@@ -0,0 +1,132 @@
+//
+// Canonical keys for bins
+//
+
+#include "Combination/BinKey.h"
+#include "Combination/BinNameUtils.h"
+#include "Combination/FNVHash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  // The table of axis names. There are only a handful of axes, so a single lock is fine.
+  mutex gAxisLock;
+  map<string, unsigned int> gAxisIds;
+  vector<string> gAxisNames;
+
+  // FNV-1a, fed 8 bytes at a time, low byte first whatever the machine.
+  void HashWord (unsigned long long &h, unsigned long long word)
+  {
+    char bytes[8];
+    for (int i = 0; i < 8; i++)
+      bytes[i] = static_cast<char>((word >> (8*i)) & 0xff);
+    h = FNV1a64(bytes, sizeof(bytes), h);
+  }
+
+  void HashDouble (unsigned long long &h, double v)
+  {
+    // -0.0 == 0.0, so they must hash the same.
+    if (v == 0.0)
+      v = 0.0;
+    unsigned long long bits;
+    memcpy(&bits, &v, sizeof(bits));
+    HashWord(h, bits);
+  }
+}
+
+namespace BTagCombination {
+
+  unsigned int InternAxisName (const string &name)
+  {
+    lock_guard<mutex> lock(gAxisLock);
+    map<string, unsigned int>::const_iterator itr = gAxisIds.find(name);
+    if (itr != gAxisIds.end())
+      return itr->second;
+
+    unsigned int id = gAxisNames.size();
+    gAxisIds[name] = id;
+    gAxisNames.push_back(name);
+    return id;
+  }
+
+  string AxisName (unsigned int id)
+  {
+    lock_guard<mutex> lock(gAxisLock);
+    return gAxisNames[id];
+  }
+
+  BinKey::BinKey()
+    : _hash(kFNV1a64Offset)
+  {}
+
+  BinKey::BinKey (const vector<CalibrationBinBoundary> &binSpec)
+  {
+    vector<CalibrationBinBoundary> spec(binSpec);
+    sort(spec.begin(), spec.end());
+    spec.erase(unique(spec.begin(), spec.end()), spec.end());
+    init(spec);
+  }
+
+  BinKey::BinKey (const set<CalibrationBinBoundary> &binSpec)
+  {
+    vector<CalibrationBinBoundary> spec(binSpec.begin(), binSpec.end());
+    init(spec);
+  }
+
+  BinKey::BinKey (const CalibrationBin &bin)
+    : BinKey(bin.binSpec)
+  {}
+
+  // Spec must already be sorted and unique.
+  void BinKey::init (vector<CalibrationBinBoundary> &spec)
+  {
+    _axis.reserve(spec.size());
+    _low.reserve(spec.size());
+    _high.reserve(spec.size());
+
+    _hash = kFNV1a64Offset;
+    for (size_t i = 0; i < spec.size(); i++) {
+      _axis.push_back(InternAxisName(spec[i].variable));
+      _low.push_back(spec[i].lowvalue);
+      _high.push_back(spec[i].highvalue);
+
+      HashWord(_hash, _axis[i]);
+      HashDouble(_hash, _low[i]);
+      HashDouble(_hash, _high[i]);
+    }
+  }
+
+  bool BinKey::operator< (const BinKey &other) const
+  {
+    if (_axis != other._axis)
+      return _axis < other._axis;
+    if (_low != other._low)
+      return _low < other._low;
+    return _high < other._high;
+  }
+
+  vector<CalibrationBinBoundary> BinKey::binSpec() const
+  {
+    vector<CalibrationBinBoundary> result;
+    for (size_t i = 0; i < _axis.size(); i++) {
+      CalibrationBinBoundary b;
+      b.variable = AxisName(_axis[i]);
+      b.lowvalue = _low[i];
+      b.highvalue = _high[i];
+      result.push_back(b);
+    }
+    return result;
+  }
+
+  string BinKey::name() const
+  {
+    return OPBinName(binSpec());
+  }
+}
@@ -3,6 +3,10 @@
 //
 
 #include "Combination/BinUtils.h"
+#include "Combination/BinKey.h"
+#include "Combination/CalibrationInfoView.h"
+
+#include <unordered_set>
 
 using namespace std;
 
@@ -29,9 +33,12 @@ namespace BTagCombination {
   {
     set<set<CalibrationBinBoundary> > result;
 
+    // Most bins are repeated across the analyses - only build the sets for ones not seen yet.
+    unordered_set<BinKey, BinKeyHash> seen;
     for (vector<CalibrationAnalysis>::const_iterator i_ana = analyses.begin(); i_ana != analyses.end(); i_ana++) {
       for (vector<CalibrationBin>::const_iterator i_bin = i_ana->bins.begin(); i_bin != i_ana->bins.end(); i_bin++) {
-	result.insert(set<CalibrationBinBoundary>(i_bin->binSpec.begin(), i_bin->binSpec.end()));
+	if (seen.insert(BinKey(*i_bin)).second)
+	  result.insert(set<CalibrationBinBoundary>(i_bin->binSpec.begin(), i_bin->binSpec.end()));
       }
     }
 
@@ -50,24 +57,13 @@ namespace BTagCombination {
 
   //
   // Return a list of analyses that are just like the orginal, with the specified bin removed.
+  // Only the copy made at the end is paid for - use a CalibrationInfoView directly to avoid it.
   //
   vector<CalibrationAnalysis> removeBin (const vector<CalibrationAnalysis> &analyses, const set<CalibrationBinBoundary> &binToRemove)
   {
-    vector<CalibrationAnalysis> result;
-    for (vector<CalibrationAnalysis>::const_iterator i_ana = analyses.begin(); i_ana != analyses.end(); i_ana++) {
-      CalibrationAnalysis rana (*i_ana);
-      rana.bins.clear();
-
-      for (vector<CalibrationBin>::const_iterator i_bin = i_ana->bins.begin(); i_bin != i_ana->bins.end(); i_bin++) {
-	set<CalibrationBinBoundary> binspec (i_bin->binSpec.begin(), i_bin->binSpec.end());
-	if (binspec != binToRemove) {
-	  rana.bins.push_back(*i_bin);
-	}
-      }
-      if (rana.bins.size() > 0)
-	result.push_back (rana);
-    }
-    return result;
+    CalibrationInfoView view (analyses);
+    view.removeBin(binToRemove);
+    return view.materialize();
   }
 
   //
@@ -75,21 +71,9 @@ namespace BTagCombination {
   //
   vector<CalibrationAnalysis> removeAllBinsButBin (const vector<CalibrationAnalysis> &analyses, const set<CalibrationBinBoundary> &binToRemove)
   {
-    vector<CalibrationAnalysis> result;
-    for (vector<CalibrationAnalysis>::const_iterator i_ana = analyses.begin(); i_ana != analyses.end(); i_ana++) {
-      CalibrationAnalysis rana (*i_ana);
-      rana.bins.clear();
-
-      for (vector<CalibrationBin>::const_iterator i_bin = i_ana->bins.begin(); i_bin != i_ana->bins.end(); i_bin++) {
-	set<CalibrationBinBoundary> binspec (i_bin->binSpec.begin(), i_bin->binSpec.end());
-	if (binspec == binToRemove) {
-	  rana.bins.push_back(*i_bin);
-	}
-      }
-      if (rana.bins.size() > 0)
-	result.push_back (rana);
-    }
-    return result;
+    CalibrationInfoView view (analyses);
+    view.keepOnlyBin(binToRemove);
+    return view.materialize();
   }
 
   set<string> listAllSysErrors (const vector<CalibrationAnalysis> &analyses)
@@ -108,49 +92,17 @@ namespace BTagCombination {
   // Remove a sys error from our fits.
   vector<CalibrationAnalysis> removeSysError(const vector<CalibrationAnalysis> &analyses, const string &sysErrorName)
   {
-    vector<CalibrationAnalysis> results;
-    for(vector<CalibrationAnalysis>::const_iterator itr = analyses.begin(); itr != analyses.end(); itr++) {
-      CalibrationAnalysis a (*itr);
-      a.bins.clear();
-
-      for(vector<CalibrationBin>::const_iterator i_bin = itr->bins.begin(); i_bin != itr->bins.end(); i_bin++) {
-	CalibrationBin b(*i_bin);
-	b.systematicErrors.clear();
-	for(vector<SystematicError>::const_iterator i_sys = i_bin->systematicErrors.begin(); i_sys != i_bin->systematicErrors.end(); i_sys++) {
-	  if (i_sys->name != sysErrorName) {
-	    b.systematicErrors.push_back(*i_sys);
-	  }
-	}
-	a.bins.push_back(b);
-      }
-      results.push_back(a);
-    }
-    return results;
+    CalibrationInfoView view (analyses);
+    view.removeSysError(sysErrorName);
+    return view.materialize();
   }
 
   // Make a systematic error uncorrelated
   vector<CalibrationAnalysis> makeSysErrorUncorrelated(const vector<CalibrationAnalysis> &analyses, const string &sysErrorName)
   {
-    vector<CalibrationAnalysis> results;
-    for(vector<CalibrationAnalysis>::const_iterator itr = analyses.begin(); itr != analyses.end(); itr++) {
-      CalibrationAnalysis a (*itr);
-      a.bins.clear();
-
-      for(vector<CalibrationBin>::const_iterator i_bin = itr->bins.begin(); i_bin != itr->bins.end(); i_bin++) {
-	CalibrationBin b(*i_bin);
-	b.systematicErrors.clear();
-	for(vector<SystematicError>::const_iterator i_sys = i_bin->systematicErrors.begin(); i_sys != i_bin->systematicErrors.end(); i_sys++) {
-	  SystematicError t (*i_sys);
-	  if (i_sys->name == sysErrorName) {
-	    t.uncorrelated = true;
-	  }
-	  b.systematicErrors.push_back(t);
-	}
-	a.bins.push_back(b);
-      }
-      results.push_back(a);
-    }
-    return results;
+    CalibrationInfoView view (analyses);
+    view.makeSysErrorUncorrelated(sysErrorName);
+    return view.materialize();
   }
 
   double bin_sys(const vector<SystematicError> &errors)
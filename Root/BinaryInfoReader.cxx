@@ -0,0 +1,314 @@
+//
+// Decode the binary calibration format from memory.
+//
+
+#include "Combination/BinaryInfoReader.h"
+#include "Combination/CalibrationDataModelBinary.h"
+
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace BTagCombination {
+
+  using namespace BinaryInfoFormat;
+
+  BinaryInfoReader::BinaryInfoReader (const char *data, size_t size, const string &source)
+    : _data (data), _size (size), _source (source), _analysisTable (0), _nAnalyses (0)
+  {
+    if (!IsBinaryInfo(data, size))
+      Fail("not in the binary calibration format.");
+    uint32_t version = U32At(8);
+    if (version != cVersion) {
+      ostringstream err;
+      err << "format version " << version << " is not known (only version " << cVersion << ").";
+      Fail(err.str());
+    }
+    if (U64At(cFileSizeOffset) != size)
+      Fail("cut short.");
+
+    uint64_t strings = U64At(cStringsOffset);
+    uint32_t nStrings = U32At(strings);
+    CheckCount(strings + 8, nStrings, 8);
+    _strings.reserve(nStrings);
+    for (uint32_t i = 0; i < nStrings; i++) {
+      uint64_t s = U64At(strings + 8 + 8*uint64_t(i));
+      uint32_t length = U32At(s);
+      _strings.push_back(string(At(s + 4, length), length));
+    }
+
+    _analysisTable = U64At(cAnalysesOffset);
+    _nAnalyses = U32At(_analysisTable);
+    CheckCount(_analysisTable + 8, _nAnalyses, cAnalysisEntrySize);
+  }
+
+  CalibrationInfo BinaryInfoReader::Info() const
+  {
+    CalibrationInfo info;
+    info.Analyses.reserve(_nAnalyses);
+    for (size_t i = 0; i < _nAnalyses; i++)
+      info.Analyses.push_back(Analysis(AnalysisEntry(i)));
+    info.Correlations = Correlations();
+    info.Defaults = Defaults();
+    info.Aliases = Aliases();
+    return info;
+  }
+
+  //
+  // Analyses
+  //
+
+  uint64_t BinaryInfoReader::AnalysisEntry (size_t index) const
+  {
+    if (index >= _nAnalyses)
+      throw runtime_error("Analysis index out of range in binary calibration data.");
+    return _analysisTable + 8 + cAnalysisEntrySize*uint64_t(index);
+  }
+
+  const string &BinaryInfoReader::EntryName (uint64_t entry, NameField field) const
+  {
+    return Str(entry + 8 + 4*field);
+  }
+
+  uint32_t BinaryInfoReader::EntryNameIndex (uint64_t entry, NameField field) const
+  {
+    return U32At(entry + 8 + 4*field);
+  }
+
+  size_t BinaryInfoReader::nBins (uint64_t entry) const
+  {
+    return U32At(U64At(entry));
+  }
+
+  uint64_t BinaryInfoReader::BinPos (uint64_t entry, size_t index) const
+  {
+    uint64_t pos = U64At(entry);
+    if (index >= U32At(pos))
+      throw runtime_error("Bin index out of range in binary calibration data.");
+    return U64At(pos + 16 + 8*uint64_t(index));
+  }
+
+  CalibrationAnalysis BinaryInfoReader::AnalysisHeader (uint64_t entry) const
+  {
+    CalibrationAnalysis ana;
+    ana.name = EntryName(entry, kName);
+    ana.flavor = EntryName(entry, kFlavor);
+    ana.tagger = EntryName(entry, kTagger);
+    ana.operatingPoint = EntryName(entry, kOperatingPoint);
+    ana.jetAlgorithm = EntryName(entry, kJetAlgorithm);
+
+    // The meta data follows the last bin.
+    uint64_t pos = U64At(entry);
+    uint32_t nBins = U32At(pos);
+    uint32_t nMetadata = U32At(pos + 4);
+    uint32_t nMetadata_s = U32At(pos + 8);
+    CheckCount(pos + 16, nBins, 8);
+    pos = nBins == 0 ? pos + 16 : Bin(BinPos(entry, nBins - 1)).endPos();
+
+    for (uint32_t i = 0; i < nMetadata; i++) {
+      vector<double> &values (ana.metadata[Str(pos)]);
+      uint32_t n = U32At(pos + 4);
+      pos += 8;
+      CheckCount(pos, n, 8);
+      values.resize(n);
+      for (uint32_t v = 0; v < n; v++, pos += 8)
+	values[v] = F64At(pos);
+    }
+    CheckCount(pos, nMetadata_s, 8);
+    for (uint32_t i = 0; i < nMetadata_s; i++, pos += 8)
+      ana.metadata_s[Str(pos)] = Str(pos + 4);
+    return ana;
+  }
+
+  CalibrationAnalysis BinaryInfoReader::Analysis (uint64_t entry) const
+  {
+    CalibrationAnalysis ana (AnalysisHeader(entry));
+    size_t n = nBins(entry);
+    ana.bins.reserve(n);
+    for (size_t i = 0; i < n; i++)
+      ana.bins.push_back(DecodeBin(Bin(BinPos(entry, i))));
+    return ana;
+  }
+
+  //
+  // Bins
+  //
+
+  uint64_t BinaryInfoReader::BinRecord::boundariesPos() const { return pos + cBinHeaderSize; }
+  uint64_t BinaryInfoReader::BinRecord::sysErrorsPos() const { return boundariesPos() + cBoundarySize*uint64_t(nBoundaries); }
+  uint64_t BinaryInfoReader::BinRecord::metadataPos() const { return sysErrorsPos() + cSysErrorSize*(uint64_t(nSys) + nRefSys); }
+  uint64_t BinaryInfoReader::BinRecord::endPos() const { return metadataPos() + cBinMetadataSize*uint64_t(nMetadata); }
+
+  BinaryInfoReader::BinRecord BinaryInfoReader::Bin (uint64_t pos) const
+  {
+    BinRecord bin;
+    bin.pos = pos;
+    bin.nBoundaries = U32At(pos);
+    bin.nSys = U32At(pos + 4);
+    bin.nRefSys = U32At(pos + 8);
+    bin.nMetadata = U32At(pos + 12);
+    At(pos, cBinHeaderSize);
+    At(bin.boundariesPos(), bin.endPos() - bin.boundariesPos());
+    return bin;
+  }
+
+  CalibrationBin BinaryInfoReader::DecodeBin (const BinRecord &b) const
+  {
+    CalibrationBin bin;
+    bin.isExtended = IsExtended(b);
+    bin.centralValue = CentralValue(b);
+    bin.centralValueStatisticalError = StatisticalError(b);
+    uint64_t pos = Boundaries(b.boundariesPos(), b.nBoundaries, bin.binSpec);
+    pos = SysErrors(pos, b.nSys, bin.systematicErrors);
+    pos = SysErrors(pos, b.nRefSys, bin.referenceBinSystematicErrors);
+    for (uint32_t i = 0; i < b.nMetadata; i++, pos += cBinMetadataSize)
+      bin.metadata[Str(pos)] = make_pair(F64At(pos + 8), F64At(pos + 16));
+    return bin;
+  }
+
+  double BinaryInfoReader::CentralValue (const BinRecord &bin) const { return F64At(bin.pos + 24); }
+  double BinaryInfoReader::StatisticalError (const BinRecord &bin) const { return F64At(bin.pos + 32); }
+  bool BinaryInfoReader::IsExtended (const BinRecord &bin) const { return U32At(bin.pos + 16) != 0; }
+
+  CalibrationBinBoundary BinaryInfoReader::Boundary (uint64_t pos) const
+  {
+    CalibrationBinBoundary b;
+    b.variable = Str(pos);
+    b.lowvalue = F64At(pos + 8);
+    b.highvalue = F64At(pos + 16);
+    return b;
+  }
+
+  const string &BinaryInfoReader::SysErrorName (uint64_t pos) const { return Str(pos); }
+  double BinaryInfoReader::SysErrorValue (uint64_t pos) const { return F64At(pos + 8); }
+  bool BinaryInfoReader::SysErrorUncorrelated (uint64_t pos) const { return U32At(pos + 4) != 0; }
+
+  SystematicError BinaryInfoReader::SysError (uint64_t pos) const
+  {
+    SystematicError e;
+    e.name = SysErrorName(pos);
+    e.value = SysErrorValue(pos);
+    e.uncorrelated = SysErrorUncorrelated(pos);
+    return e;
+  }
+
+  uint64_t BinaryInfoReader::Boundaries (uint64_t pos, uint32_t n, vector<CalibrationBinBoundary> &spec) const
+  {
+    CheckCount(pos, n, cBoundarySize);
+    spec.resize(n);
+    for (uint32_t i = 0; i < n; i++, pos += cBoundarySize)
+      spec[i] = Boundary(pos);
+    return pos;
+  }
+
+  uint64_t BinaryInfoReader::SysErrors (uint64_t pos, uint32_t n, vector<SystematicError> &errors) const
+  {
+    CheckCount(pos, n, cSysErrorSize);
+    errors.resize(n);
+    for (uint32_t i = 0; i < n; i++, pos += cSysErrorSize)
+      errors[i] = SysError(pos);
+    return pos;
+  }
+
+  //
+  // The other sections
+  //
+
+  vector<AnalysisCorrelation> BinaryInfoReader::Correlations() const
+  {
+    uint64_t pos = U64At(cCorrelationsOffset);
+    uint32_t n = U32At(pos);
+    pos += 8;
+    CheckCount(pos, n, 32);
+    vector<AnalysisCorrelation> result (n);
+    for (uint32_t i = 0; i < n; i++) {
+      AnalysisCorrelation &c (result[i]);
+      c.analysis1Name = Str(pos);
+      c.analysis2Name = Str(pos + 4);
+      c.flavor = Str(pos + 8);
+      c.tagger = Str(pos + 12);
+      c.operatingPoint = Str(pos + 16);
+      c.jetAlgorithm = Str(pos + 20);
+      uint32_t nBins = U32At(pos + 24);
+      pos += 32;
+      CheckCount(pos, nBins, 16);
+      c.bins.resize(nBins);
+      for (uint32_t b = 0; b < nBins; b++) {
+	uint32_t nBoundaries = U32At(pos);
+	c.bins[b].hasStatCorrelation = U32At(pos + 4) != 0;
+	c.bins[b].statCorrelation = F64At(pos + 8);
+	pos = Boundaries(pos + 16, nBoundaries, c.bins[b].binSpec);
+      }
+    }
+    return result;
+  }
+
+  vector<DefaultAnalysis> BinaryInfoReader::Defaults() const
+  {
+    uint64_t pos = U64At(cDefaultsOffset);
+    uint32_t n = U32At(pos);
+    pos += 8;
+    CheckCount(pos, n, 24);
+    vector<DefaultAnalysis> result (n);
+    for (uint32_t i = 0; i < n; i++, pos += 24)
+      Names(pos, result[i]);
+    return result;
+  }
+
+  vector<AliasAnalysis> BinaryInfoReader::Aliases() const
+  {
+    uint64_t pos = U64At(cAliasesOffset);
+    uint32_t n = U32At(pos);
+    pos += 8;
+    CheckCount(pos, n, 24);
+    vector<AliasAnalysis> result (n);
+    for (uint32_t i = 0; i < n; i++) {
+      AliasAnalysis &a (result[i]);
+      Names(pos, a);
+      uint32_t nTargets = U32At(pos + 20);
+      pos += 24;
+      CheckCount(pos, nTargets, 24);
+      a.CopyTargets.resize(nTargets);
+      for (uint32_t t = 0; t < nTargets; t++, pos += 24)
+	Names(pos, a.CopyTargets[t]);
+    }
+    return result;
+  }
+
+  //
+  // Checked access
+  //
+
+  void BinaryInfoReader::Fail (const string &what) const
+  {
+    if (_source == "")
+      throw runtime_error("Binary calibration data: " + what);
+    throw runtime_error("Binary calibration file '" + _source + "': " + what);
+  }
+
+  const char *BinaryInfoReader::At (uint64_t offset, uint64_t n) const
+  {
+    if (offset > _size || n > _size - offset)
+      Fail("the data is cut short or corrupt.");
+    return _data + offset;
+  }
+
+  void BinaryInfoReader::CheckCount (uint64_t offset, uint64_t n, uint64_t recordSize) const
+  {
+    // n is at most 32 bits and the records are small, so this can't overflow.
+    At(offset, n*recordSize);
+  }
+
+  uint32_t BinaryInfoReader::U32At (uint64_t offset) const { return U32(At(offset, 4)); }
+  uint64_t BinaryInfoReader::U64At (uint64_t offset) const { return U64(At(offset, 8)); }
+  double BinaryInfoReader::F64At (uint64_t offset) const { return F64(At(offset, 8)); }
+
+  const string &BinaryInfoReader::Str (uint64_t offset) const
+  {
+    uint32_t i = U32At(offset);
+    if (i >= _strings.size())
+      Fail("the data refers to a string that isn't there.");
+    return _strings[i];
+  }
+}
@@ -7,10 +7,17 @@
 #include "Combination/CommonCommandLineUtils.h"
 #include "Combination/CalibrationDataModelStreams.h"
 #include "Combination/FitLinage.h"
+#include "Combination/CalibrationColumns.h"
+#include "Combination/BinKey.h"
+#include "Combination/Tracing.h"
+#include "Combination/FNVHash.h"
 
 #include "CalibrationDataInterface/CalibrationDataContainer.h"
 
 #include "TH2F.h"
+#include "TDirectory.h"
+#include "TMap.h"
+#include "TObjString.h"
 
 #include <boost/function.hpp>
 #include <boost/lambda/lambda.hpp>
@@ -25,6 +32,7 @@
 #include <iterator>
 #include <sstream>
 #include <cmath>
+#include <algorithm>
 
 
 using Analysis::CalibrationDataHistogramContainer;
@@ -42,6 +50,13 @@ namespace {
 
   // helper functions and objects for below
 
+  // Goes into ConversionHash. Change it whenever a change here changes what ends up in
+  // the containers, so incremental updates of CDI files redo everything.
+  const char *gConverterVersion = "CDIConverter-2";
+
+  // Where WriteConversionHashes keeps them: a single map at the top of the file.
+  const char *gConversionHashesName = "ConversionHashes";
+
   // Helper class to generate historams, etc., for the bin boundaies we fine.
   class bin_boundaries_hist : public bin_boundaries {
   public:
@@ -81,18 +96,28 @@ namespace {
 		      yaxis.second.size()-1, &(yaxis.second[0]));
     }
 
-    // Set the central value and error of a histogram with a particualr bin setting.
-    // Trust that lower bin boundary is all that counds for lookup!!
+    // Set the central value and error of a histogram for bin ibin of the analysis. The cell
+    // found by calcBoundaries is used when there is one; otherwise
+    // trust that lower bin boundary is all that counds for lookup!!
     void set_bin_contents(TH2 *histo,
+			  size_t ibin,
 			  const vector<CalibrationBinBoundary> &bin_spec,
 			  double central, double error) const
     {
-      int xbin = get_xaxis_bin (bin_spec);
-      int ybin = get_yaxis_bin (bin_spec);
+      int xbin, ybin;
+      get_cell (ibin, bin_spec, xbin, ybin);
 
       histo->SetBinContent (xbin, ybin, central);
       histo->SetBinError (xbin, ybin, error);
     }
+
+    // The x and y histogram bins of bin ibin of the analysis.
+    void get_cell (size_t ibin, const vector<CalibrationBinBoundary> &bin_spec,
+		   int &xbin, int &ybin) const
+    {
+      xbin = get_xaxis_bin (ibin, bin_spec);
+      ybin = get_yaxis_bin (ibin, bin_spec);
+    }
   };
 
   // Using a functor to extract the name/value pairs for all the bins, set them.
@@ -114,7 +139,7 @@ namespace {
 	const CalibrationBin &bin (ana.bins[ibin]);
 	if (extendedOK || !bin.isExtended) {
 	  pair<double, double> val_and_error (getter(bin));
-	  bins.set_bin_contents (values, bin.binSpec, val_and_error.first, val_and_error.second);
+	  bins.set_bin_contents (values, ibin, bin.binSpec, val_and_error.first, val_and_error.second);
 	}
       }
 
@@ -132,12 +157,6 @@ namespace {
     }
   }
 
-  // Extract central value and statistical error from a bin
-  pair<double, double> get_central_value (const CalibrationBin &bin)
-  {
-    return make_pair(bin.centralValue, bin.centralValueStatisticalError);
-  }
-
   // Get the extrapolation error - which is whatever the sys error is.
   pair<double, double> get_extrapolation_error (const CalibrationBin &bin)
   {
@@ -152,56 +171,74 @@ namespace {
     }
   }
 
- // Helper to find errors. Lord, what-for to have lambda functions enabled in ATLAS already!
-  class find_error
-  {
-  public:
-    inline find_error (const string &name)
-      : _name(name)
-    {}
-    inline bool operator() (const SystematicError &err)
-    { return err.name == _name;}
-  private:
-    const string &_name;
+  // The central value histogram, and one histogram per systematic error (in name order).
+  struct regular_histograms {
+    TH2 *central;
+    vector<string> names;
+    vector<TH2*> errors;
+    vector<bool> uncorrelated;
   };
 
-  // Extract a systematic error
-  class get_sys_error
+  //
+  // Fill the central value and all the systematic error histograms in a single sweep over
+  // the bins (of an analysis that already has its total error - see addTotalSysError).
+  // Each bin is placed in the grid once, and the errors come out of the dense bins x
+  // systematics matrix (a missing error is a zero) rather than being looked up by name for
+  // every histogram. Extended bins are left out. Where a bin has two errors with the same
+  // name the first is used, as a lookup by name would have found - so a bin that already
+  // had a "systematics" error keeps it, not the total added after it.
+  //
+  regular_histograms fill_regular_histograms (const bin_boundaries_hist &bins,
+					      const CalibrationAnalysis &ana)
   {
-  public:
-    inline get_sys_error (const string &sys_name)
-      : _name (sys_name)
-    {}
-    pair<double, double> operator() (const CalibrationBin &bin) const
-    {
-      vector<SystematicError>::const_iterator e = find_if (bin.systematicErrors.begin(),
-							   bin.systematicErrors.end(),
-							   find_error(_name));
-      if (e == bin.systematicErrors.end())
-	return make_pair(0.0, 0.0);
-      return make_pair(e->value, e->value);
-    }
-  private:
-    const string &_name;
-  };
-
+    try {
+      CalibrationColumns columns (ana, false, kFirstDuplicate);
+
+      // Correlation comes from the first bin with the error (extended or not).
+      map<string, bool> uncorrelated;
+      for (size_t ibin = 0; ibin < ana.bins.size(); ibin++) {
+	const vector<SystematicError> &errs(ana.bins[ibin].systematicErrors);
+	for (size_t i_sys = 0; i_sys < errs.size(); i_sys++)
+	  uncorrelated.insert(make_pair(errs[i_sys].name, errs[i_sys].uncorrelated));
+      }
 
-  // Returns a list of all systematic errors used in this analysis
-  set<string> sys_error_names (const CalibrationAnalysis &ana)
-  {
-    set<string> result;
-    for (unsigned int ibin = 0; ibin < ana.bins.size(); ibin++) {
-      const CalibrationBin &bin (ana.bins[ibin]);
+      regular_histograms h;
+      h.central = bins.create_histo("central");
+      vector<size_t> ids (columns.sysNames.sorted_ids());
+      for (size_t i = 0; i < ids.size(); i++) {
+	const string &name (columns.sysNames.name(ids[i]));
+	h.names.push_back(name);
+	h.errors.push_back(bins.create_histo(name));
+	map<string, bool>::const_iterator u = uncorrelated.find(name);
+	h.uncorrelated.push_back(u != uncorrelated.end() && u->second);
+      }
 
-      // Ignore extended bins.
-      if (bin.isExtended)
-	continue;
+      for (size_t row = 0; row < columns.nbins(); row++) {
+	size_t ibin = columns.binIndex[row];
+	int xbin, ybin;
+	bins.get_cell (ibin, ana.bins[ibin].binSpec, xbin, ybin);
+
+	h.central->SetBinContent (xbin, ybin, columns.centralValue[row]);
+	h.central->SetBinError (xbin, ybin, columns.statError[row]);
+	for (size_t i = 0; i < ids.size(); i++) {
+	  double v = columns.sys(row, ids[i]);
+	  h.errors[i]->SetBinContent (xbin, ybin, v);
+	  h.errors[i]->SetBinError (xbin, ybin, v);
+	}
+      }
 
-      transform (bin.systematicErrors.begin(), bin.systematicErrors.end(),
-		 inserter(result, result.begin()),
-		 bind<const string&>(&SystematicError::name, ph::_1));
+      return h;
+    } catch (bad_cdi_config_exception &e) {
+      ostringstream msg;
+      msg << "Error while processing analysis: " << e.what() << endl
+	  << ana;
+      throw  bad_cdi_config_exception(msg.str().c_str());
+    } catch (runtime_error &e) {
+      ostringstream msg;
+      msg << "Error while processing analysis: " << e.what() << endl
+	  << ana;
+      throw runtime_error(msg.str().c_str());
     }
-    return result;
   }
 
   // sees if this error is uncorrelated or not.
@@ -221,21 +258,16 @@ namespace {
 
   CalibrationAnalysis addTotalSysError (const CalibrationAnalysis &eff)
   {
+    // Total up all systematics. Ignore extended guys - they should already be converted.
+    CalibrationColumns columns (eff, false);
+    vector<double> totals (ColumnSysQuadratureSum(columns));
+
     CalibrationAnalysis ana (eff);
-    for (vector<CalibrationBin>::iterator itr = ana.bins.begin(); itr != ana.bins.end(); itr++) {
-      // Ignore extended guys. They should already be converted
-      if (itr->isExtended)
-	continue;
-
-      // Total up all systematics
-      double totS = 0.0;
-      for (vector<SystematicError>::const_iterator i_s = itr->systematicErrors.begin(); i_s != itr->systematicErrors.end(); i_s++) {
-	totS += i_s->value*i_s->value;
-      }
+    for (size_t row = 0; row < columns.nbins(); row++) {
       SystematicError s;
-      s.value = sqrt(totS);
+      s.value = totals[row];
       s.name = "systematics";
-      itr->systematicErrors.push_back(s);
+      ana.bins[columns.binIndex[row]].systematicErrors.push_back(s);
     }
     return ana;
   }
@@ -275,19 +307,13 @@ namespace {
     //
 
     bin_boundaries_hist bins = calcBoundaries(ana);
-    TH2 *central_value = set_bin_values(bins, ana, "central", get_central_value);
-    result->setResult(central_value);
+    regular_histograms histos (fill_regular_histograms(bins, ana));
+    result->setResult(histos.central);
 
-    // Get all systematic errors
-    set<string> error_names (sys_error_names(ana));
-
-    // Get the full set of values for each.
-    for (set<string>::const_iterator e_name = error_names.begin(); e_name != error_names.end(); e_name++) {
-      TH2 *errors = set_bin_values(bins, ana, *e_name, get_sys_error(*e_name));
-      result->setUncertainty(e_name->c_str(), errors);
-
-      if (is_uncorrelated(ana, *e_name))
-	result->setUncorrelated(e_name->c_str());
+    for (size_t i = 0; i < histos.names.size(); i++) {
+      result->setUncertainty(histos.names[i].c_str(), histos.errors[i]);
+      if (histos.uncorrelated[i])
+	result->setUncorrelated(histos.names[i].c_str());
     }
 
     // If there are any extrapolation bins, then set that too.
@@ -322,7 +348,10 @@ namespace {
       }
       vector<string> vbin_names(bin_names.begin(), bin_names.end());
       for (size_t ib = 0; ib < vbin_names.size(); ib++) {
-	_bin_lookup[vbin_names[ib]] = int(ib);
+	unsigned int axis = InternAxisName(vbin_names[ib]);
+	if (axis >= _bin_lookup.size())
+	  _bin_lookup.resize(axis+1, 0);
+	_bin_lookup[axis] = int(ib);
       }
 
       c->setMappedVariables(vbin_names);
@@ -336,23 +365,22 @@ namespace {
       if (binCoord.size() > maxCoord)
 	throw runtime_error ("More coordinates that we can deal with - rebuild for more than 10!");
 
-      // Put them in a set so we can sort them (they are sorted first by variable, then coordinates, see
-      // operator< in Parser.h
+      // The key has the coordinates sorted (first by variable, then coordinates, see
+      // operator< in Parser.h) and the variable names already looked up.
 
-      set<CalibrationBinBoundary> items(binCoord.begin(), binCoord.end());
-      int index = 0;
+      BinKey key(binCoord);
       double low[maxCoord];
       double high[maxCoord];
       for (size_t i = 0; i < maxCoord; i++)
 	low[i] = high[i] = 0.0;
 
-      for (set<CalibrationBinBoundary>::const_iterator itr = items.begin(); itr != items.end(); itr++) {
-	low[_bin_lookup[itr->variable]] = itr->lowvalue;
-	high[_bin_lookup[itr->variable]] = itr->highvalue;
-	index++;
+      for (size_t i = 0; i < key.dimension(); i++) {
+	int col = key.axis(i) < _bin_lookup.size() ? _bin_lookup[key.axis(i)] : 0;
+	low[col] = key.low(i);
+	high[col] = key.high(i);
       }
 
-      CalibrationDataMappedHistogramContainer::Bin b(items.size(), low, high);
+      CalibrationDataMappedHistogramContainer::Bin b(key.dimension(), low, high);
       return _container->addBin(b);
     }
 
@@ -363,7 +391,7 @@ namespace {
   private:
     int _nbin;
     CalibrationDataMappedHistogramContainer *_container;
-    map<string, int> _bin_lookup;
+    vector<int> _bin_lookup; // Column for each interned axis id
   };
 
   // Simple TH1F bin holder just makes the code below make more "sense".
@@ -481,6 +509,8 @@ namespace BTagCombination {
   //
   CalibrationDataContainer *ConvertToCDI (const CalibrationAnalysis &eff, const std::string &name)
   {
+    TraceSpan span("convert to CDI", name);
+
     // Try the regular flat/grid binning first.
 
     string binError;
@@ -503,4 +533,146 @@ namespace BTagCombination {
       throw;
     }
   }
+
+  //
+  // Hash the full-precision text version of the analysis along with our version.
+  //
+  string ConversionHash (const CalibrationAnalysis &eff)
+  {
+    ostringstream text;
+    text.precision(17);
+    try {
+      text << gConverterVersion << endl << eff;
+    } catch (runtime_error &) {
+      return "";
+    }
+
+    const string &s (text.str());
+    unsigned long long h = FNV1a64(s.data(), s.size());
+
+    ostringstream result;
+    result << hex << h << "-" << dec << s.size();
+    return result.str();
+  }
+
+  //
+  // Convert from the flavor used in our input text files to the one
+  // that is used by the calibration data interface
+  //
+  string CDIFlavorName (const string &flavor)
+  {
+    if (flavor == "bottom" || flavor == "B" || flavor == "b")
+      return "B";
+    if (flavor == "charm" || flavor == "C" || flavor == "c")
+      return "C";
+    if (flavor == "light" || flavor == "L" || flavor == "l")
+      return "Light";
+    if (flavor == "tau" || flavor == "T" || flavor == "t")
+      return "T";
+
+    throw runtime_error (("Do not know flavor '" + flavor + "' - please use 'bottom', 'charm', or 'light' in the input text file!").c_str());
+  }
+
+  vector<string> CDIContainerDirectories (const CalibrationAnalysis &eff)
+  {
+    vector<string> result;
+    result.push_back(eff.tagger);
+    result.push_back(eff.jetAlgorithm);
+    result.push_back(eff.operatingPoint);
+    result.push_back(CDIFlavorName(eff.flavor));
+    return result;
+  }
+
+  string CDIContainerPath (const CalibrationAnalysis &eff, const string &name)
+  {
+    vector<string> dirs (CDIContainerDirectories(eff));
+    string result;
+    for (size_t i = 0; i < dirs.size(); i++) {
+      replace (dirs[i].begin(), dirs[i].end(), '.', '_');
+      result += dirs[i] + "/";
+    }
+    return result + name;
+  }
+
+  //
+  // Create a sub-directory in the given parent directory. If it is already
+  // there then return it. Sanitize the directory name.
+  // If create is false and the directory doesn't exist, then return null.
+  TDirectory *CDISubDirectory (TDirectory *parent, const string &name, bool create)
+  {
+    //
+    // Sanitize the name of the sub directory
+    //
+
+    string sname (name);
+    replace (sname.begin(), sname.end(), '.', '_');
+
+    //
+    // If the sub dir is already there...
+    //
+
+    TDirectory *candidate = static_cast<TDirectory*>(parent->Get(sname.c_str()));
+    if (candidate != 0)
+      return candidate;
+
+    //
+    // if we are not meant to do the creation...
+    //
+
+    if (!create)
+      return 0;
+
+    //
+    // Create it.
+    //
+
+    return parent->mkdir(sname.c_str());
+  }
+
+  void WriteCDIContainer (TDirectory *file, const CalibrationAnalysis &eff, CalibrationDataContainer *container, bool replace)
+  {
+    TraceSpan span("write container", container->GetName());
+    vector<string> dirs (CDIContainerDirectories(eff));
+    TDirectory *loc = file;
+    for (size_t id = 0; id < dirs.size(); id++)
+      loc = CDISubDirectory(loc, dirs[id]);
+
+    if (replace)
+      loc->Delete((string(container->GetName()) + ";*").c_str());
+    loc->WriteTObject(container, 0, "SingleKey");
+  }
+
+  map<string, string> ReadConversionHashes (TDirectory *file)
+  {
+    map<string, string> result;
+    TMap *m = dynamic_cast<TMap*>(file->Get(gConversionHashesName));
+    if (m == 0)
+      return result;
+
+    TIter next(m);
+    TObject *k;
+    while ((k = next())) {
+      TObject *v = m->GetValue(k);
+      result[k->GetName()] = v == 0 ? "" : v->GetName();
+    }
+    m->DeleteAll();
+    delete m;
+    return result;
+  }
+
+  void WriteConversionHashes (TDirectory *file, const map<string, string> &hashes)
+  {
+    TMap m;
+    for (map<string, string>::const_iterator itr = hashes.begin(); itr != hashes.end(); itr++)
+      m.Add(new TObjString(itr->first.c_str()), new TObjString(itr->second.c_str()));
+    TraceSpan span("write hashes");
+    file->Delete((string(gConversionHashesName) + ";*").c_str());
+    file->WriteTObject(&m, gConversionHashesName, "SingleKey");
+    m.DeleteAll();
+  }
+
+  bool IsConversionHashesKey (const string &name)
+  {
+    return name == gConversionHashesName;
+  }
 }
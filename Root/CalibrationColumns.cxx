@@ -0,0 +1,311 @@
+//
+// Columnar copy of a calibration analysis, and the kernels that work on it.
+//
+// The kernels are deliberately written as plain loops over contiguous
+// arrays with no branches in the inner loop - that is what lets the compiler
+// vectorize them.
+//
+
+#include "Combination/CalibrationColumns.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace BTagCombination {
+
+  size_t SystematicNameTable::intern (const string &name)
+  {
+    map<string, size_t>::const_iterator itr = _lookup.find(name);
+    if (itr != _lookup.end())
+      return itr->second;
+
+    size_t id = _names.size();
+    _names.push_back(name);
+    _lookup[name] = id;
+    return id;
+  }
+
+  int SystematicNameTable::find (const string &name) const
+  {
+    map<string, size_t>::const_iterator itr = _lookup.find(name);
+    if (itr == _lookup.end())
+      return -1;
+    return int(itr->second);
+  }
+
+  vector<size_t> SystematicNameTable::sorted_ids() const
+  {
+    vector<size_t> r;
+    for (map<string, size_t>::const_iterator itr = _lookup.begin(); itr != _lookup.end(); itr++)
+      r.push_back(itr->second);
+    return r;
+  }
+
+  CalibrationColumns::CalibrationColumns()
+    : _duplicates(kFirstDuplicate)
+  {}
+
+  CalibrationColumns::CalibrationColumns (const CalibrationAnalysis &ana, bool includeExtended,
+					  DuplicateErrors duplicates)
+    : _duplicates(duplicates)
+  {
+    // First pass - find the bins we want and intern all the names so we know how
+    // wide the matrix is going to be.
+    for (size_t ib = 0; ib < ana.bins.size(); ib++) {
+      const CalibrationBin &b(ana.bins[ib]);
+      if (!includeExtended && b.isExtended)
+	continue;
+
+      binIndex.push_back(ib);
+      centralValue.push_back(b.centralValue);
+      statError.push_back(b.centralValueStatisticalError);
+
+      for (size_t is = 0; is < b.systematicErrors.size(); is++) {
+	const SystematicError &e(b.systematicErrors[is]);
+	size_t id = sysNames.intern(e.name);
+	if (id == sysUncorrelated.size())
+	  sysUncorrelated.push_back(e.uncorrelated);
+      }
+    }
+
+    // Second pass - fill the matrix. If a bin has the same error twice, only one goes in,
+    // and the rest are only counted in the totals.
+    const size_t ns = nsys();
+    sysValue.assign(nbins()*ns, 0.0);
+    sysPresent.assign(nbins()*ns, 0);
+    sysDuplicateSquares.assign(nbins(), 0.0);
+    for (size_t row = 0; row < binIndex.size(); row++) {
+      const CalibrationBin &b(ana.bins[binIndex[row]]);
+      vector<char> use (in_columns(b));
+      for (size_t is = 0; is < b.systematicErrors.size(); is++) {
+	const SystematicError &e(b.systematicErrors[is]);
+	if (use[is])
+	  set_sys(row, size_t(sysNames.find(e.name)), e.value);
+	else
+	  sysDuplicateSquares[row] += e.value*e.value;
+      }
+    }
+  }
+
+  vector<char> CalibrationColumns::in_columns (const CalibrationBin &b) const
+  {
+    const size_t n = b.systematicErrors.size();
+    vector<char> result (n, 0);
+    vector<char> seen (nsys(), 0);
+    for (size_t i = 0; i < n; i++) {
+      size_t is = _duplicates == kFirstDuplicate ? i : n - 1 - i;
+      int id = sysNames.find(b.systematicErrors[is].name);
+      if (id >= 0 && !seen[id]) {
+	seen[id] = 1;
+	result[is] = 1;
+      }
+    }
+    return result;
+  }
+
+  // Re-layout the matrix for a new number of systematic columns.
+  void CalibrationColumns::resize_sys (size_t newNSys)
+  {
+    const size_t oldNSys = sysUncorrelated.size();
+    vector<double> values (nbins()*newNSys, 0.0);
+    vector<char> present (nbins()*newNSys, 0);
+    for (size_t row = 0; row < nbins(); row++) {
+      copy(sysValue.begin() + row*oldNSys, sysValue.begin() + (row+1)*oldNSys, values.begin() + row*newNSys);
+      copy(sysPresent.begin() + row*oldNSys, sysPresent.begin() + (row+1)*oldNSys, present.begin() + row*newNSys);
+    }
+    sysValue.swap(values);
+    sysPresent.swap(present);
+  }
+
+  size_t CalibrationColumns::add_systematic (const string &name, bool uncorrelated)
+  {
+    int old = sysNames.find(name);
+    if (old >= 0)
+      return size_t(old);
+
+    resize_sys(nsys() + 1);
+    size_t id = sysNames.intern(name);
+    sysUncorrelated.push_back(uncorrelated);
+    return id;
+  }
+
+  void CalibrationColumns::drop_systematic (const string &name)
+  {
+    int id = sysNames.find(name);
+    if (id < 0)
+      return;
+    for (size_t row = 0; row < nbins(); row++) {
+      sys(row, id) = 0.0;
+      sysPresent[row*nsys() + id] = 0;
+    }
+  }
+
+  void CalibrationColumns::set_sys (size_t bin, size_t id, double value)
+  {
+    sys(bin, id) = value;
+    sysPresent[bin*nsys() + id] = 1;
+  }
+
+  void CalibrationColumns::write_back (CalibrationAnalysis &ana) const
+  {
+    const size_t ns = nsys();
+    vector<char> seen (ns);
+    for (size_t row = 0; row < nbins(); row++) {
+      CalibrationBin &b(ana.bins[binIndex[row]]);
+      b.centralValue = centralValue[row];
+      b.centralValueStatisticalError = statError[row];
+
+      // Update the errors that are already there (or remove them). Other errors with the
+      // same name as one in the columns are left as they are.
+      fill(seen.begin(), seen.end(), 0);
+      vector<char> use (in_columns(b));
+      vector<SystematicError> errors;
+      errors.reserve(b.systematicErrors.size());
+      for (size_t is = 0; is < b.systematicErrors.size(); is++) {
+	SystematicError e(b.systematicErrors[is]);
+	int id = sysNames.find(e.name);
+	if (id >= 0 && use[is]) {
+	  seen[id] = 1;
+	  if (!has_sys(row, id))
+	    continue;
+	  e.value = sys(row, id);
+	}
+	errors.push_back(e);
+      }
+
+      // And anything new
+      for (size_t id = 0; id < ns; id++) {
+	if (has_sys(row, id) && !seen[id]) {
+	  SystematicError e;
+	  e.name = sysNames.name(id);
+	  e.value = sys(row, id);
+	  e.uncorrelated = sysUncorrelated[id] != 0;
+	  errors.push_back(e);
+	}
+      }
+
+      b.systematicErrors.swap(errors);
+    }
+  }
+
+  vector<double> ColumnSysQuadratureSum (const CalibrationColumns &c)
+  {
+    const size_t nb = c.nbins();
+    const size_t ns = c.nsys();
+    vector<double> result (nb, 0.0);
+    const double *m = c.sysValue.empty() ? 0 : &c.sysValue[0];
+    for (size_t row = 0; row < nb; row++) {
+      const double *r = m + row*ns;
+      double acc = c.sysDuplicateSquares[row];
+      for (size_t id = 0; id < ns; id++)
+	acc += r[id]*r[id];
+      result[row] = sqrt(acc);
+    }
+    return result;
+  }
+
+  vector<double> ColumnTotalError (const CalibrationColumns &c)
+  {
+    vector<double> result (ColumnSysQuadratureSum(c));
+    const size_t nb = c.nbins();
+    for (size_t row = 0; row < nb; row++) {
+      double s = c.statError[row];
+      result[row] = sqrt(result[row]*result[row] + s*s);
+    }
+    return result;
+  }
+
+  void RelativeErrors (const double *errors, const double *centralValues, double *result, size_t n)
+  {
+    for (size_t i = 0; i < n; i++) {
+      double cv = centralValues[i];
+      result[i] = cv != 0.0 ? errors[i] / cv * 100.0 : errors[i];
+    }
+  }
+
+  void ScaleSystematic (CalibrationColumns &c, size_t id, double factor)
+  {
+    const size_t nb = c.nbins();
+    const size_t ns = c.nsys();
+    for (size_t row = 0; row < nb; row++)
+      c.sysValue[row*ns + id] *= factor;
+  }
+
+  void SetSystematicFromPercent (CalibrationColumns &c, size_t id, double percent)
+  {
+    const size_t nb = c.nbins();
+    const size_t ns = c.nsys();
+    for (size_t row = 0; row < nb; row++) {
+      c.sysValue[row*ns + id] = percent * (c.centralValue[row] / 100.0);
+      c.sysPresent[row*ns + id] = 1;
+    }
+  }
+
+  double WeightedAverage (const double *values, const double *weights, size_t n, double &sumWeights)
+  {
+    double sumWV = 0.0;
+    double sumW = 0.0;
+    for (size_t i = 0; i < n; i++) {
+      sumWV += values[i]*weights[i];
+      sumW += weights[i];
+    }
+    sumWeights = sumW;
+    return sumWV / sumW;
+  }
+
+  CalibrationColumns WeightedAverageRows (const CalibrationColumns &c,
+					  const vector<vector<size_t> > &groups)
+  {
+    const size_t ns = c.nsys();
+
+    CalibrationColumns r;
+    r.sysNames = c.sysNames;
+    r.sysUncorrelated = c.sysUncorrelated;
+    r.centralValue.resize(groups.size());
+    r.statError.resize(groups.size());
+    r.binIndex.resize(groups.size());
+    r.sysValue.assign(groups.size()*ns, 0.0);
+    r.sysPresent.assign(groups.size()*ns, 0);
+    r.sysDuplicateSquares.assign(groups.size(), 0.0);
+
+    for (size_t ig = 0; ig < groups.size(); ig++) {
+      const vector<size_t> &rows(groups[ig]);
+      if (rows.size() == 0)
+	throw runtime_error("Unable to combine zero bins");
+
+      double *acc = ns == 0 ? 0 : &r.sysValue[ig*ns];
+      char *present = ns == 0 ? 0 : &r.sysPresent[ig*ns];
+
+      // Accumulate w*row for every row in the group - the matrix-vector product
+      // of the group's systematics matrix with the weight vector.
+      double sumW = 0.0;
+      double sumWCV = 0.0;
+      for (size_t i = 0; i < rows.size(); i++) {
+	const size_t row = rows[i];
+	const double stat = c.statError[row];
+	const double w = 1.0 / (stat*stat);
+	sumW += w;
+	sumWCV += w * c.centralValue[row];
+
+	const double *s = ns == 0 ? 0 : &c.sysValue[row*ns];
+	const char *p = ns == 0 ? 0 : &c.sysPresent[row*ns];
+	for (size_t id = 0; id < ns; id++) {
+	  acc[id] += w * s[id];
+	  present[id] |= p[id];
+	}
+      }
+
+      for (size_t id = 0; id < ns; id++)
+	acc[id] /= sumW;
+
+      r.centralValue[ig] = sumWCV / sumW;
+      r.statError[ig] = sqrt(1 / sumW);
+      r.binIndex[ig] = c.binIndex[rows[0]];
+    }
+
+    return r;
+  }
+}
@@ -0,0 +1,499 @@
+//
+// Binary encoding of the calibration data model
+//
+
+#include "Combination/CalibrationDataModelBinary.h"
+#include "Combination/BinaryInfoReader.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  //
+  // The basic types
+  //
+
+  void put (ostream &out, unsigned long long v)
+  {
+    char b[8];
+    for (int i = 0; i < 8; i++)
+      b[i] = (char) ((v >> (8*i)) & 0xff);
+    out.write(b, 8);
+  }
+
+  void put (ostream &out, double v)
+  {
+    unsigned long long bits;
+    memcpy(&bits, &v, sizeof(bits));
+    put(out, bits);
+  }
+
+  void put (ostream &out, bool v)
+  {
+    out.put(v ? 1 : 0);
+  }
+
+  void put (ostream &out, const string &v)
+  {
+    put(out, (unsigned long long) v.size());
+    out.write(v.data(), v.size());
+  }
+
+  void check (istream &in)
+  {
+    if (!in)
+      throw runtime_error("Unexpected end of binary calibration data.");
+  }
+
+  unsigned long long get_u64 (istream &in)
+  {
+    unsigned char b[8];
+    in.read((char*) b, 8);
+    check(in);
+    unsigned long long v = 0;
+    for (int i = 0; i < 8; i++)
+      v |= ((unsigned long long) b[i]) << (8*i);
+    return v;
+  }
+
+  double get_double (istream &in)
+  {
+    unsigned long long bits = get_u64(in);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+  }
+
+  bool get_bool (istream &in)
+  {
+    char c = 0;
+    in.get(c);
+    check(in);
+    return c != 0;
+  }
+
+  string get_string (istream &in)
+  {
+    unsigned long long n = get_u64(in);
+    string v;
+    // Read in pieces so a corrupt length can't ask for a huge buffer up front.
+    char buffer[4096];
+    while (n > 0) {
+      size_t chunk = n < sizeof(buffer) ? (size_t) n : sizeof(buffer);
+      in.read(buffer, chunk);
+      check(in);
+      v.append(buffer, chunk);
+      n -= chunk;
+    }
+    return v;
+  }
+
+  //
+  // The data model
+  //
+
+  void put (ostream &out, const SystematicError &e)
+  {
+    put(out, e.name);
+    put(out, e.value);
+    put(out, e.uncorrelated);
+  }
+
+  SystematicError get_sys_error (istream &in)
+  {
+    SystematicError e;
+    e.name = get_string(in);
+    e.value = get_double(in);
+    e.uncorrelated = get_bool(in);
+    return e;
+  }
+
+  void put (ostream &out, const vector<SystematicError> &errors)
+  {
+    put(out, (unsigned long long) errors.size());
+    for (size_t i = 0; i < errors.size(); i++)
+      put(out, errors[i]);
+  }
+
+  vector<SystematicError> get_sys_errors (istream &in)
+  {
+    vector<SystematicError> errors;
+    for (unsigned long long n = get_u64(in); n > 0; n--)
+      errors.push_back(get_sys_error(in));
+    return errors;
+  }
+
+  void put (ostream &out, const CalibrationBin &bin)
+  {
+    put(out, (unsigned long long) bin.binSpec.size());
+    for (size_t i = 0; i < bin.binSpec.size(); i++) {
+      put(out, bin.binSpec[i].variable);
+      put(out, bin.binSpec[i].lowvalue);
+      put(out, bin.binSpec[i].highvalue);
+    }
+    put(out, bin.centralValue);
+    put(out, bin.centralValueStatisticalError);
+    put(out, bin.isExtended);
+    put(out, bin.systematicErrors);
+    put(out, bin.referenceBinSystematicErrors);
+    put(out, (unsigned long long) bin.metadata.size());
+    for (map<string, pair<double, double> >::const_iterator itr = bin.metadata.begin(); itr != bin.metadata.end(); itr++) {
+      put(out, itr->first);
+      put(out, itr->second.first);
+      put(out, itr->second.second);
+    }
+  }
+
+  CalibrationBin get_bin (istream &in)
+  {
+    CalibrationBin bin;
+    for (unsigned long long n = get_u64(in); n > 0; n--) {
+      CalibrationBinBoundary b;
+      b.variable = get_string(in);
+      b.lowvalue = get_double(in);
+      b.highvalue = get_double(in);
+      bin.binSpec.push_back(b);
+    }
+    bin.centralValue = get_double(in);
+    bin.centralValueStatisticalError = get_double(in);
+    bin.isExtended = get_bool(in);
+    bin.systematicErrors = get_sys_errors(in);
+    bin.referenceBinSystematicErrors = get_sys_errors(in);
+    for (unsigned long long n = get_u64(in); n > 0; n--) {
+      string name (get_string(in));
+      double first = get_double(in);
+      double second = get_double(in);
+      bin.metadata[name] = make_pair(first, second);
+    }
+    return bin;
+  }
+
+  //
+  // The whole-file format (see the header for the layout).
+  //
+
+  using namespace BinaryInfoFormat;
+
+  class InfoWriter
+  {
+  public:
+    InfoWriter()
+      : _data (cHeaderSize, '\0')
+    {
+      memcpy(&_data[0], cMagic, sizeof(cMagic));
+      SetU32(8, cVersion);
+    }
+
+    size_t Pos() const { return _data.size(); }
+
+    void U32 (uint32_t v)
+    {
+      for (int i = 0; i < 4; i++)
+	_data += (char) ((v >> (8*i)) & 0xff);
+    }
+
+    void U64 (uint64_t v)
+    {
+      U32((uint32_t) (v & 0xffffffff));
+      U32((uint32_t) (v >> 32));
+    }
+
+    void F64 (double v)
+    {
+      uint64_t bits;
+      memcpy(&bits, &v, sizeof(bits));
+      U64(bits);
+    }
+
+    // Room for something to be filled in later.
+    size_t Reserve (size_t n)
+    {
+      size_t at = _data.size();
+      _data.append(n, '\0');
+      return at;
+    }
+
+    void SetU32 (size_t at, uint32_t v)
+    {
+      for (int i = 0; i < 4; i++)
+	_data[at + i] = (char) ((v >> (8*i)) & 0xff);
+    }
+
+    void SetU64 (size_t at, uint64_t v)
+    {
+      SetU32(at, (uint32_t) (v & 0xffffffff));
+      SetU32(at + 4, (uint32_t) (v >> 32));
+    }
+
+    void Align ()
+    {
+      while (_data.size() % 8 != 0)
+	_data += '\0';
+    }
+
+    // The number of a string in the string table, adding it if it is new.
+    uint32_t Str (const string &s)
+    {
+      unordered_map<string, uint32_t>::const_iterator i = _index.find(s);
+      if (i != _index.end())
+	return i->second;
+      uint32_t n = _strings.size();
+      _index[s] = n;
+      _strings.push_back(s);
+      return n;
+    }
+
+    void Count (size_t n)
+    {
+      if (n > 0xffffffffULL)
+	throw runtime_error("Too many items to write in the binary calibration format.");
+      U32((uint32_t) n);
+    }
+
+    void Boundaries (const vector<CalibrationBinBoundary> &spec)
+    {
+      for (size_t i = 0; i < spec.size(); i++) {
+	U32(Str(spec[i].variable));
+	U32(0);
+	F64(spec[i].lowvalue);
+	F64(spec[i].highvalue);
+      }
+    }
+
+    void SysErrors (const vector<SystematicError> &errors)
+    {
+      for (size_t i = 0; i < errors.size(); i++) {
+	U32(Str(errors[i].name));
+	U32(errors[i].uncorrelated ? 1 : 0);
+	F64(errors[i].value);
+      }
+    }
+
+    void Bin (const CalibrationBin &bin)
+    {
+      Count(bin.binSpec.size());
+      Count(bin.systematicErrors.size());
+      Count(bin.referenceBinSystematicErrors.size());
+      Count(bin.metadata.size());
+      U32(bin.isExtended ? 1 : 0);
+      U32(0);
+      F64(bin.centralValue);
+      F64(bin.centralValueStatisticalError);
+      Boundaries(bin.binSpec);
+      SysErrors(bin.systematicErrors);
+      SysErrors(bin.referenceBinSystematicErrors);
+      for (map<string, pair<double, double> >::const_iterator itr = bin.metadata.begin(); itr != bin.metadata.end(); itr++) {
+	U32(Str(itr->first));
+	U32(0);
+	F64(itr->second.first);
+	F64(itr->second.second);
+      }
+    }
+
+    // Returns where it was written.
+    size_t Analysis (const CalibrationAnalysis &ana)
+    {
+      size_t at = Pos();
+      Count(ana.bins.size());
+      Count(ana.metadata.size());
+      Count(ana.metadata_s.size());
+      U32(0);
+      size_t binTable = Reserve(8*ana.bins.size());
+      for (size_t i = 0; i < ana.bins.size(); i++) {
+	SetU64(binTable + 8*i, Pos());
+	Bin(ana.bins[i]);
+      }
+      for (map<string, vector<double> >::const_iterator itr = ana.metadata.begin(); itr != ana.metadata.end(); itr++) {
+	U32(Str(itr->first));
+	Count(itr->second.size());
+	for (size_t i = 0; i < itr->second.size(); i++)
+	  F64(itr->second[i]);
+      }
+      for (map<string, string>::const_iterator itr = ana.metadata_s.begin(); itr != ana.metadata_s.end(); itr++) {
+	U32(Str(itr->first));
+	U32(Str(itr->second));
+      }
+      return at;
+    }
+
+    template <typename T>
+    void Names (const T &a)
+    {
+      U32(Str(a.name));
+      U32(Str(a.flavor));
+      U32(Str(a.tagger));
+      U32(Str(a.operatingPoint));
+      U32(Str(a.jetAlgorithm));
+    }
+
+    void Write (const CalibrationInfo &info)
+    {
+      // Analyses, with the table up front.
+      SetU64(cAnalysesOffset, Pos());
+      Count(info.Analyses.size());
+      U32(0);
+      size_t table = Reserve(cAnalysisEntrySize*info.Analyses.size());
+      for (size_t i = 0; i < info.Analyses.size(); i++) {
+	const CalibrationAnalysis &ana (info.Analyses[i]);
+	size_t entry = table + cAnalysisEntrySize*i;
+	SetU64(entry, Analysis(ana));
+	SetU32(entry + 8, Str(ana.name));
+	SetU32(entry + 12, Str(ana.flavor));
+	SetU32(entry + 16, Str(ana.tagger));
+	SetU32(entry + 20, Str(ana.operatingPoint));
+	SetU32(entry + 24, Str(ana.jetAlgorithm));
+	SetU32(entry + 28, (uint32_t) ana.bins.size());
+      }
+
+      SetU64(cCorrelationsOffset, Pos());
+      Count(info.Correlations.size());
+      U32(0);
+      for (size_t i = 0; i < info.Correlations.size(); i++) {
+	const AnalysisCorrelation &c (info.Correlations[i]);
+	U32(Str(c.analysis1Name));
+	U32(Str(c.analysis2Name));
+	U32(Str(c.flavor));
+	U32(Str(c.tagger));
+	U32(Str(c.operatingPoint));
+	U32(Str(c.jetAlgorithm));
+	Count(c.bins.size());
+	U32(0);
+	for (size_t b = 0; b < c.bins.size(); b++) {
+	  Count(c.bins[b].binSpec.size());
+	  U32(c.bins[b].hasStatCorrelation ? 1 : 0);
+	  F64(c.bins[b].statCorrelation);
+	  Boundaries(c.bins[b].binSpec);
+	}
+      }
+
+      SetU64(cDefaultsOffset, Pos());
+      Count(info.Defaults.size());
+      U32(0);
+      for (size_t i = 0; i < info.Defaults.size(); i++) {
+	Names(info.Defaults[i]);
+	U32(0);
+      }
+
+      SetU64(cAliasesOffset, Pos());
+      Count(info.Aliases.size());
+      U32(0);
+      for (size_t i = 0; i < info.Aliases.size(); i++) {
+	const AliasAnalysis &a (info.Aliases[i]);
+	Names(a);
+	Count(a.CopyTargets.size());
+	for (size_t t = 0; t < a.CopyTargets.size(); t++) {
+	  Names(a.CopyTargets[t]);
+	  U32(0);
+	}
+      }
+
+      // And last the strings, now we know them all.
+      SetU64(cStringsOffset, Pos());
+      Count(_strings.size());
+      U32(0);
+      size_t offsets = Reserve(8*_strings.size());
+      for (size_t i = 0; i < _strings.size(); i++) {
+	SetU64(offsets + 8*i, Pos());
+	Count(_strings[i].size());
+	_data += _strings[i];
+	Align();
+      }
+
+      SetU64(cFileSizeOffset, Pos());
+    }
+
+    const string &Data() const { return _data; }
+
+  private:
+    string _data;
+    vector<string> _strings;
+    unordered_map<string, uint32_t> _index;
+  };
+}
+
+namespace BTagCombination {
+
+  void WriteBinary (ostream &out, const CalibrationAnalysis &ana)
+  {
+    put(out, ana.name);
+    put(out, ana.flavor);
+    put(out, ana.tagger);
+    put(out, ana.operatingPoint);
+    put(out, ana.jetAlgorithm);
+
+    put(out, (unsigned long long) ana.bins.size());
+    for (size_t i = 0; i < ana.bins.size(); i++)
+      put(out, ana.bins[i]);
+
+    put(out, (unsigned long long) ana.metadata.size());
+    for (map<string, vector<double> >::const_iterator itr = ana.metadata.begin(); itr != ana.metadata.end(); itr++) {
+      put(out, itr->first);
+      put(out, (unsigned long long) itr->second.size());
+      for (size_t i = 0; i < itr->second.size(); i++)
+	put(out, itr->second[i]);
+    }
+
+    put(out, (unsigned long long) ana.metadata_s.size());
+    for (map<string, string>::const_iterator itr = ana.metadata_s.begin(); itr != ana.metadata_s.end(); itr++) {
+      put(out, itr->first);
+      put(out, itr->second);
+    }
+  }
+
+  CalibrationAnalysis ReadBinaryAnalysis (istream &in)
+  {
+    CalibrationAnalysis ana;
+    ana.name = get_string(in);
+    ana.flavor = get_string(in);
+    ana.tagger = get_string(in);
+    ana.operatingPoint = get_string(in);
+    ana.jetAlgorithm = get_string(in);
+
+    for (unsigned long long n = get_u64(in); n > 0; n--)
+      ana.bins.push_back(get_bin(in));
+
+    for (unsigned long long n = get_u64(in); n > 0; n--) {
+      vector<double> &values (ana.metadata[get_string(in)]);
+      for (unsigned long long nv = get_u64(in); nv > 0; nv--)
+	values.push_back(get_double(in));
+    }
+
+    for (unsigned long long n = get_u64(in); n > 0; n--) {
+      string name (get_string(in));
+      ana.metadata_s[name] = get_string(in);
+    }
+    return ana;
+  }
+
+  void WriteBinaryInfo (ostream &out, const CalibrationInfo &info)
+  {
+    InfoWriter w;
+    w.Write(info);
+    out.write(w.Data().data(), w.Data().size());
+  }
+
+  CalibrationInfo ReadBinaryInfo (const char *data, size_t size)
+  {
+    return BinaryInfoReader(data, size).Info();
+  }
+
+  CalibrationInfo ReadBinaryInfo (istream &in)
+  {
+    ostringstream text;
+    text << in.rdbuf();
+    string data (text.str());
+    return ReadBinaryInfo(data.data(), data.size());
+  }
+
+  bool IsBinaryInfo (const char *data, size_t size)
+  {
+    return size >= sizeof(BinaryInfoFormat::cMagic)
+      && memcmp(data, BinaryInfoFormat::cMagic, sizeof(BinaryInfoFormat::cMagic)) == 0;
+  }
+}
@@ -0,0 +1,230 @@
+//
+// A masked view of the analyses in a CalibrationInfo.
+//
+
+#include "Combination/CalibrationInfoView.h"
+#include "Combination/BinNameUtils.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  // Copy everything but the bins (avoid copying the bins only to throw them away).
+  CalibrationAnalysis AnalysisHeader (const CalibrationAnalysis &ana)
+  {
+    CalibrationAnalysis h;
+    h.name = ana.name;
+    h.flavor = ana.flavor;
+    h.tagger = ana.tagger;
+    h.operatingPoint = ana.operatingPoint;
+    h.jetAlgorithm = ana.jetAlgorithm;
+    h.metadata = ana.metadata;
+    h.metadata_s = ana.metadata_s;
+    return h;
+  }
+}
+
+namespace BTagCombination {
+
+  CalibrationInfoView::CalibrationInfoView (const CalibrationInfo &info)
+    : _analyses(&info.Analyses), _info(&info)
+  {
+    init();
+  }
+
+  CalibrationInfoView::CalibrationInfoView (const vector<CalibrationAnalysis> &analyses)
+    : _analyses(&analyses), _info(0)
+  {
+    init();
+  }
+
+  // Everything is selected to start with, and the bin keys are built once here.
+  void CalibrationInfoView::init()
+  {
+    vector<vector<BinKey> > *keys = new vector<vector<BinKey> >(_analyses->size());
+    for (size_t i = 0; i < _analyses->size(); i++) {
+      const vector<CalibrationBin> &bins((*_analyses)[i].bins);
+      (*keys)[i].reserve(bins.size());
+      for (size_t ib = 0; ib < bins.size(); ib++)
+	(*keys)[i].push_back(BinKey(bins[ib]));
+      _selected.push_back(i);
+    }
+    _binKeys.reset(keys);
+  }
+
+  void CalibrationInfoView::selectAnalyses (const vector<size_t> &indices)
+  {
+    _selected = indices;
+  }
+
+  void CalibrationInfoView::removeBin (const set<CalibrationBinBoundary> &bin)
+  {
+    _removedBins.push_back(BinKey(bin));
+  }
+
+  void CalibrationInfoView::keepOnlyBin (const set<CalibrationBinBoundary> &bin)
+  {
+    _keepOnlyBins.push_back(BinKey(bin));
+  }
+
+  void CalibrationInfoView::removeSysError (const string &name)
+  {
+    _removedSys.insert(name);
+  }
+
+  void CalibrationInfoView::makeSysErrorUncorrelated (const string &name)
+  {
+    _uncorrelatedSys.insert(name);
+  }
+
+  bool CalibrationInfoView::binVisible (size_t index, size_t bin) const
+  {
+    const BinKey &key(binKey(index, bin));
+    for (size_t i = 0; i < _keepOnlyBins.size(); i++) {
+      if (key != _keepOnlyBins[i])
+	return false;
+    }
+    for (size_t i = 0; i < _removedBins.size(); i++) {
+      if (key == _removedBins[i])
+	return false;
+    }
+    return true;
+  }
+
+  bool CalibrationInfoView::sysVisible (const SystematicError &e) const
+  {
+    return _removedSys.size() == 0 || _removedSys.find(e.name) == _removedSys.end();
+  }
+
+  bool CalibrationInfoView::sysUncorrelated (const SystematicError &e) const
+  {
+    return e.uncorrelated
+      || (_uncorrelatedSys.size() > 0 && _uncorrelatedSys.find(e.name) != _uncorrelatedSys.end());
+  }
+
+  vector<size_t> CalibrationInfoView::analysisIndices() const
+  {
+    if (!hasBinMask())
+      return _selected;
+
+    vector<size_t> result;
+    for (size_t i = 0; i < _selected.size(); i++) {
+      size_t index = _selected[i];
+      for (size_t ib = 0; ib < analysis(index).bins.size(); ib++) {
+	if (binVisible(index, ib)) {
+	  result.push_back(index);
+	  break;
+	}
+      }
+    }
+    return result;
+  }
+
+  const vector<AnalysisCorrelation> &CalibrationInfoView::correlations() const
+  {
+    static const vector<AnalysisCorrelation> none;
+    return _info == 0 ? none : _info->Correlations;
+  }
+
+  const string &CalibrationInfoView::combinationName() const
+  {
+    static const string none;
+    return _info == 0 ? none : _info->CombinationAnalysisName;
+  }
+
+  set<set<CalibrationBinBoundary> > CalibrationInfoView::listAllBins() const
+  {
+    set<set<CalibrationBinBoundary> > result;
+    for (size_t i = 0; i < _selected.size(); i++) {
+      const CalibrationAnalysis &ana(analysis(_selected[i]));
+      for (size_t ib = 0; ib < ana.bins.size(); ib++) {
+	if (binVisible(_selected[i], ib))
+	  result.insert(set<CalibrationBinBoundary>(ana.bins[ib].binSpec.begin(), ana.bins[ib].binSpec.end()));
+      }
+    }
+    return result;
+  }
+
+  set<string> CalibrationInfoView::listAllSysErrors() const
+  {
+    set<string> result;
+    for (size_t i = 0; i < _selected.size(); i++) {
+      const CalibrationAnalysis &ana(analysis(_selected[i]));
+      for (size_t ib = 0; ib < ana.bins.size(); ib++) {
+	if (!binVisible(_selected[i], ib))
+	  continue;
+	const vector<SystematicError> &errs(ana.bins[ib].systematicErrors);
+	for (size_t is = 0; is < errs.size(); is++) {
+	  if (sysVisible(errs[is]))
+	    result.insert(errs[is].name);
+	}
+      }
+    }
+    return result;
+  }
+
+  map<string, CalibrationInfoView> CalibrationInfoView::splitByJetTagFlavOp() const
+  {
+    map<string, vector<size_t> > groups;
+    vector<size_t> indices(analysisIndices());
+    for (size_t i = 0; i < indices.size(); i++) {
+      groups[OPIndependentName(analysis(indices[i]))].push_back(indices[i]);
+    }
+
+    map<string, CalibrationInfoView> result;
+    for (map<string, vector<size_t> >::const_iterator itr = groups.begin(); itr != groups.end(); itr++) {
+      CalibrationInfoView v(*this);
+      v.selectAnalyses(itr->second);
+      result.insert(make_pair(itr->first, v));
+    }
+    return result;
+  }
+
+  vector<CalibrationAnalysis> CalibrationInfoView::headers() const
+  {
+    vector<CalibrationAnalysis> result;
+    vector<size_t> indices(analysisIndices());
+    for (size_t i = 0; i < indices.size(); i++) {
+      result.push_back(AnalysisHeader(analysis(indices[i])));
+    }
+    return result;
+  }
+
+  vector<CalibrationAnalysis> CalibrationInfoView::materialize() const
+  {
+    vector<CalibrationAnalysis> result;
+    vector<size_t> indices(analysisIndices());
+    for (size_t i = 0; i < indices.size(); i++) {
+      const CalibrationAnalysis &ana(analysis(indices[i]));
+      CalibrationAnalysis r(AnalysisHeader(ana));
+
+      for (size_t ib = 0; ib < ana.bins.size(); ib++) {
+	if (!binVisible(indices[i], ib))
+	  continue;
+
+	const CalibrationBin &src(ana.bins[ib]);
+	CalibrationBin b;
+	b.binSpec = src.binSpec;
+	b.centralValue = src.centralValue;
+	b.centralValueStatisticalError = src.centralValueStatisticalError;
+	b.isExtended = src.isExtended;
+	b.metadata = src.metadata;
+	b.referenceBinSystematicErrors = src.referenceBinSystematicErrors;
+	for (size_t is = 0; is < src.systematicErrors.size(); is++) {
+	  const SystematicError &e(src.systematicErrors[is]);
+	  if (!sysVisible(e))
+	    continue;
+	  b.systematicErrors.push_back(e);
+	  b.systematicErrors.back().uncorrelated = sysUncorrelated(e);
+	}
+	r.bins.push_back(b);
+      }
+
+      result.push_back(r);
+    }
+    return result;
+  }
+}
@@ -5,6 +5,7 @@
 #include "Combination/CombinationContext.h"
 #include "Combination/Measurement.h"
 #include "Combination/MeasurementUtils.h"
+#include "Combination/Tracing.h"
 
 #include <RooRealVar.h>
 #include <RooAbsReal.h>
@@ -16,6 +17,9 @@
 #include <RooAddition.h>
 #include <RooPlot.h>
 #include <RooFitResult.h>
+#include <RooMinimizer.h>
+
+#include <Math/MinimizerOptions.h>
 
 #include <TFile.h>
 #include <TH1F.h>
@@ -25,6 +29,9 @@
 #include <stdexcept>
 #include <iterator>
 #include <sstream>
+#include <chrono>
+#include <ctime>
+#include <memory>
 
 using namespace std;
 
@@ -89,6 +96,70 @@ namespace {
     return RooFit::Range(low, high);
   }
 
+  //
+  // Times one phase of the fit (wall and cpu), and, if the phase runs a minimization,
+  // records how MINUIT got on. The phase is also a span in the trace.
+  //
+  class PhaseTimer
+  {
+  public:
+    PhaseTimer(const char *name, const string &sysErrorName = "")
+      : _span(name, sysErrorName), _wallStart(chrono::steady_clock::now()), _cpuStart(clock())
+    {
+      _phase.name = name;
+      _phase.sysErrorName = sysErrorName;
+      _phase.wallTime = 0.0;
+      _phase.cpuTime = 0.0;
+      _phase.minimized = false;
+      _phase.minuitStatus = 0;
+      _phase.edm = 0.0;
+      _phase.nllCalls = 0;
+    }
+
+    // Minimize the pdf on the data. Normally this is just fitTo. fitTo gives no way of
+    // getting at the NLL call count, so when that is wanted (countCalls) the minimizer is
+    // run by hand, with the settings fitTo would have used (RooAbsPdf::fitTo defaults:
+    // Optimize(2), PrintLevel(1), PrintEvalErrors(10), EvalErrorWall, migrad then hesse).
+    void Minimize(RooAbsPdf &pdf, RooDataSet &data, bool countCalls)
+    {
+      unique_ptr<RooFitResult> r;
+      if (!countCalls) {
+	r.reset(pdf.fitTo(data, RooFit::Strategy(cMINUITStrat), RooFit::Save()));
+      } else {
+	unique_ptr<RooAbsReal> nll(pdf.createNLL(data));
+	RooMinimizer m(*nll);
+	m.setEvalErrorWall(true);
+	m.setPrintEvalErrors(10);
+	m.setPrintLevel(1);
+	m.setStrategy(cMINUITStrat);
+	m.optimizeConst(2);
+	m.migrad();
+	m.hesse();
+	r.reset(m.save());
+	_phase.nllCalls = m.evalCounter();
+      }
+
+      _phase.minimized = true;
+      _phase.minuitStatus = r->status();
+      _phase.edm = r->edm();
+    }
+
+    // Stop the clocks and return the phase.
+    const CombinationContextBase::ExtraFitInfo::FitPhase &Stop()
+    {
+      _phase.wallTime = chrono::duration<double>(chrono::steady_clock::now() - _wallStart).count();
+      _phase.cpuTime = double(clock() - _cpuStart) / CLOCKS_PER_SEC;
+      _span.End();
+      return _phase;
+    }
+
+  private:
+    CombinationContextBase::ExtraFitInfo::FitPhase _phase;
+    TraceSpan _span;
+    chrono::steady_clock::time_point _wallStart;
+    clock_t _cpuStart;
+  };
+
 }
 
 namespace BTagCombination {
@@ -97,8 +168,24 @@ namespace BTagCombination {
   /// Creates a new combination context.
   ///
   CombinationContext::CombinationContext(void)
-    : _verbose(true), _doPlots(false)
+    : _verbose(true), _doPlots(false), _fitTiming(false)
+  {
+  }
+
+  ///
+  /// The settings Minimize uses. fitTo and RooMinimizer take the minimizer, tolerance and
+  /// precision from the global defaults, so those can change from job to job.
+  ///
+  string CombinationContext::FitSettings()
   {
+    ostringstream s;
+    s.precision(17);
+    s << "strategy " << cMINUITStrat << ", optimize 2, migrad+hesse"
+      << ", minimizer " << ROOT::Math::MinimizerOptions::DefaultMinimizerType()
+      << "/" << ROOT::Math::MinimizerOptions::DefaultMinimizerAlgo()
+      << ", tolerance " << ROOT::Math::MinimizerOptions::DefaultTolerance()
+      << ", precision " << ROOT::Math::MinimizerOptions::DefaultPrecision();
+    return s.str();
   }
 
   //
@@ -156,7 +243,9 @@ namespace BTagCombination {
     // We do keep some state (I know, not perfect)
     //
 
+    TraceSpan fitSpan("fit", name);
     _extraInfo.clear();
+    PhaseTimer buildPhase("build");
 
     //
     // First thing to do is x-check the measurements to eliminate any combinations
@@ -282,14 +371,19 @@ namespace BTagCombination {
     RooDataSet measuredPoints("pointsMeasured", "Measured Values", varNames);
     measuredPoints.add(varValues);
 
+    _extraInfo._nMeasurements = gMeas.size();
+    _extraInfo._nParameters = allVars.size() + _whatMeasurements.size();
+    _extraInfo._phases.push_back(buildPhase.Stop());
+
     ///
     /// And do the fit
     ///
 
     if (_verbose)
       cout << "Starting the master fit..." << endl;
-    RooFitResult *r = finalPDF.fitTo(measuredPoints, RooFit::Strategy(cMINUITStrat));
-    delete r;
+    PhaseTimer masterPhase("master");
+    masterPhase.Minimize(finalPDF, measuredPoints, _fitTiming);
+    _extraInfo._phases.push_back(masterPhase.Stop());
 
     ///
     /// Dump out the graph-viz tree
@@ -320,6 +414,8 @@ namespace BTagCombination {
     //
 
     {
+      PhaseTimer chi2Phase("chi2");
+
       // Get the matrix of the measurements, the fits, and the covariance.
       TMatrixT<double> y(gMeas.size(), 1); // Actual measurement
       TMatrixT<double> Ux(gMeas.size(), 1); // The fit measurements for each guy
@@ -355,6 +451,8 @@ namespace BTagCombination {
 
       if (_verbose)
         cout << "Total chi2 for " << name << ": " << xchi2(0, 0) << " measurements: " << gMeas.size() << " fits: " << _whatMeasurements.size() << endl;
+
+      _extraInfo._phases.push_back(chi2Phase.Stop());
     }
 
     //
@@ -500,8 +598,9 @@ namespace BTagCombination {
         sysErr->setVal(0.0);
         sysErr->setError(0.0);
 
-        RooFitResult *r = finalPDF.fitTo(measuredPoints, RooFit::Strategy(cMINUITStrat));
-        delete r;
+        PhaseTimer sysPhase("sys", sysErrorName);
+        sysPhase.Minimize(finalPDF, measuredPoints, _fitTiming);
+        _extraInfo._phases.push_back(sysPhase.Stop());
 
         // Loop over all measurements. If the measurement knows about
         // this systematic error, then extract a number from it.
@@ -547,7 +646,9 @@ namespace BTagCombination {
       // of sigma. The fit just doesn't work well.
       //
 
+      PhaseTimer statPhase("stat");
       map<string, double> stat_errors = CalculateStatisticalErrors();
+      _extraInfo._phases.push_back(statPhase.Stop());
 
       for (unsigned int i_mn = 0; i_mn < allMeasureNames.size(); i_mn++) {
         const string item(allMeasureNames[i_mn]);
@@ -613,7 +714,9 @@ namespace BTagCombination {
     /// Since we've been futzing with all of this, we had better return the fit to be "normal".
     ///
 
-    finalPDF.fitTo(measuredPoints, RooFit::Strategy(cMINUITStrat));
+    PhaseTimer restorePhase("restore");
+    restorePhase.Minimize(finalPDF, measuredPoints, _fitTiming);
+    _extraInfo._phases.push_back(restorePhase.Stop());
 
     //
     // How did the total errors work out?
@@ -61,6 +61,9 @@ namespace BTagCombination {
   {
     _globalChi2 = 0.0;
     _ndof = 0.0;
+    _phases.clear();
+    _nParameters = 0;
+    _nMeasurements = 0;
   }
 
   ///
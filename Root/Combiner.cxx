@@ -13,6 +13,12 @@
 #include "Combination/CalibrationDataModelStreams.h"
 #include "Combination/FitLinage.h"
 #include "Combination/MeasurementUtils.h"
+#include "Combination/CalibrationColumns.h"
+#include "Combination/BinGeometry.h"
+#include "Combination/BinKey.h"
+#include "Combination/CalibrationInfoView.h"
+#include "Combination/Tracing.h"
+#include "Combination/FitResultCache.h"
 
 #include <RooRealVar.h>
 
@@ -20,20 +26,22 @@
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <unordered_map>
 
 using namespace std;
 
 namespace {
   using namespace BTagCombination;
 
-  // Fill the context info for a single bin.
+  // Fill the context info for a single bin. binName is the name of what is being
+  // measured (the prefix plus the OPBinName of the bin). If the bin is seen through
+  // a view, the view's systematic error masks are applied.
   void FillContextWithBinInfo(CombinationContext &ctx,
     const CalibrationBin &b,
-    const string &prefix = "",
+    const string &binName,
     const string &mname = "",
-    bool verbose = true) {
-
-    string binName(prefix + OPBinName(b));
+    bool verbose = true,
+    const CalibrationInfoView *view = 0) {
 
     Measurement *m;
     if (mname.size() == 0) {
@@ -47,9 +55,11 @@ namespace {
 
     for (unsigned int i_sys = 0; i_sys < b.systematicErrors.size(); i_sys++) {
       const SystematicError &err(b.systematicErrors[i_sys]);
+      if (view != 0 && !view->sysVisible(err))
+        continue;
 
       string ename(err.name);
-      if (err.uncorrelated) {
+      if (view != 0 ? view->sysUncorrelated(err) : err.uncorrelated) {
         ename = string("UNCORBIN-") + ename + "-**" + binName;
       }
 
@@ -72,29 +82,61 @@ namespace {
     // For each bin, add the info
     for (unsigned int i = 0; i < bins.size(); i++) {
       const CalibrationBin &b(bins[i]);
-      FillContextWithBinInfo(ctx, b, prefix);
+      FillContextWithBinInfo(ctx, b, prefix + OPBinName(b));
     }
   }
 
+  // The bins from a set of analyses, grouped by bin. The name is the name of the
+  // bin in the fit, and is only built once per bin. bin is the first bin seen (in the
+  // analyses that were used to fill the context - they must outlive the group). order
+  // counts the groups in the order they were first seen.
+  struct BinGroup {
+    BinGroup() : bin(0), order(0) {}
+    string name;
+    const CalibrationBin *bin;
+    size_t order;
+  };
+  typedef unordered_map<BinKey, BinGroup, BinKeyHash> t_binGroups;
+
   // Fill the fitting context with a list of analyses info... it is assumed that common bins
   // in here can be fit together.
-  map<string, vector<CalibrationBin> > FillContextWithCommonAnaInfo(CombinationContext &ctx, const vector<CalibrationAnalysis> &ana, const string &prefix = "", bool verbose = true)
+  // Only what is visible in the view goes into the fit.
+  t_binGroups FillContextWithCommonAnaInfo(CombinationContext &ctx, const CalibrationInfoView &view, const string &prefix = "", bool verbose = true)
   {
     // Sort the bins all together.
-    map<string, vector<CalibrationBin> > bybins;
-    for (unsigned int i_ana = 0; i_ana < ana.size(); i_ana++) {
-      const CalibrationAnalysis &a(ana[i_ana]);
-      for (unsigned int i_bin = 0; i_bin < a.bins.size(); i_bin++) {
+    t_binGroups bybins;
+    vector<size_t> indices(view.analysisIndices());
+    for (size_t i_ana = 0; i_ana < indices.size(); i_ana++) {
+      const CalibrationAnalysis &a(view.analysis(indices[i_ana]));
+      string anaName(OPFullName(a));
+      for (size_t i_bin = 0; i_bin < a.bins.size(); i_bin++) {
+        if (!view.binVisible(indices[i_ana], i_bin))
+          continue;
+
         const CalibrationBin &b(a.bins[i_bin]);
-        string binName(OPBinName(b));
-        bybins[prefix + binName].push_back(b);
-        FillContextWithBinInfo(ctx, b, prefix, OPIgnoreFormat(a, b), verbose);
+        BinGroup &g(bybins[view.binKey(indices[i_ana], i_bin)]);
+        if (g.bin == 0) {
+          g.name = prefix + OPBinName(b);
+          g.bin = &b;
+          g.order = bybins.size() - 1;
+        }
+
+        // The measurement name is the OPIgnoreFormat of the bin.
+        FillContextWithBinInfo(ctx, b, g.name, anaName + ":" + g.name.substr(prefix.size()), verbose, &view);
       }
     }
 
     return bybins;
   }
 
+  // Order bin groups by name, and groups with the same name in the order they were seen.
+  bool BinGroupNameLess(const BinGroup *g1, const BinGroup *g2)
+  {
+    if (g1->name != g2->name)
+      return g1->name < g2->name;
+    return g1->order < g2->order;
+  }
+
   //
   // Extract the complete result - with sys errors - from the calibration bin
   //  - Context has already had the fit run.
@@ -136,12 +178,25 @@ namespace {
 
   // Given a mapping of bins to analysis bins, and a set of fit results, extract the mapping
   // and return a list of combined fits.
-  vector<CalibrationBin> ExtractBinsResult(const map<string, vector<CalibrationBin> > &bybins,
+  // The bins come back sorted by name.
+  vector<CalibrationBin> ExtractBinsResult(const t_binGroups &bybins,
     const map<string, CombinationContext::FitResult> &fitResult)
   {
+    vector<const BinGroup*> groups;
+    for (t_binGroups::const_iterator i_b = bybins.begin(); i_b != bybins.end(); i_b++) {
+      groups.push_back(&(i_b->second));
+    }
+    sort(groups.begin(), groups.end(), BinGroupNameLess);
+
     vector<CalibrationBin> result;
-    for (map<string, vector<CalibrationBin> >::const_iterator i_b = bybins.begin(); i_b != bybins.end(); i_b++) {
-      string binName = i_b->first;
+    for (size_t i_g = 0; i_g < groups.size(); i_g++) {
+      const string &binName(groups[i_g]->name);
+
+      // Bins whose edges differ past the precision of the name are the same bin in the fit.
+      // The first one seen is used, as when the bins were grouped by name.
+      if (i_g > 0 && binName == groups[i_g - 1]->name)
+        continue;
+
       map<string, CombinationContext::FitResult>::const_iterator itr = fitResult.find(binName);
       if (itr == fitResult.end()) {
         ostringstream err;
@@ -149,243 +204,46 @@ namespace {
         throw runtime_error(err.str().c_str());
       }
 
-      CalibrationBin thisBin(ExtractBinResult(itr->second, i_b->second[0]));
+      CalibrationBin thisBin(ExtractBinResult(itr->second, *(groups[i_g]->bin)));
       result.push_back(thisBin);
     }
     return result;
   }
 
-  // Nice way of sorting analyses for fitting.
-  typedef map<string, vector<CalibrationAnalysis> > t_anaMap;
-
-  // Looking at sets of bin boundaries, return true if one of the sent in bins is a container of our
-  // given bin.
-  class ContainsBin {
-  public:
-    inline ContainsBin(const CalibrationBin &b)
-    {
-      for (size_t i = 0; i < b.binSpec.size(); i++) {
-        _binB[b.binSpec[i].variable] = b.binSpec[i];
-      }
-    }
-
-    bool operator() (const set<CalibrationBinBoundary> &bounds)
-    {
-      if (bounds.size() != _binB.size())
-        return false;
-
-      for (set<CalibrationBinBoundary>::const_iterator itr = bounds.begin(); itr != bounds.end(); itr++) {
-        map<string, CalibrationBinBoundary>::const_iterator fb = _binB.find(itr->variable);
-        if (fb == _binB.end())
-          return false;
-
-        if (fb->second.lowvalue < itr->lowvalue
-          || fb->second.highvalue > itr->highvalue)
-          return false;
-      }
-
-      return true;
-    }
-
-  private:
-    map<string, CalibrationBinBoundary> _binB;
-  };
-
-  double BinArea(const set<CalibrationBinBoundary> &b)
-  {
-    double r = 1.0;
-    for (set<CalibrationBinBoundary>::const_iterator i = b.begin(); i != b.end(); i++) {
-      r *= (i->highvalue - i->lowvalue);
-    }
-    return r;
-  }
-
-  // Calculate the bin area
-  double BinArea(const CalibrationBin &b)
-  {
-    set<CalibrationBinBoundary> spec(b.binSpec.begin(), b.binSpec.end());
-    return BinArea(spec);
-  }
-
-  //
-  // Return true if these bins have any overlap at all. To have overlap then every single
-  // coordinate must have overlap. Any of them don't and then you don't have overlap.
-  //
-  bool BinsOverlap(const CalibrationBin &b1, const CalibrationBin &b2)
-  {
-    // Put in a map to make the lookup easier.
-    map<string, vector<CalibrationBinBoundary> > binfo;
-    for (size_t i = 0; i < b1.binSpec.size(); i++) {
-      binfo[b1.binSpec[i].variable].push_back(b1.binSpec[i]);
-    }
-    for (size_t i = 0; i < b2.binSpec.size(); i++) {
-      binfo[b2.binSpec[i].variable].push_back(b2.binSpec[i]);
-    }
-
-    for (map<string, vector<CalibrationBinBoundary> >::const_iterator i = binfo.begin(); i != binfo.end(); i++) {
-      if (i->second.size() != 2)
-        return false;
-      const CalibrationBinBoundary &bb1(i->second[0]);
-      const CalibrationBinBoundary &bb2(i->second[1]);
-
-      if (bb1.highvalue <= bb2.lowvalue)
-        return false;
-      if (bb1.lowvalue >= bb2.highvalue)
-        return false;
-    }
-    return true;
-  }
-
-  // Return the list of bins in two analyses that overlap
-  vector<CalibrationBin> PartialOverlappingBins(const CalibrationAnalysis &a1, const CalibrationAnalysis &a2)
-  {
-    for (vector<CalibrationBin>::const_iterator i_b1 = a1.bins.begin(); i_b1 != a1.bins.end(); i_b1++) {
-      set<CalibrationBinBoundary> b1_bins(i_b1->binSpec.begin(), i_b1->binSpec.end());
-      for (vector<CalibrationBin>::const_iterator i_b2 = a2.bins.begin(); i_b2 != a2.bins.end(); i_b2++) {
-        set<CalibrationBinBoundary> b2_bins(i_b2->binSpec.begin(), i_b2->binSpec.end());
-        if (BinsOverlap(*i_b1, *i_b2) && (b1_bins != b2_bins)) {
-          vector<CalibrationBin> result;
-          result.push_back(*i_b1);
-          result.push_back(*i_b2);
-          return result;
-        }
-      }
-    }
-    return vector<CalibrationBin>();
-  }
-
-  // Return any bins in two analyses that overlap partially.
-  vector<CalibrationBin> PartialOverlappingBins(const vector<CalibrationAnalysis> &anas)
-  {
-    for (vector<CalibrationAnalysis>::const_iterator i_a1 = anas.begin(); i_a1 != anas.end(); i_a1++) {
-      for (vector<CalibrationAnalysis>::const_iterator i_a2(i_a1); i_a2 != anas.end(); i_a2++) {
-        vector<CalibrationBin> r(PartialOverlappingBins(*i_a1, *i_a2));
-        if (r.size() > 0)
-          return r;
-      }
-    }
-    return vector<CalibrationBin>();
-  }
-
-  // Make sure that the bin area is totally covered by "bins". There are all sorts of crazy things
-  // that can be done when we are talking about 2D. :( As a result, since writing a general algorithm
-  // seems odd, we will be a little clever. First, we know when we get here that all bins are already
-  // within the area. So, we can then calculate the total area and see if they match. If they do, then
-  // we make sure that no bin is overlapping any other bin. Those two criteria together should assure
-  // that we are ok.
-  bool BinAreaCovered(const set<CalibrationBinBoundary> &area, const vector<CalibrationBin> &bins)
-  {
-    double barea = 0.0;
-    for (size_t i = 0; i < bins.size(); i++) {
-      barea += BinArea(bins[i]);
-    }
-
-    if (barea != BinArea(area))
-      return false;
-
-    // Now check for overlap
-    for (size_t i = 0; i < bins.size(); i++) {
-      for (size_t j = i + 1; j < bins.size(); j++) {
-        if (BinsOverlap(bins[i], bins[j])) {
-          return false;
-        }
-      }
-    }
-
-    // Ok - then we are satisfied!
-    return true;
-  }
-
-  // Calc the weighted average
-  double CalcWTAverage(vector<double> values, vector<double> weights)
-  {
-    if (values.size() != weights.size())
-      throw runtime_error("Unable to calculate weighted average when weights and values are not same size!");
-
-    double wtSum = 0.0;
-    double avgSum = 0.0;
-    for (size_t i = 0; i < values.size(); i++) {
-      wtSum += weights[i];
-      avgSum += weights[i] * values[i];
-    }
-    return avgSum / wtSum;
-  }
+  // Analyses split up for fitting.
+  typedef map<string, CalibrationInfoView> t_anaMap;
 
   //
-  // Calculate the weighted sigma for statistical errors.
+  // The fit can't deal with bins that partially overlap (it would be fitting two different
+  // things as if they were the same). Look through all the bins of all the analyses, and
+  // report every conflicting pair before bailing out.
   //
-  double CalcWTStatError(vector<double> weights)
+  void CheckForPartialOverlaps(const CalibrationInfoView &anas)
   {
-    double wtsum = 0.0;
-    for (size_t i = 0; i < weights.size(); i++) {
-      wtsum += weights[i];
-    }
-    return sqrt(1 / wtsum);
-  }
-
-  // Combine all given bins using a weighted average.
-  // The weight is due to the stat error only.
-  // It is assumed that the sys errors don't scale with statistics, so it just
-  // becomes a question of how much to weight each relative contribution of systematic
-  // error.
-  CalibrationBin CombineBinsWeightedAverage(const vector<CalibrationBin> &bins)
-  {
-    // Initial setup of everything we need
-    // - weights
-    // - systematic errors
-
-    vector<double> weights;
-    vector<double> cvs;
-    vector<map<string, SystematicError> > sysErrors;
-    set<string> sysErrorNames;
-    for (size_t i = 0; i < bins.size(); i++) {
-      double statSigma(bins[i].centralValueStatisticalError);
-      weights.push_back(1.0 / (statSigma*statSigma));
-      cvs.push_back(bins[i].centralValue);
-
-      sysErrors.push_back(map<string, SystematicError>());
-      for (size_t i_sys = 0; i_sys < bins[i].systematicErrors.size(); i_sys++){
-        const SystematicError &e(bins[i].systematicErrors[i_sys]);
-        sysErrors[i][e.name] = e;
-        sysErrorNames.insert(e.name);
+    vector<const CalibrationBin*> bins;
+    vector<size_t> binAnalysis;
+    vector<size_t> indices(anas.analysisIndices());
+    for (size_t i_a = 0; i_a < indices.size(); i_a++) {
+      const CalibrationAnalysis &a(anas.analysis(indices[i_a]));
+      for (size_t i_b = 0; i_b < a.bins.size(); i_b++) {
+        if (!anas.binVisible(indices[i_a], i_b))
+          continue;
+        bins.push_back(&(a.bins[i_b]));
+        binAnalysis.push_back(indices[i_a]);
       }
     }
 
-    // Calculate a new central value and stat error.
-
-    CalibrationBin result(bins[0]);
-
-    result.centralValue = CalcWTAverage(cvs, weights);
-    result.centralValueStatisticalError = CalcWTStatError(weights);
-
-    // And the systematic errors
-
-    result.systematicErrors.clear();
-    for (set<string>::const_iterator sysName = sysErrorNames.begin(); sysName != sysErrorNames.end(); sysName++) {
-      vector<double> sysErrList;
-      bool unCorrelated = false;
-      for (size_t i = 0; i < sysErrors.size(); i++) {
-        map<string, SystematicError>::const_iterator sys = sysErrors[i].find(*sysName);
-        if (sys == sysErrors[i].end()) {
-          sysErrList.push_back(0.0);
-        }
-        else {
-          sysErrList.push_back(sys->second.value);
-          unCorrelated = sys->second.uncorrelated;
-        }
+    vector<pair<size_t, size_t> > partialOverlap(FindPartialOverlaps(bins));
+    if (partialOverlap.size() > 0) {
+      cerr << "Error: Found partially overlapping bins during fit! Not allowed!" << endl;
+      for (size_t i = 0; i < partialOverlap.size(); i++) {
+        size_t b1 = partialOverlap[i].first;
+        size_t b2 = partialOverlap[i].second;
+        cerr << "  " << anas.analysis(binAnalysis[b1]).name << ": " << *bins[b1] << endl
+          << "  " << anas.analysis(binAnalysis[b2]).name << ": " << *bins[b2] << endl;
       }
-
-      SystematicError r;
-      r.name = *sysName;
-      r.value = CalcWTAverage(sysErrList, weights);
-      r.uncorrelated = unCorrelated;
-      result.systematicErrors.push_back(r);
+      throw runtime_error("Partial overlap of analyses found!");
     }
-
-    // Done!
-
-    return result;
-
   }
 
   // Combine an arbitrary set of bins. The resulting bin coordinates are zeroed out, and left
@@ -503,14 +361,8 @@ namespace BTagCombination
       return result;
     }
 
-    vector<CalibrationBin> partialOverlap(PartialOverlappingBins(ana));
-    if (partialOverlap.size() > 0) {
-      cerr << "Error: Found partially overlapping bins during fit! Not allowed!" << endl;
-      for (unsigned int i = 0; i < partialOverlap.size(); i++) {
-        cerr << "  " << partialOverlap[i] << endl;
-      }
-      throw runtime_error("Partial overlap of analyses found!");
-    }
+    CalibrationInfoView view(ana);
+    CheckForPartialOverlaps(view);
 
 
     result.bins.clear();
@@ -521,7 +373,7 @@ namespace BTagCombination
     //
 
     CombinationContext ctx;
-    map<string, vector<CalibrationBin> > bybins = FillContextWithCommonAnaInfo(ctx, ana);
+    t_binGroups bybins = FillContextWithCommonAnaInfo(ctx, view);
     const map<string, CombinationContext::FitResult> fitResult = ctx.Fit();
 
     //
@@ -533,6 +385,35 @@ namespace BTagCombination
     return result;
   }
 
+  // Record where the fit spent its time in the meta data. Each phase gets a fit_time_<phase>
+  // (wall and cpu seconds) and, if it ran MINUIT, a fit_minuit_<phase> (status, edm and
+  // NLL calls). The frozen systematic error refits are rolled up into a single "sys" entry:
+  // total times and calls, the last bad status and the largest edm.
+  void AddFitTimingMetadata(map<string, vector<double> > &meta, const CombinationContext::ExtraFitInfo &info)
+  {
+    for (size_t i = 0; i < info._phases.size(); i++) {
+      const CombinationContext::ExtraFitInfo::FitPhase &p(info._phases[i]);
+
+      vector<double> &t(meta["fit_time_" + p.name]);
+      if (t.size() == 0)
+        t.resize(2, 0.0);
+      t[0] += p.wallTime;
+      t[1] += p.cpuTime;
+
+      if (p.minimized) {
+        vector<double> &m(meta["fit_minuit_" + p.name]);
+        if (m.size() == 0)
+          m.resize(3, 0.0);
+        if (p.minuitStatus != 0)
+          m[0] = p.minuitStatus;
+        m[1] = max(m[1], p.edm);
+        m[2] += p.nllCalls;
+      }
+    }
+    meta["fit_nparameters"].push_back(info._nParameters);
+    meta["fit_nmeasurements"].push_back(info._nMeasurements);
+  }
+
   // Merge the meta data from all the analyses into the current meta data stream.
   void MergeMetadata(map<string, vector<double> > &meta, const vector<CalibrationAnalysis> &anas)
   {
@@ -574,23 +455,16 @@ namespace BTagCombination
 
   // We plunk everything we are given here into a single context, and return the new
   // fit.
-  pair<CombinationContext *, map<string, vector<CalibrationBin> > > CreateContextInOneContext(const vector<CalibrationAnalysis> &anas,
+  pair<CombinationContext *, t_binGroups> CreateContextInOneContext(const CalibrationInfoView &anas,
     const vector<AnalysisCorrelation> &correlations,
     bool verbose)
   {
     // Make sure that we have a good setup for a fit - no non-overlapping bins.
-    vector<CalibrationBin> partialOverlap(PartialOverlappingBins(anas));
-    if (partialOverlap.size() > 0) {
-      cerr << "Error: Found partially overlapping bins during fit! Not allowed!" << endl;
-      for (unsigned int i = 0; i < partialOverlap.size(); i++) {
-        cerr << "  " << partialOverlap[i] << endl;
-      }
-      throw runtime_error("Partial overlap of analyses found!");
-    }
+    CheckForPartialOverlaps(anas);
 
     CombinationContext *ctx = new CombinationContext();
     ctx->SetVerbose(verbose);
-    map<string, vector<CalibrationBin> > bins = FillContextWithCommonAnaInfo(*ctx, anas, "", verbose);
+    t_binGroups bins = FillContextWithCommonAnaInfo(*ctx, anas, "", verbose);
 
     // Now, go look for any correlations that might apply here.
     for (size_t i_cor = 0; i_cor < correlations.size(); i_cor++) {
@@ -626,8 +500,11 @@ namespace BTagCombination
     return make_pair(ctx, bins);
   }
 
-  // Do the actual fit, extract results, return them.
-  CalibrationAnalysis CombineAnalysesInOneContext(pair<CombinationContext *, map<string, vector<CalibrationBin> > > &info, const vector<CalibrationAnalysis> &anas, const string &resultFitName)
+  // Do the actual fit, extract results, return them. Only the headers of the analyses
+  // (names and meta data) are used here - the bins are already in the context. If fitTiming
+  // is set, the per-phase timing of the fit goes into the meta data as well.
+  CalibrationAnalysis CombineAnalysesInOneContext(pair<CombinationContext *, t_binGroups> &info, const vector<CalibrationAnalysis> &anas, const string &resultFitName,
+    bool fitTiming = false)
   {
     // We make an assumption about the fit name here, and the way the fit is being done (constant over flavor, tag, OP).
     string fitName = anas[0].flavor
@@ -636,6 +513,7 @@ namespace BTagCombination
 
     // Do the fit.
     CombinationContext *ctx(info.first);
+    ctx->SetFitTiming(fitTiming);
     map<string, CombinationContext::FitResult> fitResult = ctx->Fit(fitName);
     CombinationContext::ExtraFitInfo extraInfo = ctx->GetExtraFitInformation();
 
@@ -654,6 +532,8 @@ namespace BTagCombination
       r.metadata[string("Nuisance ") + i_p->first].push_back(i_p->second.first);
       r.metadata[string("Nuisance ") + i_p->first].push_back(i_p->second.second);
     }
+    if (fitTiming)
+      AddFitTimingMetadata(r.metadata, extraInfo);
 
     // Update the meta-data from the various analyses. The chi2 is a special case as we calculate it
     // explicitly.
@@ -669,45 +549,68 @@ namespace BTagCombination
 
   // We plunk everything we are given here into a single context, and return the new
   // fit.
-  CalibrationAnalysis CombineAnalysesInOneContext(const vector<CalibrationAnalysis> &anas,
+  CalibrationAnalysis CombineAnalysesInOneContext(const CalibrationInfoView &anas,
     const vector<AnalysisCorrelation> &correlations,
     const string &resultFitName,
-    bool verbose)
+    bool verbose,
+    bool fitTiming)
   {
-    pair<CombinationContext *, map<string, vector<CalibrationBin> > > info(CreateContextInOneContext(anas, correlations, verbose));
-    CalibrationAnalysis a(CombineAnalysesInOneContext(info, anas, resultFitName));
+    pair<CombinationContext *, t_binGroups> info(CreateContextInOneContext(anas, correlations, verbose));
+    CalibrationAnalysis a(CombineAnalysesInOneContext(info, anas.headers(), resultFitName, fitTiming));
     delete info.first;
     return a;
   }
 
+  // The key for the fit of a group of analyses - blank if there is no cache. how is the
+  // kind of fit. The fitter settings go in too, so a change to them is a refit.
+  string FitCacheKey(const FitResultCache *cache, const CalibrationInfoView &group, const CalibrationInfoView &info,
+    const string &how, bool fitTiming)
+  {
+    if (cache == 0)
+      return "";
+    return FitResultCache::Key(group.materialize(), info.correlations(),
+      how + "\n" + info.combinationName() + (fitTiming ? "\ntiming" : "")
+      + "\n" + CombinationContext::FitSettings());
+  }
+
   // Do the combination, doing everything across bins.
-  vector<CalibrationAnalysis> CombineAnalysesAllBins(const CalibrationInfo &info, bool verbose)
+  void CombineAnalysesAllBins(const CalibrationInfoView &info, const CombinedGroupSink &done, bool verbose, bool fitTiming,
+    FitResultCache *cache)
   {
-    t_anaMap binnedAnalyses(BinAnalysesByJetTagFlavOp(info.Analyses));
+    t_anaMap binnedAnalyses(info.splitByJetTagFlavOp());
 
     //
     // in each bin, fit everything. one odd thing is we have to loop through all
     // the correlations and extract any we need.
     //
 
-    vector<CalibrationAnalysis> result;
     for (t_anaMap::const_iterator i_ana = binnedAnalyses.begin(); i_ana != binnedAnalyses.end(); i_ana++) {
-      if (i_ana->second.size() > 1) {
-        CalibrationAnalysis r(CombineAnalysesInOneContext(i_ana->second,
-          info.Correlations,
-          info.CombinationAnalysisName,
-          verbose));
+      TraceSpan span("combine group", i_ana->first);
+      if (i_ana->second.nAnalyses() > 1) {
+        string key(FitCacheKey(cache, i_ana->second, info, "AllBins", fitTiming));
+        CalibrationAnalysis r;
+        if (cache != 0 && cache->Lookup(key, r)) {
+          if (verbose)
+            cout << "Using the cached fit for " << i_ana->first << endl;
+        }
+        else {
+          r = CombineAnalysesInOneContext(i_ana->second,
+            info.correlations(),
+            info.combinationName(),
+            verbose,
+            fitTiming);
+          if (cache != 0)
+            cache->Store(key, r);
+        }
 
-        result.push_back(r);
+        done(r);
       }
       else {
-        CalibrationAnalysis r(i_ana->second[0]);
-        r.name = info.CombinationAnalysisName;
-        result.push_back(r);
+        CalibrationAnalysis r(i_ana->second.materialize()[0]);
+        r.name = info.combinationName();
+        done(r);
       }
     }
-
-    return result;
   }
 
   // Merge the resulting analyses. Assume all bins are mutually exclusive, undefined result
@@ -730,41 +633,47 @@ namespace BTagCombination
   }
 
   // Do the fits bin-by-bin.
-  vector<CalibrationAnalysis> CombineAnalysesByBin(const CalibrationInfo &info, bool verbose)
+  void CombineAnalysesByBin(const CalibrationInfoView &info, const CombinedGroupSink &done, bool verbose, bool fitTiming,
+    FitResultCache *cache)
   {
     // Split this list of analyses by bin, do the fit, and then recombine.
-    t_anaMap analysesInCommon(BinAnalysesByJetTagFlavOp(info.Analyses));
-    vector<CalibrationAnalysis> result;
+    t_anaMap analysesInCommon(info.splitByJetTagFlavOp());
     for (t_anaMap::const_iterator i_ana = analysesInCommon.begin(); i_ana != analysesInCommon.end(); i_ana++) {
-      if (i_ana->second.size() > 1) {
-        vector<CalibrationBin> partialOverlap(PartialOverlappingBins(i_ana->second));
-        if (partialOverlap.size() > 0) {
-          cerr << "Error: Found partially overlapping bins during fit! Not allowed!" << endl;
-          for (unsigned int i = 0; i < partialOverlap.size(); i++) {
-            cerr << "  " << partialOverlap[i] << endl;
-          }
-          throw runtime_error("Partial overlap of analyses found!");
+      TraceSpan span("combine group", i_ana->first);
+      if (i_ana->second.nAnalyses() > 1) {
+        // The whole group (all its bins, and the chi2) is one entry in the cache.
+        string key(FitCacheKey(cache, i_ana->second, info, "ByBin", fitTiming));
+        CalibrationAnalysis cached;
+        if (cache != 0 && cache->Lookup(key, cached)) {
+          if (verbose)
+            cout << "Using the cached fit for " << i_ana->first << endl;
+          done(cached);
+          continue;
         }
 
+        CheckForPartialOverlaps(i_ana->second);
+
         // Do the fits bin-by-bin here. For each bin, collect the measurements as we will be needing them
-        // to calculate the chi2 at the end of the process.
-        set<set<CalibrationBinBoundary> > allBins(listAllBins(i_ana->second));
+        // to calculate the chi2 at the end of the process. Each bin is just a mask on the analyses.
+        set<set<CalibrationBinBoundary> > allBins(i_ana->second.listAllBins());
         vector<CalibrationAnalysis> binByBinFits;
         vector<CombinationContext*> contexts;
         for (set<set<CalibrationBinBoundary> >::const_iterator i_bin = allBins.begin(); i_bin != allBins.end(); i_bin++) {
-          vector<CalibrationAnalysis> anaForBin(removeAllBinsButBin(i_ana->second, *i_bin));
+          TraceSpan binSpan("combine bin", OPBinName(*i_bin));
+          CalibrationInfoView anaForBin(i_ana->second);
+          anaForBin.keepOnlyBin(*i_bin);
 
-          pair<CombinationContext*, map<string, vector<CalibrationBin> > > resultInfo(CreateContextInOneContext(anaForBin,
-            info.Correlations, verbose));
-          CalibrationAnalysis r(CombineAnalysesInOneContext(resultInfo, anaForBin, OPBinName(*i_bin)));
+          pair<CombinationContext*, t_binGroups> resultInfo(CreateContextInOneContext(anaForBin,
+            info.correlations(), verbose));
+          CalibrationAnalysis r(CombineAnalysesInOneContext(resultInfo, anaForBin.headers(), OPBinName(*i_bin), fitTiming));
 
           binByBinFits.push_back(r);
           contexts.push_back(resultInfo.first);
         }
 
         // Merge the various bins into a single bin, track the linage.
-        CalibrationAnalysis mergedResult(MergeAnalyses(binByBinFits, info.CombinationAnalysisName));
-        mergedResult.metadata_s["Linage"] = CombineLinage(i_ana->second, LCFitCombine);
+        CalibrationAnalysis mergedResult(MergeAnalyses(binByBinFits, info.combinationName()));
+        mergedResult.metadata_s["Linage"] = CombineLinage(i_ana->second.headers(), LCFitCombine);
 
         // Calculate the chi2.
         //  - The official chi2 is a fully correlated calculation.
@@ -774,7 +683,8 @@ namespace BTagCombination
         //  - A summed chi2 will be calculated in MergeAnalysis above, and transferred to sum_gchi2 below.
         vector<CalibrationAnalysis> anasForResult;
         anasForResult.push_back(mergedResult);
-        pair<CombinationContext*, map<string, vector<CalibrationBin> > > resultInfo(CreateContextInOneContext(anasForResult, vector<AnalysisCorrelation>(), false));
+        CalibrationInfoView viewForResult(anasForResult);
+        pair<CombinationContext*, t_binGroups> resultInfo(CreateContextInOneContext(viewForResult, vector<AnalysisCorrelation>(), false));
 
         vector<Measurement*> initialMeasurements, finalMeasurements;
         copy(resultInfo.first->GetAllMeasurements().begin(), resultInfo.first->GetAllMeasurements().end(), back_inserter(finalMeasurements));
@@ -793,30 +703,49 @@ namespace BTagCombination
         }
 
         // Save it to be returned.
-        result.push_back(mergedResult);
+        if (cache != 0)
+          cache->Store(key, mergedResult);
+        done(mergedResult);
       }
       else {
         // If there is only a single analysis, then just copy it over
-        CalibrationAnalysis copy(i_ana->second[0]);
-        copy.name = info.CombinationAnalysisName;
-        result.push_back(copy);
+        CalibrationAnalysis copy(i_ana->second.materialize()[0]);
+        copy.name = info.combinationName();
+        done(copy);
       }
     }
-    return result;
   }
 
   //
   // Master entry to do the fitting. Shell routine that calls out depending on the type of fit
   // desired.
   //
-  vector<CalibrationAnalysis> CombineAnalyses(const CalibrationInfo &info, bool verbose, CombinationType combineType)
+  vector<CalibrationAnalysis> CombineAnalyses(const CalibrationInfo &info, bool verbose, CombinationType combineType, bool fitTiming,
+    FitResultCache *cache)
+  {
+    return CombineAnalyses(CalibrationInfoView(info), verbose, combineType, fitTiming, cache);
+  }
+
+  vector<CalibrationAnalysis> CombineAnalyses(const CalibrationInfoView &info, bool verbose, CombinationType combineType, bool fitTiming,
+    FitResultCache *cache)
+  {
+    vector<CalibrationAnalysis> result;
+    CombineAnalyses(info, [&result](const CalibrationAnalysis &r) { result.push_back(r); },
+      verbose, combineType, fitTiming, cache);
+    return result;
+  }
+
+  void CombineAnalyses(const CalibrationInfoView &info, const CombinedGroupSink &done, bool verbose, CombinationType combineType,
+    bool fitTiming, FitResultCache *cache)
   {
     switch (combineType) {
     case kCombineByFullAnalysis:
-      return CombineAnalysesAllBins(info, verbose);
+      CombineAnalysesAllBins(info, done, verbose, fitTiming, cache);
+      break;
 
     case kCombineBySingleBin:
-      return CombineAnalysesByBin(info, verbose);
+      CombineAnalysesByBin(info, done, verbose, fitTiming, cache);
+      break;
 
     default:
       throw runtime_error("Unknown combination type!");
@@ -832,6 +761,15 @@ namespace BTagCombination
   //
   CalibrationAnalysis RebinAnalysis(const set<set<CalibrationBinBoundary> > &templateBinning,
     const CalibrationAnalysis &ana)
+  {
+    if (templateBinning.size() == 0)
+      throw runtime_error("Can't rebin analysis if there are not bins in the template!");
+
+    return RebinAnalysis(BinLookupIndex(templateBinning), ana);
+  }
+
+  CalibrationAnalysis RebinAnalysis(const BinLookupIndex &templateBinning,
+    const CalibrationAnalysis &ana)
   {
     // Do quick checks to make sure inputs look basically good.
 
@@ -841,71 +779,114 @@ namespace BTagCombination
     if (ana.bins.size() == 0)
       throw runtime_error("Unable to rebin an empty analysis!");
 
-    // We need to associate bins in the source analysis with the targets. We create a map and look
-    // for completely contained bins.
+    // We need to associate bins in the source analysis with the targets. We look up the template
+    // bin that completely contains each bin. We track the bins by their index in the analysis, and
+    // the template bins by their index in the template.
 
-    map<set<CalibrationBinBoundary>, vector<CalibrationBin> > matchedBins;
-    for (set<set<CalibrationBinBoundary> >::const_iterator itr = templateBinning.begin(); itr != templateBinning.end(); itr++) {
-      matchedBins[*itr] = vector<CalibrationBin>();
+    vector<BinBox> anaBoxes;
+    anaBoxes.reserve(ana.bins.size());
+    for (size_t i_bin = 0; i_bin < ana.bins.size(); i_bin++) {
+      anaBoxes.push_back(BinBox(ana.bins[i_bin].binSpec));
     }
 
+    vector<vector<size_t> > matchedBins(templateBinning.size());
     for (size_t i_bin = 0; i_bin < ana.bins.size(); i_bin++) {
-      const CalibrationBin &anab(ana.bins[i_bin]);
-      set<set<CalibrationBinBoundary> >::const_iterator foundBin =
-        find_if(templateBinning.begin(), templateBinning.end(), ContainsBin(anab));
+      int foundBin = templateBinning.find_containing(anaBoxes[i_bin]);
 
-      if (foundBin == templateBinning.end()) {
+      if (foundBin < 0) {
+        const CalibrationBin &anab(ana.bins[i_bin]);
         ostringstream err;
         err << "Bin " << OPBinName(anab) << " is not contained by any template bins:" << endl;
-        for (set<set<CalibrationBinBoundary> >::const_iterator i_be = templateBinning.begin(); i_be != templateBinning.end(); i_be++) {
-          err << " - " << OPBinName(*i_be) << endl;
+        for (size_t i_be = 0; i_be < templateBinning.size(); i_be++) {
+          err << " - " << OPBinName(templateBinning.binSpec(i_be)) << endl;
         }
         err << "  -> Analysis: " << ana.name << endl;
         throw runtime_error(err.str().c_str());
       }
 
-      matchedBins[*foundBin].push_back(anab);
+      matchedBins[foundBin].push_back(i_bin);
     }
 
     //
-    // Now, go through and make sure each one is fully covered. This loop does not modify the data, it
-    // just looks for consistency before we spend anytime running fits.
+    // Now, go through and make sure each one is fully covered. This does not modify the data, it
+    // just looks for consistency before we spend anytime running fits. All template bins are checked
+    // at once, and every problem is reported.
     //
 
-    for (map<set<CalibrationBinBoundary>, vector<CalibrationBin> >::const_iterator itr = matchedBins.begin(); itr != matchedBins.end(); itr++) {
+    vector<vector<CalibrationBinBoundary> > resultBinning;
+    vector<vector<size_t> > groups;
+    vector<BinBox> areas;
+    for (size_t i_tmp = 0; i_tmp < matchedBins.size(); i_tmp++) {
 
       // If there are zero source bins, then it is as if this guy didn't exist!
-      if (itr->second.size() == 0) {
+      if (matchedBins[i_tmp].size() == 0) {
         continue;
       }
 
-      // Make sure there are no gaps in any of the coverage
-      if (!BinAreaCovered(itr->first, itr->second)) {
-        ostringstream err;
-        err << "Gaps or extra overlaps discovered in binning covering " << OPBinName(itr->first) << ". The following has a gap/overlap: " << endl;
-        for (size_t i = 0; i < itr->second.size(); i++) {
-          err << "  - " << OPBinName(itr->second[i]) << endl;
-        }
-        err << "  -> Analysis: " << ana.name << endl;
-        throw runtime_error(err.str().c_str());
+      resultBinning.push_back(templateBinning.binSpec(i_tmp));
+      groups.push_back(matchedBins[i_tmp]);
+      areas.push_back(templateBinning.bin(i_tmp));
+    }
+
+    vector<BinCoverage> coverage(CheckCoverage(areas, anaBoxes, groups));
+    ostringstream coverageErrors;
+    for (size_t ig = 0; ig < groups.size(); ig++) {
+      if (coverage[ig].exact())
+        continue;
+
+      coverageErrors << "Gaps or extra overlaps discovered in binning covering " << OPBinName(resultBinning[ig]) << ". The following has a gap/overlap: " << endl;
+      for (size_t i = 0; i < groups[ig].size(); i++) {
+        coverageErrors << "  - " << OPBinName(ana.bins[groups[ig][i]]) << endl;
+      }
+      for (size_t i = 0; i < coverage[ig].gaps.size(); i++) {
+        coverageErrors << "  Not covered: " << OPBinName(coverage[ig].gaps[i].boundaries()) << endl;
+      }
+      for (size_t i = 0; i < coverage[ig].overlaps.size(); i++) {
+        coverageErrors << "  Covered more than once: " << OPBinName(coverage[ig].overlaps[i].boundaries()) << endl;
       }
     }
+    if (coverageErrors.str().size() > 0) {
+      coverageErrors << "  -> Analysis: " << ana.name << endl;
+      throw runtime_error(coverageErrors.str().c_str());
+    }
 
-    // 
-    // Loop through all the bins and run the combiner on them.
+    //
+    // Do the weighted average for all the template bins in one go. The
+    // weight is due to the stat error only. It is assumed that the sys errors
+    // don't scale with statistics, so it just becomes a question of how much
+    // to weight each relative contribution of systematic error.
+    //
+
+    // If a bin has the same systematic error twice, the last one is used.
+    CalibrationColumns columns(ana, true, kLastDuplicate);
+    CalibrationColumns averaged(WeightedAverageRows(columns, groups));
+    vector<size_t> sysOrder(averaged.sysNames.sorted_ids());
+
+    //
+    // And build the new bins. Everything but the numbers comes from the first bin in each group.
     //
 
     CalibrationAnalysis result(ana);
     result.bins.clear();
-    for (map<set<CalibrationBinBoundary>, vector<CalibrationBin> >::const_iterator itr = matchedBins.begin(); itr != matchedBins.end(); itr++) {
+    for (size_t ig = 0; ig < groups.size(); ig++) {
+      CalibrationBin b(ana.bins[averaged.binIndex[ig]]);
+      b.binSpec = resultBinning[ig];
+      b.centralValue = averaged.centralValue[ig];
+      b.centralValueStatisticalError = averaged.statError[ig];
+
+      b.systematicErrors.clear();
+      for (size_t i = 0; i < sysOrder.size(); i++) {
+        size_t id = sysOrder[i];
+        if (!averaged.has_sys(ig, id))
+          continue;
 
-      // If there are zero source bins, then it is as if this guy didn't exist!
-      if (itr->second.size() == 0) {
-        continue;
+        SystematicError e;
+        e.name = averaged.sysNames.name(id);
+        e.value = averaged.sys(ig, id);
+        e.uncorrelated = averaged.sysUncorrelated[id] != 0;
+        b.systematicErrors.push_back(e);
       }
 
-      CalibrationBin b(CombineBinsWeightedAverage(itr->second));
-      b.binSpec = vector<CalibrationBinBoundary>(itr->first.begin(), itr->first.end());
       result.bins.push_back(b);
     }
 
@@ -917,7 +898,7 @@ namespace BTagCombination
   {
     vector<CalibrationAnalysis> anas;
     anas.push_back(ana);
-    FillContextWithCommonAnaInfo(ctx, anas);
+    FillContextWithCommonAnaInfo(ctx, CalibrationInfoView(anas));
   }
 }
 
@@ -7,6 +7,9 @@
 #include "Combination/Parser.h"
 #include "Combination/CommonCommandLineUtils.h"
 #include "Combination/BinBoundaryUtils.h"
+#include "Combination/CalibrationDataModelBinary.h"
+#include "Combination/MappedCalibrationFile.h"
+#include "Combination/Tracing.h"
 
 #include <TSystem.h>
 
@@ -52,9 +55,87 @@ namespace {
     }
   }
 
-  // Load operating points from a text file on disk.
+  // Read a binary format file. It gets the same filtering and merging as a text file.
+  CalibrationInfo loadBinaryFile(const string &fname, calibrationFilterInfo &fInfo)
+  {
+    TraceSpan span("read binary", fname);
+    ifstream input(fname.c_str(), ios::binary);
+    input.seekg(0, ios::end);
+    string data(static_cast<size_t>(input.tellg()), '\0');
+    input.seekg(0, ios::beg);
+    input.read(&data[0], data.size());
+    if (!input)
+      throw runtime_error("Unable to read the file.");
+
+    CalibrationInfo calib(ReadBinaryInfo(data.data(), data.size()));
+    FilterAnalyses(calib, fInfo);
+    calib.Analyses = CombineSameAnalyses(calib.Analyses);
+    return calib;
+  }
+
+  // Text inputs already parsed (when KeepParsedInputs is on), by full path. They are kept
+  // as parsed, before any filtering; the size and modification time tell if the file has
+  // changed since. A file that didn't parse is kept too (as not good), so it isn't parsed
+  // again until it changes.
+  struct ParsedInput {
+    Long64_t size;
+    Long_t modified;
+    bool good;
+    CalibrationInfo info;
+  };
+  bool gKeepParsedInputs = false;
+  map<string, ParsedInput> gParsedInputs;
+
+  // The files loaded from gParsedInputs by ParseOPInputArgs, in the order they were.
+  vector<string> gLoadedInputs;
+
+  string fullPath(const string &fname)
+  {
+    if (gSystem->IsAbsoluteFileName(fname.c_str()))
+      return fname;
+    return string(gSystem->WorkingDirectory()) + "/" + fname;
+  }
+
+  // Find a text file in the parsed inputs, parsing it if it isn't there or has changed.
+  // Returns null if it can't be parsed by itself (or at all) - the caller's own parse will
+  // then say why.
+  const CalibrationInfo *parsedInput(const string &fname)
+  {
+    FileStat_t stat;
+    if (gSystem->GetPathInfo(fname.c_str(), stat) != 0)
+      return 0;
+
+    string path(fullPath(fname));
+    map<string, ParsedInput>::const_iterator found(gParsedInputs.find(path));
+    if (found != gParsedInputs.end()
+      && found->second.size == stat.fSize
+      && found->second.modified == stat.fMtime)
+      return found->second.good ? &(found->second.info) : 0;
+
+    ParsedInput &saved(gParsedInputs[path]);
+    saved.size = stat.fSize;
+    saved.modified = stat.fMtime;
+    saved.good = false;
+    saved.info = CalibrationInfo();
+    try {
+      TraceSpan parseSpan("parse", fname);
+      ifstream input(fname.c_str());
+      calibrationFilterInfo noFilter;
+      saved.info = Parse(input, noFilter);
+      saved.good = true;
+    }
+    catch (exception &) {
+      return 0;
+    }
+    return &saved.info;
+  }
+
+  // Load operating points from a file on disk. The binary format is spotted by its
+  // magic number; anything else is parsed as text.
   void loadOPsFromFile(CalibrationInfo &list, const string &fname, calibrationFilterInfo &fInfo)
   {
+    TraceSpan span("load", fname);
+
     // See if the file exists - bomb if not!
     if (gSystem->AccessPathName(fname.c_str(), kFileExists)) {
       ostringstream msg;
@@ -64,9 +145,23 @@ namespace {
 
     // Load it up!
     try {
-      ifstream input(fname.c_str());
-      CalibrationInfo calib = Parse(input, fInfo);
-      input.close();
+      CalibrationInfo calib;
+      const CalibrationInfo *parsed = 0;
+      if (MappedCalibrationFile::IsBinaryFile(fname)) {
+        calib = loadBinaryFile(fname, fInfo);
+      }
+      else if (gKeepParsedInputs && (parsed = parsedInput(fname)) != 0) {
+        // Same as Parse would have done with the filter.
+        gLoadedInputs.push_back(fullPath(fname));
+        calib = *parsed;
+        FilterAnalyses(calib, fInfo);
+        calib.Analyses = CombineSameAnalyses(calib.Analyses);
+      }
+      else {
+        ifstream input(fname.c_str());
+        TraceSpan parseSpan("parse", fname);
+        calib = Parse(input, fInfo);
+      }
       Combine(list.Analyses, calib.Analyses);
       list.Correlations.insert(list.Correlations.end(), calib.Correlations.begin(), calib.Correlations.end());
       list.Defaults.insert(list.Defaults.begin(), calib.Defaults.begin(), calib.Defaults.end());
@@ -141,6 +236,62 @@ namespace {
     }
   }
 
+  // Move the "reference_" systematic errors of an extrapolated bin to the reference bin
+  // list (see AFT-161).
+  void splitReferenceSysErrors(CalibrationBin &bin)
+  {
+    vector<SystematicError> errs;
+
+    // Fetch referenceBinSystematicErrors
+    vector<SystematicError> refErrs;
+
+    // copy_if does not seem to be available
+    for (size_t i_se = 0; i_se < bin.systematicErrors.size(); i_se++) {
+      if (bin.systematicErrors[i_se].name.find("reference_") == 0) {// if exbin syst error contains "reference_" at 0 position
+        refErrs.push_back(bin.systematicErrors[i_se]);
+      }
+      else {
+        errs.push_back(bin.systematicErrors[i_se]);
+      }
+    }
+    bin.systematicErrors = errs;
+    // Binary format inputs arrive with these already split out.
+    bin.referenceBinSystematicErrors.insert(bin.referenceBinSystematicErrors.end(), refErrs.begin(), refErrs.end());
+  }
+
+  // The flags ParseOPInputArgs acts on, other than --trace. Anything with one of these
+  // has to be loaded by ParseOPInputArgs.
+  const char *cLoadingFlags[] = {
+    "ignore", "ignoreSysError", "flavor", "tagger", "operatingPoint", "jetAlgorithm",
+    "analysis", "combinedName", "binbybin", "profile"
+  };
+
+  bool isLoadingFlag(const string &flag)
+  {
+    for (size_t i = 0; i < sizeof(cLoadingFlags) / sizeof(cLoadingFlags[0]); i++) {
+      if (flag == cLoadingFlags[i])
+        return true;
+    }
+    return false;
+  }
+
+  // The bins of all the parts of a mapped analysis, with only their boundaries read -
+  // enough for calcBoundaries.
+  CalibrationAnalysis mappedBinning(const MappedInputAnalysis &m)
+  {
+    CalibrationAnalysis ana(m.header);
+    for (size_t i = 0; i < m.parts.size(); i++) {
+      size_t nBins = m.parts[i].nBins();
+      for (size_t b = 0; b < nBins; b++) {
+        MappedBin mb(m.parts[i].bin(b));
+        CalibrationBin bin;
+        bin.binSpec = mb.binSpec();
+        bin.isExtended = mb.isExtended();
+        ana.bins.push_back(bin);
+      }
+    }
+    return ana;
+  }
 }
 
 //
@@ -165,6 +316,8 @@ namespace BTagCombination {
   // Clean out the incoming analysis according to spec.
   void FilterAnalyses(CalibrationInfo &operatingPoints, const calibrationFilterInfo &fInfo)
   {
+    TraceSpan span("filter");
+
     for (map<string, boost::regex*>::const_iterator itr = fInfo.OPsToIgnore.begin(); itr != fInfo.OPsToIgnore.end(); itr++) {
       vector<CalibrationAnalysis> &ops(operatingPoints.Analyses);
       for (unsigned int op = 0; op < ops.size(); op++) {
@@ -324,6 +477,13 @@ namespace BTagCombination {
           else if (flag == "profile") {
             operatingPoints.BinByBin = false;
           }
+          else if (flag == "trace") {
+            if (index + 1 == args.size()) {
+              throw runtime_error("--trace must have an output file name");
+            }
+            index++;
+            StartTracing(args[index]);
+          }
           else {
             unknownFlags.push_back(flag);
           }
@@ -343,29 +503,15 @@ namespace BTagCombination {
       loadOPsFromFile(operatingPoints, filesToLoad[i], fInfo);
     }
 
+    TraceSpan prepareSpan("prepare inputs");
+
     //
     // For extrapolated bins, sepeated if the systematicErrors from referenceBinSystematic errors (see AFT-161)
     //
 
       for (vector<CalibrationAnalysis>::iterator anaItr = operatingPoints.Analyses.begin(); anaItr != operatingPoints.Analyses.end(); anaItr++) {
         for (vector<CalibrationBin>::iterator i_bin = anaItr->bins.begin(); i_bin != anaItr->bins.end(); i_bin++) {
-          vector<SystematicError> errs;
-
-          // Fetch referenceBinSystematicErrors
-          vector<SystematicError> refErrs;
-
-          // copy_if does not seem to be available
-          for (size_t i_se = 0; i_se < i_bin->systematicErrors.size(); i_se++) {
-
-              if(i_bin->systematicErrors[i_se].name.find("reference_") == 0 ) {// if exbin syst error contains "reference_" at 0 position
-                refErrs.push_back(i_bin->systematicErrors[i_se]);
-              }
-              else {
-              errs.push_back(i_bin->systematicErrors[i_se]);
-              }
-          }
-          i_bin->systematicErrors = errs;
-          i_bin->referenceBinSystematicErrors = refErrs;
+          splitReferenceSysErrors(*i_bin);
         }
       }
 
@@ -456,6 +602,148 @@ namespace BTagCombination {
     }
   }
 
+  //
+  // Map a single binary input file, when nothing on the command line would change what
+  // ParseOPInputArgs loads from it.
+  //
+  unique_ptr<MappedCalibrationFile> MapOPInputArgs(const vector<string> &args,
+    vector<string> &unknownFlags)
+  {
+    unknownFlags.clear();
+
+    vector<string> files;
+    vector<string> flags;
+    string traceFile;
+    for (size_t index = 0; index < args.size(); index++) {
+      const string &a(args[index]);
+      if (a.size() == 0)
+        continue;
+      if (a.substr(0, 2) != "--") {
+        files.push_back(a);
+        continue;
+      }
+
+      string flag(a.substr(2));
+      if (isLoadingFlag(flag))
+        return unique_ptr<MappedCalibrationFile>();
+      if (flag == "trace") {
+        if (index + 1 == args.size())
+          return unique_ptr<MappedCalibrationFile>();
+        traceFile = args[++index];
+      }
+      else {
+        flags.push_back(flag);
+      }
+    }
+
+    if (files.size() != 1 || !MappedCalibrationFile::IsBinaryFile(files[0]))
+      return unique_ptr<MappedCalibrationFile>();
+
+    if (traceFile.size() > 0)
+      StartTracing(traceFile);
+    unknownFlags = flags;
+    return unique_ptr<MappedCalibrationFile>(new MappedCalibrationFile(files[0]));
+  }
+
+  //
+  // What ParseOPInputArgs would have made of a mapped file: same-named analyses merged
+  // (see CombineSameAnalyses), empty ones dropped, and the aliases copied - but only the
+  // names, meta data and bin boundaries are read. As in CombineSameAnalyses, the binning
+  // of each analysis must make sense (calcBoundaries throws if it doesn't).
+  //
+  vector<MappedInputAnalysis> MappedInputAnalyses(const MappedCalibrationFile &file)
+  {
+    TraceSpan span("index analyses", file.fileName());
+
+    map<string, MappedInputAnalysis> byName;
+    for (size_t i = 0; i < file.nAnalyses(); i++) {
+      MappedAnalysis a(file.analysis(i));
+      DefaultAnalysis names;
+      names.name = a.name();
+      names.flavor = a.flavor();
+      names.tagger = a.tagger();
+      names.operatingPoint = a.operatingPoint();
+      names.jetAlgorithm = a.jetAlgorithm();
+
+      MappedInputAnalysis &m(byName[OPFullName(names)]);
+      if (m.parts.size() == 0)
+        m.header = a.header();
+      m.parts.push_back(a);
+    }
+
+    vector<MappedInputAnalysis> result;
+    for (map<string, MappedInputAnalysis>::const_iterator itr = byName.begin(); itr != byName.end(); itr++) {
+      size_t nBins = 0;
+      for (size_t i = 0; i < itr->second.parts.size(); i++)
+        nBins += itr->second.parts[i].nBins();
+      if (nBins > 0) {
+        bin_boundaries temp(calcBoundaries(mappedBinning(itr->second), false));
+        result.push_back(itr->second);
+      }
+    }
+
+    vector<AliasAnalysis> aliases(file.aliases());
+    for (size_t i = 0; i < aliases.size(); i++) {
+      const AliasAnalysis &a(aliases[i]);
+      vector<MappedInputAnalysis> copied;
+      for (vector<MappedInputAnalysis>::const_iterator anaItr = result.begin(); anaItr != result.end(); anaItr++) {
+        if (OPFullName(anaItr->header) == OPFullName(a)) {
+          for (vector<AliasAnalysisCopyTo>::const_iterator cItr = a.CopyTargets.begin(); cItr != a.CopyTargets.end(); cItr++) {
+            MappedInputAnalysis cp(*anaItr);
+            cp.header.name = cItr->name;
+            cp.header.flavor = cItr->flavor;
+            cp.header.tagger = cItr->tagger;
+            cp.header.operatingPoint = cItr->operatingPoint;
+            cp.header.jetAlgorithm = cItr->jetAlgorithm;
+            copied.push_back(cp);
+          }
+        }
+      }
+      result.insert(result.begin(), copied.begin(), copied.end());
+    }
+
+    return result;
+  }
+
+  CalibrationAnalysis MappedInputAnalysis::load() const
+  {
+    CalibrationAnalysis ana(header);
+    for (size_t i = 0; i < parts.size(); i++) {
+      size_t nBins = parts[i].nBins();
+      for (size_t b = 0; b < nBins; b++) {
+        ana.bins.push_back(parts[i].bin(b).materialize());
+        splitReferenceSysErrors(ana.bins.back());
+      }
+    }
+    return ana;
+  }
+
+  //
+  // Keeping parsed text inputs in memory.
+  //
+  void KeepParsedInputs(bool keep)
+  {
+    gKeepParsedInputs = keep;
+    if (!keep) {
+      gParsedInputs.clear();
+      gLoadedInputs.clear();
+    }
+  }
+
+  bool PreloadInputFile(const string &fname)
+  {
+    if (!gKeepParsedInputs
+      || gSystem->AccessPathName(fname.c_str(), kFileExists)
+      || MappedCalibrationFile::IsBinaryFile(fname))
+      return false;
+    return parsedInput(fname) != 0;
+  }
+
+  vector<string> LoadedInputFiles()
+  {
+    return gLoadedInputs;
+  }
+
   //
   // Split analyzes into lists. These lists are generally what we need when dealing
   // with the combination.
@@ -486,7 +774,8 @@ namespace BTagCombination {
       }
     }
 
-    // Change the map back into a list. For each one make sure we can calculate a reasonable set of binning boundaries.
+    // Change the map back into a list. For each one make sure we can calculate a reasonable set of binning boundaries
+    // (calcBoundaries remembers them, so whoever uses this binning next gets them for free).
     // Only return bins that have at least one bin in them (e.g. aren't empty!).
     vector<CalibrationAnalysis> result;
     for (map<string, CalibrationAnalysis>::const_iterator itr(combinedAnalyses.begin()); itr != combinedAnalyses.end(); itr++) {
@@ -6,6 +6,7 @@
 #include "Combination/BinNameUtils.h"
 #include "Combination/CommonCommandLineUtils.h"
 #include "Combination/FitLinage.h"
+#include "Combination/BinGeometry.h"
 
 #include <vector>
 #include <sstream>
@@ -40,11 +41,6 @@ namespace {
     return r;
   }
 
-  // Helper function to return bin coordinates
-  set<CalibrationBinBoundary> boundary_set(const vector<CalibrationBinBoundary> &coords) {
-    return set<CalibrationBinBoundary>(coords.begin(), coords.end());
-  }
-
   // Helper function that will catalog the bins by coordinates other than the axis
   map<set<CalibrationBinBoundary>, CalibrationBin> bin_dict(const string &axis, const vector<CalibrationBin> &bins)
   {
@@ -208,10 +204,9 @@ namespace BTagCombination {
 
     CalibrationAnalysis r(ana);
 
-    set<set<CalibrationBinBoundary> > all_analysis_bin_boundaries(listAnalysisBins(ana));
+    BinLookupIndex all_analysis_bins(listAnalysisBins(ana));
     for (auto e_itr = extrapolated.bins.begin(); e_itr != extrapolated.bins.end(); e_itr++) {
-      set<CalibrationBinBoundary> all_bounds(boundary_set(e_itr->binSpec));
-      if (all_analysis_bin_boundaries.find(all_bounds) == all_analysis_bin_boundaries.end()) {
+      if (all_analysis_bins.find_exact(e_itr->binSpec) < 0) {
         set<CalibrationBinBoundary> bounds(boundary_set_without(extrapolated_axis, e_itr->binSpec));
         if (ext_sys.find(bounds) != ext_sys.end()) {
 
@@ -286,10 +281,9 @@ namespace BTagCombination {
 
     CalibrationAnalysis r(ana);
 
-    set<set<CalibrationBinBoundary> > all_analysis_bin_boundaries(listAnalysisBins(ana));
+    BinLookupIndex all_analysis_bins(listAnalysisBins(ana));
     for (vector<CalibrationBin>::const_iterator e_itr = extrapolated.bins.begin(); e_itr != extrapolated.bins.end(); e_itr++) {
-      set<CalibrationBinBoundary> all_bounds(boundary_set(e_itr->binSpec));
-      if (all_analysis_bin_boundaries.find(all_bounds) == all_analysis_bin_boundaries.end()) {
+      if (all_analysis_bins.find_exact(e_itr->binSpec) < 0) {
         set<CalibrationBinBoundary> bounds(boundary_set_without(extrapolated_axis, e_itr->binSpec));
         if (ana_sys.find(bounds) != ana_sys.end()) {
           double ext_sys_current = bin_sys(*e_itr);
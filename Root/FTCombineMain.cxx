@@ -0,0 +1,144 @@
+//
+// FTCombine - combine several different measurements.
+//
+
+#include "Combination/ToolMains.h"
+#include "Combination/Parser.h"
+#include "Combination/CommonCommandLineUtils.h"
+#include "Combination/Combiner.h"
+#include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/FitResultCache.h"
+#include "Combination/Sharding.h"
+
+#include <RooMsgService.h>
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  void usage (void);
+}
+
+int BTagCombination::FTCombineMain (int argc, char **argv)
+{
+  try {
+    // Parse the input arguments. The shard has to come out first, or it would be taken
+    // for an input file.
+    vector<string> args;
+    bool sharded = false;
+    ShardSpec shard;
+    for (int i = 1; i < argc; i++) {
+      if (string(argv[i]) == "--shard") {
+	if (i+1 == argc)
+	  throw runtime_error("--shard must be followed by i/N");
+	i++;
+	shard = ParseShardSpec(argv[i]);
+	sharded = true;
+      } else {
+	args.push_back(argv[i]);
+      }
+    }
+
+    CalibrationInfo info;
+    vector<string> otherFlags;
+    ParseOPInputArgs (args, info, otherFlags);
+
+    bool balanceShards = false;
+    bool verbose = false;
+    bool fitTiming = false;
+    string prefix = "";
+    string fitCacheDir = "";
+    unsigned long long fitCacheBytes = 1024ULL*1024*1024;
+
+    for (unsigned int i = 0; i < otherFlags.size(); i++) {
+      if (otherFlags[i] == "verbose") {
+	verbose = true;
+      } else if (otherFlags[i] == "fitTiming") {
+	fitTiming = true;
+      } else if (otherFlags[i] == "balanceShards") {
+	balanceShards = true;
+      } else if (otherFlags[i].substr(0, 6) == "prefix") {
+	prefix = otherFlags[i].substr(6);
+      } else if (otherFlags[i].substr(0, 9) == "fitCache=") {
+	fitCacheDir = otherFlags[i].substr(9);
+      } else if (otherFlags[i].substr(0, 11) == "fitCacheMB=") {
+	fitCacheBytes = ParseFitCacheMB(otherFlags[i].substr(11));
+      } else {
+	cout << "Error: Unknown flag: " << otherFlags[i] << endl;
+	usage();
+	return 1;
+      }
+    }
+
+    // Turn off all those fitting messages!
+    if (!verbose) {
+      RooMsgService::instance().setSilentMode(true);
+      RooMsgService::instance().setGlobalKillBelow(RooFit::ERROR);
+    }
+
+    // Only fit this shard's groups.
+    if (sharded)
+      KeepShard(info, shard, balanceShards);
+
+    // Fits already done (same inputs, same settings) come from here.
+    unique_ptr<FitResultCache> cache;
+    if (fitCacheDir != "")
+      cache.reset(new FitResultCache(fitCacheDir, fitCacheBytes));
+
+    // Now that we have the calibrations, just combine them!
+    vector<CalibrationAnalysis> result;
+    if (!info.BinByBin) {
+      result = CombineAnalyses(info, true, kCombineByFullAnalysis, fitTiming, cache.get());
+    } else {
+      result = CombineAnalyses(info, true, kCombineBySingleBin, fitTiming, cache.get());
+    }
+
+    if (cache.get() != 0)
+      cout << "Fit cache " << cache->directory() << ": " << cache->stats() << endl;
+    
+    if (prefix != "") {
+      for (vector<CalibrationAnalysis>::iterator itr = result.begin(); itr != result.end(); itr++) {
+	itr->name = prefix + itr->name;
+      }
+    }
+
+    // Dump them out to an output file.
+    if (sharded) {
+      ostringstream name;
+      name << "combined-shard-" << shard.index << "-of-" << shard.count << ".txt";
+      ofstream out (name.str().c_str());
+      WriteShard(out, shard, result);
+      out.close();
+    } else {
+      ofstream out ("combined.txt");
+      for (unsigned int i = 0; i < result.size(); i++) {
+	out << result[i] << endl;
+      }
+      out.close();
+    }
+
+  } catch (exception &e) {
+    cerr << "Error while doing the combination: " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
+
+namespace {
+  void usage (void)
+  {
+    cerr << "Usage: FTCombine <files, --ignore> --verbose --fitTiming [--profile | --binbybin] --prefixXXX --fitCache=<dir> --fitCacheMB=<size> --shard <i/N> --balanceShards" << endl;
+    cerr << "  --fitCache=<dir>  Reuse the results of fits done before with the same inputs, and save new ones, in dir" << endl;
+    cerr << "  --fitCacheMB=<size>  Remove the oldest results when the cache is bigger than this many MB (default 1024, 0 for no limit)" << endl;
+    cerr << "  --shard <i/N>  Only fit shard i (0 to N-1) of the groups, writing combined-shard-<i>-of-<N>.txt. FTMergeShards" << endl;
+    cerr << "                 puts the N of them together into the combined.txt a single run would have written" << endl;
+    cerr << "  --balanceShards  Split the groups by how long they should take to fit, rather than by name. Every shard" << endl;
+    cerr << "                   must be run with the same inputs and flags" << endl;
+  }
+}
@@ -0,0 +1,447 @@
+//
+// This program will convert from an input calibration results file (in the standard text format)
+// to a ROOT file for use by the CalibrationDataInterface.
+//
+
+#include "Combination/ToolMains.h"
+#include "Combination/Parser.h"
+#include "Combination/CDIConverter.h"
+#include "Combination/Pipeline.h"
+#include "Combination/CommonCommandLineUtils.h"
+#include "Combination/ParallelUtils.h"
+#include "Combination/Tracing.h"
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TDirectory.h>
+#include <TH1.h>
+#include <TKey.h>
+#include <TClass.h>
+#include <TVirtualStreamerInfo.h>
+#include <TObjString.h>
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <set>
+#include <cstdlib>
+#include <memory>
+
+using namespace std;
+using namespace BTagCombination;
+using namespace Analysis;
+
+namespace {
+  vector<string> m_slimVector;
+
+  void Usage (void);
+
+  string eatArg (char **argv, int &index, const int maxArg)
+  {
+    if (index == (maxArg-1)) 
+      throw runtime_error ("Not enough arguments.");
+    index++;
+    return argv[index];
+  }
+
+  //
+  // Sometimes we need to kludge a directry name translation in the CDI efficiency files
+  // (we can't easily edit those - they are ROOT files, not text files). This provides for
+  // a very simple extension point to enable that.
+  //
+  string TranslateDirectoryName(const string &sName)
+  {
+    if(sName == "1_01")
+      return "1_00";
+    return sName;
+  }
+
+  // Remove all cycles of a container written by an earlier run.
+  void delete_container (TDirectory *file, const string &path)
+  {
+    TDirectory *loc = file;
+    size_t start = 0;
+    size_t slash;
+    while (loc != 0 && (slash = path.find('/', start)) != string::npos) {
+      loc = CDISubDirectory(loc, path.substr(start, slash-start), false);
+      start = slash + 1;
+    }
+    if (loc != 0)
+      loc->Delete((path.substr(start) + ";*").c_str());
+  }
+
+  //
+  // We are copying these objects, so we have to be able to reference them
+  // to make sure they are linked in.
+  //
+
+  Analysis::CalibrationDataFunctionContainer *__c1 __attribute ((unused));
+  Analysis::CalibrationDataContainer *__c2 __attribute ((unused));
+
+  // Do a deep copy of the in directory into the out directory
+  void copy_directory_structure (TDirectory *out, TDirectory *in, bool create = true)
+  {
+    //
+    // Do a simple depth copy. Renaming and slimming act on directories. Everything
+    // else is copied key by key: the compressed buffer goes straight into the output
+    // file, without the object ever being read back in, unpacked, or recompressed.
+    // Nothing is streamed, so the class' streamer info has to be put in the output
+    // file by hand - without it the copy can't be read back.
+    //
+
+    TClass *directory (TDirectory::Class());
+    TIter next(in->GetListOfKeys());
+    TKey *k;
+    while ((k = (TKey*)next())) {
+      if (TClass::GetClass(k->GetClassName())->InheritsFrom(directory)) {
+	string outname(TranslateDirectoryName(k->GetName()));
+
+	for (unsigned int i = 0; i < m_slimVector.size(); i++) {
+	  if (outname == m_slimVector.at(i)) {
+	    cout << "not creating directory " << outname << endl;
+	    create=false;
+	  }
+	}
+
+	TDirectory *out_subdir = CDISubDirectory(out, outname, create);
+
+	if (out_subdir != 0) {
+	  TDirectory *in_subdir = (TDirectory*) CDISubDirectory(in, k->GetName());
+	  copy_directory_structure(out_subdir, in_subdir, create);
+	}
+      } else if (IsConversionHashesKey(k->GetName())) {
+	// They describe the other file's containers, not ours.
+	continue;
+      } else {
+	TClass *cl = TClass::GetClass(k->GetClassName());
+	if (cl != 0 && cl->GetStreamerInfo() != 0)
+	  cl->GetStreamerInfo()->ForceWriteInfo(out->GetFile());
+
+	TKey *copy = new TKey(out, *k, 0);
+	copy->WriteFile(0);
+      }
+    }
+  }
+}
+
+int BTagCombination::FTConvertToCDIMain (int argc, char **argv)
+{
+  //
+  // Parse input arguments
+  //
+
+  if (argc <= 1) {
+    Usage();
+    return 1;
+  }
+
+  vector<string> otherArgs;
+    
+  // Parse the input args for commands
+  string outputFile ("output.root");
+  map<string, string> configInfo;
+  vector<string> taggers;
+  unsigned int nThreads = 1;
+
+  for (int i = 1; i < argc; i++) {
+    string a(argv[i]);
+    if (a == "output") {
+      outputFile = eatArg(argv, i, argc);
+    } else if (a == "--threads") {
+      int n = atoi(eatArg(argv, i, argc).c_str());
+      if (n < 1) {
+	cerr << "ERROR: --threads needs a number of threads of 1 or more." << endl;
+	Usage();
+	return 1;
+      }
+      nThreads = n;
+    } else if (a == "--config-info") {
+      string k (eatArg(argv, i, argc));
+      string v (eatArg(argv, i, argc));
+      configInfo[k] = v;
+    } else {
+      otherArgs.push_back(a);
+    }
+  }
+
+  CalibrationInfo info;
+  unique_ptr<MappedCalibrationFile> mapped;
+  bool updateROOTFile = false;
+  bool incremental = false;
+  vector<string> other_mcfiles_flat;
+  vector<string> other_mcfiles_slim;
+
+  string inputfile = "";
+
+  try {
+
+    // A binary input file is mapped, and each analysis read only when it is converted.
+    vector<string> otherFlags;
+    mapped = MapOPInputArgs (otherArgs, otherFlags);
+    if (mapped)
+      info.Defaults = mapped->defaults();
+    else
+      ParseOPInputArgs (otherArgs, info, otherFlags);
+
+    bool useInputFile = false;
+
+    for (unsigned int i = 0; i < otherFlags.size(); i++) {
+      if (otherFlags[i] == "update") {
+	updateROOTFile = true;
+      } else if (otherFlags[i] == "incremental") {
+	updateROOTFile = true;
+	incremental = true;
+      } else if (otherFlags[i].find("copySlim") == 0) {
+	useInputFile = true;
+	other_mcfiles_slim.push_back(otherFlags[i].substr(8));
+      } else if (otherFlags[i].find("copy") == 0) {
+	other_mcfiles_flat.push_back(otherFlags[i].substr(4));
+      } else {
+        if (otherFlags[i].find("inputSlim") == string::npos) {
+	  cerr << "ERROR: Unknown command line flag '" << otherFlags[i] << "'." << endl;
+	  Usage();
+	  return 1;
+	}
+      }
+    }
+
+    bool found=false;
+
+    if (useInputFile) {
+      for (unsigned int i = 0; i < otherFlags.size(); i++) {
+	if (otherFlags[i].find("inputSlim") != string::npos) {
+	  found=true;
+	  istringstream is(otherFlags[i].substr(9, otherFlags[i].length() - 9));
+	  is >> inputfile;
+	  ifstream inputdata;
+	  inputdata.open(inputfile.c_str());
+	  if (!inputdata.is_open()) {
+	    cerr << "ERROR: couldn't open input file " << inputfile.c_str() << " to steer the slimming" << endl;
+	    Usage();
+	    return 1;
+	  }
+	}
+      }
+    }
+
+    if (useInputFile && !found) {
+      cerr << "ERROR: input file to steering the slimming of the file content is missing" << endl;
+      Usage();
+      return 1;
+    }
+
+  } catch (exception &e) {
+    cerr << "Error parsing input files: " << e.what() << endl;
+    return 1;
+  }
+
+
+
+  //
+  // Convert it to an output root file. The directory structure is pretty
+  // specific!
+  //
+
+  TH1::AddDirectory(false);
+  TFile *output;
+  string outputROOTName ("output.root");
+  if (!updateROOTFile) {
+    output = TFile::Open(outputROOTName.c_str(), "RECREATE");
+  } else {
+    output = TFile::Open(outputROOTName.c_str(), "UPDATE");
+  }
+  if (!output->IsOpen()) {
+    cerr << "Unable to open 'output.root' for output!" << endl;
+    return 1;
+  }
+
+  // If there are any config info guys that should be written out,
+  // do that here
+
+  if (configInfo.size() > 0) {
+    TDirectory *d = output->mkdir("VersionInfo");
+    for (map<string,string>::const_iterator itr = configInfo.begin(); itr != configInfo.end(); itr++) {
+      TObjString *s = new TObjString(itr->second.c_str());
+      d->WriteTObject(s, itr->first.c_str());
+    }
+  }
+
+  //
+  // Work out what needs converting - normally everything. In an incremental update,
+  // analyses whose containers are already in the file with the same hash are left
+  // alone, and containers from analyses no longer in the input are removed.
+  //
+
+  vector<MappedInputAnalysis> mappedCalib;
+  vector<CalibrationAnalysis> mappedHeaders;
+  if (mapped) {
+    mappedCalib = MappedInputAnalyses(*mapped);
+    for (size_t i = 0; i < mappedCalib.size(); i++)
+      mappedHeaders.push_back(mappedCalib[i].header);
+  }
+
+  // The names are all that is needed to place the containers, the whole analysis to
+  // convert it. When mapped, only one analysis is read in at a time.
+  const vector<CalibrationAnalysis> &calib (mapped ? mappedHeaders : info.Analyses);
+  auto fullAnalysis = [&] (size_t i, CalibrationAnalysis &buffer) -> const CalibrationAnalysis & {
+    if (!mapped)
+      return calib[i];
+    buffer = mappedCalib[i].load();
+    return buffer;
+  };
+
+  // The hashes are only saved when asked for (they are a key at the top of the file that
+  // readers don't expect), or to keep those already in an updated file right.
+  map<string, string> hashes;
+  if (updateROOTFile)
+    hashes = ReadConversionHashes(output);
+  bool saveHashes = incremental || hashes.size() > 0;
+
+  vector<size_t> toConvert;
+  set<string> current;
+  for (size_t i = 0; i < calib.size(); i++) {
+    const CalibrationAnalysis &c(calib[i]);
+    CalibrationAnalysis buffer;
+    string h (ConversionHash(fullAnalysis(i, buffer)));
+
+    vector<string> paths;
+    paths.push_back(CDIContainerPath(c, c.name + "_SF"));
+    if (IsDefaultAnalysis(info.Defaults, c))
+      paths.push_back(CDIContainerPath(c, "default_SF"));
+
+    bool unchanged = incremental && h != "";
+    for (size_t ip = 0; ip < paths.size(); ip++) {
+      map<string, string>::const_iterator old = hashes.find(paths[ip]);
+      unchanged = unchanged && old != hashes.end() && old->second == h;
+      hashes[paths[ip]] = h;
+      current.insert(paths[ip]);
+    }
+
+    if (!unchanged)
+      toConvert.push_back(i);
+  }
+
+  if (incremental) {
+    size_t nRemoved = 0;
+    map<string, string> kept;
+    for (map<string, string>::const_iterator itr = hashes.begin(); itr != hashes.end(); itr++) {
+      if (current.find(itr->first) == current.end()) {
+	delete_container(output, itr->first);
+	nRemoved++;
+      } else {
+	kept.insert(*itr);
+      }
+    }
+    hashes = kept;
+
+    cout << "Incremental update: converting " << toConvert.size() << " of " << calib.size()
+	 << " analyses, removing " << nRemoved << " old containers." << endl;
+  }
+
+  //
+  // Now, write out everything. The conversions are independent, so they can be run
+  // on several threads. Only this thread touches the output file, and it writes the
+  // containers in input order, so the file doesn't depend on the number of threads.
+  // A default is a clone of the analysis' container, renamed.
+  //
+
+  if (nThreads > 1)
+    ROOT::EnableThreadSafety();
+
+  // Owned, so anything converted but not yet written is freed if the run fails.
+  typedef pair<unique_ptr<CalibrationDataContainer>, unique_ptr<CalibrationDataContainer> > t_converted;
+  OrderedParallelFor<t_converted>
+    (toConvert.size(), nThreads,
+     [&] (size_t i) {
+      CalibrationAnalysis buffer;
+      const CalibrationAnalysis &c(fullAnalysis(toConvert[i], buffer));
+      t_converted r;
+      r.first.reset(ConvertToCDI (c, c.name + "_SF"));
+      if (IsDefaultAnalysis(info.Defaults, c))
+	r.second.reset(static_cast<CalibrationDataContainer*>(r.first->Clone("default_SF")));
+      return r;
+    },
+     [&] (size_t i, t_converted &r) {
+      const CalibrationAnalysis &c(calib[toConvert[i]]);
+
+      // Replace, rather than add a cycle to, what an earlier run left.
+      WriteCDIContainer(output, c, r.first.get(), incremental);
+      if (r.second)
+	WriteCDIContainer(output, c, r.second.get(), incremental);
+
+      r.first.reset();
+      r.second.reset();
+    });
+
+
+  //
+  // Save what info from the other mc files we may want to exclude
+  //
+
+  if (inputfile.c_str()) {
+
+    ifstream inputdata;
+    inputdata.open(inputfile.c_str());
+
+    string token;
+    string name = "";
+
+    while (inputdata) {
+      inputdata >> token;
+      if (token == "slim")  {
+	inputdata >> name;
+	m_slimVector.push_back(name);
+      }
+    }
+
+    cout << "Reading information to slim from file " << inputfile.c_str() << endl;
+    for (unsigned int i = 0; i < m_slimVector.size(); i++) 
+      cout << "  " << i << " " << m_slimVector.at(i) << endl;
+  }
+
+  //
+  // The other mc files may need copying in...
+  //
+
+  for (unsigned int i = 0; i < other_mcfiles_slim.size(); i++) {
+    TFile *in = TFile::Open(other_mcfiles_slim[i].c_str(), "READ");
+    copy_directory_structure(output, in, true); 
+    in->Close();
+    delete in;
+  }
+
+  for (unsigned int i = 0; i < other_mcfiles_flat.size(); i++) {
+    TFile *in = TFile::Open(other_mcfiles_flat[i].c_str(), "READ");
+    copy_directory_structure(output, in, true); 
+    in->Close();
+    delete in;
+  }
+
+  if (saveHashes)
+    WriteConversionHashes(output, hashes);
+
+  TraceSpan closeSpan("close output");
+  output->Close();
+  delete output;
+
+  return 0;
+}
+
+namespace {
+  void Usage (void)
+  {
+    cout << "Convert a text (or binary) file to a CalibrationDataInterface ROOT file" << endl;
+    cout << "FTConvertToCDI <input-filenames> <options>" << endl;
+    cout << "  --ignore <item> - use to ignore a particular bin in the input" << endl;
+    cout << "  --update <rootfname> - use to update the root file" << endl;
+    cout << "  --incremental - update the root file, only converting analyses that changed since" << endl;
+    cout << "                  it was written, and removing those no longer in the input. The first" << endl;
+    cout << "                  --incremental run converts everything, and saves what it needs" << endl;
+    cout << "                  for the next (a ConversionHashes map at the top of the file)" << endl;
+    cout << "  --copy <filename> - to include the file content" << endl;
+    cout << "  --copySlim <filename> - to include and slim the file content" << endl;
+    cout << "  --inputSlim - to steer the slimming of the file content" << endl;
+    cout << "  --threads <n> - convert the analyses on n threads (default 1)" << endl;
+  }
+}
@@ -0,0 +1,308 @@
+//
+// FTPipeline - combine, extrapolate, pick out the defaults, and write the CDI file, all in
+// one go. The same as running FTCombine, FTExtrapolateAnalyses, FTCopyDefaults and
+// FTConvertToCDI one after the other, but nothing is written out as text and parsed back
+// in between: each group goes through every step as soon as its fit is done. The CDI
+// containers are built, in memory, on another thread while the rest are fit; only the
+// writes to the CDI file are done on the fitting thread, between fits, so the file (and
+// gDirectory) is never touched from two threads.
+//
+// FTConvertToCDI's --copy, --copySlim, --update, --incremental and --threads aren't
+// supported: run FTConvertToCDI on the output for those.
+//
+
+#include "Combination/ToolMains.h"
+#include "Combination/Parser.h"
+#include "Combination/CommonCommandLineUtils.h"
+#include "Combination/Combiner.h"
+#include "Combination/CalibrationInfoView.h"
+#include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/CDIConverter.h"
+#include "Combination/FitResultCache.h"
+#include "Combination/ParallelUtils.h"
+#include "Combination/Pipeline.h"
+#include "Combination/Tracing.h"
+
+#include <RooMsgService.h>
+#include <TROOT.h>
+#include <TFile.h>
+#include <TDirectory.h>
+#include <TH1.h>
+#include <TObjString.h>
+
+#include <iostream>
+#include <fstream>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+using namespace BTagCombination;
+using namespace Analysis;
+
+namespace {
+  void usage (void);
+
+  string eatArg (const vector<string> &args, size_t &index)
+  {
+    if (index == (args.size()-1))
+      throw runtime_error ("Not enough arguments after " + args[index] + ".");
+    index++;
+    return args[index];
+  }
+
+  // Where the text of a step goes, if anywhere.
+  class AuditFile
+  {
+  public:
+    void Open (const string &fname)
+    {
+      _out.reset(new ofstream(fname.c_str()));
+      if (!*_out)
+	throw runtime_error("Unable to open '" + fname + "' for output");
+    }
+    void Write (const CalibrationAnalysis &ana)
+    {
+      if (_out)
+	(*_out) << ana << endl;
+    }
+  private:
+    unique_ptr<ofstream> _out;
+  };
+
+  // A group's containers, converted but not yet written. A default is a clone of the
+  // analysis' container, renamed.
+  struct ConvertedGroup
+  {
+    CalibrationAnalysis ana;
+    unique_ptr<CalibrationDataContainer> sf;
+    unique_ptr<CalibrationDataContainer> def;
+  };
+
+  // Handed from the converter thread back to the fitting thread, in the order they were
+  // converted.
+  class ConvertedGroups
+  {
+  public:
+    void Add (ConvertedGroup &g)
+    {
+      lock_guard<mutex> l (_lock);
+      _groups.push_back(std::move(g));
+    }
+    deque<ConvertedGroup> TakeAll ()
+    {
+      lock_guard<mutex> l (_lock);
+      deque<ConvertedGroup> r;
+      r.swap(_groups);
+      return r;
+    }
+  private:
+    mutex _lock;
+    deque<ConvertedGroup> _groups;
+  };
+}
+
+int BTagCombination::FTPipelineMain (int argc, char **argv)
+{
+  TFile *output = 0;
+  try {
+    // Parse the input arguments. Anything with a value has to come out first, or the
+    // value would be taken for an input file.
+    vector<string> allArgs (argv + 1, argv + argc);
+    vector<string> args;
+    vector<string> extrapolationNames;
+    string outputROOTName ("output.root");
+    map<string, string> configInfo;
+    AuditFile combinedText, extrapolatedText, defaultsText;
+
+    for (size_t i = 0; i < allArgs.size(); i++) {
+      const string &a (allArgs[i]);
+      if (a == "--extrapolation") {
+	extrapolationNames.push_back(eatArg(allArgs, i));
+      } else if (a == "--output") {
+	outputROOTName = eatArg(allArgs, i);
+      } else if (a == "--dumpCombined") {
+	combinedText.Open(eatArg(allArgs, i));
+      } else if (a == "--dumpExtrapolated") {
+	extrapolatedText.Open(eatArg(allArgs, i));
+      } else if (a == "--dumpDefaults") {
+	defaultsText.Open(eatArg(allArgs, i));
+      } else if (a == "--config-info") {
+	string k (eatArg(allArgs, i));
+	string v (eatArg(allArgs, i));
+	configInfo[k] = v;
+      } else if (a == "--threads") {
+	cout << "Error: FTPipeline doesn't support --threads - the conversion is done on one other thread while the fits run." << endl;
+	usage();
+	return 1;
+      } else {
+	args.push_back(a);
+      }
+    }
+
+    CalibrationInfo info;
+    vector<string> otherFlags;
+    ParseOPInputArgs (args, info, otherFlags);
+
+    bool verbose = false;
+    bool fitTiming = false;
+    string prefix = "";
+    string fitCacheDir = "";
+    unsigned long long fitCacheBytes = 1024ULL*1024*1024;
+
+    for (unsigned int i = 0; i < otherFlags.size(); i++) {
+      if (otherFlags[i] == "verbose") {
+	verbose = true;
+      } else if (otherFlags[i] == "fitTiming") {
+	fitTiming = true;
+      } else if (otherFlags[i].substr(0, 6) == "prefix") {
+	prefix = otherFlags[i].substr(6);
+      } else if (otherFlags[i].substr(0, 9) == "fitCache=") {
+	fitCacheDir = otherFlags[i].substr(9);
+      } else if (otherFlags[i].substr(0, 11) == "fitCacheMB=") {
+	fitCacheBytes = ParseFitCacheMB(otherFlags[i].substr(11));
+      } else if (otherFlags[i] == "update" || otherFlags[i] == "incremental" || otherFlags[i].find("copy") == 0) {
+	cout << "Error: FTPipeline doesn't support --" << otherFlags[i] << " - run FTConvertToCDI on its output for that." << endl;
+	usage();
+	return 1;
+      } else {
+	cout << "Error: Unknown flag: " << otherFlags[i] << endl;
+	usage();
+	return 1;
+      }
+    }
+
+    // The extrapolations are applied to the combination, not part of it.
+    Extrapolator extrapolator (TakeAnalyses(info, extrapolationNames));
+
+    // Turn off all those fitting messages!
+    if (!verbose) {
+      RooMsgService::instance().setSilentMode(true);
+      RooMsgService::instance().setGlobalKillBelow(RooFit::ERROR);
+    }
+
+    unique_ptr<FitResultCache> cache;
+    if (fitCacheDir != "")
+      cache.reset(new FitResultCache(fitCacheDir, fitCacheBytes));
+
+    //
+    // Open the CDI file.
+    //
+
+    TH1::AddDirectory(false);
+    output = TFile::Open(outputROOTName.c_str(), "RECREATE");
+    if (output == 0 || !output->IsOpen())
+      throw runtime_error("Unable to open '" + outputROOTName + "' for output");
+
+    if (configInfo.size() > 0) {
+      TDirectory *d = output->mkdir("VersionInfo");
+      for (map<string,string>::const_iterator itr = configInfo.begin(); itr != configInfo.end(); itr++) {
+	TObjString *s = new TObjString(itr->second.c_str());
+	d->WriteTObject(s, itr->first.c_str());
+      }
+    }
+
+    //
+    // Convert each group on another thread, in the order they are fit. The containers are
+    // only built there (nothing is attached to a directory - see TH1::AddDirectory above);
+    // they are handed back to be written here. No conversion hashes are saved: as for
+    // FTConvertToCDI, they are only for --incremental.
+    //
+
+    ROOT::EnableThreadSafety();
+
+    ConvertedGroups converted;
+    BackgroundConsumer<CalibrationAnalysis> converter
+      ([&] (CalibrationAnalysis &c) {
+	ConvertedGroup g;
+	g.sf.reset(ConvertToCDI (c, c.name + "_SF"));
+	if (IsDefaultAnalysis(info.Defaults, c))
+	  g.def.reset(static_cast<CalibrationDataContainer*>(g.sf->Clone("default_SF")));
+	g.ana = c;
+	converted.Add(g);
+      });
+
+    // Write whatever has been converted so far, in order.
+    auto writeConverted = [&] () {
+      deque<ConvertedGroup> ready (converted.TakeAll());
+      for (size_t i = 0; i < ready.size(); i++) {
+	WriteCDIContainer(output, ready[i].ana, ready[i].sf.get());
+	if (ready[i].def)
+	  WriteCDIContainer(output, ready[i].ana, ready[i].def.get());
+      }
+    };
+
+    //
+    // Each group goes through the rest of the steps as soon as it has been fit, and
+    // whatever was converted during the fit is written out. The fits run with gDirectory
+    // at gROOT, not the CDI file, so nothing RooFit makes can end up in it.
+    //
+
+    size_t nGroups = 0;
+    {
+      TDirectory::TContext fitContext (gROOT);
+      CombineAnalyses(CalibrationInfoView(info),
+		      [&] (const CalibrationAnalysis &combined) {
+			TraceSpan span("pipeline group", combined.name);
+			writeConverted();
+
+			CalibrationAnalysis r (combined);
+			r.name = prefix + r.name;
+			combinedText.Write(r);
+
+			r = extrapolator.Apply(r);
+			extrapolatedText.Write(r);
+
+			if (IsDefaultAnalysis(info.Defaults, r))
+			  defaultsText.Write(MakeDefaultAnalysis(r));
+
+			converter.Push(r);
+			nGroups++;
+		      },
+		      true,
+		      info.BinByBin ? kCombineBySingleBin : kCombineByFullAnalysis,
+		      fitTiming,
+		      cache.get());
+
+      converter.Finish();
+      writeConverted();
+    }
+
+    if (cache.get() != 0)
+      cout << "Fit cache " << cache->directory() << ": " << cache->stats() << endl;
+    if (nGroups == 0)
+      cout << " --> There was nothing to do!" << endl;
+
+    TraceSpan closeSpan("close output");
+    output->Close();
+    delete output;
+    output = 0;
+
+  } catch (exception &e) {
+    cerr << "Error while running the pipeline: " << e.what() << endl;
+    delete output;
+    return 1;
+  }
+  return 0;
+}
+
+namespace {
+  void usage (void)
+  {
+    cerr << "Usage: FTPipeline <files, --ignore> --extrapolation <ana> --output <rootfname> --verbose --fitTiming [--profile | --binbybin] --prefixXXX" << endl;
+    cerr << "                  --fitCache=<dir> --fitCacheMB=<size> --dumpCombined <fname> --dumpExtrapolated <fname> --dumpDefaults <fname>" << endl;
+    cerr << "                  --config-info <key> <value>" << endl;
+    cerr << "  Combine, extrapolate and write the CDI file in one go (FTCombine, FTExtrapolateAnalyses, FTCopyDefaults" << endl;
+    cerr << "  and FTConvertToCDI, without the text files in between)." << endl;
+    cerr << "  --extrapolation <ana>  Name of an extrapolation analysis in the inputs. Multiple can be specified" << endl;
+    cerr << "  --output <rootfname>  The CDI file to write (default output.root)" << endl;
+    cerr << "  --dumpCombined <fname>  Also write the combined results, as FTCombine would have in combined.txt" << endl;
+    cerr << "  --dumpExtrapolated <fname>  Also write the results after extrapolation, as FTExtrapolateAnalyses would have" << endl;
+    cerr << "  --dumpDefaults <fname>  Also write the defaults, as FTCopyDefaults would have" << endl;
+    cerr << "  --config-info <key> <value>  Saved in the VersionInfo directory of the CDI file" << endl;
+    cerr << "  The rest are as for FTCombine. FTConvertToCDI's --copy, --copySlim, --update, --incremental and" << endl;
+    cerr << "  --threads aren't supported - run FTConvertToCDI on the output for those." << endl;
+  }
+}
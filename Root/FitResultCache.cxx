@@ -0,0 +1,278 @@
+//
+// On-disk cache of combination results.
+//
+
+#include "Combination/FitResultCache.h"
+#include "Combination/CalibrationDataModelBinary.h"
+#include "Combination/Tracing.h"
+#include "Combination/FNVHash.h"
+
+#include <TSystem.h>
+#include <RVersion.h>
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  // Goes into every key. Change it whenever a change to the fitting code changes the
+  // results, so old entries are no longer used. The fitter settings are part of the key
+  // already (see FitCacheKey in Combiner.cxx).
+  const char *gFitVersion = "FitResultCache-2";
+
+  // Entry files start with this on a line of its own, then the size of the key on a line
+  // of its own, then the key itself.
+  const char *gEntryMagic = "FTFIT2";
+  const char *gEntrySuffix = ".ftfit";
+
+  int ProcessId ()
+  {
+#ifndef _WIN32
+    return getpid();
+#else
+    return _getpid();
+#endif
+  }
+
+  // FNV-1a, as ConversionHash. Only used to name the entry files.
+  string Hash (const string &s)
+  {
+    unsigned long long h = FNV1a64(s.data(), s.size());
+    ostringstream result;
+    result << hex << h << "-" << dec << s.size();
+    return result.str();
+  }
+
+  bool EndsWith (const string &s, const string &end)
+  {
+    return s.size() >= end.size() && s.compare(s.size() - end.size(), end.size(), end) == 0;
+  }
+
+  struct Entry {
+    string path;
+    long modified;
+    unsigned long long size;
+  };
+
+  bool OlderEntry (const Entry &e1, const Entry &e2)
+  {
+    if (e1.modified != e2.modified)
+      return e1.modified < e2.modified;
+    return e1.path < e2.path;
+  }
+}
+
+namespace BTagCombination {
+
+  FitResultCache::FitResultCache (const string &directory, unsigned long long maxBytes, size_t maxEntries)
+    : _directory (directory), _maxBytes (maxBytes), _maxEntries (maxEntries)
+  {
+    if (gSystem->AccessPathName(directory.c_str(), kFileExists)) {
+      gSystem->mkdir(directory.c_str(), true);
+      if (gSystem->AccessPathName(directory.c_str(), kFileExists))
+	throw runtime_error("Unable to create the fit cache directory '" + directory + "'.");
+    }
+
+    lock_guard<mutex> l (_lock);
+    Evict();
+  }
+
+  string FitResultCache::Key (const vector<CalibrationAnalysis> &anas,
+			      const vector<AnalysisCorrelation> &correlations,
+			      const string &settings)
+  {
+    // The binary format is exact, so the key changes with any change to a number.
+    CalibrationInfo inputs;
+    inputs.Analyses = anas;
+
+    set<string> names;
+    for (size_t i = 0; i < anas.size(); i++)
+      names.insert(anas[i].name);
+    for (size_t i = 0; i < correlations.size(); i++) {
+      const AnalysisCorrelation &c (correlations[i]);
+      if (anas.size() > 0
+	  && c.flavor == anas[0].flavor && c.tagger == anas[0].tagger
+	  && c.operatingPoint == anas[0].operatingPoint && c.jetAlgorithm == anas[0].jetAlgorithm
+	  && names.find(c.analysis1Name) != names.end()
+	  && names.find(c.analysis2Name) != names.end())
+	inputs.Correlations.push_back(c);
+    }
+
+    ostringstream text;
+    text << gFitVersion << " " << ROOT_RELEASE << endl << settings << endl;
+    WriteBinaryInfo(text, inputs);
+    return text.str();
+  }
+
+  string FitResultCache::Path (const string &key) const
+  {
+    return _directory + "/" + Hash(key) + gEntrySuffix;
+  }
+
+  bool FitResultCache::Lookup (const string &key, CalibrationAnalysis &result)
+  {
+    TraceSpan span ("fit cache lookup", Hash(key));
+    string path (Path(key));
+    bool found = false;
+    {
+      // Another key with the same hash is a miss.
+      ifstream in (path.c_str(), ios::binary);
+      string magic;
+      size_t keySize = 0;
+      if (in && getline(in, magic) && magic == gEntryMagic
+	  && (in >> keySize) && in.get() == '\n' && keySize == key.size()) {
+	string storedKey (keySize, ' ');
+	if (in.read(&storedKey[0], keySize) && storedKey == key) {
+	  try {
+	    result = ReadBinaryAnalysis(in);
+	    found = true;
+	  } catch (runtime_error &) {
+	  }
+	}
+      }
+    }
+
+    // Mark it as used, so it is the last to go.
+    if (found) {
+      long now = time(0);
+      gSystem->Utime(path.c_str(), now, now);
+    }
+
+    lock_guard<mutex> l (_lock);
+    if (found)
+      _stats.hits++;
+    else
+      _stats.misses++;
+    return found;
+  }
+
+  void FitResultCache::Store (const string &key, const CalibrationAnalysis &result)
+  {
+    TraceSpan span ("fit cache store", Hash(key));
+
+    // Write it to the side, and move it into place, so no one ever sees half an entry.
+    string path (Path(key));
+    ostringstream temp;
+    temp << path << ".tmp" << ProcessId();
+    {
+      ofstream out (temp.str().c_str(), ios::out | ios::binary);
+      out << gEntryMagic << "\n" << key.size() << "\n" << key;
+      WriteBinary(out, result);
+      out.close();
+      if (!out) {
+	gSystem->Unlink(temp.str().c_str());
+	throw runtime_error("Unable to write to the fit cache '" + _directory + "'.");
+      }
+    }
+    FileStat_t written, replaced;
+    unsigned long long size = gSystem->GetPathInfo(temp.str().c_str(), written) == 0 ? written.fSize : 0;
+    bool replacing = gSystem->GetPathInfo(path.c_str(), replaced) == 0;
+    if (gSystem->Rename(temp.str().c_str(), path.c_str()) != 0) {
+      gSystem->Unlink(temp.str().c_str());
+      throw runtime_error("Unable to write to the fit cache '" + _directory + "'.");
+    }
+
+    // Keep count here, and only look at the directory when it is time to remove some.
+    lock_guard<mutex> l (_lock);
+    _stats.stores++;
+    if (replacing)
+      _stats.bytes -= min(_stats.bytes, (unsigned long long) replaced.fSize);
+    else
+      _stats.entries++;
+    _stats.bytes += size;
+    if (OverLimits())
+      Evict();
+  }
+
+  bool FitResultCache::OverLimits () const
+  {
+    return (_maxBytes > 0 && _stats.bytes > _maxBytes)
+      || (_maxEntries > 0 && _stats.entries > _maxEntries);
+  }
+
+  void FitResultCache::Evict ()
+  {
+    vector<Entry> entries;
+    void *dir = gSystem->OpenDirectory(_directory.c_str());
+    if (dir == 0)
+      return;
+    const char *name;
+    while ((name = gSystem->GetDirEntry(dir)) != 0) {
+      if (!EndsWith(name, gEntrySuffix))
+	continue;
+      Entry e;
+      e.path = _directory + "/" + name;
+      FileStat_t info;
+      if (gSystem->GetPathInfo(e.path.c_str(), info) != 0)
+	continue;
+      e.modified = info.fMtime;
+      e.size = info.fSize;
+      entries.push_back(e);
+    }
+    gSystem->FreeDirectory(dir);
+
+    _stats.entries = entries.size();
+    _stats.bytes = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+      _stats.bytes += entries[i].size;
+    if (!OverLimits())
+      return;
+
+    unsigned long long keepBytes = _maxBytes - _maxBytes/10;
+    size_t keepEntries = _maxEntries - _maxEntries/10;
+
+    sort(entries.begin(), entries.end(), OlderEntry);
+    for (size_t i = 0; i < entries.size(); i++) {
+      bool overSize = _maxBytes > 0 && _stats.bytes > keepBytes;
+      bool overCount = _maxEntries > 0 && _stats.entries > keepEntries;
+      if (!overSize && !overCount)
+	break;
+      gSystem->Unlink(entries[i].path.c_str());
+      _stats.bytes -= entries[i].size;
+      _stats.entries--;
+      _stats.evictions++;
+    }
+  }
+
+  FitResultCache::Stats FitResultCache::stats () const
+  {
+    lock_guard<mutex> l (_lock);
+    return _stats;
+  }
+
+  unsigned long long ParseFitCacheMB (const string &value)
+  {
+    // Plain digits only: strtoull would take "10GB", "-1" or "" without complaint.
+    const unsigned long long maxMB = ~0ULL / (1024*1024);
+    bool good = value.size() > 0;
+    unsigned long long mb = 0;
+    for (size_t i = 0; good && i < value.size(); i++) {
+      good = value[i] >= '0' && value[i] <= '9' && mb <= (maxMB - (value[i] - '0'))/10;
+      mb = mb*10 + (value[i] - '0');
+    }
+    if (!good)
+      throw runtime_error("--fitCacheMB must be a whole number of megabytes, not '" + value + "'");
+    return mb*1024*1024;
+  }
+
+  ostream &operator<< (ostream &out, const FitResultCache::Stats &s)
+  {
+    out << s.hits << " hits, " << s.misses << " misses, "
+	<< s.stores << " stored, " << s.evictions << " evicted; "
+	<< s.entries << " entries, " << s.bytes << " bytes";
+    return out;
+  }
+}
@@ -0,0 +1,458 @@
+//
+// The combination as a generalised least squares problem, with the low rank
+// updates used to look at variations of it.
+//
+
+#include "Combination/LinearCombination.h"
+#include "Combination/BinNameUtils.h"
+
+#include <stdexcept>
+#include <sstream>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  //
+  // Matrices are n x n, stored by row.
+  //
+
+  // Invert a symmetric positive definite matrix (by its Cholesky decomposition).
+  vector<double> InvertSymmetric (const vector<double> &m, size_t n, const string &what)
+  {
+    // m = L L'
+    vector<double> L (n*n, 0.0);
+    for (size_t j = 0; j < n; j++) {
+      double d = m[j*n+j];
+      for (size_t k = 0; k < j; k++)
+	d -= L[j*n+k]*L[j*n+k];
+      if (!(d > 0.0)) {
+	ostringstream err;
+	err << "Unable to invert the " << what << " - it is not positive definite.";
+	throw runtime_error(err.str());
+      }
+      L[j*n+j] = sqrt(d);
+      for (size_t i = j+1; i < n; i++) {
+	double s = m[i*n+j];
+	for (size_t k = 0; k < j; k++)
+	  s -= L[i*n+k]*L[j*n+k];
+	L[i*n+j] = s / L[j*n+j];
+      }
+    }
+
+    // L^-1, which is also lower triangular
+    vector<double> Linv (n*n, 0.0);
+    for (size_t j = 0; j < n; j++) {
+      Linv[j*n+j] = 1.0 / L[j*n+j];
+      for (size_t i = j+1; i < n; i++) {
+	double s = 0.0;
+	for (size_t k = j; k < i; k++)
+	  s -= L[i*n+k]*Linv[k*n+j];
+	Linv[i*n+j] = s / L[i*n+i];
+      }
+    }
+
+    // m^-1 = L'^-1 L^-1
+    vector<double> r (n*n, 0.0);
+    for (size_t i = 0; i < n; i++) {
+      for (size_t j = 0; j <= i; j++) {
+	double s = 0.0;
+	for (size_t k = i; k < n; k++)
+	  s += Linv[k*n+i]*Linv[k*n+j];
+	r[i*n+j] = s;
+	r[j*n+i] = s;
+      }
+    }
+    return r;
+  }
+
+  // Invert a general matrix (Gauss-Jordan, with partial pivoting).
+  vector<double> Invert (vector<double> m, size_t n, const string &what)
+  {
+    vector<double> r (n*n, 0.0);
+    for (size_t i = 0; i < n; i++)
+      r[i*n+i] = 1.0;
+
+    for (size_t c = 0; c < n; c++) {
+      size_t pivot = c;
+      for (size_t i = c+1; i < n; i++) {
+	if (fabs(m[i*n+c]) > fabs(m[pivot*n+c]))
+	  pivot = i;
+      }
+      if (m[pivot*n+c] == 0.0) {
+	ostringstream err;
+	err << "Unable to invert the " << what << " - it is singular.";
+	throw runtime_error(err.str());
+      }
+      if (pivot != c) {
+	for (size_t j = 0; j < n; j++) {
+	  swap(m[c*n+j], m[pivot*n+j]);
+	  swap(r[c*n+j], r[pivot*n+j]);
+	}
+      }
+
+      double d = m[c*n+c];
+      for (size_t j = 0; j < n; j++) {
+	m[c*n+j] /= d;
+	r[c*n+j] /= d;
+      }
+      for (size_t i = 0; i < n; i++) {
+	if (i == c || m[i*n+c] == 0.0)
+	  continue;
+	double f = m[i*n+c];
+	for (size_t j = 0; j < n; j++) {
+	  m[i*n+j] -= f*m[c*n+j];
+	  r[i*n+j] -= f*r[c*n+j];
+	}
+      }
+    }
+    return r;
+  }
+}
+
+namespace BTagCombination {
+
+  //
+  // Build the measurements and their covariance matrix from the view, the same
+  // way the combiner fills its fit.
+  //
+  LinearCombination::LinearCombination (const CalibrationInfoView &info)
+  {
+    map<set<CalibrationBinBoundary>, size_t> binIndex;
+    map<string, size_t> measurementIndex;
+    map<pair<string, int>, size_t> sysIndex;
+    vector<double> stat;
+
+    vector<size_t> indices (info.analysisIndices());
+    for (size_t i_ana = 0; i_ana < indices.size(); i_ana++) {
+      const CalibrationAnalysis &a (info.analysis(indices[i_ana]));
+      for (size_t i_bin = 0; i_bin < a.bins.size(); i_bin++) {
+	if (!info.binVisible(indices[i_ana], i_bin))
+	  continue;
+
+	const CalibrationBin &b (a.bins[i_bin]);
+	set<CalibrationBinBoundary> spec (b.binSpec.begin(), b.binSpec.end());
+	map<set<CalibrationBinBoundary>, size_t>::const_iterator i_b = binIndex.find(spec);
+	if (i_b == binIndex.end()) {
+	  i_b = binIndex.insert(make_pair(spec, _bins.size())).first;
+	  _bins.push_back(spec);
+	}
+
+	size_t row = _y.size();
+	_y.push_back(b.centralValue);
+	_bin.push_back(i_b->second);
+	stat.push_back(b.centralValueStatisticalError);
+	measurementIndex[OPIgnoreFormat(a, b)] = row;
+
+	for (size_t i_sys = 0; i_sys < b.systematicErrors.size(); i_sys++) {
+	  const SystematicError &e (b.systematicErrors[i_sys]);
+	  if (!info.sysVisible(e))
+	    continue;
+
+	  pair<string, int> key (e.name, info.sysUncorrelated(e) ? (int) i_b->second : -1);
+	  map<pair<string, int>, size_t>::const_iterator i_s = sysIndex.find(key);
+	  if (i_s == sysIndex.end()) {
+	    i_s = sysIndex.insert(make_pair(key, _sys.size())).first;
+	    SysColumn s;
+	    s.name = key.first;
+	    s.bin = key.second;
+	    _sys.push_back(s);
+	  }
+	  vector<double> &values (_sys[i_s->second].values);
+	  values.resize(row+1, 0.0);
+	  values[row] += e.value;
+	}
+      }
+    }
+
+    size_t n = _y.size();
+    for (size_t i = 0; i < _sys.size(); i++)
+      _sys[i].values.resize(n, 0.0);
+
+    //
+    // The covariance matrix
+    //
+
+    vector<double> W (n*n, 0.0);
+    for (size_t i = 0; i < n; i++)
+      W[i*n+i] = stat[i]*stat[i];
+
+    const vector<AnalysisCorrelation> &correlations (info.correlations());
+    for (size_t i_cor = 0; i_cor < correlations.size(); i_cor++) {
+      for (size_t i_cbin = 0; i_cbin < correlations[i_cor].bins.size(); i_cbin++) {
+	const BinCorrelation &bin (correlations[i_cor].bins[i_cbin]);
+	if (!bin.hasStatCorrelation)
+	  continue;
+
+	pair<string, string> names (OPIgnoreCorrelatedFormat(correlations[i_cor], bin));
+	map<string, size_t>::const_iterator m1 = measurementIndex.find(names.first);
+	map<string, size_t>::const_iterator m2 = measurementIndex.find(names.second);
+	if (m1 == measurementIndex.end() || m2 == measurementIndex.end()) {
+	  if (!(m1 == measurementIndex.end() && m2 == measurementIndex.end())) {
+	    ostringstream out;
+	    out << "Both analyses not present for correlation " << OPFullName(correlations[i_cor]) << " - but at least one is!";
+	    throw runtime_error(out.str());
+	  }
+	  continue;
+	}
+
+	// The fit can't take a correlation of 1, so the combiner uses 0.99.
+	double rho = bin.statCorrelation == 1.0 ? 0.99 : bin.statCorrelation;
+	size_t i1 = m1->second, i2 = m2->second;
+	W[i1*n+i2] += rho*stat[i1]*stat[i2];
+	W[i2*n+i1] += rho*stat[i1]*stat[i2];
+      }
+    }
+
+    for (size_t s = 0; s < _sys.size(); s++) {
+      const vector<double> &v (_sys[s].values);
+      for (size_t i = 0; i < n; i++) {
+	if (v[i] == 0.0)
+	  continue;
+	for (size_t j = 0; j < n; j++)
+	  W[i*n+j] += v[i]*v[j];
+      }
+    }
+
+    _P = InvertSymmetric(W, n, "covariance matrix of the measurements");
+  }
+
+  LinearCombination::Result LinearCombination::Solve() const
+  {
+    vector<size_t> rows (_y.size());
+    for (size_t i = 0; i < rows.size(); i++)
+      rows[i] = i;
+    return Solve(rows, _P);
+  }
+
+  //
+  // The inverse of the covariance matrix of the measurements that are left is the
+  // Schur complement of the removed ones in P.
+  //
+  LinearCombination::Result LinearCombination::SolveWithoutBins (const set<set<CalibrationBinBoundary> > &bins) const
+  {
+    size_t n = _y.size();
+    vector<size_t> keep, remove;
+    for (size_t i = 0; i < n; i++) {
+      if (bins.find(_bins[_bin[i]]) == bins.end())
+	keep.push_back(i);
+      else
+	remove.push_back(i);
+    }
+    if (remove.size() == 0)
+      return Solve();
+
+    size_t nk = keep.size(), nr = remove.size();
+    vector<double> Prr (nr*nr);
+    for (size_t i = 0; i < nr; i++)
+      for (size_t j = 0; j < nr; j++)
+	Prr[i*nr+j] = _P[remove[i]*n+remove[j]];
+    vector<double> PrrInv (InvertSymmetric(Prr, nr, "inverse covariance matrix of the removed measurements"));
+
+    // X = P_kr P_rr^-1
+    vector<double> X (nk*nr, 0.0);
+    for (size_t i = 0; i < nk; i++)
+      for (size_t a = 0; a < nr; a++) {
+	double p = _P[keep[i]*n+remove[a]];
+	if (p == 0.0)
+	  continue;
+	for (size_t b = 0; b < nr; b++)
+	  X[i*nr+b] += p*PrrInv[a*nr+b];
+      }
+
+    vector<double> P (nk*nk);
+    for (size_t i = 0; i < nk; i++)
+      for (size_t j = 0; j < nk; j++) {
+	double s = _P[keep[i]*n+keep[j]];
+	for (size_t b = 0; b < nr; b++)
+	  s -= X[i*nr+b]*_P[remove[b]*n+keep[j]];
+	P[i*nk+j] = s;
+      }
+
+    return Solve(keep, P);
+  }
+
+  //
+  // Removing a systematic error takes v v' off the covariance matrix for each of its columns.
+  //
+  LinearCombination::Result LinearCombination::SolveWithoutSysErrors (const set<string> &names) const
+  {
+    vector<vector<double> > U;
+    vector<double> Cinv;
+    for (size_t s = 0; s < _sys.size(); s++) {
+      if (names.find(_sys[s].name) != names.end()) {
+	U.push_back(_sys[s].values);
+	Cinv.push_back(-1.0);
+      }
+    }
+    if (U.size() == 0)
+      return Solve();
+
+    vector<size_t> rows (_y.size());
+    for (size_t i = 0; i < rows.size(); i++)
+      rows[i] = i;
+    return Solve(rows, Woodbury(U, Cinv));
+  }
+
+  //
+  // Making an error uncorrelated swaps its one correlated column, v, for one column
+  // per bin, v_b. If the error was already uncorrelated in some of the measurements
+  // of a bin (u_b), the two are merged in the fit, as they have the same name.
+  //
+  LinearCombination::Result LinearCombination::SolveWithSysErrorsUncorrelated (const set<string> &names) const
+  {
+    map<pair<string, int>, size_t> sysIndex;
+    for (size_t s = 0; s < _sys.size(); s++)
+      sysIndex[make_pair(_sys[s].name, _sys[s].bin)] = s;
+
+    size_t n = _y.size();
+    vector<vector<double> > U;
+    vector<double> Cinv;
+    for (size_t s = 0; s < _sys.size(); s++) {
+      if (_sys[s].bin >= 0 || names.find(_sys[s].name) == names.end())
+	continue;
+
+      const vector<double> &v (_sys[s].values);
+      U.push_back(v);
+      Cinv.push_back(-1.0);
+
+      for (size_t b = 0; b < _bins.size(); b++) {
+	vector<double> vb (n, 0.0);
+	bool any = false;
+	for (size_t i = 0; i < n; i++) {
+	  if (_bin[i] == b && v[i] != 0.0) {
+	    vb[i] = v[i];
+	    any = true;
+	  }
+	}
+	if (!any)
+	  continue;
+
+	map<pair<string, int>, size_t>::const_iterator i_u = sysIndex.find(make_pair(_sys[s].name, (int) b));
+	if (i_u != sysIndex.end()) {
+	  const vector<double> &u (_sys[i_u->second].values);
+	  U.push_back(u);
+	  Cinv.push_back(-1.0);
+	  for (size_t i = 0; i < n; i++)
+	    vb[i] += u[i];
+	}
+	U.push_back(vb);
+	Cinv.push_back(1.0);
+      }
+    }
+    if (U.size() == 0)
+      return Solve();
+
+    vector<size_t> rows (n);
+    for (size_t i = 0; i < n; i++)
+      rows[i] = i;
+    return Solve(rows, Woodbury(U, Cinv));
+  }
+
+  //
+  // (W + U C U')^-1 = P - P U (C^-1 + U' P U)^-1 U' P
+  //
+  vector<double> LinearCombination::Woodbury (const vector<vector<double> > &U, const vector<double> &Cinv) const
+  {
+    size_t n = _y.size(), k = U.size();
+
+    vector<double> PU (n*k, 0.0);
+    for (size_t i = 0; i < n; i++)
+      for (size_t a = 0; a < k; a++) {
+	double s = 0.0;
+	for (size_t l = 0; l < n; l++)
+	  s += _P[i*n+l]*U[a][l];
+	PU[i*k+a] = s;
+      }
+
+    vector<double> M (k*k, 0.0);
+    for (size_t a = 0; a < k; a++) {
+      M[a*k+a] = Cinv[a];
+      for (size_t b = 0; b < k; b++)
+	for (size_t l = 0; l < n; l++)
+	  M[a*k+b] += U[a][l]*PU[l*k+b];
+    }
+    vector<double> Minv (Invert(M, k, "update to the covariance matrix"));
+
+    // T = P U M^-1
+    vector<double> T (n*k, 0.0);
+    for (size_t i = 0; i < n; i++)
+      for (size_t a = 0; a < k; a++)
+	for (size_t b = 0; b < k; b++)
+	  T[i*k+b] += PU[i*k+a]*Minv[a*k+b];
+
+    vector<double> P (_P);
+    for (size_t i = 0; i < n; i++)
+      for (size_t j = 0; j < n; j++) {
+	double s = 0.0;
+	for (size_t a = 0; a < k; a++)
+	  s += T[i*k+a]*PU[j*k+a];
+	P[i*n+j] -= s;
+      }
+    return P;
+  }
+
+  //
+  // The least squares solution for the measurements in rows, given the inverse of
+  // their covariance matrix.
+  //
+  LinearCombination::Result LinearCombination::Solve (const vector<size_t> &rows, const vector<double> &P) const
+  {
+    size_t n = rows.size();
+
+    // Number the bins that are left.
+    map<size_t, size_t> binColumn;
+    vector<size_t> column (n), columnBin;
+    for (size_t i = 0; i < n; i++) {
+      size_t b = _bin[rows[i]];
+      map<size_t, size_t>::const_iterator i_c = binColumn.find(b);
+      if (i_c == binColumn.end()) {
+	i_c = binColumn.insert(make_pair(b, columnBin.size())).first;
+	columnBin.push_back(b);
+      }
+      column[i] = i_c->second;
+    }
+    size_t m = columnBin.size();
+
+    // PA, then F = A' P A and g = A' P y
+    vector<double> PA (n*m, 0.0);
+    for (size_t i = 0; i < n; i++)
+      for (size_t k = 0; k < n; k++)
+	PA[i*m+column[k]] += P[i*n+k];
+
+    vector<double> F (m*m, 0.0), g (m, 0.0);
+    for (size_t i = 0; i < n; i++)
+      for (size_t b = 0; b < m; b++) {
+	F[column[i]*m+b] += PA[i*m+b];
+	g[b] += PA[i*m+b]*_y[rows[i]];
+      }
+
+    vector<double> cov (InvertSymmetric(F, m, "information matrix of the combined bins"));
+    vector<double> mu (m, 0.0);
+    for (size_t a = 0; a < m; a++)
+      for (size_t b = 0; b < m; b++)
+	mu[a] += cov[a*m+b]*g[b];
+
+    vector<double> r (n);
+    for (size_t i = 0; i < n; i++)
+      r[i] = _y[rows[i]] - mu[column[i]];
+
+    Result result;
+    result.chi2 = 0.0;
+    for (size_t i = 0; i < n; i++)
+      for (size_t k = 0; k < n; k++)
+	result.chi2 += r[i]*P[i*n+k]*r[k];
+    result.ndof = (int) n - (int) m;
+
+    for (size_t a = 0; a < m; a++) {
+      BinResult br;
+      br.centralValue = mu[a];
+      br.error = sqrt(cov[a*m+a]);
+      result.bins[_bins[columnBin[a]]] = br;
+    }
+
+    return result;
+  }
+}
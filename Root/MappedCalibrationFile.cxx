@@ -0,0 +1,221 @@
+//
+// Read a binary format calibration file in place, from a memory mapping.
+//
+
+#include "Combination/MappedCalibrationFile.h"
+#include "Combination/CalibrationDataModelBinary.h"
+#include "Combination/Tracing.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+  using namespace BTagCombination::BinaryInfoFormat;
+
+  // Throw with the name of the file in the message.
+  void Fail (const string &fileName, const string &what)
+  {
+    throw runtime_error("Binary calibration file '" + fileName + "': " + what);
+  }
+}
+
+namespace BTagCombination {
+
+  //
+  // The file and mapping
+  //
+
+  MappedCalibrationFile::MappedCalibrationFile (const string &fileName)
+    : _fileName (fileName), _data (0), _size (0)
+  {
+    TraceSpan span ("map", fileName);
+
+#ifndef _WIN32
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      Fail(fileName, "unable to open it.");
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      close(fd);
+      Fail(fileName, "unable to find its size.");
+    }
+    if (info.st_size < (off_t) cHeaderSize) {
+      close(fd);
+      Fail(fileName, "not in the binary calibration format.");
+    }
+    void *m = mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+      Fail(fileName, "unable to map it into memory.");
+    _data = static_cast<const char*>(m);
+    _size = info.st_size;
+#else
+    // No mapping here - read it all instead.
+    ifstream input (fileName.c_str(), ios::binary);
+    if (!input)
+      Fail(fileName, "unable to open it.");
+    ostringstream text;
+    text << input.rdbuf();
+    _buffer = text.str();
+    _data = _buffer.data();
+    _size = _buffer.size();
+#endif
+
+    try {
+      _reader.reset(new BinaryInfoReader(_data, _size, fileName));
+
+      // The numbers of the names, so find can look them up.
+      const vector<string> &strings (_reader->strings());
+      for (size_t i = 0; i < strings.size(); i++)
+	_stringIndex.insert(make_pair(strings[i], (uint32_t) i));
+
+      // Index the analyses by their names - all of that is in the analysis table.
+      for (size_t i = 0; i < _reader->nAnalyses(); i++) {
+	uint64_t entry = _reader->AnalysisEntry(i);
+	t_NameKey key;
+	for (int n = BinaryInfoReader::kName; n <= BinaryInfoReader::kJetAlgorithm; n++)
+	  key.push_back(_reader->EntryNameIndex(entry, BinaryInfoReader::NameField(n)));
+	_index[key].push_back(i);
+      }
+    } catch (...) {
+#ifndef _WIN32
+      munmap(const_cast<char*>(_data), _size);
+#endif
+      throw;
+    }
+  }
+
+  MappedCalibrationFile::~MappedCalibrationFile()
+  {
+#ifndef _WIN32
+    munmap(const_cast<char*>(_data), _size);
+#endif
+  }
+
+  bool MappedCalibrationFile::IsBinaryFile (const string &fileName)
+  {
+    char magic[sizeof(cMagic)];
+    ifstream probe (fileName.c_str(), ios::binary);
+    probe.read(magic, sizeof(magic));
+    return probe.gcount() == sizeof(magic) && IsBinaryInfo(magic, sizeof(magic));
+  }
+
+  MappedAnalysis MappedCalibrationFile::analysis (size_t index) const
+  {
+    return MappedAnalysis(_reader.get(), _reader->AnalysisEntry(index));
+  }
+
+  vector<MappedAnalysis> MappedCalibrationFile::find (const string &name, const string &flavor,
+						      const string &tagger, const string &operatingPoint,
+						      const string &jetAlgorithm) const
+  {
+    vector<MappedAnalysis> result;
+
+    // A name that isn't in the string table can't be in any analysis.
+    const string *names[] = { &name, &flavor, &tagger, &operatingPoint, &jetAlgorithm };
+    t_NameKey key;
+    for (int n = 0; n < 5; n++) {
+      unordered_map<string, uint32_t>::const_iterator s = _stringIndex.find(*names[n]);
+      if (s == _stringIndex.end())
+	return result;
+      key.push_back(s->second);
+    }
+
+    map<t_NameKey, vector<size_t> >::const_iterator f = _index.find(key);
+    if (f != _index.end()) {
+      for (size_t i = 0; i < f->second.size(); i++)
+	result.push_back(analysis(f->second[i]));
+    }
+    return result;
+  }
+
+  vector<AnalysisCorrelation> MappedCalibrationFile::correlations() const { return _reader->Correlations(); }
+  vector<DefaultAnalysis> MappedCalibrationFile::defaults() const { return _reader->Defaults(); }
+  vector<AliasAnalysis> MappedCalibrationFile::aliases() const { return _reader->Aliases(); }
+
+  CalibrationInfo MappedCalibrationFile::materialize() const
+  {
+    return _reader->Info();
+  }
+
+  //
+  // Analyses
+  //
+
+  const string &MappedAnalysis::name() const { return _reader->EntryName(_entry, BinaryInfoReader::kName); }
+  const string &MappedAnalysis::flavor() const { return _reader->EntryName(_entry, BinaryInfoReader::kFlavor); }
+  const string &MappedAnalysis::tagger() const { return _reader->EntryName(_entry, BinaryInfoReader::kTagger); }
+  const string &MappedAnalysis::operatingPoint() const { return _reader->EntryName(_entry, BinaryInfoReader::kOperatingPoint); }
+  const string &MappedAnalysis::jetAlgorithm() const { return _reader->EntryName(_entry, BinaryInfoReader::kJetAlgorithm); }
+
+  size_t MappedAnalysis::nBins() const { return _reader->nBins(_entry); }
+
+  MappedBin MappedAnalysis::bin (size_t index) const
+  {
+    return MappedBin(_reader, _reader->BinPos(_entry, index));
+  }
+
+  CalibrationAnalysis MappedAnalysis::header() const { return _reader->AnalysisHeader(_entry); }
+  CalibrationAnalysis MappedAnalysis::materialize() const { return _reader->Analysis(_entry); }
+
+  //
+  // Bins
+  //
+
+  CalibrationBinBoundary MappedBin::boundary (size_t index) const
+  {
+    if (index >= _bin.nBoundaries)
+      throw runtime_error("Bin boundary index out of range in a mapped calibration file.");
+    return _reader->Boundary(_bin.boundariesPos() + cBoundarySize*index);
+  }
+
+  vector<CalibrationBinBoundary> MappedBin::binSpec() const
+  {
+    vector<CalibrationBinBoundary> spec;
+    spec.reserve(_bin.nBoundaries);
+    for (size_t i = 0; i < _bin.nBoundaries; i++)
+      spec.push_back(boundary(i));
+    return spec;
+  }
+
+  double MappedBin::centralValue() const { return _reader->CentralValue(_bin); }
+  double MappedBin::statisticalError() const { return _reader->StatisticalError(_bin); }
+  bool MappedBin::isExtended() const { return _reader->IsExtended(_bin); }
+
+  MappedSysError MappedBin::sysError (size_t index) const
+  {
+    if (index >= _bin.nSys)
+      throw runtime_error("Systematic error index out of range in a mapped calibration file.");
+    return MappedSysError(_reader, _bin.sysErrorsPos() + cSysErrorSize*index);
+  }
+
+  MappedSysError MappedBin::referenceSysError (size_t index) const
+  {
+    if (index >= _bin.nRefSys)
+      throw runtime_error("Systematic error index out of range in a mapped calibration file.");
+    return MappedSysError(_reader, _bin.sysErrorsPos() + cSysErrorSize*(uint64_t(_bin.nSys) + index));
+  }
+
+  CalibrationBin MappedBin::materialize() const { return _reader->DecodeBin(_bin); }
+
+  //
+  // Systematic errors
+  //
+
+  const string &MappedSysError::name() const { return _reader->SysErrorName(_pos); }
+  double MappedSysError::value() const { return _reader->SysErrorValue(_pos); }
+  bool MappedSysError::uncorrelated() const { return _reader->SysErrorUncorrelated(_pos); }
+
+  SystematicError MappedSysError::materialize() const { return _reader->SysError(_pos); }
+}
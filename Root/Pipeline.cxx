@@ -0,0 +1,87 @@
+//
+// The in-memory steps between a combination and a CDI file.
+//
+
+#include "Combination/Pipeline.h"
+#include "Combination/ExtrapolationTools.h"
+#include "Combination/BinNameUtils.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  // Very simple wild-card matching
+  bool wCompare (const string &s1, const string &s2)
+  {
+    if (s1 == "*" || s2 == "*")
+      return true;
+    return s1 == s2;
+  }
+}
+
+namespace BTagCombination {
+
+  vector<CalibrationAnalysis> TakeAnalyses (CalibrationInfo &info, const vector<string> &names)
+  {
+    vector<CalibrationAnalysis> taken, kept;
+    for (vector<CalibrationAnalysis>::const_iterator itr = info.Analyses.begin(); itr != info.Analyses.end(); itr++) {
+      if (find(names.begin(), names.end(), itr->name) != names.end()) {
+	taken.push_back(*itr);
+      } else {
+	kept.push_back(*itr);
+      }
+    }
+    info.Analyses = kept;
+    return taken;
+  }
+
+  Extrapolator::Extrapolator (const vector<CalibrationAnalysis> &extrapolations)
+  {
+    for (vector<CalibrationAnalysis>::const_iterator itr = extrapolations.begin(); itr != extrapolations.end(); itr++)
+      _byGroup[OPIndependentName(*itr)].push_back(*itr);
+  }
+
+  CalibrationAnalysis Extrapolator::Apply (const CalibrationAnalysis &ana) const
+  {
+    map<string, vector<CalibrationAnalysis> >::const_iterator e_itr = _byGroup.find(OPIndependentName(ana));
+    if (e_itr == _byGroup.end())
+      return ana;
+
+    if (e_itr->second.size() > 1) {
+      ostringstream err;
+      err << "More than one extrapolated analysis to apply (" << e_itr->first << "):";
+      for (vector<CalibrationAnalysis>::const_iterator bad_ana = e_itr->second.begin(); bad_ana != e_itr->second.end(); bad_ana++)
+	err << " " << OPFullName(*bad_ana);
+      throw runtime_error(err.str());
+    }
+    return addExtrapolation(e_itr->second[0], ana);
+  }
+
+  // Match with some basic wildcard info
+  bool IsDefaultAnalysis (const vector<DefaultAnalysis> &defaults, const CalibrationAnalysis &ana)
+  {
+    for (unsigned int i = 0; i < defaults.size(); i++) {
+      const DefaultAnalysis &d(defaults[i]);
+      if (wCompare(ana.jetAlgorithm, d.jetAlgorithm)
+	  && wCompare(ana.flavor, d.flavor)
+	  && wCompare(ana.tagger, d.tagger)
+	  && wCompare(ana.operatingPoint, d.operatingPoint)
+	  && wCompare(ana.name, d.name)
+	  )
+	return true;
+    }
+    return false;
+  }
+
+  CalibrationAnalysis MakeDefaultAnalysis (const CalibrationAnalysis &ana)
+  {
+    CalibrationAnalysis def (ana);
+    def.name = "default";
+    return def;
+  }
+}
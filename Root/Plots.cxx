@@ -7,6 +7,7 @@
 #include "Combination/BinNameUtils.h"
 #include "Combination/AtlasLabels.h"
 #include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/BinKey.h"
 
 #include "TGraphErrors.h"
 #include "TCanvas.h"
@@ -17,6 +18,7 @@
 #include "TLegend.h"
 
 #include <map>
+#include <unordered_map>
 #include <cmath>
 #include <set>
 #include <vector>
@@ -36,6 +38,7 @@ namespace {
   typedef map<string, vector<CalibrationAnalysis> > t_grouping;
   typedef set<CalibrationBinBoundary> t_BBSet;
   typedef map<string, t_BBSet> t_BinSet;
+  typedef unordered_map<BinKey, size_t, BinKeyHash> t_BinIndex;
 
   // A few global constants...
   const double c_legendXStart = 0.55;
@@ -73,19 +76,25 @@ namespace {
   /// utility was needed.
   ///
 
+  // Index the bins of an analysis by their boundaries (the first bin wins if
+  // there are duplicates).
+  t_BinIndex IndexBins (const CalibrationAnalysis &ana)
+  {
+    t_BinIndex result;
+    for (size_t ib = 0; ib < ana.bins.size(); ib++) {
+      result.insert(make_pair(BinKey(ana.bins[ib]), ib));
+    }
+    return result;
+  }
+
   // Find the bin results for a particular bin. Return an empty if we
   // can't find it.
-  CalibrationBin FindBin (const CalibrationAnalysis &ana, t_BBSet &bininfo, bool &found)
+  CalibrationBin FindBin (const CalibrationAnalysis &ana, const t_BinIndex &index, const t_BBSet &bininfo, bool &found)
   {
-    found = false;
-    for (unsigned int ib = 0; ib < ana.bins.size(); ib++) {
-      const CalibrationBin &cb (ana.bins[ib]);
-      t_BBSet t (cb.binSpec.begin(), cb.binSpec.end());
-      if (t == bininfo) {
-	found = true;
-	return cb;
-      }
-    }
+    t_BinIndex::const_iterator itr = index.find(BinKey(bininfo));
+    found = itr != index.end();
+    if (found)
+      return ana.bins[itr->second];
 
     // This line will cause an analysis that isn't present to appear as a "ZERO"
     // in the plot. We should fix this.
@@ -425,12 +434,17 @@ namespace {
     typedef map<CalibrationBinBoundary, t_CBMap> t_BoundaryMap;
     t_BoundaryMap taggerResults;
 
+    vector<t_BinIndex> anaBins;
+    for(unsigned int ia = 0; ia < anas.size(); ia++) {
+      anaBins.push_back(IndexBins(anas[ia]));
+    }
+
     for (t_BBSet::const_iterator ib = allAxisBins.begin(); ib != allAxisBins.end(); ib++) {
       t_BBSet coordinate (specifiedBins);
       coordinate.insert(*ib);
       for(unsigned int ia = 0; ia < anas.size(); ia++) {
 	bool found;
-	CalibrationBin fb = FindBin (anas[ia], coordinate, found);
+	CalibrationBin fb = FindBin (anas[ia], anaBins[ia], coordinate, found);
 	if (found)
 	  taggerResults[*ib][NamingForAna(anas[ia],gp)] = fb;
       }
@@ -0,0 +1,175 @@
+//
+// Split a combination into shards, and merge the results.
+//
+
+#include "Combination/Sharding.h"
+#include "Combination/CommonCommandLineUtils.h"
+#include "Combination/BinNameUtils.h"
+#include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/FNVHash.h"
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  const string cShardHeader = "# FTCombine shard ";
+  const string cGroupHeader = "# group ";
+
+  // FNV-1a - the same on every machine, unlike std::hash.
+  unsigned long long StableHash (const string &s)
+  {
+    return FNV1a64(s.data(), s.size());
+  }
+
+  string ShardName (const ShardSpec &shard)
+  {
+    ostringstream name;
+    name << shard.index << "/" << shard.count;
+    return name.str();
+  }
+
+  // Most expensive first; the name settles ties, so every shard sorts the same way.
+  bool MoreExpensive (const pair<double, string> &g1, const pair<double, string> &g2)
+  {
+    if (g1.first != g2.first)
+      return g1.first > g2.first;
+    return g1.second < g2.second;
+  }
+}
+
+namespace BTagCombination {
+
+  ShardSpec ParseShardSpec (const string &spec)
+  {
+    ShardSpec shard;
+    istringstream in (spec);
+    long long index = -1, count = -1;
+    char slash = 0;
+    in >> index >> slash >> count;
+    if (in.fail() || !in.eof() || slash != '/' || count < 1 || index < 0 || index >= count)
+      throw runtime_error("A shard must be given as i/N, with 0 <= i < N, not '" + spec + "'");
+    shard.index = index;
+    shard.count = count;
+    return shard;
+  }
+
+  double EstimateGroupCost (const vector<CalibrationAnalysis> &group)
+  {
+    size_t nMeasurements = 0;
+    set<string> sysErrors;
+    for (size_t i_ana = 0; i_ana < group.size(); i_ana++) {
+      const vector<CalibrationBin> &bins (group[i_ana].bins);
+      nMeasurements += bins.size();
+      for (size_t i_bin = 0; i_bin < bins.size(); i_bin++) {
+	for (size_t i_sys = 0; i_sys < bins[i_bin].systematicErrors.size(); i_sys++)
+	  sysErrors.insert(bins[i_bin].systematicErrors[i_sys].name);
+      }
+    }
+    return double(nMeasurements) * double(max(sysErrors.size(), (size_t) 1));
+  }
+
+  map<string, size_t> AssignShards (const map<string, vector<CalibrationAnalysis> > &groups,
+				    size_t nShards, bool balance)
+  {
+    if (nShards == 0)
+      throw runtime_error("Can't split a combination into zero shards");
+
+    map<string, size_t> result;
+    if (!balance) {
+      for (map<string, vector<CalibrationAnalysis> >::const_iterator itr = groups.begin(); itr != groups.end(); itr++)
+	result[itr->first] = StableHash(itr->first) % nShards;
+      return result;
+    }
+
+    vector<pair<double, string> > costs;
+    for (map<string, vector<CalibrationAnalysis> >::const_iterator itr = groups.begin(); itr != groups.end(); itr++)
+      costs.push_back(make_pair(EstimateGroupCost(itr->second), itr->first));
+    sort(costs.begin(), costs.end(), MoreExpensive);
+
+    vector<double> load (nShards, 0.0);
+    for (size_t i = 0; i < costs.size(); i++) {
+      size_t least = min_element(load.begin(), load.end()) - load.begin();
+      result[costs[i].second] = least;
+      load[least] += costs[i].first;
+    }
+    return result;
+  }
+
+  void KeepShard (CalibrationInfo &info, const ShardSpec &shard, bool balance)
+  {
+    map<string, size_t> assigned (AssignShards(BinAnalysesByJetTagFlavOp(info.Analyses), shard.count, balance));
+
+    vector<CalibrationAnalysis> kept;
+    for (size_t i = 0; i < info.Analyses.size(); i++) {
+      if (assigned[OPIndependentName(info.Analyses[i])] == shard.index)
+	kept.push_back(info.Analyses[i]);
+    }
+    info.Analyses = kept;
+  }
+
+  void WriteShard (ostream &out, const ShardSpec &shard, const vector<CalibrationAnalysis> &results)
+  {
+    out << cShardHeader << ShardName(shard) << endl;
+    for (size_t i = 0; i < results.size(); i++) {
+      out << cGroupHeader << OPIndependentName(results[i]) << endl;
+      out << results[i] << endl;
+    }
+  }
+
+  void MergeShards (const vector<string> &shards, ostream &out)
+  {
+    if (shards.size() == 0)
+      throw runtime_error("No shards to merge");
+
+    map<string, string> groups;
+    set<size_t> seen;
+    size_t count = 0;
+
+    for (size_t i_shard = 0; i_shard < shards.size(); i_shard++) {
+      istringstream in (shards[i_shard]);
+      string line;
+      getline(in, line);
+      if (line.substr(0, cShardHeader.size()) != cShardHeader) {
+	ostringstream msg;
+	msg << "Input " << i_shard+1 << " isn't the output of a sharded combination";
+	throw runtime_error(msg.str());
+      }
+      ShardSpec shard (ParseShardSpec(line.substr(cShardHeader.size())));
+
+      if (count == 0)
+	count = shard.count;
+      if (shard.count != count)
+	throw runtime_error("Shard " + ShardName(shard) + " is from a different split than the others");
+      if (!seen.insert(shard.index).second)
+	throw runtime_error("Shard " + ShardName(shard) + " was given twice");
+
+      string *group = 0;
+      while (getline(in, line)) {
+	if (line.substr(0, cGroupHeader.size()) == cGroupHeader) {
+	  string name (line.substr(cGroupHeader.size()));
+	  if (groups.find(name) != groups.end())
+	    throw runtime_error("Group " + name + " is in more than one shard");
+	  group = &groups[name];
+	} else if (group != 0) {
+	  *group += line + "\n";
+	}
+      }
+    }
+
+    if (seen.size() != count) {
+      ostringstream msg;
+      msg << "Only " << seen.size() << " of the " << count << " shards were given";
+      throw runtime_error(msg.str());
+    }
+
+    // Groups come out of the combination in name order.
+    for (map<string, string>::const_iterator itr = groups.begin(); itr != groups.end(); itr++)
+      out << itr->second;
+  }
+}
@@ -0,0 +1,63 @@
+//
+// Counting and numbering k-subsets
+//
+
+#include "Combination/SubsetUtils.h"
+
+#include <stdexcept>
+#include <sstream>
+#include <limits>
+
+using namespace std;
+
+namespace BTagCombination {
+
+  unsigned long long nChooseK (size_t n, size_t k)
+  {
+    if (k > n)
+      return 0;
+    if (k > n - k)
+      k = n - k;
+
+    // After step i r is (n choose i+1), so the division is always exact.
+    unsigned long long r = 1;
+    for (size_t i = 0; i < k; i++) {
+      unsigned long long m = n - i;
+      if (r > numeric_limits<unsigned long long>::max() / m) {
+	ostringstream err;
+	err << "Too many subsets to count: " << n << " choose " << k << ".";
+	throw runtime_error(err.str());
+      }
+      r = r * m / (i + 1);
+    }
+    return r;
+  }
+
+  //
+  // Pick the items one at a time. If the next item is c, there are (n-c-1 choose
+  // items-left) subsets that start that way - skip past whole blocks until rank
+  // falls inside one.
+  //
+  vector<size_t> NthSubset (size_t n, size_t k, unsigned long long rank)
+  {
+    if (rank >= nChooseK(n, k)) {
+      ostringstream err;
+      err << "There is no subset number " << rank << " of " << n << " choose " << k << ".";
+      throw runtime_error(err.str());
+    }
+
+    vector<size_t> result;
+    size_t c = 0;
+    for (size_t pos = 0; pos < k; pos++) {
+      for (;; c++) {
+	unsigned long long block = nChooseK(n - c - 1, k - pos - 1);
+	if (rank < block)
+	  break;
+	rank -= block;
+      }
+      result.push_back(c);
+      c++;
+    }
+    return result;
+  }
+}
@@ -0,0 +1,231 @@
+//
+// Generate made up calibration inputs for scaling studies.
+//
+
+#include "Combination/SyntheticInputs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  // mt19937_64 gives the same numbers everywhere, but the standard distributions
+  // don't - so we do our own.
+  double Uniform (mt19937_64 &rng, double low, double high)
+  {
+    return low + (high - low) * ((rng() >> 11) * (1.0 / 9007199254740992.0));
+  }
+
+  bool Chance (mt19937_64 &rng, double p)
+  {
+    return Uniform(rng, 0.0, 1.0) < p;
+  }
+
+  CalibrationBinBoundary Boundary (const string &variable, double low, double high)
+  {
+    CalibrationBinBoundary b;
+    b.variable = variable;
+    b.lowvalue = low;
+    b.highvalue = high;
+    return b;
+  }
+
+  // pt bin edges that get wider as pt goes up: 20, 30, 50, 80, 120, ...
+  vector<double> PtEdges (size_t nBins)
+  {
+    vector<double> edges (1, 20.0);
+    for (size_t i = 0; i < nBins; i++)
+      edges.push_back(edges.back() + 10.0*(i+1));
+    return edges;
+  }
+
+  SystematicError Sys (const string &name, double value, bool uncorrelated)
+  {
+    SystematicError e;
+    e.name = name;
+    e.value = value;
+    e.uncorrelated = uncorrelated;
+    return e;
+  }
+
+  void CheckFraction (double f, const string &what)
+  {
+    if (f < 0.0 || f > 1.0) {
+      ostringstream err;
+      err << "The " << what << " must be between 0 and 1 (not " << f << ").";
+      throw runtime_error(err.str());
+    }
+  }
+}
+
+namespace BTagCombination {
+
+  SyntheticInputSpec::SyntheticInputSpec()
+    : seed (1),
+      nAnalyses (3),
+      flavors (1, "bottom"),
+      taggers (1, "MV1"),
+      operatingPoints (1, "0.7"),
+      jetAlgorithms (1, "AntiKt4Topo"),
+      nPtBins (6),
+      nEtaBins (1),
+      nExtendedBins (0),
+      nSys (10),
+      sharedSysFraction (0.5),
+      uncorrelatedSysFraction (0.1),
+      correlationDensity (0.3),
+      defaults (true),
+      copies (false)
+  {}
+
+  CalibrationInfo GenerateSyntheticInputs (const SyntheticInputSpec &spec)
+  {
+    if (spec.nAnalyses == 0 || spec.nPtBins == 0)
+      throw runtime_error("Synthetic inputs need at least one analysis and one pt bin.");
+    if (spec.flavors.size() == 0 || spec.taggers.size() == 0
+	|| spec.operatingPoints.size() == 0 || spec.jetAlgorithms.size() == 0)
+      throw runtime_error("Synthetic inputs need at least one flavor, tagger, operating point and jet algorithm.");
+    CheckFraction(spec.sharedSysFraction, "shared systematic error fraction");
+    CheckFraction(spec.uncorrelatedSysFraction, "uncorrelated systematic error fraction");
+    CheckFraction(spec.correlationDensity, "correlation density");
+
+    mt19937_64 rng (spec.seed);
+
+    size_t nShared = (size_t) (spec.nSys*spec.sharedSysFraction + 0.5);
+    size_t nPrivate = spec.nSys - nShared;
+    size_t nUncorrelated = (size_t) (nPrivate*spec.uncorrelatedSysFraction + 0.5);
+
+    vector<double> ptEdges (PtEdges(spec.nPtBins + spec.nExtendedBins));
+    vector<pair<double, double> > etaBins;
+    for (size_t i = 0; i < spec.nEtaBins; i++)
+      etaBins.push_back(make_pair(2.5*i/spec.nEtaBins, 2.5*(i+1)/spec.nEtaBins));
+    if (etaBins.size() == 0)
+      etaBins.push_back(make_pair(0.0, 0.0));
+
+    // The statistical correlation of two analyses in a bin is the product of their
+    // "loadings" in that bin, as if they shared part of their data. With every loading
+    // at most sqrt(0.8/nAnalyses) (and 0.4), leaving some of the correlations out can't
+    // make the covariance matrix lose its positive definiteness.
+    double maxLoading = min(0.4, sqrt(0.8/spec.nAnalyses));
+
+    CalibrationInfo info;
+    for (size_t i_f = 0; i_f < spec.flavors.size(); i_f++) {
+      for (size_t i_t = 0; i_t < spec.taggers.size(); i_t++) {
+	for (size_t i_op = 0; i_op < spec.operatingPoints.size(); i_op++) {
+	  for (size_t i_j = 0; i_j < spec.jetAlgorithms.size(); i_j++) {
+	    vector<CalibrationAnalysis> group;
+	    vector<vector<double> > loadings;
+
+	    for (size_t i_ana = 0; i_ana < spec.nAnalyses; i_ana++) {
+	      CalibrationAnalysis ana;
+	      ostringstream name;
+	      name << "ana" << i_ana;
+	      ana.name = name.str();
+	      ana.flavor = spec.flavors[i_f];
+	      ana.tagger = spec.taggers[i_t];
+	      ana.operatingPoint = spec.operatingPoints[i_op];
+	      ana.jetAlgorithm = spec.jetAlgorithms[i_j];
+	      ana.metadata["synthetic_seed"].push_back((double) spec.seed);
+
+	      size_t nPt = spec.nPtBins + (i_ana == 0 ? spec.nExtendedBins : 0);
+	      loadings.push_back(vector<double>());
+	      for (size_t i_pt = 0; i_pt < nPt; i_pt++) {
+		for (size_t i_eta = 0; i_eta < etaBins.size(); i_eta++) {
+		  CalibrationBin bin;
+		  bin.binSpec.push_back(Boundary("pt", ptEdges[i_pt], ptEdges[i_pt+1]));
+		  if (spec.nEtaBins > 0)
+		    bin.binSpec.push_back(Boundary("abseta", etaBins[i_eta].first, etaBins[i_eta].second));
+		  bin.centralValue = Uniform(rng, 0.85, 1.15);
+		  bin.centralValueStatisticalError = bin.centralValue*Uniform(rng, 0.02, 0.10);
+
+		  if (i_pt >= spec.nPtBins) {
+		    // The CDI wants exactly one error in an extended bin.
+		    bin.isExtended = true;
+		    bin.systematicErrors.push_back(Sys("extrapolated", bin.centralValue*Uniform(rng, 0.02, 0.10), false));
+		  } else {
+		    for (size_t i_s = 0; i_s < nShared; i_s++) {
+		      ostringstream sname;
+		      sname << "FT_EFF_shared_" << i_s;
+		      bin.systematicErrors.push_back(Sys(sname.str(), bin.centralValue*Uniform(rng, -0.03, 0.03), false));
+		    }
+		    for (size_t i_s = 0; i_s < nPrivate; i_s++) {
+		      ostringstream sname;
+		      sname << "FT_EFF_" << ana.name << "_" << i_s;
+		      bin.systematicErrors.push_back(Sys(sname.str(), bin.centralValue*Uniform(rng, -0.03, 0.03), i_s < nUncorrelated));
+		    }
+		    loadings.back().push_back(Uniform(rng, 0.0, maxLoading));
+		  }
+		  ana.bins.push_back(bin);
+		}
+	      }
+	      group.push_back(ana);
+	    }
+
+	    // The extended bins come after all the others, so bin index i is the same
+	    // bin in every analysis.
+	    size_t nNormalBins = spec.nPtBins*etaBins.size();
+	    for (size_t a1 = 0; a1 < group.size(); a1++) {
+	      for (size_t a2 = a1+1; a2 < group.size(); a2++) {
+		AnalysisCorrelation cor;
+		cor.analysis1Name = group[a1].name;
+		cor.analysis2Name = group[a2].name;
+		cor.flavor = group[a1].flavor;
+		cor.tagger = group[a1].tagger;
+		cor.operatingPoint = group[a1].operatingPoint;
+		cor.jetAlgorithm = group[a1].jetAlgorithm;
+		for (size_t i_bin = 0; i_bin < nNormalBins; i_bin++) {
+		  if (!Chance(rng, spec.correlationDensity))
+		    continue;
+		  BinCorrelation bc;
+		  bc.binSpec = group[a1].bins[i_bin].binSpec;
+		  bc.hasStatCorrelation = true;
+		  bc.statCorrelation = loadings[a1][i_bin]*loadings[a2][i_bin];
+		  cor.bins.push_back(bc);
+		}
+		if (cor.bins.size() > 0)
+		  info.Correlations.push_back(cor);
+	      }
+	    }
+
+	    if (spec.defaults) {
+	      DefaultAnalysis d;
+	      d.name = group[0].name;
+	      d.flavor = group[0].flavor;
+	      d.tagger = group[0].tagger;
+	      d.operatingPoint = group[0].operatingPoint;
+	      d.jetAlgorithm = group[0].jetAlgorithm;
+	      info.Defaults.push_back(d);
+	    }
+
+	    if (spec.copies) {
+	      AliasAnalysis alias;
+	      alias.name = group[0].name;
+	      alias.flavor = group[0].flavor;
+	      alias.tagger = group[0].tagger;
+	      alias.operatingPoint = group[0].operatingPoint;
+	      alias.jetAlgorithm = group[0].jetAlgorithm;
+	      AliasAnalysisCopyTo to;
+	      to.name = group[0].name;
+	      to.flavor = group[0].flavor;
+	      to.tagger = group[0].tagger;
+	      to.operatingPoint = group[0].operatingPoint;
+	      to.jetAlgorithm = group[0].jetAlgorithm + "Copy";
+	      alias.CopyTargets.push_back(to);
+	      info.Aliases.push_back(alias);
+	    }
+
+	    info.Analyses.insert(info.Analyses.end(), group.begin(), group.end());
+	  }
+	}
+      }
+    }
+
+    return info;
+  }
+}
@@ -0,0 +1,310 @@
+//
+// Serve tool runs over a Unix-domain socket, a forked process per run.
+//
+
+#include "Combination/ToolServer.h"
+#include "Combination/ToolProtocol.h"
+#include "Combination/CommonCommandLineUtils.h"
+#include "Combination/Tracing.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+using namespace std;
+
+#ifndef _WIN32
+namespace {
+  using namespace BTagCombination;
+  using namespace BTagCombination::ToolProtocol;
+
+  void CloseAll (const int *fds, int n)
+  {
+    for (int i = 0; i < n; i++)
+      close(fds[i]);
+  }
+
+  void CloseAll (const vector<int> &fds)
+  {
+    for (size_t i = 0; i < fds.size(); i++)
+      close(fds[i]);
+  }
+
+  // Run the tool - in the forked process, with the client's stdin, etc. already in place.
+  int RunTool (const map<string, ToolMain> &tools, const string &cwd, const vector<string> &args)
+  {
+    if (chdir(cwd.c_str()) != 0) {
+      cerr << "Error: unable to change to the directory '" << cwd << "'." << endl;
+      return 1;
+    }
+    map<string, ToolMain>::const_iterator tool (tools.find(args[0]));
+    if (tool == tools.end()) {
+      cerr << "Error: this server doesn't run '" << args[0] << "'. It runs:";
+      for (tool = tools.begin(); tool != tools.end(); tool++)
+	cerr << " " << tool->first;
+      cerr << endl;
+      return 127;
+    }
+
+    vector<char*> argv;
+    for (size_t i = 0; i < args.size(); i++)
+      argv.push_back(const_cast<char*>(args[i].c_str()));
+    argv.push_back(0);
+
+    try {
+      return tool->second(args.size(), &argv[0]);
+    } catch (exception &e) {
+      cerr << "Error running " << args[0] << ": " << e.what() << endl;
+      return 1;
+    }
+  }
+
+  // Is there a server answering on the socket at addr? Throws if there is something
+  // there, but we can't tell.
+  bool ServerAnswers (const string &path, const sockaddr_un &addr)
+  {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+      throw runtime_error(string("Unable to make a socket: ") + strerror(errno));
+    bool answers = connect(probe, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    int why = errno;
+    close(probe);
+    if (!answers && why != ECONNREFUSED)
+      throw runtime_error("Unable to tell if a server is using '" + path + "': " + strerror(why));
+    return answers;
+  }
+
+  // Only the user running the server may use it.
+  bool FromSameUser (int conn)
+  {
+#ifdef SO_PEERCRED
+    ucred peer;
+    socklen_t len = sizeof(peer);
+    return getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &peer, &len) == 0 && peer.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(conn, &uid, &gid) == 0 && uid == getuid();
+#endif
+  }
+
+  // A client that connects and then says nothing gives up its turn after this long.
+  void SetReadTimeout (int conn, int seconds)
+  {
+    timeval t;
+    t.tv_sec = seconds;
+    t.tv_usec = 0;
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &t, sizeof(t));
+  }
+
+  // A run reports back the text input files it loaded (see LoadedInputFiles), and they are
+  // parsed here, so the next run starts with them. Nothing is parsed before a run: the run
+  // doesn't wait for it, and only files the tool took as inputs are parsed.
+  void PreloadReportedInputs (int report)
+  {
+    vector<string> files;
+    try {
+      files = ReadStrings(report);
+    } catch (exception &) {
+      // The run died before it could say.
+    }
+    close(report);
+    for (size_t i = 0; i < files.size(); i++)
+      PreloadInputFile(files[i]);
+  }
+}
+#endif
+
+namespace BTagCombination {
+
+  void ServeTools (const string &socketPath, const map<string, ToolMain> &tools, int requestTimeout)
+  {
+#ifdef _WIN32
+    throw runtime_error("The tool server is not available on Windows.");
+#else
+    // The server changes directory for each request, so hang on to the full path.
+    string path (socketPath);
+    if (path.size() > 0 && path[0] != '/') {
+      char cwd[4096];
+      if (getcwd(cwd, sizeof(cwd)) == 0)
+	throw runtime_error("Unable to find the working directory.");
+      path = string(cwd) + "/" + path;
+    }
+    sockaddr_un addr (SocketAddress(path));
+
+    // A socket left by a server that died can go - a live server, or anything else, is
+    // left alone.
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+      if (ServerAnswers(path, addr))
+	throw runtime_error("A server is already running on '" + path + "'.");
+      unlink(path.c_str());
+    }
+
+    // No one can connect until listen, so the socket is never open to other users.
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0
+	|| bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+	|| chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0
+	|| listen(listener, 16) != 0) {
+      string why (strerror(errno));
+      if (listener >= 0)
+	close(listener);
+      throw runtime_error("Unable to listen on '" + path + "': " + why);
+    }
+
+    KeepParsedInputs();
+
+    // The runs report back to the client themselves - the server need not wait for them.
+    signal(SIGCHLD, SIG_IGN);
+
+    // The ends of the pipes the runs report their inputs on.
+    vector<int> reports;
+
+    cout << "Serving on " << path << endl;
+    while (true) {
+      // Wait for a request, or for a run to report.
+      vector<pollfd> waiting (reports.size() + 1);
+      waiting[0].fd = listener;
+      waiting[0].events = POLLIN;
+      for (size_t i = 0; i < reports.size(); i++) {
+	waiting[i+1].fd = reports[i];
+	waiting[i+1].events = POLLIN;
+      }
+      if (poll(&waiting[0], waiting.size(), -1) < 0) {
+	if (errno == EINTR)
+	  continue;
+	string why (strerror(errno));
+	CloseAll(reports);
+	close(listener);
+	unlink(path.c_str());
+	throw runtime_error("Unable to wait for a connection on '" + path + "': " + why);
+      }
+      for (size_t i = reports.size(); i > 0; i--) {
+	if (waiting[i].revents != 0) {
+	  PreloadReportedInputs(reports[i-1]);
+	  reports.erase(reports.begin() + (i-1));
+	}
+      }
+      if (waiting[0].revents == 0)
+	continue;
+
+      int conn = accept(listener, 0, 0);
+      if (conn < 0) {
+	if (errno == EINTR)
+	  continue;
+	string why (strerror(errno));
+	CloseAll(reports);
+	close(listener);
+	unlink(path.c_str());
+	throw runtime_error("Unable to accept a connection on '" + path + "': " + why);
+      }
+
+      if (!FromSameUser(conn)) {
+	cout << "Ignoring a request from another user." << endl;
+	close(conn);
+	continue;
+      }
+      SetReadTimeout(conn, requestTimeout);
+
+      int fds[3];
+      int nfds = ReceiveFds(conn, fds, 3);
+      vector<string> request;
+      try {
+	request = ReadStrings(conn);
+      } catch (exception &) {
+	request.clear();
+      }
+      if (nfds != 3 || request.size() < 2) {
+	cout << "Ignoring a bad request." << endl;
+	CloseAll(fds, nfds);
+	close(conn);
+	continue;
+      }
+
+      string cwd (request[0]);
+      vector<string> args (request.begin()+1, request.end());
+
+      if (args.size() == 1 && args[0] == "--stop") {
+	cout << "Stopping." << endl;
+	int32_t code = 0;
+	try {
+	  WriteAll(conn, &code, sizeof(code));
+	} catch (exception &) {
+	}
+	CloseAll(fds, nfds);
+	close(conn);
+	break;
+      }
+
+      cout << args[0] << " in " << cwd << endl;
+
+      int report[2];
+      if (pipe(report) != 0) {
+	report[0] = -1;
+	report[1] = -1;
+      }
+
+      // Flush first, or whatever is waiting to go out would be written by both processes.
+      cout.flush();
+      cerr.flush();
+      fflush(0);
+      pid_t pid = fork();
+      if (pid == 0) {
+	close(listener);
+	CloseAll(reports);
+	if (report[0] >= 0)
+	  close(report[0]);
+	for (int i = 0; i < 3; i++)
+	  dup2(fds[i], i);
+	CloseAll(fds, nfds);
+	signal(SIGCHLD, SIG_DFL);
+
+	int32_t code = RunTool(tools, cwd, args);
+
+	// Leave with _exit, so none of the server's clean up runs here.
+	cout.flush();
+	cerr.flush();
+	fflush(0);
+	FlushTrace();
+	try {
+	  WriteAll(conn, &code, sizeof(code));
+	} catch (exception &) {
+	}
+	try {
+	  if (report[1] >= 0)
+	    WriteStrings(report[1], LoadedInputFiles());
+	} catch (exception &) {
+	}
+	_exit(code);
+      }
+      if (pid < 0)
+	cout << "Unable to start a process for " << args[0] << ": " << strerror(errno) << endl;
+
+      if (report[1] >= 0)
+	close(report[1]);
+      if (pid > 0 && report[0] >= 0)
+	reports.push_back(report[0]);
+      else if (report[0] >= 0)
+	close(report[0]);
+
+      CloseAll(fds, nfds);
+      close(conn);
+    }
+
+    CloseAll(reports);
+    close(listener);
+    unlink(path.c_str());
+#endif
+  }
+}
@@ -0,0 +1,207 @@
+//
+// Record spans and write them out in the Chrome trace event format.
+//
+
+#include "Combination/Tracing.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  struct TraceEvent {
+    const char *name;
+    string detail;
+    long long start;
+    long long duration;
+    int thread;
+  };
+
+  // Write out every so often so a long run doesn't pile up memory.
+  const size_t cFlushEvents = 10000;
+
+  mutex gLock;
+  vector<TraceEvent> gEvents;
+  string gFileName;
+  bool gHandlersRegistered = false;
+
+  atomic<int> gNextThread (0);
+  thread_local int tThread = -1;
+
+  int ThisThread ()
+  {
+    if (tThread < 0)
+      tThread = gNextThread++;
+    return tThread;
+  }
+
+  // Microseconds on the steady clock. It is the same clock in every process, so the
+  // spans from forked processes line up.
+  long long Now ()
+  {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  int ProcessId ()
+  {
+#ifndef _WIN32
+    return getpid();
+#else
+    return _getpid();
+#endif
+  }
+
+  string Escape (const string &s)
+  {
+    string r;
+    for (size_t i = 0; i < s.size(); i++) {
+      char c = s[i];
+      if (c == '"' || c == '\\') {
+	r += '\\';
+	r += c;
+      } else if ((unsigned char) c < 0x20) {
+	r += ' ';
+      } else {
+	r += c;
+      }
+    }
+    return r;
+  }
+
+  // Append to the trace file. The file is a JSON array that is never closed (which the
+  // trace viewers allow), so any process can add to it. Each batch goes out in a single
+  // append, so batches from different processes don't get mixed up.
+  void Append (const string &text)
+  {
+#ifndef _WIN32
+    int fd = open(gFileName.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0)
+      return;
+    const char *b = text.data();
+    size_t n = text.size();
+    while (n > 0) {
+      ssize_t w = write(fd, b, n);
+      if (w <= 0)
+	break;
+      b += w;
+      n -= w;
+    }
+    close(fd);
+#else
+    ofstream out (gFileName.c_str(), ios::app | ios::binary);
+    out << text;
+#endif
+  }
+
+  // Write out the buffered events. gLock must be held.
+  void WriteEvents ()
+  {
+    if (gEvents.size() == 0 || gFileName == "")
+      return;
+
+    int pid = ProcessId();
+    ostringstream out;
+    for (size_t i = 0; i < gEvents.size(); i++) {
+      const TraceEvent &e (gEvents[i]);
+      out << "{\"name\":\"" << Escape(e.name) << "\",\"cat\":\"ft\",\"ph\":\"X\""
+	  << ",\"ts\":" << e.start << ",\"dur\":" << e.duration
+	  << ",\"pid\":" << pid << ",\"tid\":" << e.thread;
+      if (e.detail.size() > 0)
+	out << ",\"args\":{\"detail\":\"" << Escape(e.detail) << "\"}";
+      out << "},\n";
+    }
+    gEvents.clear();
+    Append(out.str());
+  }
+
+  void FlushAtExit ()
+  {
+    FlushTrace();
+  }
+
+#ifndef _WIN32
+  // Across a fork: make sure no one holds the lock, and the child forgets the parent's
+  // events (the parent will write those).
+  void BeforeFork () { gLock.lock(); }
+  void AfterForkInParent () { gLock.unlock(); }
+  void AfterForkInChild ()
+  {
+    gEvents.clear();
+    gLock.unlock();
+  }
+#endif
+}
+
+namespace BTagCombination {
+
+  namespace Tracing {
+    atomic<bool> gEnabled (false);
+  }
+
+  void StartTracing (const string &fileName)
+  {
+    lock_guard<mutex> l (gLock);
+    WriteEvents();
+
+    gFileName = fileName;
+    ofstream out (fileName.c_str(), ios::trunc);
+    out << "[\n";
+    if (!out)
+      throw runtime_error("Unable to write the trace file '" + fileName + "'.");
+
+    if (!gHandlersRegistered) {
+      atexit(FlushAtExit);
+#ifndef _WIN32
+      pthread_atfork(BeforeFork, AfterForkInParent, AfterForkInChild);
+#endif
+      gHandlersRegistered = true;
+    }
+    Tracing::gEnabled = true;
+  }
+
+  void FlushTrace ()
+  {
+    lock_guard<mutex> l (gLock);
+    WriteEvents();
+  }
+
+  void TraceSpan::Start (const char *name, const string *detail)
+  {
+    _name = name;
+    if (detail != 0)
+      _detail = *detail;
+    _start = Now();
+  }
+
+  void TraceSpan::Stop ()
+  {
+    TraceEvent e;
+    e.name = _name;
+    e.detail.swap(_detail);
+    e.start = _start;
+    e.duration = Now() - _start;
+    e.thread = ThisThread();
+    _name = 0;
+
+    lock_guard<mutex> l (gLock);
+    gEvents.push_back(e);
+    if (gEvents.size() >= cFlushEvents)
+      WriteEvents();
+  }
+}
@@ -0,0 +1,520 @@
+///
+/// FTBenchmark
+///
+///  Time the expensive parts of the package - parsing, filtering, building the
+/// covariance matrix, fitting, combining, rebinning and converting to the CDI -
+/// on generated inputs of a few sizes. The results are written as JSON (or CSV)
+/// so they can be compared between versions.
+///
+///  For each benchmark we report, per iteration, the wall time, the CPU time,
+/// and the number and size of memory allocations. The peak RSS is that of the
+/// whole process so far - run one benchmark at a time (--filter) for a peak that
+/// belongs to it alone.
+///
+///  Not built by default: "make bench" (CMT) builds it.
+///
+
+#include "Combination/Parser.h"
+#include "Combination/CommonCommandLineUtils.h"
+#include "Combination/Combiner.h"
+#include "Combination/CombinationContext.h"
+#include "Combination/Measurement.h"
+#include "Combination/MeasurementUtils.h"
+#include "Combination/CDIConverter.h"
+#include "Combination/BinNameUtils.h"
+#include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/SyntheticInputs.h"
+
+#include <RooMsgService.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+using namespace BTagCombination;
+
+//
+// Count every allocation made by the process.
+//
+
+namespace {
+  atomic<long long> gAllocations (0);
+  atomic<long long> gAllocatedBytes (0);
+}
+
+void *operator new (size_t size)
+{
+  gAllocations++;
+  gAllocatedBytes += size;
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == 0)
+    throw bad_alloc();
+  return p;
+}
+
+void *operator new[] (size_t size)
+{
+  return operator new (size);
+}
+
+void operator delete (void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[] (void *p) noexcept
+{
+  free(p);
+}
+
+void usage (void);
+
+namespace {
+
+  // What one benchmark measured, per iteration.
+  struct BenchResult {
+    string name;
+    string params;
+    long long iterations;
+    double wall;
+    double cpu;
+    double allocations;
+    double allocatedBytes;
+    long peakRSS; // kB
+  };
+
+  long PeakRSS (void)
+  {
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+      return usage.ru_maxrss;
+#endif
+    return 0;
+  }
+
+  //
+  // Run body until at least minTime seconds have gone by (and at least once, after
+  // one untimed call to warm up).
+  //
+  BenchResult RunBenchmark (const string &name, const string &params, double minTime, const function<void (void)> &body)
+  {
+    body();
+
+    long long allocations = gAllocations;
+    long long bytes = gAllocatedBytes;
+    clock_t cpuStart = clock();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    long long iterations = 0;
+    double wall = 0.0;
+    do {
+      body();
+      iterations++;
+      wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (wall < minTime);
+
+    BenchResult r;
+    r.name = name;
+    r.params = params;
+    r.iterations = iterations;
+    r.wall = wall / iterations;
+    r.cpu = double(clock() - cpuStart) / CLOCKS_PER_SEC / iterations;
+    r.allocations = double(gAllocations - allocations) / iterations;
+    r.allocatedBytes = double(gAllocatedBytes - bytes) / iterations;
+    r.peakRSS = PeakRSS();
+    return r;
+  }
+
+  //
+  // Generated inputs. The same numbers every time.
+  //
+
+  CalibrationBinBoundary Boundary (const string &variable, double low, double high)
+  {
+    CalibrationBinBoundary b;
+    b.variable = variable;
+    b.lowvalue = low;
+    b.highvalue = high;
+    return b;
+  }
+
+  // nAnalyses analyses of one flavor/tagger/op/jet, each with nBins pt bins (and one
+  // abseta bin) and the same nSys systematic errors.
+  CalibrationInfo MakeInfo (size_t nAnalyses, size_t nBins, size_t nSys)
+  {
+    SyntheticInputSpec spec;
+    spec.seed = 1234;
+    spec.nAnalyses = nAnalyses;
+    spec.nPtBins = nBins;
+    spec.nSys = nSys;
+    spec.sharedSysFraction = 1.0;
+    spec.correlationDensity = 0.0;
+    spec.defaults = false;
+    return GenerateSyntheticInputs(spec);
+  }
+
+  string Params (size_t nAnalyses, size_t nBins, size_t nSys)
+  {
+    ostringstream p;
+    p << "analyses=" << nAnalyses << ",bins=" << nBins << ",sys=" << nSys;
+    return p.str();
+  }
+
+  void WriteFile (const string &name, const string &text)
+  {
+    ofstream out (name.c_str());
+    out << text;
+    if (!out)
+      throw runtime_error("Unable to write the benchmark input file " + name);
+  }
+
+  //
+  // The benchmarks. Each adds its results to the list.
+  //
+
+  typedef vector<BenchResult> t_results;
+
+  void BenchParse (t_results &results, double minTime)
+  {
+    size_t sizes[][3] = { {2, 5, 5}, {5, 20, 20}, {10, 40, 60} };
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+      ostringstream text;
+      text << MakeInfo(sizes[i][0], sizes[i][1], sizes[i][2]);
+      string input (text.str());
+      results.push_back(RunBenchmark("Parse", Params(sizes[i][0], sizes[i][1], sizes[i][2]), minTime,
+				     [&] () { Parse(input); }));
+    }
+  }
+
+  // Load a file from the command line, with the top half of the bins of each analysis
+  // ignored - by name for half the analyses, from an ignore file for the rest.
+  void BenchParseOPInputArgs (t_results &results, double minTime)
+  {
+    size_t nAnalyses = 5, nBins = 20, nSys = 20;
+    CalibrationInfo info (MakeInfo(nAnalyses, nBins, nSys));
+    ostringstream text;
+    text << info;
+
+    string inputFile ("FTBenchmark-input.txt");
+    string ignoreFile ("FTBenchmark-ignore.txt");
+    WriteFile(inputFile, text.str());
+
+    vector<string> args;
+    args.push_back(inputFile);
+    ostringstream ignores;
+    for (size_t a = 0; a < info.Analyses.size(); a++) {
+      for (size_t b = nBins/2; b < nBins; b++) {
+	string name (OPIgnoreFormat(info.Analyses[a], info.Analyses[a].bins[b]));
+	if (a % 2 == 0) {
+	  args.push_back("--ignore");
+	  args.push_back(name);
+	} else {
+	  ignores << name << endl;
+	}
+      }
+    }
+    WriteFile(ignoreFile, ignores.str());
+    args.push_back("--ignore");
+    args.push_back("@" + ignoreFile);
+
+    try {
+      results.push_back(RunBenchmark("ParseOPInputArgs", Params(nAnalyses, nBins, nSys) + ",ignored=half", minTime,
+				     [&] () {
+				       CalibrationInfo loaded;
+				       vector<string> otherFlags;
+				       ParseOPInputArgs(args, loaded, otherFlags);
+				     }));
+    } catch (...) {
+      remove(inputFile.c_str());
+      remove(ignoreFile.c_str());
+      throw;
+    }
+    remove(inputFile.c_str());
+    remove(ignoreFile.c_str());
+  }
+
+  // Fill a context with nMeas measurements of 4 bins, each with nSys errors.
+  void FillContext (CombinationContext &ctx, size_t nMeas, size_t nSys, vector<Measurement*> &measurements)
+  {
+    mt19937 rng (4321);
+    uniform_real_distribution<double> value (0.9, 1.1), stat (0.02, 0.08), sys (0.005, 0.03);
+    for (size_t m = 0; m < nMeas; m++) {
+      ostringstream name, what;
+      name << "m" << m;
+      what << "bin" << m % 4;
+      Measurement *meas = ctx.AddMeasurement(name.str(), what.str(), -10.0, 10.0, value(rng), stat(rng));
+      for (size_t s = 0; s < nSys; s++) {
+	ostringstream sname;
+	sname << "sys" << s;
+	meas->addSystematicAbs(sname.str(), sys(rng));
+      }
+      measurements.push_back(meas);
+    }
+  }
+
+  string ContextParams (size_t nMeas, size_t nSys)
+  {
+    ostringstream p;
+    p << "measurements=" << nMeas << ",sys=" << nSys;
+    return p.str();
+  }
+
+  void BenchCovarMatrix (t_results &results, double minTime)
+  {
+    size_t sizes[][2] = { {10, 10}, {50, 50}, {200, 50} };
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+      CombinationContext ctx;
+      vector<Measurement*> measurements;
+      FillContext(ctx, sizes[i][0], sizes[i][1], measurements);
+      results.push_back(RunBenchmark("CalcCovarMatrixUsingComposition", ContextParams(sizes[i][0], sizes[i][1]), minTime,
+				     [&] () { CalcCovarMatrixUsingComposition(measurements); }));
+    }
+  }
+
+  // A context can only be fit once, so filling it is part of what is timed.
+  void BenchFit (t_results &results, double minTime)
+  {
+    size_t sizes[][2] = { {4, 2}, {8, 5}, {20, 20}, {40, 40} };
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+      size_t nMeas = sizes[i][0], nSys = sizes[i][1];
+      results.push_back(RunBenchmark("CombinationContext::Fit", ContextParams(nMeas, nSys) + ",includes=fill", minTime,
+				     [&] () {
+				       CombinationContext ctx;
+				       ctx.SetVerbose(false);
+				       vector<Measurement*> measurements;
+				       FillContext(ctx, nMeas, nSys, measurements);
+				       ctx.Fit();
+				     }));
+    }
+  }
+
+  void BenchCombine (t_results &results, double minTime)
+  {
+    size_t sizes[][3] = { {2, 3, 3}, {3, 8, 10} };
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+      CalibrationInfo info (MakeInfo(sizes[i][0], sizes[i][1], sizes[i][2]));
+      string params (Params(sizes[i][0], sizes[i][1], sizes[i][2]));
+      results.push_back(RunBenchmark("CombineAnalyses", params + ",mode=full", minTime,
+				     [&] () { CombineAnalyses(info, false, kCombineByFullAnalysis); }));
+      results.push_back(RunBenchmark("CombineAnalyses", params + ",mode=bin", minTime,
+				     [&] () { CombineAnalyses(info, false, kCombineBySingleBin); }));
+    }
+  }
+
+  // Rebin into bins twice as wide.
+  void BenchRebin (t_results &results, double minTime)
+  {
+    size_t nBins = 20, nSys = 20;
+    CalibrationInfo info (MakeInfo(1, nBins, nSys));
+    set<set<CalibrationBinBoundary> > templateBinning;
+    const vector<CalibrationBin> &bins (info.Analyses[0].bins);
+    for (size_t b = 0; b+1 < bins.size(); b += 2) {
+      set<CalibrationBinBoundary> bin;
+      bin.insert(Boundary("pt", bins[b].binSpec[0].lowvalue, bins[b+1].binSpec[0].highvalue));
+      bin.insert(bins[b].binSpec[1]);
+      templateBinning.insert(bin);
+    }
+    results.push_back(RunBenchmark("RebinAnalysis", Params(1, nBins, nSys) + ",merge=2", minTime,
+				   [&] () { RebinAnalysis(templateBinning, info.Analyses[0]); }));
+  }
+
+  void BenchConvertToCDI (t_results &results, double minTime)
+  {
+    size_t sizes[][2] = { {5, 5}, {20, 40} };
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+      CalibrationInfo info (MakeInfo(1, sizes[i][0], sizes[i][1]));
+      results.push_back(RunBenchmark("ConvertToCDI", Params(1, sizes[i][0], sizes[i][1]), minTime,
+				     [&] () { delete ConvertToCDI(info.Analyses[0], "bench"); }));
+    }
+  }
+
+  // The end-to-end steps on a real (or FTGenerateSynthetic) input file.
+  void BenchInputFile (t_results &results, double minTime, const string &fname, const string &filter)
+  {
+    ifstream in (fname.c_str());
+    if (!in.is_open())
+      throw runtime_error("Unable to open the input file " + fname);
+    ostringstream text;
+    text << in.rdbuf();
+    string input (text.str());
+
+    string params ("input=" + fname);
+    if (filter == "" || string("Parse").find(filter) != string::npos)
+      results.push_back(RunBenchmark("Parse", params, minTime,
+				     [&] () { Parse(input); }));
+
+    if (filter == "" || string("CombineAnalyses").find(filter) != string::npos) {
+      CalibrationInfo info (Parse(input));
+      results.push_back(RunBenchmark("CombineAnalyses", params + ",mode=full", minTime,
+				     [&] () { CombineAnalyses(info, false, kCombineByFullAnalysis); }));
+      results.push_back(RunBenchmark("CombineAnalyses", params + ",mode=bin", minTime,
+				     [&] () { CombineAnalyses(info, false, kCombineBySingleBin); }));
+    }
+  }
+
+  //
+  // Output
+  //
+
+  string JSONString (const string &s)
+  {
+    ostringstream out;
+    out << "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+      if (s[i] == '"' || s[i] == '\\')
+	out << '\\';
+      out << s[i];
+    }
+    out << "\"";
+    return out.str();
+  }
+
+  void WriteJSON (ostream &out, const t_results &results)
+  {
+    out << "{" << endl << "  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+      const BenchResult &r (results[i]);
+      out << (i == 0 ? "" : ",") << endl
+	  << "    {\"name\": " << JSONString(r.name)
+	  << ", \"params\": " << JSONString(r.params)
+	  << ", \"iterations\": " << r.iterations
+	  << ", \"wall_s\": " << r.wall
+	  << ", \"cpu_s\": " << r.cpu
+	  << ", \"allocations\": " << r.allocations
+	  << ", \"allocated_bytes\": " << r.allocatedBytes
+	  << ", \"peak_rss_kb\": " << r.peakRSS
+	  << "}";
+    }
+    out << endl << "  ]" << endl << "}" << endl;
+  }
+
+  void WriteCSV (ostream &out, const t_results &results)
+  {
+    out << "name,params,iterations,wall_s,cpu_s,allocations,allocated_bytes,peak_rss_kb" << endl;
+    for (size_t i = 0; i < results.size(); i++) {
+      const BenchResult &r (results[i]);
+      out << r.name
+	  << ",\"" << r.params << "\""
+	  << "," << r.iterations
+	  << "," << r.wall
+	  << "," << r.cpu
+	  << "," << r.allocations
+	  << "," << r.allocatedBytes
+	  << "," << r.peakRSS
+	  << endl;
+    }
+  }
+}
+
+int main (int argc, char **argv)
+{
+  string format ("json");
+  string outputName;
+  string filter;
+  string inputName;
+  double minTime = 0.5;
+
+  for (int i = 1; i < argc; i++) {
+    string a (argv[i]);
+    if (a == "--format" && i+1 < argc) {
+      format = argv[++i];
+    } else if (a == "--output" && i+1 < argc) {
+      outputName = argv[++i];
+    } else if (a == "--filter" && i+1 < argc) {
+      filter = argv[++i];
+    } else if (a == "--input" && i+1 < argc) {
+      inputName = argv[++i];
+    } else if (a == "--min-time" && i+1 < argc) {
+      minTime = atof(argv[++i]);
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (format != "json" && format != "csv") {
+    usage();
+    return 1;
+  }
+
+  RooMsgService::instance().setSilentMode(true);
+  RooMsgService::instance().setGlobalKillBelow(RooFit::ERROR);
+
+  typedef void (*t_bench)(t_results &, double);
+  struct { const char *name; t_bench run; } benchmarks[] = {
+    { "Parse", BenchParse },
+    { "ParseOPInputArgs", BenchParseOPInputArgs },
+    { "CalcCovarMatrixUsingComposition", BenchCovarMatrix },
+    { "CombinationContext::Fit", BenchFit },
+    { "CombineAnalyses", BenchCombine },
+    { "RebinAnalysis", BenchRebin },
+    { "ConvertToCDI", BenchConvertToCDI }
+  };
+
+  t_results results;
+  bool failed = false;
+  if (inputName != "") {
+    cerr << "Running on " << inputName << endl;
+    try {
+      BenchInputFile(results, minTime, inputName, filter);
+    } catch (exception &e) {
+      cerr << "Benchmark of " << inputName << " failed: " << e.what() << endl;
+      failed = true;
+    }
+  }
+
+  for (size_t i = 0; inputName == "" && i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++) {
+    if (filter != "" && string(benchmarks[i].name).find(filter) == string::npos)
+      continue;
+    cerr << "Running " << benchmarks[i].name << endl;
+    try {
+      benchmarks[i].run(results, minTime);
+    } catch (exception &e) {
+      cerr << "Benchmark " << benchmarks[i].name << " failed: " << e.what() << endl;
+      failed = true;
+    }
+  }
+
+  if (outputName == "") {
+    if (format == "json")
+      WriteJSON(cout, results);
+    else
+      WriteCSV(cout, results);
+  } else {
+    ofstream out (outputName.c_str());
+    if (format == "json")
+      WriteJSON(out, results);
+    else
+      WriteCSV(out, results);
+    if (!out) {
+      cerr << "Error writing " << outputName << endl;
+      return 1;
+    }
+  }
+
+  return failed ? 1 : 0;
+}
+
+void usage (void)
+{
+  cout << "FTBenchmark [--format json|csv] [--output <file>] [--filter <name>] [--min-time <seconds>] [--input <file>]" << endl;
+  cout << "  format - how to write the results (default json)" << endl;
+  cout << "  output - write the results to a file rather than the screen" << endl;
+  cout << "  filter - only run the benchmarks whose name contains this" << endl;
+  cout << "  min-time - run each benchmark for at least this long (default 0.5 seconds)" << endl;
+  cout << "  input - instead of the generated inputs, parse and combine this file (e.g. from FTGenerateSynthetic)" << endl;
+}
@@ -28,6 +28,10 @@ class BinBoundaryUtilsTest : public CppUnit::TestFixture
   CPPUNIT_TEST_EXCEPTION ( TestGappedBins, std::runtime_error );
   CPPUNIT_TEST_EXCEPTION(thinBins, std::runtime_error);
   CPPUNIT_TEST_EXCEPTION(totalOverlapBins, std::runtime_error);
+  CPPUNIT_TEST( testBinIndex2D );
+  CPPUNIT_TEST( testBinIndexExtrapolated );
+  CPPUNIT_TEST( testCachedCopy );
+  CPPUNIT_TEST_EXCEPTION( testCacheSeesChangedBins, std::runtime_error );
 
   CPPUNIT_TEST (TestBBOK1D);
   CPPUNIT_TEST (TestBBOK1D2);
@@ -72,6 +76,86 @@ class BinBoundaryUtilsTest : public CppUnit::TestFixture
     bin_boundaries result (calcBoundaries(ana));
   }
 
+  // A 2x2 grid of pt/eta bins, listed out of order.
+  CalibrationAnalysis makeGrid()
+  {
+    CalibrationAnalysis ana;
+    ana.name = "grid";
+    double pt[] = {20.0, 30.0, 30.0, 20.0};
+    double eta[] = {0.0, 1.2, 0.0, 1.2};
+    for (int i = 0; i < 4; i++) {
+      CalibrationBin b;
+      CalibrationBinBoundary bpt, beta;
+      bpt.variable = "pt";
+      bpt.lowvalue = pt[i];
+      bpt.highvalue = pt[i] + 10.0;
+      beta.variable = "eta";
+      beta.lowvalue = eta[i];
+      beta.highvalue = eta[i] + 1.2;
+      b.binSpec.push_back(bpt);
+      b.binSpec.push_back(beta);
+      ana.bins.push_back(b);
+    }
+    return ana;
+  }
+
+  void testBinIndex2D()
+  {
+    bin_boundaries result (calcBoundaries(makeGrid()));
+
+    // Axes are in name order - eta, then pt.
+    int eta[] = {1, 2, 1, 2};
+    int pt[] = {1, 2, 2, 1};
+    for (int i = 0; i < 4; i++) {
+      vector<int> cell (result.bin_index(i));
+      CPPUNIT_ASSERT_EQUAL((size_t)2, cell.size());
+      CPPUNIT_ASSERT_EQUAL(eta[i], cell[0]);
+      CPPUNIT_ASSERT_EQUAL(pt[i], cell[1]);
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t)0, result.bin_index(4).size());
+  }
+
+  void testBinIndexExtrapolated()
+  {
+    CalibrationAnalysis ana (makeGrid());
+    ana.bins[3].isExtended = true;
+    ana.bins[3].binSpec[0].lowvalue = 40.0;
+    ana.bins[3].binSpec[0].highvalue = 100.0;
+
+    bin_boundaries result (calcBoundaries(ana));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, result.bin_index(3).size());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, result.get_axis_bins("pt").size());
+
+    bin_boundaries eresult (calcBoundaries(ana, false));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, eresult.bin_index(3).size());
+    CPPUNIT_ASSERT_EQUAL(3, eresult.bin_index(3)[1]);
+    CPPUNIT_ASSERT_EQUAL((size_t)4, eresult.get_axis_bins("pt").size());
+  }
+
+  void testCachedCopy()
+  {
+    CalibrationAnalysis ana1 (makeGrid());
+    CalibrationAnalysis ana2 (makeGrid());
+    ana2.name = "other";
+    ana2.bins[0].centralValue = 5.0;
+
+    bin_boundaries r1 (calcBoundaries(ana1));
+    bin_boundaries r2 (calcBoundaries(ana2));
+    CPPUNIT_ASSERT(r1.get_axis_bins("pt") == r2.get_axis_bins("pt"));
+    CPPUNIT_ASSERT(r1.bin_index(2) == r2.bin_index(2));
+  }
+
+  void testCacheSeesChangedBins()
+  {
+    // Once it has been seen, changing the bins must still be noticed.
+    CalibrationAnalysis ana (makeGrid());
+    bin_boundaries r1 (calcBoundaries(ana));
+
+    ana.bins[2].binSpec[0].lowvalue = 35.0;
+    ana.bins[3].binSpec[0].lowvalue = 35.0;
+    bin_boundaries result (calcBoundaries(ana));
+  }
+
   void TestOverlapBins()
   {
     CalibrationAnalysis ana;
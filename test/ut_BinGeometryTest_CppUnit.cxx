@@ -0,0 +1,497 @@
+///
+/// CppUnit tests for the bin geometry code (overlaps, etc.)
+///
+
+#include "Combination/BinGeometry.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  CalibrationBinBoundary makeBound (const string &var, double low, double high)
+  {
+    CalibrationBinBoundary b;
+    b.variable = var;
+    b.lowvalue = low;
+    b.highvalue = high;
+    return b;
+  }
+
+  BinBox box1D (double low, double high, const string &var = "pt")
+  {
+    vector<CalibrationBinBoundary> spec;
+    spec.push_back(makeBound(var, low, high));
+    return BinBox(spec);
+  }
+
+  BinBox box2D (double ptLow, double ptHigh, double etaLow, double etaHigh)
+  {
+    vector<CalibrationBinBoundary> spec;
+    spec.push_back(makeBound("pt", ptLow, ptHigh));
+    spec.push_back(makeBound("abseta", etaLow, etaHigh));
+    return BinBox(spec);
+  }
+
+  // The slow way of doing it.
+  vector<pair<size_t, size_t> > bruteForceOverlaps (const vector<BinBox> &boxes)
+  {
+    vector<pair<size_t, size_t> > r;
+    for (size_t i = 0; i < boxes.size(); i++) {
+      for (size_t j = i+1; j < boxes.size(); j++) {
+	bool same = boxes[i].low == boxes[j].low && boxes[i].high == boxes[j].high;
+	if (BoxesOverlap(boxes[i], boxes[j]) && !same)
+	  r.push_back(make_pair(i, j));
+      }
+    }
+    return r;
+  }
+}
+
+class BinGeometryTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( BinGeometryTest );
+
+  CPPUNIT_TEST( testBoxAxesSorted );
+  CPPUNIT_TEST( testBoxRepeatedAxis );
+  CPPUNIT_TEST( testOverlapTouching );
+  CPPUNIT_TEST( testOverlapDifferentAxes );
+  CPPUNIT_TEST( testNoBins );
+  CPPUNIT_TEST( testIdenticalBinsDoNotConflict );
+  CPPUNIT_TEST( testPartialOverlap1D );
+  CPPUNIT_TEST( testGrid2DNoOverlap );
+  CPPUNIT_TEST( testAllPairsReported );
+  CPPUNIT_TEST( testCalibrationBins );
+  CPPUNIT_TEST( testRandomAgainstBruteForce );
+  CPPUNIT_TEST( testSharedFirstAxis );
+  CPPUNIT_TEST( testRandom3DAgainstBruteForce );
+  CPPUNIT_TEST( testCoverageExact1D );
+  CPPUNIT_TEST( testCoverageRounding );
+  CPPUNIT_TEST( testCoverageGap );
+  CPPUNIT_TEST( testCoverageOverlap );
+  CPPUNIT_TEST( testCoverageExact2D );
+  CPPUNIT_TEST( testCoverageGap2D );
+  CPPUNIT_TEST( testCoverageBatched );
+  CPPUNIT_TEST_EXCEPTION( testCoverageWrongAxes, std::runtime_error );
+  CPPUNIT_TEST( testLookupEmpty );
+  CPPUNIT_TEST( testLookup1D );
+  CPPUNIT_TEST( testLookupNotContained );
+  CPPUNIT_TEST( testLookup2D );
+  CPPUNIT_TEST( testLookupDifferentAxes );
+  CPPUNIT_TEST( testLookupOverlappingTemplates );
+  CPPUNIT_TEST( testLookupExact );
+  CPPUNIT_TEST( testLookupFromSet );
+  CPPUNIT_TEST( testLookupRandomAgainstScan );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  void testBoxAxesSorted()
+  {
+    BinBox b (box2D(20.0, 30.0, 0.0, 1.2));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, b.dimension());
+    CPPUNIT_ASSERT_EQUAL(string("abseta"), b.axes[0]);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.2, b.high[0], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(20.0, b.low[1], 0.0001);
+    CPPUNIT_ASSERT(!b.repeatedAxis);
+  }
+
+  void testBoxRepeatedAxis()
+  {
+    vector<CalibrationBinBoundary> spec;
+    spec.push_back(makeBound("pt", 0.0, 10.0));
+    spec.push_back(makeBound("pt", 5.0, 15.0));
+    BinBox b (spec);
+    CPPUNIT_ASSERT(b.repeatedAxis);
+    CPPUNIT_ASSERT(!BoxesOverlap(b, box1D(0.0, 20.0)));
+  }
+
+  void testOverlapTouching()
+  {
+    CPPUNIT_ASSERT(!BoxesOverlap(box1D(0.0, 10.0), box1D(10.0, 20.0)));
+    CPPUNIT_ASSERT(!BoxesOverlap(box1D(10.0, 20.0), box1D(0.0, 10.0)));
+    CPPUNIT_ASSERT(BoxesOverlap(box1D(0.0, 10.0), box1D(9.0, 20.0)));
+  }
+
+  void testOverlapDifferentAxes()
+  {
+    CPPUNIT_ASSERT(!BoxesOverlap(box1D(0.0, 10.0, "pt"), box1D(0.0, 10.0, "eta")));
+    CPPUNIT_ASSERT(!BoxesOverlap(box1D(0.0, 10.0), box2D(0.0, 10.0, 0.0, 1.0)));
+  }
+
+  void testNoBins()
+  {
+    vector<BinBox> boxes;
+    CPPUNIT_ASSERT_EQUAL((size_t)0, FindPartialOverlaps(boxes).size());
+  }
+
+  void testIdenticalBinsDoNotConflict()
+  {
+    vector<BinBox> boxes;
+    boxes.push_back(box1D(0.0, 10.0));
+    boxes.push_back(box1D(0.0, 10.0));
+    boxes.push_back(box1D(10.0, 20.0));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, FindPartialOverlaps(boxes).size());
+  }
+
+  void testPartialOverlap1D()
+  {
+    vector<BinBox> boxes;
+    boxes.push_back(box1D(0.0, 10.0));
+    boxes.push_back(box1D(10.0, 20.0));
+    boxes.push_back(box1D(5.0, 15.0));
+    vector<pair<size_t, size_t> > r (FindPartialOverlaps(boxes));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, r[0].first);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r[0].second);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r[1].first);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r[1].second);
+  }
+
+  void testGrid2DNoOverlap()
+  {
+    vector<BinBox> boxes;
+    for (int ipt = 0; ipt < 5; ipt++) {
+      for (int ieta = 0; ieta < 4; ieta++) {
+	boxes.push_back(box2D(20.0*ipt, 20.0*(ipt+1), 0.5*ieta, 0.5*(ieta+1)));
+	boxes.push_back(box2D(20.0*ipt, 20.0*(ipt+1), 0.5*ieta, 0.5*(ieta+1)));
+      }
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t)0, FindPartialOverlaps(boxes).size());
+  }
+
+  void testAllPairsReported()
+  {
+    // One wide bin sitting on top of three narrow ones.
+    vector<BinBox> boxes;
+    boxes.push_back(box2D(0.0, 10.0, 0.0, 1.0));
+    boxes.push_back(box2D(10.0, 20.0, 0.0, 1.0));
+    boxes.push_back(box2D(20.0, 30.0, 0.0, 1.0));
+    boxes.push_back(box2D(0.0, 30.0, 0.5, 1.5));
+    vector<pair<size_t, size_t> > r (FindPartialOverlaps(boxes));
+    CPPUNIT_ASSERT_EQUAL((size_t)3, r.size());
+    for (size_t i = 0; i < r.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(i, r[i].first);
+      CPPUNIT_ASSERT_EQUAL((size_t)3, r[i].second);
+    }
+  }
+
+  void testCalibrationBins()
+  {
+    CalibrationBin b1, b2;
+    b1.binSpec.push_back(makeBound("pt", 0.0, 10.0));
+    b2.binSpec.push_back(makeBound("pt", 5.0, 10.0));
+    vector<const CalibrationBin*> bins;
+    bins.push_back(&b1);
+    bins.push_back(&b2);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, FindPartialOverlaps(bins).size());
+  }
+
+  void testRandomAgainstBruteForce()
+  {
+    srand(1234);
+    for (int trial = 0; trial < 20; trial++) {
+      vector<BinBox> boxes;
+      for (int i = 0; i < 60; i++) {
+	double x = rand() % 10;
+	double y = rand() % 5;
+	double dx = 1 + rand() % 3;
+	double dy = rand() % 3;
+	if (rand() % 4 == 0) {
+	  boxes.push_back(box1D(x, x+dx));
+	} else {
+	  boxes.push_back(box2D(x, x+dx, y, y+dy));
+	}
+      }
+      vector<pair<size_t, size_t> > expected (bruteForceOverlaps(boxes));
+      vector<pair<size_t, size_t> > found (FindPartialOverlaps(boxes));
+      CPPUNIT_ASSERT_EQUAL(expected.size(), found.size());
+      CPPUNIT_ASSERT(expected == found);
+    }
+  }
+
+  // Everything is in the same eta bin, so only the pt sweep separates them.
+  void testSharedFirstAxis()
+  {
+    vector<BinBox> boxes;
+    for (int ipt = 0; ipt < 50; ipt++)
+      boxes.push_back(box2D(10.0*ipt, 10.0*(ipt+1), 0.0, 2.5));
+    boxes.push_back(box2D(15.0, 25.0, 0.0, 2.5));
+    vector<pair<size_t, size_t> > r (FindPartialOverlaps(boxes));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.size());
+    CPPUNIT_ASSERT(r[0] == make_pair((size_t)1, (size_t)50));
+    CPPUNIT_ASSERT(r[1] == make_pair((size_t)2, (size_t)50));
+  }
+
+  void testRandom3DAgainstBruteForce()
+  {
+    srand(4321);
+    for (int trial = 0; trial < 20; trial++) {
+      vector<BinBox> boxes;
+      for (int i = 0; i < 60; i++) {
+	vector<CalibrationBinBoundary> spec;
+	double x = rand() % 10;
+	double y = rand() % 5;
+	double z = rand() % 3;
+	spec.push_back(makeBound("pt", x, x + 1 + rand() % 3));
+	spec.push_back(makeBound("abseta", y, y + rand() % 3));
+	spec.push_back(makeBound("mv1", z, z + 1 + rand() % 2));
+	boxes.push_back(BinBox(spec));
+      }
+      vector<pair<size_t, size_t> > expected (bruteForceOverlaps(boxes));
+      vector<pair<size_t, size_t> > found (FindPartialOverlaps(boxes));
+      CPPUNIT_ASSERT_EQUAL(expected.size(), found.size());
+      CPPUNIT_ASSERT(expected == found);
+    }
+  }
+
+  void testCoverageExact1D()
+  {
+    vector<BinBox> pieces;
+    pieces.push_back(box1D(20.0, 30.0));
+    pieces.push_back(box1D(0.0, 20.0));
+    CPPUNIT_ASSERT(CheckCoverage(box1D(0.0, 30.0), pieces).exact());
+  }
+
+  void testCoverageRounding()
+  {
+    // Summing the widths of these doesn't give exactly 0.3.
+    vector<BinBox> pieces;
+    pieces.push_back(box1D(0.0, 0.1));
+    pieces.push_back(box1D(0.1, 0.2));
+    pieces.push_back(box1D(0.2, 0.3));
+    CPPUNIT_ASSERT(CheckCoverage(box1D(0.0, 0.3), pieces).exact());
+  }
+
+  void testCoverageGap()
+  {
+    vector<BinBox> pieces;
+    pieces.push_back(box1D(0.0, 10.0));
+    pieces.push_back(box1D(20.0, 30.0));
+    BinCoverage r (CheckCoverage(box1D(0.0, 30.0), pieces));
+    CPPUNIT_ASSERT(!r.exact());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.gaps.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, r.overlaps.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, r.gaps[0].low[0], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(20.0, r.gaps[0].high[0], 0.0001);
+  }
+
+  void testCoverageOverlap()
+  {
+    vector<BinBox> pieces;
+    pieces.push_back(box1D(0.0, 20.0));
+    pieces.push_back(box1D(10.0, 30.0));
+    BinCoverage r (CheckCoverage(box1D(0.0, 30.0), pieces));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, r.gaps.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.overlaps.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, r.overlaps[0].low[0], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(20.0, r.overlaps[0].high[0], 0.0001);
+  }
+
+  void testCoverageExact2D()
+  {
+    // An L shape and a square make up the area - the areas would add up
+    // even if the pieces were in the wrong place, so the edges have to be used.
+    vector<BinBox> pieces;
+    pieces.push_back(box2D(0.0, 20.0, 0.0, 1.0));
+    pieces.push_back(box2D(0.0, 10.0, 1.0, 2.0));
+    pieces.push_back(box2D(10.0, 20.0, 1.0, 2.0));
+    CPPUNIT_ASSERT(CheckCoverage(box2D(0.0, 20.0, 0.0, 2.0), pieces).exact());
+  }
+
+  void testCoverageGap2D()
+  {
+    // Same total area as the area, but one piece is doubled up and a corner is missing.
+    vector<BinBox> pieces;
+    pieces.push_back(box2D(0.0, 20.0, 0.0, 1.0));
+    pieces.push_back(box2D(0.0, 10.0, 1.0, 2.0));
+    pieces.push_back(box2D(0.0, 10.0, 1.0, 2.0));
+    BinCoverage r (CheckCoverage(box2D(0.0, 20.0, 0.0, 2.0), pieces));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.gaps.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.overlaps.size());
+    CPPUNIT_ASSERT_EQUAL(string("abseta"), r.gaps[0].axes[0]);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, r.gaps[0].low[0], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, r.gaps[0].low[1], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(20.0, r.gaps[0].high[1], 0.0001);
+  }
+
+  void testCoverageBatched()
+  {
+    vector<BinBox> pieces;
+    pieces.push_back(box1D(0.0, 10.0));
+    pieces.push_back(box1D(10.0, 20.0));
+    pieces.push_back(box1D(20.0, 25.0));
+
+    vector<BinBox> areas;
+    areas.push_back(box1D(0.0, 20.0));
+    areas.push_back(box1D(20.0, 30.0));
+
+    vector<vector<size_t> > groups(2);
+    groups[0].push_back(0);
+    groups[0].push_back(1);
+    groups[1].push_back(2);
+
+    vector<BinCoverage> r (CheckCoverage(areas, pieces, groups));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.size());
+    CPPUNIT_ASSERT(r[0].exact());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r[1].gaps.size());
+  }
+
+  void testCoverageWrongAxes()
+  {
+    vector<BinBox> pieces;
+    pieces.push_back(box1D(0.0, 10.0, "eta"));
+    CheckCoverage(box1D(0.0, 10.0), pieces);
+  }
+
+  vector<CalibrationBinBoundary> spec1D (double low, double high, const string &var = "pt")
+  {
+    return box1D(low, high, var).boundaries();
+  }
+
+  vector<CalibrationBinBoundary> spec2D (double ptLow, double ptHigh, double etaLow, double etaHigh)
+  {
+    return box2D(ptLow, ptHigh, etaLow, etaHigh).boundaries();
+  }
+
+  void testLookupEmpty()
+  {
+    BinLookupIndex idx;
+    CPPUNIT_ASSERT_EQUAL((size_t)0, idx.size());
+    CPPUNIT_ASSERT_EQUAL(-1, idx.find_containing(box1D(0.0, 1.0)));
+  }
+
+  void testLookup1D()
+  {
+    vector<vector<CalibrationBinBoundary> > t;
+    t.push_back(spec1D(20.0, 40.0));
+    t.push_back(spec1D(0.0, 20.0));
+    t.push_back(spec1D(40.0, 100.0));
+    BinLookupIndex idx(t);
+
+    CPPUNIT_ASSERT_EQUAL(1, idx.find_containing(box1D(0.0, 10.0)));
+    CPPUNIT_ASSERT_EQUAL(1, idx.find_containing(box1D(10.0, 20.0)));
+    CPPUNIT_ASSERT_EQUAL(0, idx.find_containing(box1D(20.0, 40.0)));
+    CPPUNIT_ASSERT_EQUAL(2, idx.find_containing(box1D(50.0, 100.0)));
+  }
+
+  void testLookupNotContained()
+  {
+    vector<vector<CalibrationBinBoundary> > t;
+    t.push_back(spec1D(0.0, 20.0));
+    t.push_back(spec1D(20.0, 40.0));
+    t.push_back(spec1D(60.0, 80.0));
+    BinLookupIndex idx(t);
+
+    CPPUNIT_ASSERT_EQUAL(-1, idx.find_containing(box1D(10.0, 30.0)));
+    CPPUNIT_ASSERT_EQUAL(-1, idx.find_containing(box1D(40.0, 60.0)));
+    CPPUNIT_ASSERT_EQUAL(-1, idx.find_containing(box1D(-10.0, 0.0)));
+    CPPUNIT_ASSERT_EQUAL(-1, idx.find_containing(box1D(80.0, 90.0)));
+  }
+
+  void testLookup2D()
+  {
+    vector<vector<CalibrationBinBoundary> > t;
+    for (int ipt = 0; ipt < 3; ipt++)
+      for (int ieta = 0; ieta < 2; ieta++)
+	t.push_back(spec2D(20.0*ipt, 20.0*(ipt+1), 1.0*ieta, 1.0*(ieta+1)));
+    BinLookupIndex idx(t);
+
+    CPPUNIT_ASSERT_EQUAL(3, idx.find_containing(box2D(20.0, 30.0, 1.0, 1.5)));
+    CPPUNIT_ASSERT_EQUAL(4, idx.find_containing(box2D(50.0, 60.0, 0.0, 1.0)));
+    CPPUNIT_ASSERT_EQUAL(-1, idx.find_containing(box2D(10.0, 30.0, 0.0, 1.0)));
+  }
+
+  void testLookupDifferentAxes()
+  {
+    vector<vector<CalibrationBinBoundary> > t;
+    t.push_back(spec1D(0.0, 20.0));
+    t.push_back(spec1D(0.0, 2.5, "abseta"));
+    t.push_back(spec2D(0.0, 20.0, 0.0, 2.5));
+    BinLookupIndex idx(t);
+
+    CPPUNIT_ASSERT_EQUAL(0, idx.find_containing(box1D(0.0, 10.0)));
+    CPPUNIT_ASSERT_EQUAL(1, idx.find_containing(box1D(0.0, 1.0, "abseta")));
+    CPPUNIT_ASSERT_EQUAL(2, idx.find_containing(box2D(0.0, 10.0, 0.0, 1.0)));
+    CPPUNIT_ASSERT_EQUAL(-1, idx.find_containing(box1D(0.0, 1.0, "eta")));
+  }
+
+  void testLookupOverlappingTemplates()
+  {
+    // First one in the list wins.
+    vector<vector<CalibrationBinBoundary> > t;
+    t.push_back(spec1D(0.0, 50.0));
+    t.push_back(spec1D(0.0, 20.0));
+    t.push_back(spec1D(20.0, 100.0));
+    BinLookupIndex idx(t);
+
+    CPPUNIT_ASSERT_EQUAL(0, idx.find_containing(box1D(0.0, 10.0)));
+    CPPUNIT_ASSERT_EQUAL(2, idx.find_containing(box1D(40.0, 60.0)));
+    CPPUNIT_ASSERT_EQUAL(1, idx.find_exact(box1D(0.0, 20.0)));
+  }
+
+  void testLookupExact()
+  {
+    vector<vector<CalibrationBinBoundary> > t;
+    t.push_back(spec2D(0.0, 20.0, 0.0, 1.0));
+    t.push_back(spec2D(20.0, 40.0, 0.0, 1.0));
+    BinLookupIndex idx(t);
+
+    CPPUNIT_ASSERT_EQUAL(1, idx.find_exact(spec2D(20.0, 40.0, 0.0, 1.0)));
+    CPPUNIT_ASSERT_EQUAL(-1, idx.find_exact(spec2D(20.0, 30.0, 0.0, 1.0)));
+  }
+
+  void testLookupFromSet()
+  {
+    set<set<CalibrationBinBoundary> > t;
+    vector<CalibrationBinBoundary> s1 (spec1D(20.0, 40.0));
+    vector<CalibrationBinBoundary> s2 (spec1D(0.0, 20.0));
+    t.insert(set<CalibrationBinBoundary>(s1.begin(), s1.end()));
+    t.insert(set<CalibrationBinBoundary>(s2.begin(), s2.end()));
+    BinLookupIndex idx(t);
+
+    // Ids follow the set order.
+    CPPUNIT_ASSERT_EQUAL(0, idx.find_containing(box1D(0.0, 10.0)));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(20.0, idx.binSpec(1)[0].lowvalue, 0.0001);
+  }
+
+  void testLookupRandomAgainstScan()
+  {
+    srand(4321);
+    vector<vector<CalibrationBinBoundary> > t;
+    vector<BinBox> tboxes;
+    for (int ipt = 0; ipt < 10; ipt++) {
+      for (int ieta = 0; ieta < 5; ieta++) {
+	t.push_back(spec2D(10.0*ipt, 10.0*(ipt+1), 0.5*ieta, 0.5*(ieta+1)));
+	tboxes.push_back(BinBox(t.back()));
+      }
+    }
+    BinLookupIndex idx(t);
+
+    for (int i = 0; i < 500; i++) {
+      double x = rand() % 110 - 5;
+      double y = 0.1*(rand() % 30) - 0.2;
+      BinBox b (box2D(x, x + 1 + rand() % 12, y, y + 0.1*(1 + rand() % 6)));
+      int expected = -1;
+      for (size_t j = 0; j < tboxes.size() && expected < 0; j++) {
+	bool inside = true;
+	for (size_t ax = 0; ax < 2; ax++)
+	  inside = inside && tboxes[j].low[ax] <= b.low[ax] && b.high[ax] <= tboxes[j].high[ax];
+	if (inside)
+	  expected = j;
+      }
+      CPPUNIT_ASSERT_EQUAL(expected, idx.find_containing(b));
+    }
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(BinGeometryTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
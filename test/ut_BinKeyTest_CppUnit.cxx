@@ -0,0 +1,190 @@
+///
+/// CppUnit tests for the canonical bin keys
+///
+
+#include "Combination/BinKey.h"
+#include "Combination/BinNameUtils.h"
+#include "Combination/FNVHash.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  CalibrationBinBoundary makeBound (const string &var, double low, double high)
+  {
+    CalibrationBinBoundary b;
+    b.variable = var;
+    b.lowvalue = low;
+    b.highvalue = high;
+    return b;
+  }
+
+  CalibrationBin makeBin (double ptLow, double ptHigh, double etaLow, double etaHigh)
+  {
+    CalibrationBin b;
+    b.binSpec.push_back(makeBound("pt", ptLow, ptHigh));
+    b.binSpec.push_back(makeBound("abseta", etaLow, etaHigh));
+    return b;
+  }
+}
+
+class BinKeyTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( BinKeyTest );
+
+  CPPUNIT_TEST( testInternAxis );
+  CPPUNIT_TEST( testEmpty );
+  CPPUNIT_TEST( testEqual );
+  CPPUNIT_TEST( testOrderDoesNotMatter );
+  CPPUNIT_TEST( testNotEqual );
+  CPPUNIT_TEST( testNegativeZero );
+  CPPUNIT_TEST( testFromSet );
+  CPPUNIT_TEST( testDuplicateBoundary );
+  CPPUNIT_TEST( testName );
+  CPPUNIT_TEST( testBinSpec );
+  CPPUNIT_TEST( testLessThan );
+  CPPUNIT_TEST( testUnorderedMap );
+  CPPUNIT_TEST( testFNV1a64 );
+  CPPUNIT_TEST( testFNV1a64Seed );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  // The published FNV-1a test values - saved hashes depend on these.
+  void testFNV1a64()
+  {
+    CPPUNIT_ASSERT_EQUAL(14695981039346656037ULL, FNV1a64("", 0));
+    CPPUNIT_ASSERT_EQUAL(0xaf63dc4c8601ec8cULL, FNV1a64("a", 1));
+    CPPUNIT_ASSERT_EQUAL(0x85944171f73967e8ULL, FNV1a64("foobar", 6));
+    CPPUNIT_ASSERT_EQUAL(0x0a9a2607b6f6e56aULL, FNV1a64("\xff\x80", 2));
+  }
+
+  void testFNV1a64Seed()
+  {
+    CPPUNIT_ASSERT_EQUAL(FNV1a64("foobar", 6), FNV1a64("bar", 3, FNV1a64("foo", 3)));
+  }
+
+  void testInternAxis()
+  {
+    unsigned int id = InternAxisName("BinKeyTestAxis");
+    CPPUNIT_ASSERT_EQUAL(id, InternAxisName("BinKeyTestAxis"));
+    CPPUNIT_ASSERT(id != InternAxisName("BinKeyTestAxis2"));
+    CPPUNIT_ASSERT_EQUAL(string("BinKeyTestAxis"), AxisName(id));
+  }
+
+  void testEmpty()
+  {
+    BinKey k1, k2 (CalibrationBin().binSpec);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, k1.dimension());
+    CPPUNIT_ASSERT(k1 == k2);
+    CPPUNIT_ASSERT(k1.hash() == k2.hash());
+  }
+
+  void testEqual()
+  {
+    BinKey k1 (makeBin(20.0, 30.0, 0.0, 1.2));
+    BinKey k2 (makeBin(20.0, 30.0, 0.0, 1.2));
+    CPPUNIT_ASSERT(k1 == k2);
+    CPPUNIT_ASSERT(!(k1 != k2));
+    CPPUNIT_ASSERT(k1.hash() == k2.hash());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, k1.dimension());
+  }
+
+  void testOrderDoesNotMatter()
+  {
+    CalibrationBin b1 (makeBin(20.0, 30.0, 0.0, 1.2));
+    CalibrationBin b2;
+    b2.binSpec.push_back(b1.binSpec[1]);
+    b2.binSpec.push_back(b1.binSpec[0]);
+    CPPUNIT_ASSERT(BinKey(b1) == BinKey(b2));
+    CPPUNIT_ASSERT(BinKey(b1).hash() == BinKey(b2).hash());
+  }
+
+  void testNotEqual()
+  {
+    BinKey k1 (makeBin(20.0, 30.0, 0.0, 1.2));
+    CPPUNIT_ASSERT(k1 != BinKey(makeBin(20.0, 30.0, 0.0, 1.3)));
+    CPPUNIT_ASSERT(k1 != BinKey(makeBin(20.0, 31.0, 0.0, 1.2)));
+
+    CalibrationBin b (makeBin(20.0, 30.0, 0.0, 1.2));
+    b.binSpec[0].variable = "eta";
+    CPPUNIT_ASSERT(k1 != BinKey(b));
+  }
+
+  void testNegativeZero()
+  {
+    BinKey k1 (makeBin(20.0, 30.0, 0.0, 1.2));
+    BinKey k2 (makeBin(20.0, 30.0, -0.0, 1.2));
+    CPPUNIT_ASSERT(k1 == k2);
+    CPPUNIT_ASSERT(k1.hash() == k2.hash());
+  }
+
+  void testFromSet()
+  {
+    CalibrationBin b (makeBin(20.0, 30.0, 0.0, 1.2));
+    set<CalibrationBinBoundary> s (b.binSpec.begin(), b.binSpec.end());
+    CPPUNIT_ASSERT(BinKey(s) == BinKey(b));
+  }
+
+  void testDuplicateBoundary()
+  {
+    // Same as a set would do.
+    CalibrationBin b (makeBin(20.0, 30.0, 0.0, 1.2));
+    CalibrationBin b2 (b);
+    b2.binSpec.push_back(b.binSpec[0]);
+    CPPUNIT_ASSERT(BinKey(b) == BinKey(b2));
+  }
+
+  void testName()
+  {
+    CalibrationBin b (makeBin(20.0, 30.0, 0.0, 1.2));
+    CPPUNIT_ASSERT_EQUAL(OPBinName(b), BinKey(b).name());
+  }
+
+  void testBinSpec()
+  {
+    CalibrationBin b (makeBin(20.0, 30.0, 0.0, 1.2));
+    vector<CalibrationBinBoundary> spec (BinKey(b).binSpec());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, spec.size());
+    CPPUNIT_ASSERT_EQUAL(string("abseta"), spec[0].variable);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.2, spec[0].highvalue, 0.0001);
+    CPPUNIT_ASSERT_EQUAL(string("pt"), spec[1].variable);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(20.0, spec[1].lowvalue, 0.0001);
+  }
+
+  void testLessThan()
+  {
+    BinKey k1 (makeBin(20.0, 30.0, 0.0, 1.2));
+    BinKey k2 (makeBin(30.0, 40.0, 0.0, 1.2));
+    CPPUNIT_ASSERT(!(k1 < k1));
+    CPPUNIT_ASSERT((k1 < k2) != (k2 < k1));
+
+    set<BinKey> keys;
+    keys.insert(k1);
+    keys.insert(k2);
+    keys.insert(BinKey(makeBin(20.0, 30.0, 0.0, 1.2)));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, keys.size());
+  }
+
+  void testUnorderedMap()
+  {
+    unordered_map<BinKey, int, BinKeyHash> m;
+    for (int i = 0; i < 100; i++) {
+      m[BinKey(makeBin(10.0*i, 10.0*(i+1), 0.0, 2.5))] = i;
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t)100, m.size());
+    CPPUNIT_ASSERT_EQUAL(42, m[BinKey(makeBin(420.0, 430.0, 0.0, 2.5))]);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(BinKeyTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
@@ -32,7 +32,12 @@ class CDIConverterTest : public CppUnit::TestFixture
   CPPUNIT_TEST( testBasicGetIrregularSF );
   CPPUNIT_TEST( testUncorrelatedErrors );
   CPPUNIT_TEST( testForSystematics );
+  CPPUNIT_TEST( testSystematicMissingInABin );
+  CPPUNIT_TEST( testSystematicDuplicatedInABin );
+  CPPUNIT_TEST( testSystematicsAlreadyInABin );
   CPPUNIT_TEST( testForNoExtrapolation );
+  CPPUNIT_TEST( testConversionHashSame );
+  CPPUNIT_TEST( testConversionHashChanges );
 
   CPPUNIT_TEST_EXCEPTION( testExtendedBinBadSys, bad_cdi_config_exception );
   CPPUNIT_TEST( testExtendedBinNormalArea );
@@ -375,6 +380,116 @@ class CDIConverterTest : public CppUnit::TestFixture
     cout << "Done testing for systematics" << endl;
   }
 
+  void testSystematicMissingInABin()
+  {
+    // A second pt bin that has only one of the two errors.
+    CalibrationAnalysis ana (generate_no_extrap_ana());
+    CalibrationBin b2 (ana.bins[0]);
+    b2.binSpec[0].lowvalue = 100.0;
+    b2.binSpec[0].highvalue = 200.0;
+    b2.systematicErrors.pop_back();
+    b2.systematicErrors[0].value = 0.2;
+    ana.bins.push_back(b2);
+
+    CalibrationDataContainer *craw = ConvertToCDI (ana, "bogus");
+    CalibrationDataHistogramContainer *c = dynamic_cast<CalibrationDataHistogramContainer *>(craw);
+
+    Analysis::CalibrationDataVariables v;
+    v.jetPt = 150.e3;
+    v.jetEta = -1.1;
+    v.jetAuthor = "AntiKt4Topo";
+
+    map<string, UncertaintyResult> all;
+    CalibrationStatus stat;
+    stat = c->getUncertainties(v, all);
+    CPPUNIT_ASSERT_EQUAL (kSuccess, stat);
+
+    CPPUNIT_ASSERT (all.find("uerr") != all.end());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.0, all["uerr"].first, 0.001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.2, all["err"].first, 0.001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.2, all["systematics"].first, 0.001);
+  }
+
+  void testSystematicDuplicatedInABin()
+  {
+    // A second "err" counts in the total, but the histogram shows the first.
+    CalibrationAnalysis ana (generate_no_extrap_ana());
+    SystematicError e (ana.bins[0].systematicErrors[0]);
+    e.value = 0.3;
+    ana.bins[0].systematicErrors.push_back(e);
+
+    CalibrationDataContainer *craw = ConvertToCDI (ana, "bogus");
+    CalibrationDataHistogramContainer *c = dynamic_cast<CalibrationDataHistogramContainer *>(craw);
+
+    Analysis::CalibrationDataVariables v;
+    v.jetPt = 50.e3;
+    v.jetEta = -1.1;
+    v.jetAuthor = "AntiKt4Topo";
+
+    map<string, UncertaintyResult> all;
+    CalibrationStatus stat;
+    stat = c->getUncertainties(v, all);
+    CPPUNIT_ASSERT_EQUAL (kSuccess, stat);
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1, all["err"].first, 0.001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (sqrt(0.1*0.1 + 0.1*0.1 + 0.3*0.3), all["systematics"].first, 0.001);
+  }
+
+  void testSystematicsAlreadyInABin()
+  {
+    // The total is always added, but an error already called "systematics" comes
+    // first, so that is the one that ends up in the CDI.
+    CalibrationAnalysis ana (generate_no_extrap_ana());
+    SystematicError e;
+    e.name = "systematics";
+    e.value = 0.5;
+    e.uncorrelated = false;
+    ana.bins[0].systematicErrors.push_back(e);
+
+    CalibrationDataContainer *craw = ConvertToCDI (ana, "bogus");
+    CalibrationDataHistogramContainer *c = dynamic_cast<CalibrationDataHistogramContainer *>(craw);
+
+    Analysis::CalibrationDataVariables v;
+    v.jetPt = 50.e3;
+    v.jetEta = -1.1;
+    v.jetAuthor = "AntiKt4Topo";
+
+    map<string, UncertaintyResult> all;
+    CalibrationStatus stat;
+    stat = c->getUncertainties(v, all);
+    CPPUNIT_ASSERT_EQUAL (kSuccess, stat);
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1, all["err"].first, 0.001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.5, all["systematics"].first, 0.001);
+  }
+
+  void testConversionHashSame()
+  {
+    CalibrationAnalysis ana (generate_no_extrap_ana());
+    CalibrationAnalysis copy (ana);
+    CPPUNIT_ASSERT (ConversionHash(ana) != "");
+    CPPUNIT_ASSERT_EQUAL (ConversionHash(ana), ConversionHash(copy));
+  }
+
+  void testConversionHashChanges()
+  {
+    CalibrationAnalysis ana (generate_no_extrap_ana());
+    string h (ConversionHash(ana));
+
+    // Well below the precision things are printed with by default.
+    CalibrationAnalysis value (ana);
+    value.bins[0].centralValue += 1.0e-9;
+    CPPUNIT_ASSERT (h != ConversionHash(value));
+
+    CalibrationAnalysis linage (ana);
+    linage.metadata_s["Linage"] = "fit";
+    CPPUNIT_ASSERT (h != ConversionHash(linage));
+
+    CalibrationAnalysis sys (ana);
+    sys.bins[0].systematicErrors[0].uncorrelated = !sys.bins[0].systematicErrors[0].uncorrelated;
+    CPPUNIT_ASSERT (h != ConversionHash(sys));
+  }
+
   void testForNoExtrapolation()
   {
     cout << "Testing for NoExtrapolation" << endl;
@@ -0,0 +1,350 @@
+///
+/// CppUnit tests for the columnar calibration store and its kernels.
+///
+
+#include "Combination/CalibrationColumns.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  CalibrationBin makeBin (double low, double high, double cv, double stat)
+  {
+    CalibrationBin b;
+    CalibrationBinBoundary bound;
+    bound.variable = "pt";
+    bound.lowvalue = low;
+    bound.highvalue = high;
+    b.binSpec.push_back(bound);
+    b.centralValue = cv;
+    b.centralValueStatisticalError = stat;
+    return b;
+  }
+
+  void addSys (CalibrationBin &b, const string &name, double value, bool uncorrelated = false)
+  {
+    SystematicError e;
+    e.name = name;
+    e.value = value;
+    e.uncorrelated = uncorrelated;
+    b.systematicErrors.push_back(e);
+  }
+
+  // Two bins, the second missing one of the errors
+  CalibrationAnalysis makeAna ()
+  {
+    CalibrationAnalysis ana;
+    ana.name = "s8";
+    CalibrationBin b1 (makeBin(0.0, 10.0, 1.0, 0.1));
+    addSys(b1, "s1", 0.3);
+    addSys(b1, "s2", 0.4, true);
+    ana.bins.push_back(b1);
+
+    CalibrationBin b2 (makeBin(10.0, 20.0, 2.0, 0.2));
+    addSys(b2, "s2", 0.5, true);
+    ana.bins.push_back(b2);
+    return ana;
+  }
+}
+
+class CalibrationColumnsTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( CalibrationColumnsTest );
+
+  CPPUNIT_TEST( testNameTable );
+  CPPUNIT_TEST( testEmptyAnalysis );
+  CPPUNIT_TEST( testColumnsLayout );
+  CPPUNIT_TEST( testSkipExtended );
+  CPPUNIT_TEST( testQuadratureSum );
+  CPPUNIT_TEST( testTotalError );
+  CPPUNIT_TEST( testTotalsWithDuplicates );
+  CPPUNIT_TEST( testRelativeErrors );
+  CPPUNIT_TEST( testWeightedAverage );
+  CPPUNIT_TEST( testAddSystematicPercent );
+  CPPUNIT_TEST( testWriteBackDrop );
+  CPPUNIT_TEST( testWriteBackUnchanged );
+  CPPUNIT_TEST( testWriteBackDuplicates );
+  CPPUNIT_TEST( testDropFirstDuplicate );
+  CPPUNIT_TEST( testLastDuplicate );
+  CPPUNIT_TEST( testScaleSystematic );
+  CPPUNIT_TEST( testWeightedAverageRowsOneGroup );
+  CPPUNIT_TEST( testWeightedAverageRowsBatched );
+  CPPUNIT_TEST_EXCEPTION( testWeightedAverageRowsEmptyGroup, std::runtime_error );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  void testNameTable()
+  {
+    SystematicNameTable t;
+    CPPUNIT_ASSERT_EQUAL((size_t)0, t.intern("zed"));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, t.intern("alpha"));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, t.intern("zed"));
+    CPPUNIT_ASSERT_EQUAL(-1, t.find("beta"));
+    CPPUNIT_ASSERT_EQUAL(1, t.find("alpha"));
+
+    vector<size_t> sorted (t.sorted_ids());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, sorted.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, sorted[0]);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, sorted[1]);
+  }
+
+  void testEmptyAnalysis()
+  {
+    CalibrationAnalysis ana;
+    CalibrationColumns c (ana);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, c.nbins());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, c.nsys());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, ColumnSysQuadratureSum(c).size());
+  }
+
+  void testColumnsLayout()
+  {
+    CalibrationColumns c (makeAna());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, c.nbins());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, c.nsys());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, c.centralValue[1], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.2, c.statError[1], 0.0001);
+
+    size_t s1 = c.sysNames.find("s1");
+    size_t s2 = c.sysNames.find("s2");
+    CPPUNIT_ASSERT(c.has_sys(0, s1));
+    CPPUNIT_ASSERT(!c.has_sys(1, s1));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, c.sys(1, s1), 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, c.sys(1, s2), 0.0001);
+    CPPUNIT_ASSERT(!c.sysUncorrelated[s1]);
+    CPPUNIT_ASSERT(c.sysUncorrelated[s2]);
+  }
+
+  void testSkipExtended()
+  {
+    CalibrationAnalysis ana (makeAna());
+    ana.bins[0].isExtended = true;
+    CalibrationColumns c (ana, false);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, c.nbins());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, c.binIndex[0]);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, c.nsys());
+  }
+
+  void testQuadratureSum()
+  {
+    CalibrationColumns c (makeAna());
+    vector<double> r (ColumnSysQuadratureSum(c));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, r[0], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, r[1], 0.0001);
+  }
+
+  void testTotalError()
+  {
+    CalibrationColumns c (makeAna());
+    vector<double> r (ColumnTotalError(c));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(0.25+0.01), r[0], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(0.25+0.04), r[1], 0.0001);
+  }
+
+  // Every error counts towards the totals, as in the loop over systematicErrors they
+  // replaced - even the duplicates that aren't in the matrix.
+  void testTotalsWithDuplicates()
+  {
+    CalibrationAnalysis ana (makeAna());
+    addSys(ana.bins[0], "s1", 1.2);
+    addSys(ana.bins[0], "s2", 0.6);
+    for (int d = 0; d < 2; d++) {
+      CalibrationColumns c (ana, true, d == 0 ? kFirstDuplicate : kLastDuplicate);
+      vector<double> sys (ColumnSysQuadratureSum(c));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(0.09+0.16+1.44+0.36), sys[0], 0.0001);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, sys[1], 0.0001);
+      vector<double> total (ColumnTotalError(c));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(0.01+0.09+0.16+1.44+0.36), total[0], 0.0001);
+    }
+
+    // Dropping a systematic leaves its duplicates in the bin, and in the total.
+    CalibrationColumns c (ana);
+    c.drop_systematic("s1");
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(0.16+1.44+0.36), ColumnSysQuadratureSum(c)[0], 0.0001);
+  }
+
+  void testRelativeErrors()
+  {
+    double errors[] = {0.1, 0.2, 0.3};
+    double cvs[] = {1.0, 0.5, 0.0};
+    double r[3];
+    RelativeErrors(errors, cvs, r, 3);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, r[0], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(40.0, r[1], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.3, r[2], 0.0001);
+  }
+
+  void testWeightedAverage()
+  {
+    double values[] = {1.0, 2.0};
+    double weights[] = {3.0, 1.0};
+    double sumW;
+    double avg = WeightedAverage(values, weights, 2, sumW);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.25, avg, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(4.0, sumW, 0.0001);
+  }
+
+  void testAddSystematicPercent()
+  {
+    CalibrationAnalysis ana (makeAna());
+    CalibrationColumns c (ana);
+    size_t id = c.add_systematic("new");
+    CPPUNIT_ASSERT_EQUAL((size_t)2, id);
+    CPPUNIT_ASSERT_EQUAL(id, c.add_systematic("new"));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, c.sys(1, c.sysNames.find("s2")), 0.0001);
+
+    SetSystematicFromPercent(c, id, 10.0);
+    c.write_back(ana);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)3, ana.bins[0].systematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL(string("new"), ana.bins[0].systematicErrors[2].name);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.1, ana.bins[0].systematicErrors[2].value, 0.0001);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, ana.bins[1].systematicErrors.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.2, ana.bins[1].systematicErrors[1].value, 0.0001);
+  }
+
+  void testWriteBackDrop()
+  {
+    CalibrationAnalysis ana (makeAna());
+    CalibrationColumns c (ana);
+    c.drop_systematic("s2");
+    c.drop_systematic("not-there");
+    c.write_back(ana);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, ana.bins[0].systematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL(string("s1"), ana.bins[0].systematicErrors[0].name);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, ana.bins[1].systematicErrors.size());
+  }
+
+  void testWriteBackUnchanged()
+  {
+    CalibrationAnalysis ana (makeAna());
+    CalibrationAnalysis orig (ana);
+    CalibrationColumns c (ana);
+    c.write_back(ana);
+    CPPUNIT_ASSERT(orig == ana);
+  }
+
+  // Only the first of two errors with the same name is in the columns, the second is
+  // left alone.
+  void testWriteBackDuplicates()
+  {
+    CalibrationAnalysis ana (makeAna());
+    addSys(ana.bins[0], "s1", 0.7);
+    CalibrationAnalysis orig (ana);
+
+    CalibrationColumns c (ana);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, c.nsys());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.3, c.sys(0, c.sysNames.find("s1")), 0.0001);
+    c.write_back(ana);
+    CPPUNIT_ASSERT(orig == ana);
+
+    ScaleSystematic(c, c.sysNames.find("s1"), 2.0);
+    c.write_back(ana);
+    CPPUNIT_ASSERT_EQUAL((size_t)3, ana.bins[0].systematicErrors.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.6, ana.bins[0].systematicErrors[0].value, 0.0001);
+    CPPUNIT_ASSERT_EQUAL(string("s1"), ana.bins[0].systematicErrors[2].name);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.7, ana.bins[0].systematicErrors[2].value, 0.0001);
+  }
+
+  void testDropFirstDuplicate()
+  {
+    CalibrationAnalysis ana (makeAna());
+    addSys(ana.bins[0], "s1", 0.7);
+    CalibrationColumns c (ana);
+    c.drop_systematic("s1");
+    c.write_back(ana);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, ana.bins[0].systematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL(string("s2"), ana.bins[0].systematicErrors[0].name);
+    CPPUNIT_ASSERT_EQUAL(string("s1"), ana.bins[0].systematicErrors[1].name);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.7, ana.bins[0].systematicErrors[1].value, 0.0001);
+  }
+
+  void testLastDuplicate()
+  {
+    CalibrationAnalysis ana (makeAna());
+    addSys(ana.bins[0], "s1", 0.7);
+    CalibrationColumns c (ana, true, kLastDuplicate);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.7, c.sys(0, c.sysNames.find("s1")), 0.0001);
+
+    // And it is the last one that is written back.
+    ScaleSystematic(c, c.sysNames.find("s1"), 2.0);
+    c.write_back(ana);
+    CPPUNIT_ASSERT_EQUAL((size_t)3, ana.bins[0].systematicErrors.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.3, ana.bins[0].systematicErrors[0].value, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.4, ana.bins[0].systematicErrors[2].value, 0.0001);
+  }
+
+  void testScaleSystematic()
+  {
+    CalibrationAnalysis ana (makeAna());
+    CalibrationColumns c (ana);
+    ScaleSystematic(c, c.sysNames.find("s2"), 2.0);
+    c.write_back(ana);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.8, ana.bins[0].systematicErrors[1].value, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, ana.bins[1].systematicErrors[0].value, 0.0001);
+    CPPUNIT_ASSERT(ana.bins[1].systematicErrors[0].uncorrelated);
+  }
+
+  void testWeightedAverageRowsOneGroup()
+  {
+    CalibrationColumns c (makeAna());
+    vector<vector<size_t> > groups (1);
+    groups[0].push_back(0);
+    groups[0].push_back(1);
+    CalibrationColumns r (WeightedAverageRows(c, groups));
+
+    // Weights are 100 and 25.
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.nbins());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL((100.0*1.0 + 25.0*2.0)/125.0, r.centralValue[0], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(1.0/125.0), r.statError[0], 0.0001);
+
+    size_t s1 = r.sysNames.find("s1");
+    size_t s2 = r.sysNames.find("s2");
+    CPPUNIT_ASSERT(r.has_sys(0, s1));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(100.0*0.3/125.0, r.sys(0, s1), 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL((100.0*0.4 + 25.0*0.5)/125.0, r.sys(0, s2), 0.0001);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, r.binIndex[0]);
+  }
+
+  void testWeightedAverageRowsBatched()
+  {
+    CalibrationColumns c (makeAna());
+    vector<vector<size_t> > groups (2);
+    groups[0].push_back(1);
+    groups[1].push_back(0);
+    CalibrationColumns r (WeightedAverageRows(c, groups));
+
+    // A single bin just comes back as itself
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.nbins());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, r.centralValue[0], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.2, r.statError[0], 0.0001);
+    CPPUNIT_ASSERT(!r.has_sys(0, r.sysNames.find("s1")));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.binIndex[0]);
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, r.centralValue[1], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.3, r.sys(1, r.sysNames.find("s1")), 0.0001);
+  }
+
+  void testWeightedAverageRowsEmptyGroup()
+  {
+    CalibrationColumns c (makeAna());
+    vector<vector<size_t> > groups (1);
+    WeightedAverageRows(c, groups);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CalibrationColumnsTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
@@ -0,0 +1,404 @@
+///
+/// CppUnit tests for the binary encoding of the data model
+///
+
+#include "Combination/CalibrationDataModelBinary.h"
+#include "Combination/SyntheticInputs.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+
+using namespace std;
+using namespace BTagCombination;
+
+class CalibrationDataModelBinaryTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( CalibrationDataModelBinaryTest );
+
+  CPPUNIT_TEST( testRoundTrip );
+  CPPUNIT_TEST( testExactNumbers );
+  CPPUNIT_TEST( testBackToBack );
+  CPPUNIT_TEST( testEmptyAnalysis );
+  CPPUNIT_TEST_EXCEPTION( testTruncated, std::runtime_error );
+
+  CPPUNIT_TEST( testInfoRoundTrip );
+  CPPUNIT_TEST( testInfoEmpty );
+  CPPUNIT_TEST( testInfoSynthetic );
+  CPPUNIT_TEST( testInfoSharesStrings );
+  CPPUNIT_TEST( testIsBinaryInfo );
+  CPPUNIT_TEST_EXCEPTION( testInfoTruncated, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testInfoBadVersion, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testInfoNotBinary, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testInfoHugeStringCount, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testInfoHugeAnalysisCount, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testInfoHugeCorrelationCount, std::runtime_error );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  CalibrationAnalysis generate_ana()
+  {
+    CalibrationAnalysis ana;
+    ana.name = "s8";
+    ana.flavor = "bottom";
+    ana.tagger = "SV0";
+    ana.operatingPoint = "0.50";
+    ana.jetAlgorithm = "AntiKt4Topo";
+
+    CalibrationBin b;
+    CalibrationBinBoundary bb;
+    bb.variable = "pt";
+    bb.lowvalue = 20.0;
+    bb.highvalue = 30.0;
+    b.binSpec.push_back(bb);
+    bb.variable = "abseta";
+    bb.lowvalue = 0.0;
+    bb.highvalue = 2.5;
+    b.binSpec.push_back(bb);
+    b.centralValue = 1.1;
+    b.centralValueStatisticalError = 0.1;
+    b.isExtended = false;
+
+    SystematicError e;
+    e.name = "err";
+    e.value = 0.05;
+    e.uncorrelated = false;
+    b.systematicErrors.push_back(e);
+    e.name = "uerr";
+    e.uncorrelated = true;
+    b.systematicErrors.push_back(e);
+    b.metadata["weight"] = make_pair(0.5, 0.1);
+    ana.bins.push_back(b);
+
+    b.isExtended = true;
+    b.binSpec[0].lowvalue = 200.0;
+    b.binSpec[0].highvalue = 300.0;
+    e.name = "ref";
+    b.referenceBinSystematicErrors.push_back(e);
+    ana.bins.push_back(b);
+
+    ana.metadata["gchi2"].push_back(3.2);
+    ana.metadata["gndof"].push_back(2.0);
+    ana.metadata["list"].push_back(1.0);
+    ana.metadata["list"].push_back(2.0);
+    ana.metadata_s["Linage"] = "s8+ptrel";
+    return ana;
+  }
+
+  CalibrationAnalysis roundTrip (const CalibrationAnalysis &ana)
+  {
+    ostringstream out;
+    WriteBinary(out, ana);
+    istringstream in (out.str());
+    return ReadBinaryAnalysis(in);
+  }
+
+  void testRoundTrip()
+  {
+    CalibrationAnalysis ana (generate_ana());
+    CalibrationAnalysis r (roundTrip(ana));
+
+    CPPUNIT_ASSERT_EQUAL(ana.name, r.name);
+    CPPUNIT_ASSERT_EQUAL(ana.flavor, r.flavor);
+    CPPUNIT_ASSERT_EQUAL(ana.tagger, r.tagger);
+    CPPUNIT_ASSERT_EQUAL(ana.operatingPoint, r.operatingPoint);
+    CPPUNIT_ASSERT_EQUAL(ana.jetAlgorithm, r.jetAlgorithm);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.bins.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.bins[0].binSpec.size());
+    CPPUNIT_ASSERT_EQUAL(string("abseta"), r.bins[0].binSpec[1].variable);
+    CPPUNIT_ASSERT_EQUAL(2.5, r.bins[0].binSpec[1].highvalue);
+    CPPUNIT_ASSERT_EQUAL(1.1, r.bins[0].centralValue);
+    CPPUNIT_ASSERT_EQUAL(0.1, r.bins[0].centralValueStatisticalError);
+    CPPUNIT_ASSERT(!r.bins[0].isExtended);
+    CPPUNIT_ASSERT(r.bins[1].isExtended);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.bins[0].systematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL(string("uerr"), r.bins[0].systematicErrors[1].name);
+    CPPUNIT_ASSERT(r.bins[0].systematicErrors[1].uncorrelated);
+    CPPUNIT_ASSERT(!r.bins[0].systematicErrors[0].uncorrelated);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, r.bins[0].referenceBinSystematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.bins[1].referenceBinSystematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL(0.1, r.bins[0].metadata["weight"].second);
+
+    CPPUNIT_ASSERT_EQUAL(3.2, r.metadata["gchi2"][0]);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.metadata["list"].size());
+    CPPUNIT_ASSERT_EQUAL(string("s8+ptrel"), r.metadata_s["Linage"]);
+  }
+
+  void testExactNumbers()
+  {
+    // The text format rounds these - the binary format must not.
+    CalibrationAnalysis ana (generate_ana());
+    ana.bins[0].centralValue = 1.0/3.0;
+    ana.bins[0].systematicErrors[0].value = 1.0e-300;
+    ana.bins[1].centralValue = -0.0;
+    CalibrationAnalysis r (roundTrip(ana));
+    CPPUNIT_ASSERT_EQUAL(1.0/3.0, r.bins[0].centralValue);
+    CPPUNIT_ASSERT_EQUAL(1.0e-300, r.bins[0].systematicErrors[0].value);
+    CPPUNIT_ASSERT(std::signbit(r.bins[1].centralValue));
+  }
+
+  void testBackToBack()
+  {
+    CalibrationAnalysis a1 (generate_ana());
+    CalibrationAnalysis a2 (generate_ana());
+    a2.name = "ptrel";
+    ostringstream out;
+    WriteBinary(out, a1);
+    WriteBinary(out, a2);
+
+    istringstream in (out.str());
+    CPPUNIT_ASSERT_EQUAL(string("s8"), ReadBinaryAnalysis(in).name);
+    CPPUNIT_ASSERT_EQUAL(string("ptrel"), ReadBinaryAnalysis(in).name);
+    CPPUNIT_ASSERT(in.peek() == EOF);
+  }
+
+  void testEmptyAnalysis()
+  {
+    CalibrationAnalysis ana;
+    CalibrationAnalysis r (roundTrip(ana));
+    CPPUNIT_ASSERT_EQUAL(string(""), r.name);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, r.bins.size());
+  }
+
+  void testTruncated()
+  {
+    ostringstream out;
+    WriteBinary(out, generate_ana());
+    string data (out.str());
+    istringstream in (data.substr(0, data.size() - 3));
+    ReadBinaryAnalysis(in);
+  }
+
+  CalibrationInfo generate_info()
+  {
+    CalibrationInfo info;
+    info.Analyses.push_back(generate_ana());
+    info.Analyses.push_back(generate_ana());
+    info.Analyses[1].name = "ptrel";
+
+    AnalysisCorrelation c;
+    c.analysis1Name = "s8";
+    c.analysis2Name = "ptrel";
+    c.flavor = "bottom";
+    c.tagger = "SV0";
+    c.operatingPoint = "0.50";
+    c.jetAlgorithm = "AntiKt4Topo";
+    BinCorrelation bc;
+    bc.binSpec = info.Analyses[0].bins[0].binSpec;
+    bc.hasStatCorrelation = true;
+    bc.statCorrelation = 0.25;
+    c.bins.push_back(bc);
+    bc.binSpec = info.Analyses[0].bins[1].binSpec;
+    bc.hasStatCorrelation = false;
+    c.bins.push_back(bc);
+    info.Correlations.push_back(c);
+
+    DefaultAnalysis d;
+    d.name = "s8";
+    d.flavor = "bottom";
+    d.tagger = "SV0";
+    d.operatingPoint = "0.50";
+    d.jetAlgorithm = "AntiKt4Topo";
+    info.Defaults.push_back(d);
+
+    AliasAnalysis a;
+    a.name = "s8";
+    a.flavor = "bottom";
+    a.tagger = "SV0";
+    a.operatingPoint = "0.50";
+    a.jetAlgorithm = "AntiKt4Topo";
+    AliasAnalysisCopyTo t;
+    t.name = "s8";
+    t.flavor = "charm";
+    t.tagger = "SV0";
+    t.operatingPoint = "0.50";
+    t.jetAlgorithm = "AntiKt6Topo";
+    a.CopyTargets.push_back(t);
+    info.Aliases.push_back(a);
+
+    return info;
+  }
+
+  CalibrationInfo roundTrip (const CalibrationInfo &info)
+  {
+    ostringstream out;
+    WriteBinaryInfo(out, info);
+    string data (out.str());
+    return ReadBinaryInfo(data.data(), data.size());
+  }
+
+  void testInfoRoundTrip()
+  {
+    CalibrationInfo info (generate_info());
+    CalibrationInfo r (roundTrip(info));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.Analyses.size());
+    CPPUNIT_ASSERT_EQUAL(string("s8"), r.Analyses[0].name);
+    CPPUNIT_ASSERT_EQUAL(string("ptrel"), r.Analyses[1].name);
+    CPPUNIT_ASSERT_EQUAL(string("AntiKt4Topo"), r.Analyses[1].jetAlgorithm);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.Analyses[1].bins.size());
+    CPPUNIT_ASSERT_EQUAL(string("abseta"), r.Analyses[1].bins[0].binSpec[1].variable);
+    CPPUNIT_ASSERT_EQUAL(1.1, r.Analyses[1].bins[0].centralValue);
+    CPPUNIT_ASSERT(r.Analyses[1].bins[1].isExtended);
+    CPPUNIT_ASSERT(r.Analyses[1].bins[0].systematicErrors[1].uncorrelated);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.Analyses[1].bins[1].referenceBinSystematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL(string("ref"), r.Analyses[1].bins[1].referenceBinSystematicErrors[0].name);
+    CPPUNIT_ASSERT_EQUAL(0.1, r.Analyses[1].bins[0].metadata["weight"].second);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.Analyses[1].metadata["list"].size());
+    CPPUNIT_ASSERT_EQUAL(string("s8+ptrel"), r.Analyses[1].metadata_s["Linage"]);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.Correlations.size());
+    CPPUNIT_ASSERT_EQUAL(string("ptrel"), r.Correlations[0].analysis2Name);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, r.Correlations[0].bins.size());
+    CPPUNIT_ASSERT(r.Correlations[0].bins[0].hasStatCorrelation);
+    CPPUNIT_ASSERT_EQUAL(0.25, r.Correlations[0].bins[0].statCorrelation);
+    CPPUNIT_ASSERT(!r.Correlations[0].bins[1].hasStatCorrelation);
+    CPPUNIT_ASSERT_EQUAL(200.0, r.Correlations[0].bins[1].binSpec[0].lowvalue);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.Defaults.size());
+    CPPUNIT_ASSERT_EQUAL(string("0.50"), r.Defaults[0].operatingPoint);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.Aliases.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.Aliases[0].CopyTargets.size());
+    CPPUNIT_ASSERT_EQUAL(string("charm"), r.Aliases[0].CopyTargets[0].flavor);
+    CPPUNIT_ASSERT_EQUAL(string("AntiKt6Topo"), r.Aliases[0].CopyTargets[0].jetAlgorithm);
+  }
+
+  void testInfoEmpty()
+  {
+    CalibrationInfo r (roundTrip(CalibrationInfo()));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, r.Analyses.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, r.Correlations.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, r.Defaults.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, r.Aliases.size());
+  }
+
+  void testInfoSynthetic()
+  {
+    SyntheticInputSpec spec;
+    spec.nAnalyses = 3;
+    spec.nSys = 20;
+    spec.correlationDensity = 0.5;
+    spec.defaults = true;
+    spec.copies = true;
+    CalibrationInfo info (GenerateSyntheticInputs(spec));
+
+    // Through a stream, as a tool reading a file would.
+    ostringstream out;
+    WriteBinaryInfo(out, info);
+    istringstream in (out.str());
+    CalibrationInfo r (ReadBinaryInfo(in));
+
+    CPPUNIT_ASSERT_EQUAL(info.Analyses.size(), r.Analyses.size());
+    CPPUNIT_ASSERT_EQUAL(info.Correlations.size(), r.Correlations.size());
+    CPPUNIT_ASSERT_EQUAL(info.Defaults.size(), r.Defaults.size());
+    CPPUNIT_ASSERT_EQUAL(info.Aliases.size(), r.Aliases.size());
+    for (size_t i = 0; i < info.Analyses.size(); i++) {
+      const CalibrationAnalysis &a (info.Analyses[i]), &b (r.Analyses[i]);
+      CPPUNIT_ASSERT_EQUAL(a.name, b.name);
+      CPPUNIT_ASSERT_EQUAL(a.bins.size(), b.bins.size());
+      for (size_t i_b = 0; i_b < a.bins.size(); i_b++) {
+	CPPUNIT_ASSERT_EQUAL(a.bins[i_b].centralValue, b.bins[i_b].centralValue);
+	CPPUNIT_ASSERT_EQUAL(a.bins[i_b].systematicErrors.size(), b.bins[i_b].systematicErrors.size());
+	for (size_t i_s = 0; i_s < a.bins[i_b].systematicErrors.size(); i_s++) {
+	  CPPUNIT_ASSERT_EQUAL(a.bins[i_b].systematicErrors[i_s].name, b.bins[i_b].systematicErrors[i_s].name);
+	  CPPUNIT_ASSERT_EQUAL(a.bins[i_b].systematicErrors[i_s].value, b.bins[i_b].systematicErrors[i_s].value);
+	}
+      }
+    }
+    for (size_t i = 0; i < info.Correlations.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(info.Correlations[i].bins.size(), r.Correlations[i].bins.size());
+    }
+  }
+
+  void testInfoSharesStrings()
+  {
+    // Names are stored once, so many analyses with the same systematic errors cost
+    // little more than the numbers.
+    CalibrationInfo info (generate_info());
+    ostringstream one;
+    WriteBinaryInfo(one, info);
+    for (int i = 0; i < 10; i++)
+      info.Analyses.push_back(info.Analyses[0]);
+    ostringstream many;
+    WriteBinaryInfo(many, info);
+
+    size_t perAnalysis = (many.str().size() - one.str().size()) / 10;
+    CPPUNIT_ASSERT(perAnalysis < 2*2*BinaryInfoFormat::cBinHeaderSize + 300);
+  }
+
+  void testIsBinaryInfo()
+  {
+    ostringstream out;
+    WriteBinaryInfo(out, generate_info());
+    string data (out.str());
+    CPPUNIT_ASSERT(IsBinaryInfo(data.data(), data.size()));
+    CPPUNIT_ASSERT(IsBinaryInfo(data.data(), 8));
+    CPPUNIT_ASSERT(!IsBinaryInfo(data.data(), 7));
+
+    string text ("Analysis(s8, bottom, SV0, 0.50, AntiKt4Topo) {}");
+    CPPUNIT_ASSERT(!IsBinaryInfo(text.data(), text.size()));
+  }
+
+  void testInfoTruncated()
+  {
+    ostringstream out;
+    WriteBinaryInfo(out, generate_info());
+    string data (out.str());
+    ReadBinaryInfo(data.data(), data.size() - 1);
+  }
+
+  void testInfoBadVersion()
+  {
+    ostringstream out;
+    WriteBinaryInfo(out, generate_info());
+    string data (out.str());
+    data[8] = (char) (BinaryInfoFormat::cVersion + 1);
+    ReadBinaryInfo(data.data(), data.size());
+  }
+
+  void testInfoNotBinary()
+  {
+    istringstream in ("Analysis(s8, bottom, SV0, 0.50, AntiKt4Topo) {}");
+    ReadBinaryInfo(in);
+  }
+
+  // Overwrite the count at the start of a section with something huge. It must be a
+  // format error (runtime_error), not an attempt to allocate room for it (bad_alloc).
+  void readWithHugeCount (size_t sectionOffset)
+  {
+    ostringstream out;
+    WriteBinaryInfo(out, generate_info());
+    string data (out.str());
+    uint64_t section = BinaryInfoFormat::U64(&data[sectionOffset]);
+    for (int i = 0; i < 4; i++)
+      data[section + i] = '\xff';
+    ReadBinaryInfo(data.data(), data.size());
+  }
+
+  void testInfoHugeStringCount()
+  {
+    readWithHugeCount(BinaryInfoFormat::cStringsOffset);
+  }
+
+  void testInfoHugeAnalysisCount()
+  {
+    readWithHugeCount(BinaryInfoFormat::cAnalysesOffset);
+  }
+
+  void testInfoHugeCorrelationCount()
+  {
+    readWithHugeCount(BinaryInfoFormat::cCorrelationsOffset);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CalibrationDataModelBinaryTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
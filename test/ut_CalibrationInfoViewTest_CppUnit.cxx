@@ -0,0 +1,253 @@
+///
+/// CppUnit tests for the masked view of the analyses
+///
+
+#include "Combination/CalibrationInfoView.h"
+#include "Combination/BinUtils.h"
+#include "Combination/CommonCommandLineUtils.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  CalibrationBin makeBin (double ptLow, double ptHigh, double value)
+  {
+    CalibrationBinBoundary b;
+    b.variable = "pt";
+    b.lowvalue = ptLow;
+    b.highvalue = ptHigh;
+
+    CalibrationBin bin;
+    bin.binSpec.push_back(b);
+    bin.centralValue = value;
+    bin.centralValueStatisticalError = 0.1;
+
+    SystematicError e1;
+    e1.name = "s1";
+    e1.value = 0.1;
+    e1.uncorrelated = false;
+    bin.systematicErrors.push_back(e1);
+
+    SystematicError e2;
+    e2.name = "s2";
+    e2.value = 0.2;
+    e2.uncorrelated = false;
+    bin.systematicErrors.push_back(e2);
+
+    return bin;
+  }
+
+  CalibrationAnalysis makeAnalysis (const string &name, const string &op)
+  {
+    CalibrationAnalysis ana;
+    ana.name = name;
+    ana.flavor = "bottom";
+    ana.tagger = "MV1";
+    ana.operatingPoint = op;
+    ana.jetAlgorithm = "AntiKt4Topo";
+    ana.bins.push_back(makeBin(20.0, 30.0, 1.0));
+    ana.bins.push_back(makeBin(30.0, 40.0, 1.1));
+    return ana;
+  }
+
+  set<CalibrationBinBoundary> firstBin (const CalibrationAnalysis &ana)
+  {
+    return set<CalibrationBinBoundary>(ana.bins[0].binSpec.begin(), ana.bins[0].binSpec.end());
+  }
+
+  CalibrationInfo makeInfo ()
+  {
+    CalibrationInfo info;
+    info.CombinationAnalysisName = "combined";
+    info.Analyses.push_back(makeAnalysis("ptrel", "0.5"));
+    info.Analyses.push_back(makeAnalysis("system8", "0.5"));
+    info.Analyses.push_back(makeAnalysis("ptrel", "0.6"));
+    return info;
+  }
+}
+
+class CalibrationInfoViewTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( CalibrationInfoViewTest );
+
+  CPPUNIT_TEST( testFullView );
+  CPPUNIT_TEST( testRemoveBin );
+  CPPUNIT_TEST( testRemoveAllBins );
+  CPPUNIT_TEST( testKeepOnlyBin );
+  CPPUNIT_TEST( testRemoveSysError );
+  CPPUNIT_TEST( testSysUncorrelated );
+  CPPUNIT_TEST( testCopyIsIndependent );
+  CPPUNIT_TEST( testSplit );
+  CPPUNIT_TEST( testHeaders );
+  CPPUNIT_TEST( testMatchesBinUtils );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  void testFullView()
+  {
+    CalibrationInfo info (makeInfo());
+    CalibrationInfoView v (info);
+    CPPUNIT_ASSERT_EQUAL((size_t)3, v.nAnalyses());
+    CPPUNIT_ASSERT_EQUAL(string("combined"), v.combinationName());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, v.listAllBins().size());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, v.listAllSysErrors().size());
+
+    vector<CalibrationAnalysis> m (v.materialize());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, m.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, m[1].bins.size());
+    CPPUNIT_ASSERT_EQUAL(string("system8"), m[1].name);
+  }
+
+  void testRemoveBin()
+  {
+    CalibrationInfo info (makeInfo());
+    CalibrationInfoView v (info);
+    v.removeBin(firstBin(info.Analyses[0]));
+
+    CPPUNIT_ASSERT(!v.binVisible(0, 0));
+    CPPUNIT_ASSERT(v.binVisible(0, 1));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, v.listAllBins().size());
+
+    vector<CalibrationAnalysis> m (v.materialize());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, m.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, m[0].bins.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.1, m[0].bins[0].centralValue, 0.0001);
+
+    // The original is untouched
+    CPPUNIT_ASSERT_EQUAL((size_t)2, info.Analyses[0].bins.size());
+  }
+
+  void testRemoveAllBins()
+  {
+    CalibrationInfo info (makeInfo());
+    info.Analyses[1].bins.pop_back();
+    CalibrationInfoView v (info);
+    v.removeBin(firstBin(info.Analyses[0]));
+
+    // system8 had only the one bin, so it drops out.
+    CPPUNIT_ASSERT_EQUAL((size_t)2, v.nAnalyses());
+    vector<CalibrationAnalysis> m (v.materialize());
+    CPPUNIT_ASSERT_EQUAL(string("ptrel"), m[0].name);
+    CPPUNIT_ASSERT_EQUAL(string("ptrel"), m[1].name);
+  }
+
+  void testKeepOnlyBin()
+  {
+    CalibrationInfo info (makeInfo());
+    CalibrationInfoView v (info);
+    v.keepOnlyBin(firstBin(info.Analyses[0]));
+
+    CPPUNIT_ASSERT(v.binVisible(0, 0));
+    CPPUNIT_ASSERT(!v.binVisible(0, 1));
+
+    vector<CalibrationAnalysis> m (v.materialize());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, m.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, m[2].bins.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, m[2].bins[0].centralValue, 0.0001);
+  }
+
+  void testRemoveSysError()
+  {
+    CalibrationInfo info (makeInfo());
+    CalibrationInfoView v (info);
+    v.removeSysError("s1");
+
+    CPPUNIT_ASSERT(!v.sysVisible(info.Analyses[0].bins[0].systematicErrors[0]));
+    CPPUNIT_ASSERT(v.sysVisible(info.Analyses[0].bins[0].systematicErrors[1]));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, v.listAllSysErrors().size());
+
+    vector<CalibrationAnalysis> m (v.materialize());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, m[0].bins[0].systematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL(string("s2"), m[0].bins[0].systematicErrors[0].name);
+  }
+
+  void testSysUncorrelated()
+  {
+    CalibrationInfo info (makeInfo());
+    CalibrationInfoView v (info);
+    v.makeSysErrorUncorrelated("s2");
+
+    vector<CalibrationAnalysis> m (v.materialize());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, m[0].bins[0].systematicErrors.size());
+    CPPUNIT_ASSERT(!m[0].bins[0].systematicErrors[0].uncorrelated);
+    CPPUNIT_ASSERT(m[0].bins[0].systematicErrors[1].uncorrelated);
+    CPPUNIT_ASSERT(!info.Analyses[0].bins[0].systematicErrors[1].uncorrelated);
+  }
+
+  void testCopyIsIndependent()
+  {
+    CalibrationInfo info (makeInfo());
+    CalibrationInfoView v1 (info);
+    CalibrationInfoView v2 (v1);
+    v2.removeSysError("s1");
+    v2.removeBin(firstBin(info.Analyses[0]));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, v1.listAllSysErrors().size());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, v1.listAllBins().size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, v2.listAllSysErrors().size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, v2.listAllBins().size());
+  }
+
+  void testSplit()
+  {
+    CalibrationInfo info (makeInfo());
+    CalibrationInfoView v (info);
+    v.removeSysError("s1");
+    map<string, CalibrationInfoView> split (v.splitByJetTagFlavOp());
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, split.size());
+    map<string, vector<CalibrationAnalysis> > expected (BinAnalysesByJetTagFlavOp(info.Analyses));
+    for (map<string, vector<CalibrationAnalysis> >::const_iterator itr = expected.begin(); itr != expected.end(); itr++) {
+      CPPUNIT_ASSERT(split.find(itr->first) != split.end());
+      const CalibrationInfoView &s (split.find(itr->first)->second);
+      CPPUNIT_ASSERT_EQUAL(itr->second.size(), s.nAnalyses());
+
+      // The masks carry over, as does the combination info.
+      CPPUNIT_ASSERT_EQUAL((size_t)1, s.listAllSysErrors().size());
+      CPPUNIT_ASSERT_EQUAL(string("combined"), s.combinationName());
+    }
+  }
+
+  void testHeaders()
+  {
+    CalibrationInfo info (makeInfo());
+    info.Analyses[0].metadata["gchi2"].push_back(1.0);
+    CalibrationInfoView v (info);
+
+    vector<CalibrationAnalysis> h (v.headers());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, h.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, h[0].bins.size());
+    CPPUNIT_ASSERT_EQUAL(string("0.5"), h[0].operatingPoint);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, h[0].metadata["gchi2"].size());
+  }
+
+  void testMatchesBinUtils()
+  {
+    CalibrationInfo info (makeInfo());
+    set<CalibrationBinBoundary> bin (firstBin(info.Analyses[0]));
+
+    CalibrationInfoView v (info);
+    v.keepOnlyBin(bin);
+    v.removeSysError("s1");
+
+    vector<CalibrationAnalysis> expected (removeSysError(removeAllBinsButBin(info.Analyses, bin), "s1"));
+    vector<CalibrationAnalysis> m (v.materialize());
+    CPPUNIT_ASSERT_EQUAL(expected.size(), m.size());
+    for (size_t i = 0; i < m.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(expected[i].bins.size(), m[i].bins.size());
+      CPPUNIT_ASSERT_EQUAL(expected[i].bins[0].systematicErrors.size(), m[i].bins[0].systematicErrors.size());
+    }
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CalibrationInfoViewTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
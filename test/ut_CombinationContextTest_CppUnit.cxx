@@ -81,6 +81,10 @@ class CombinationContextTest : public CppUnit::TestFixture
   CPPUNIT_TEST ( testMeasurementSharedError2 );
   CPPUNIT_TEST ( testMeasurementSharedError3 );
 
+  CPPUNIT_TEST ( testFitPhases );
+  CPPUNIT_TEST ( testFitPhasesNoTiming );
+  CPPUNIT_TEST ( testFitTimingSameResult );
+
   CPPUNIT_TEST_SUITE_END();
 
   void testCTor()
@@ -966,6 +970,111 @@ class CombinationContextTest : public CppUnit::TestFixture
     CPPUNIT_ASSERT_DOUBLES_EQUAL(0.1*sqrt(2), s.second, 0.001);
   }
 
+  void testFitPhases()
+  {
+    CombinationContext c;
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    Measurement *m2 = c.AddMeasurement ("a1", -10.0, 10.0, 0.9, 0.2);
+    m1->addSystematicAbs("s1", 0.2);
+    m2->addSystematicAbs("s2", 0.4);
+
+    setupRoo();
+    c.SetFitTiming(true);
+    c.Fit();
+    CombinationContext::ExtraFitInfo info (c.GetExtraFitInformation());
+
+    CPPUNIT_ASSERT_EQUAL (2, info._nMeasurements);
+    CPPUNIT_ASSERT_EQUAL (3, info._nParameters);
+
+    // build, master, a refit for each sys error, chi2, stat, restore
+    CPPUNIT_ASSERT_EQUAL (size_t(7), info._phases.size());
+    CPPUNIT_ASSERT_EQUAL (string("build"), info._phases[0].name);
+    CPPUNIT_ASSERT_EQUAL (string("master"), info._phases[1].name);
+    CPPUNIT_ASSERT_EQUAL (string("sys"), info._phases[2].name);
+    CPPUNIT_ASSERT_EQUAL (string("s1"), info._phases[2].sysErrorName);
+    CPPUNIT_ASSERT_EQUAL (string("s2"), info._phases[3].sysErrorName);
+    CPPUNIT_ASSERT_EQUAL (string("chi2"), info._phases[4].name);
+    CPPUNIT_ASSERT_EQUAL (string("stat"), info._phases[5].name);
+    CPPUNIT_ASSERT_EQUAL (string("restore"), info._phases[6].name);
+
+    for (size_t i = 0; i < info._phases.size(); i++) {
+      const CombinationContext::ExtraFitInfo::FitPhase &p (info._phases[i]);
+      CPPUNIT_ASSERT (p.wallTime >= 0.0);
+      CPPUNIT_ASSERT (p.cpuTime >= 0.0);
+      bool minimizes = p.name == "master" || p.name == "sys" || p.name == "restore";
+      CPPUNIT_ASSERT_EQUAL (minimizes, p.minimized);
+      if (minimizes) {
+	CPPUNIT_ASSERT_EQUAL (0, p.minuitStatus);
+	CPPUNIT_ASSERT (p.nllCalls > 0);
+      }
+    }
+  }
+
+  // Without timing the fits are done with fitTo: MINUIT status, but no call count.
+  void testFitPhasesNoTiming()
+  {
+    CombinationContext c;
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    Measurement *m2 = c.AddMeasurement ("a1", -10.0, 10.0, 0.9, 0.2);
+    m1->addSystematicAbs("s1", 0.2);
+    m2->addSystematicAbs("s2", 0.4);
+
+    setupRoo();
+    c.Fit();
+    CombinationContext::ExtraFitInfo info (c.GetExtraFitInformation());
+
+    CPPUNIT_ASSERT_EQUAL (size_t(7), info._phases.size());
+    for (size_t i = 0; i < info._phases.size(); i++) {
+      const CombinationContext::ExtraFitInfo::FitPhase &p (info._phases[i]);
+      bool minimizes = p.name == "master" || p.name == "sys" || p.name == "restore";
+      CPPUNIT_ASSERT_EQUAL (minimizes, p.minimized);
+      if (minimizes)
+	CPPUNIT_ASSERT_EQUAL (0, p.minuitStatus);
+      CPPUNIT_ASSERT_EQUAL (0, p.nllCalls);
+    }
+  }
+
+  // Counting the calls must not change the numbers - and the numbers are those of the
+  // weighted average, as they always were.
+  map<string, CombinationContext::FitResult> fitTwoWithSys (bool fitTiming)
+  {
+    CombinationContext c;
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    Measurement *m2 = c.AddMeasurement ("a1", -10.0, 10.0, 0.9, 0.2);
+    m1->addSystematicAbs("s1", 0.2);
+    m2->addSystematicAbs("s2", 0.4);
+
+    setupRoo();
+    c.SetFitTiming(fitTiming);
+    return c.Fit();
+  }
+
+  void testFitTimingSameResult()
+  {
+    map<string, CombinationContext::FitResult> plain (fitTwoWithSys(false));
+    map<string, CombinationContext::FitResult> timed (fitTwoWithSys(true));
+
+    CPPUNIT_ASSERT_EQUAL (size_t(1), plain.size());
+    CPPUNIT_ASSERT_EQUAL (size_t(1), timed.size());
+    const CombinationContext::FitResult &p (plain["a1"]);
+    const CombinationContext::FitResult &t (timed["a1"]);
+
+    // Total errors: sqrt(0.1^2+0.2^2) and sqrt(0.2^2+0.4^2) - weights 0.8 and 0.2.
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.98, p.centralValue, 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (sqrt(0.8*0.8*0.01 + 0.2*0.2*0.04), p.statisticalError, 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (p.centralValue, t.centralValue, 1e-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (p.statisticalError, t.statisticalError, 1e-6);
+
+    CPPUNIT_ASSERT_EQUAL (p.sysErrors.size(), t.sysErrors.size());
+    for (map<string, double>::const_iterator i_p = p.sysErrors.begin(); i_p != p.sysErrors.end(); i_p++) {
+      map<string, double>::const_iterator i_t = t.sysErrors.find(i_p->first);
+      CPPUNIT_ASSERT (i_t != t.sysErrors.end());
+      CPPUNIT_ASSERT_DOUBLES_EQUAL (i_p->second, i_t->second, 1e-6);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.8*0.2, p.sysErrors.find("s1")->second, 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.2*0.4, p.sysErrors.find("s2")->second, 0.01);
+  }
+
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(CombinationContextTest);
@@ -39,6 +39,7 @@ class CombinerTest : public CppUnit::TestFixture
 
   CPPUNIT_TEST(testCombineTwoAnaLinage);
   CPPUNIT_TEST(testCombineThreeAnaLinage);
+  CPPUNIT_TEST(testCombineSameNameBinsFirstKept);
   CPPUNIT_TEST(combineBBBLinageCheck);
   CPPUNIT_TEST(combineBBBLinageCheckAnasNotEverywhere1);
   CPPUNIT_TEST(combineBBBLinageCheckAnasNotEverywhere2);
@@ -90,11 +91,15 @@ class CombinerTest : public CppUnit::TestFixture
   CPPUNIT_TEST ( rebinOneToOne );
   CPPUNIT_TEST ( rebinTwoToOne );
   CPPUNIT_TEST ( rebinThreeToOne );
+  CPPUNIT_TEST ( rebinThreeToOneRounding );
+  CPPUNIT_TEST ( rebinDuplicateSys );
 
   CPPUNIT_TEST (testNDOFInBinByBin);
 
   CPPUNIT_TEST(fillContextWithOneBinAnalysis);
 
+  CPPUNIT_TEST(testFitTimingMetadata);
+
   CPPUNIT_TEST_SUITE_END();
 
   void setupRoo()
@@ -689,6 +694,52 @@ class CombinerTest : public CppUnit::TestFixture
 	  CPPUNIT_ASSERT_EQUAL(string("s8+ptrel"), result[0].metadata_s["Linage"]);
   }
 
+  // Two bins whose edges only differ past the precision of the bin name are one bin in
+  // the fit. The result has the edges of the first one seen.
+  CalibrationInfo sameNameBinsInfo(double high1, double high2)
+  {
+	  CalibrationBin b1;
+	  b1.centralValue = 1.0;
+	  b1.centralValueStatisticalError = 0.1;
+	  CalibrationBinBoundary bound;
+	  bound.variable = "eta";
+	  bound.lowvalue = 0.0;
+	  bound.highvalue = high1;
+	  b1.binSpec.push_back(bound);
+
+	  CalibrationAnalysis ana1;
+	  ana1.name = "s8";
+	  ana1.flavor = "bottom";
+	  ana1.tagger = "comb";
+	  ana1.operatingPoint = "0.50";
+	  ana1.jetAlgorithm = "AntiKt4Topo";
+	  ana1.bins.push_back(b1);
+
+	  CalibrationAnalysis ana2(ana1);
+	  ana2.name = "ptrel";
+	  ana2.bins[0].binSpec[0].highvalue = high2;
+
+	  CalibrationInfo info;
+	  info.Analyses.push_back(ana1);
+	  info.Analyses.push_back(ana2);
+	  return info;
+  }
+
+  void testCombineSameNameBinsFirstKept()
+  {
+	  setupRoo();
+	  double longer = 2.5 + 1.0e-11;
+
+	  vector<CalibrationAnalysis> result(CombineAnalyses(sameNameBinsInfo(2.5, longer)));
+	  CPPUNIT_ASSERT_EQUAL(size_t(1), result.size());
+	  CPPUNIT_ASSERT_EQUAL(size_t(1), result[0].bins.size());
+	  CPPUNIT_ASSERT_EQUAL(2.5, result[0].bins[0].binSpec[0].highvalue);
+
+	  result = CombineAnalyses(sameNameBinsInfo(longer, 2.5));
+	  CPPUNIT_ASSERT_EQUAL(size_t(1), result[0].bins.size());
+	  CPPUNIT_ASSERT_EQUAL(longer, result[0].bins[0].binSpec[0].highvalue);
+  }
+
   void testCombineThreeAnaLinage()
   {
 	  // Single analysis - test simple case!
@@ -2532,6 +2583,54 @@ class CombinerTest : public CppUnit::TestFixture
     CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1/sqrt(3), result.bins[0].centralValueStatisticalError, 0.0001);
   }
 
+  void rebinThreeToOneRounding()
+  {
+    // The widths of these bins don't add up to exactly the width of the
+    // template bin in floating point.
+    CalibrationAnalysis ana(SimpleAna());
+    ana.bins[0].binSpec[0].lowvalue = 0.0;
+    ana.bins[0].binSpec[0].highvalue = 0.3;
+    set<set<CalibrationBinBoundary> > atemp (listAnalysisBins(ana));
+
+    ana.bins.clear();
+    AddBin (ana, "eta", 0.0, 0.1, 0.5, 0.1);
+    AddBin (ana, "eta", 0.1, 0.2, 0.5, 0.1);
+    AddBin (ana, "eta", 0.2, 0.3, 0.5, 0.1);
+
+    CalibrationAnalysis result (RebinAnalysis (atemp, ana));
+    CPPUNIT_ASSERT_EQUAL (size_t(1), result.bins.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1/sqrt(3), result.bins[0].centralValueStatisticalError, 0.0001);
+  }
+
+  void rebinDuplicateSys()
+  {
+    // A bin with the same systematic error twice - the last one is used.
+    CalibrationAnalysis ana(SimpleAna());
+    ana.bins[0].binSpec[0].highvalue = 5.0; // Now eta is 0 to 5 in one bin
+    set<set<CalibrationBinBoundary> > atemp (listAnalysisBins(ana));
+
+    ana = SimpleAna(false);
+    AddBin (ana,
+	    "eta",
+	    2.5, 5.0,
+	    0.5, 0.1);
+
+    SystematicError e;
+    e.name = "s1";
+    e.value = 0.1;
+    ana.bins[0].systematicErrors.push_back(e);
+    ana.bins[1].systematicErrors.push_back(e);
+    e.value = 0.3;
+    ana.bins[1].systematicErrors.push_back(e);
+
+    CalibrationAnalysis result (RebinAnalysis (atemp, ana));
+
+    CPPUNIT_ASSERT_EQUAL (size_t(1), result.bins.size());
+    CPPUNIT_ASSERT_EQUAL (size_t(1), result.bins[0].systematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL (string("s1"), result.bins[0].systematicErrors[0].name);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.2, result.bins[0].systematicErrors[0].value, 0.0001);
+  }
+
   void rebinThreeToOneWithOverlap()
   {
     // Make sure that the low and high vale tests for bins being adjacent works
@@ -2661,6 +2760,43 @@ class CombinerTest : public CppUnit::TestFixture
     // There should be only one measurement.
     CPPUNIT_ASSERT_EQUAL((size_t)1, ctx.GetAllMeasurements().size());
   }
+
+  // The fit timing only shows up in the meta data when asked for.
+  void testFitTimingMetadata()
+  {
+    CalibrationAnalysis ana1(SimpleAna(false));
+    ana1.name = "s8";
+    CalibrationAnalysis ana2(ana1);
+    ana2.name = "ptrel";
+
+    CalibrationInfo inputs;
+    inputs.Analyses.push_back(ana1);
+    inputs.Analyses.push_back(ana2);
+    inputs.CombinationAnalysisName = "combined";
+
+    setupRoo();
+    vector<CalibrationAnalysis> plain(CombineAnalyses(inputs, false));
+    CPPUNIT_ASSERT(plain[0].metadata.find("fit_time_master") == plain[0].metadata.end());
+
+    vector<CalibrationAnalysis> timed(CombineAnalyses(inputs, false, kCombineByFullAnalysis, true));
+    const map<string, vector<double> > &meta(timed[0].metadata);
+    CPPUNIT_ASSERT(meta.find("fit_time_build") != meta.end());
+    CPPUNIT_ASSERT(meta.find("fit_time_chi2") != meta.end());
+    CPPUNIT_ASSERT(meta.find("fit_time_stat") != meta.end());
+    CPPUNIT_ASSERT(meta.find("fit_minuit_stat") == meta.end());
+
+    map<string, vector<double> >::const_iterator i_t = meta.find("fit_time_master");
+    CPPUNIT_ASSERT(i_t != meta.end());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, i_t->second.size());
+
+    map<string, vector<double> >::const_iterator i_m = meta.find("fit_minuit_master");
+    CPPUNIT_ASSERT(i_m != meta.end());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, i_m->second.size());
+    CPPUNIT_ASSERT_EQUAL(0.0, i_m->second[0]);
+    CPPUNIT_ASSERT(i_m->second[2] > 0.0);
+
+    CPPUNIT_ASSERT_EQUAL(2.0, meta.find("fit_nmeasurements")->second[0]);
+  }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(CombinerTest);
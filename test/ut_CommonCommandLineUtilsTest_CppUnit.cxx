@@ -4,6 +4,9 @@
 
 #include "Combination/CommonCommandLineUtils.h"
 #include "Combination/BinNameUtils.h"
+#include "Combination/CalibrationDataModelBinary.h"
+#include "Combination/SyntheticInputs.h"
+#include "Combination/CalibrationDataModelStreams.h"
 
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/Exception.h>
@@ -11,6 +14,9 @@
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <memory>
 
 using namespace std;
 using namespace BTagCombination;
@@ -88,6 +94,12 @@ class CommonCommandLineUtilsTest : public CppUnit::TestFixture
 
   // Test reference bin systematic uncertainties and extrapolated bin uncertainties
   CPPUNIT_TEST(testInputFromFileExtrapolatedBins);
+  CPPUNIT_TEST(testInputFromBinaryFile);
+  CPPUNIT_TEST(testMapBinaryFile);
+  CPPUNIT_TEST(testMapOnlyPlainBinaryFile);
+  CPPUNIT_TEST_EXCEPTION(testMapInconsistentBinning, std::runtime_error);
+  CPPUNIT_TEST(testKeepParsedInputs);
+  CPPUNIT_TEST(testKeepBadInput);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -920,7 +932,215 @@ class CommonCommandLineUtilsTest : public CppUnit::TestFixture
     CPPUNIT_ASSERT_DOUBLES_EQUAL(acc,exAcc,0.1);
   }
 
+  // A binary file loads the same as the text file it was made from, and --ignore
+  // still applies.
+  void testInputFromBinaryFile()
+  {
+    CalibrationInfo text;
+    vector<string> unknown;
+    const char *argv[] = {TESTDATA "/extrapolatedbin.txt"};
+    ParseOPInputArgs(argv, 1, text, unknown);
+
+    const char *binFile = "ut_CommonCommandLineUtilsTest.ftb";
+    {
+      ofstream out (binFile, ios::out | ios::binary);
+      WriteBinaryInfo(out, text);
+    }
+
+    CalibrationInfo results;
+    const char *argvb[] = {binFile};
+    ParseOPInputArgs(argvb, 1, results, unknown);
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, unknown.size());
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, results.Analyses.size());
+    CPPUNIT_ASSERT_EQUAL(text.Analyses[0].name, results.Analyses[0].name);
+    CPPUNIT_ASSERT_EQUAL((size_t) 2, results.Analyses[0].bins.size());
+    CPPUNIT_ASSERT_EQUAL(text.Analyses[0].bins[1].referenceBinSystematicErrors.size(),
+			 results.Analyses[0].bins[1].referenceBinSystematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL(text.Analyses[0].bins[0].centralValue, results.Analyses[0].bins[0].centralValue);
+
+    CalibrationInfo ignored;
+    const char *argvi[] = {binFile, "--ignore", "ttbarC.*"};
+    ParseOPInputArgs(argvi, 3, ignored, unknown);
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, ignored.Analyses.size());
+
+    remove(binFile);
+  }
+
+  // A mapped file gives the same analyses as loading it, aliases and all.
+  void testMapBinaryFile()
+  {
+    SyntheticInputSpec spec;
+    spec.nAnalyses = 3;
+    spec.nExtendedBins = 1;
+    spec.copies = true;
+    const char *binFile = "ut_CommonCommandLineUtilsTest_map.ftb";
+    {
+      ofstream out (binFile, ios::out | ios::binary);
+      WriteBinaryInfo(out, GenerateSyntheticInputs(spec));
+    }
 
+    CalibrationInfo loaded;
+    vector<string> unknown;
+    const char *argv[] = {binFile};
+    ParseOPInputArgs(argv, 1, loaded, unknown);
+
+    vector<string> args;
+    args.push_back(binFile);
+    args.push_back("--names");
+    unique_ptr<MappedCalibrationFile> mapped (MapOPInputArgs(args, unknown));
+    CPPUNIT_ASSERT(mapped.get() != 0);
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, unknown.size());
+    CPPUNIT_ASSERT_EQUAL(string("names"), unknown[0]);
+
+    vector<MappedInputAnalysis> anas (MappedInputAnalyses(*mapped));
+    CPPUNIT_ASSERT_EQUAL(loaded.Analyses.size(), anas.size());
+    for (size_t i = 0; i < anas.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(OPFullName(loaded.Analyses[i]), OPFullName(anas[i].header));
+      CalibrationAnalysis a (anas[i].load());
+      CPPUNIT_ASSERT_EQUAL(loaded.Analyses[i].bins.size(), a.bins.size());
+      for (size_t b = 0; b < a.bins.size(); b++) {
+	CPPUNIT_ASSERT_EQUAL(OPBinName(loaded.Analyses[i].bins[b]), OPBinName(a.bins[b]));
+	CPPUNIT_ASSERT_EQUAL(loaded.Analyses[i].bins[b].centralValue, a.bins[b].centralValue);
+	CPPUNIT_ASSERT_EQUAL(loaded.Analyses[i].bins[b].systematicErrors.size(), a.bins[b].systematicErrors.size());
+      }
+    }
+    CPPUNIT_ASSERT_EQUAL(loaded.Defaults.size(), mapped->defaults().size());
+
+    remove(binFile);
+  }
+
+  // The parts of a mapped analysis are checked as CombineSameAnalyses checks them.
+  void testMapInconsistentBinning()
+  {
+    CalibrationInfo info;
+    info.Analyses.push_back(CreateOneBinAnalsis());
+    info.Analyses.push_back(CreateOneBinAnalsis());
+    info.Analyses[1].bins[0].binSpec[0].lowvalue = 25;
+    info.Analyses[1].bins[0].binSpec[0].highvalue = 35;
+    const char *binFile = "ut_CommonCommandLineUtilsTest_map.ftb";
+    {
+      ofstream out (binFile, ios::out | ios::binary);
+      WriteBinaryInfo(out, info);
+    }
+
+    MappedCalibrationFile mapped (binFile);
+    remove(binFile);
+    MappedInputAnalyses(mapped);
+  }
+
+  // Anything that changes what would be loaded, or a text file, isn't mapped.
+  void testMapOnlyPlainBinaryFile()
+  {
+    const char *binFile = "ut_CommonCommandLineUtilsTest_map.ftb";
+    {
+      ofstream out (binFile, ios::out | ios::binary);
+      WriteBinaryInfo(out, GenerateSyntheticInputs(SyntheticInputSpec()));
+    }
+
+    vector<string> unknown;
+    vector<string> args;
+    args.push_back(binFile);
+    CPPUNIT_ASSERT(MapOPInputArgs(args, unknown).get() != 0);
+
+    args.push_back("--ignore");
+    args.push_back(".*");
+    CPPUNIT_ASSERT(MapOPInputArgs(args, unknown).get() == 0);
+
+    args.clear();
+    args.push_back(binFile);
+    args.push_back(binFile);
+    CPPUNIT_ASSERT(MapOPInputArgs(args, unknown).get() == 0);
+
+    args.clear();
+    args.push_back(TESTDATA "/JetFitcnn_eff60.txt");
+    CPPUNIT_ASSERT(MapOPInputArgs(args, unknown).get() == 0);
+
+    remove(binFile);
+  }
+
+  // Loading from the parsed inputs gives what parsing would, filters and all, and a
+  // changed file is parsed again.
+  void testKeepParsedInputs()
+  {
+    SyntheticInputSpec spec;
+    spec.nAnalyses = 3;
+    const char *textFile = "ut_CommonCommandLineUtilsTest_keep.txt";
+    {
+      ofstream out (textFile);
+      out << GenerateSyntheticInputs(spec);
+    }
+
+    vector<string> args;
+    args.push_back(textFile);
+    args.push_back("--analysis");
+    args.push_back("ana[0-3]");
+
+    CalibrationInfo parsed;
+    vector<string> unknown;
+    ParseOPInputArgs(args, parsed, unknown);
+
+    KeepParsedInputs();
+    CPPUNIT_ASSERT(PreloadInputFile(textFile));
+    CPPUNIT_ASSERT(!PreloadInputFile("ut_CommonCommandLineUtilsTest_notthere.txt"));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, LoadedInputFiles().size());
+
+    for (int i = 0; i < 2; i++) {
+      CalibrationInfo kept;
+      ParseOPInputArgs(args, kept, unknown);
+      CPPUNIT_ASSERT(parsed.Analyses.size() > 0);
+      CPPUNIT_ASSERT_EQUAL(parsed.Analyses.size(), kept.Analyses.size());
+      for (size_t a = 0; a < kept.Analyses.size(); a++) {
+	CPPUNIT_ASSERT_EQUAL(OPFullName(parsed.Analyses[a]), OPFullName(kept.Analyses[a]));
+	CPPUNIT_ASSERT_EQUAL(parsed.Analyses[a].bins.size(), kept.Analyses[a].bins.size());
+      }
+      CPPUNIT_ASSERT_EQUAL(parsed.Correlations.size(), kept.Correlations.size());
+    }
+    vector<string> loaded (LoadedInputFiles());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, loaded.size());
+    CPPUNIT_ASSERT(loaded[0].size() > string(textFile).size() && loaded[0][0] == '/');
+    CPPUNIT_ASSERT_EQUAL(string(textFile), loaded[0].substr(loaded[0].size() - string(textFile).size()));
+
+    // A different file, and a different size.
+    spec.nAnalyses = 5;
+    {
+      ofstream out (textFile);
+      out << GenerateSyntheticInputs(spec);
+    }
+    CalibrationInfo changed, reparsed;
+    ParseOPInputArgs(args, changed, unknown);
+    KeepParsedInputs(false);
+    ParseOPInputArgs(args, reparsed, unknown);
+    CPPUNIT_ASSERT_EQUAL(reparsed.Analyses.size(), changed.Analyses.size());
+    CPPUNIT_ASSERT(changed.Analyses.size() > parsed.Analyses.size());
+    CPPUNIT_ASSERT(!PreloadInputFile(textFile));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, LoadedInputFiles().size());
+
+    remove(textFile);
+  }
+
+  // A file that doesn't parse isn't kept, and is parsed again once it changes.
+  void testKeepBadInput()
+  {
+    const char *textFile = "ut_CommonCommandLineUtilsTest_keepbad.txt";
+    {
+      ofstream out (textFile);
+      out << "this is not an analysis";
+    }
+    KeepParsedInputs();
+    CPPUNIT_ASSERT(!PreloadInputFile(textFile));
+    CPPUNIT_ASSERT(!PreloadInputFile(textFile));
+
+    SyntheticInputSpec spec;
+    spec.nAnalyses = 1;
+    {
+      ofstream out (textFile);
+      out << GenerateSyntheticInputs(spec);
+    }
+    CPPUNIT_ASSERT(PreloadInputFile(textFile));
+    KeepParsedInputs(false);
+
+    remove(textFile);
+  }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(CommonCommandLineUtilsTest);
@@ -0,0 +1,427 @@
+///
+/// CppUnit tests for the fit result cache
+///
+
+#include "Combination/FitResultCache.h"
+
+#include <TSystem.h>
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  // Remove a cache directory and everything in it.
+  void removeCache (const string &dir)
+  {
+    void *d = gSystem->OpenDirectory(dir.c_str());
+    if (d == 0)
+      return;
+    const char *name;
+    while ((name = gSystem->GetDirEntry(d)) != 0) {
+      string n (name);
+      if (n != "." && n != "..")
+	gSystem->Unlink((dir + "/" + n).c_str());
+    }
+    gSystem->FreeDirectory(d);
+    gSystem->Unlink(dir.c_str());
+  }
+
+  // The entry files in a cache directory.
+  vector<string> entryFiles (const string &dir)
+  {
+    vector<string> files;
+    void *d = gSystem->OpenDirectory(dir.c_str());
+    const char *name;
+    while ((name = gSystem->GetDirEntry(d)) != 0) {
+      string n (name);
+      if (n.size() > 6 && n.substr(n.size() - 6) == ".ftfit")
+	files.push_back(dir + "/" + n);
+    }
+    gSystem->FreeDirectory(d);
+    return files;
+  }
+
+  CalibrationAnalysis generate_ana (const string &name, double central)
+  {
+    CalibrationAnalysis ana;
+    ana.name = name;
+    ana.flavor = "bottom";
+    ana.tagger = "SV0";
+    ana.operatingPoint = "0.50";
+    ana.jetAlgorithm = "AntiKt4Topo";
+
+    CalibrationBin b;
+    CalibrationBinBoundary bb;
+    bb.variable = "pt";
+    bb.lowvalue = 20.0;
+    bb.highvalue = 30.0;
+    b.binSpec.push_back(bb);
+    b.centralValue = central;
+    b.centralValueStatisticalError = 0.1;
+    b.isExtended = false;
+
+    SystematicError e;
+    e.name = "err";
+    e.value = 0.05;
+    e.uncorrelated = false;
+    b.systematicErrors.push_back(e);
+    ana.bins.push_back(b);
+
+    ana.metadata["gchi2"].push_back(1.5);
+    return ana;
+  }
+
+  vector<CalibrationAnalysis> generate_anas ()
+  {
+    vector<CalibrationAnalysis> anas;
+    anas.push_back(generate_ana("s8", 1.1));
+    anas.push_back(generate_ana("ptrel", 0.9));
+    return anas;
+  }
+
+  AnalysisCorrelation generate_cor (const string &name1, const string &name2)
+  {
+    AnalysisCorrelation c;
+    c.analysis1Name = name1;
+    c.analysis2Name = name2;
+    c.flavor = "bottom";
+    c.tagger = "SV0";
+    c.operatingPoint = "0.50";
+    c.jetAlgorithm = "AntiKt4Topo";
+
+    BinCorrelation b;
+    CalibrationBinBoundary bb;
+    bb.variable = "pt";
+    bb.lowvalue = 20.0;
+    bb.highvalue = 30.0;
+    b.binSpec.push_back(bb);
+    b.hasStatCorrelation = true;
+    b.statCorrelation = 0.3;
+    c.bins.push_back(b);
+    return c;
+  }
+}
+
+class FitResultCacheTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( FitResultCacheTest );
+
+  CPPUNIT_TEST( testKeyStable );
+  CPPUNIT_TEST( testKeyValueChange );
+  CPPUNIT_TEST( testKeySettings );
+  CPPUNIT_TEST( testKeyCorrelations );
+
+  CPPUNIT_TEST( testMiss );
+  CPPUNIT_TEST( testRoundTrip );
+  CPPUNIT_TEST( testSharedDirectory );
+  CPPUNIT_TEST( testCorruptEntry );
+  CPPUNIT_TEST( testOtherKeySameFile );
+  CPPUNIT_TEST( testStoreTwice );
+  CPPUNIT_TEST( testEvictByCount );
+  CPPUNIT_TEST( testEvictBySize );
+  CPPUNIT_TEST( testEvictToUnderLimit );
+
+  CPPUNIT_TEST( testParseMB );
+  CPPUNIT_TEST_EXCEPTION( testParseMBNotNumber, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testParseMBUnits, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testParseMBNegative, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testParseMBEmpty, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testParseMBTooBig, std::runtime_error );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  void testKeyStable()
+  {
+    vector<AnalysisCorrelation> cors;
+    cors.push_back(generate_cor("s8", "ptrel"));
+    string k1 (FitResultCache::Key(generate_anas(), cors, "AllBins"));
+    string k2 (FitResultCache::Key(generate_anas(), cors, "AllBins"));
+    CPPUNIT_ASSERT_EQUAL(k1, k2);
+    CPPUNIT_ASSERT(k1.find("AllBins") != string::npos);
+  }
+
+  void testKeyValueChange()
+  {
+    vector<AnalysisCorrelation> cors;
+    vector<CalibrationAnalysis> anas (generate_anas());
+    string k1 (FitResultCache::Key(anas, cors, "AllBins"));
+
+    // Even the smallest change is a different fit.
+    anas[1].bins[0].systematicErrors[0].value += 1.0e-15;
+    CPPUNIT_ASSERT(k1 != FitResultCache::Key(anas, cors, "AllBins"));
+  }
+
+  void testKeySettings()
+  {
+    vector<AnalysisCorrelation> cors;
+    CPPUNIT_ASSERT(FitResultCache::Key(generate_anas(), cors, "AllBins")
+		   != FitResultCache::Key(generate_anas(), cors, "ByBin"));
+  }
+
+  void testKeyCorrelations()
+  {
+    vector<AnalysisCorrelation> cors;
+    string k1 (FitResultCache::Key(generate_anas(), cors, "AllBins"));
+
+    // A correlation with an analysis that isn't in the fit makes no difference.
+    cors.push_back(generate_cor("s8", "system8"));
+    AnalysisCorrelation otherOP (generate_cor("s8", "ptrel"));
+    otherOP.operatingPoint = "0.60";
+    cors.push_back(otherOP);
+    CPPUNIT_ASSERT_EQUAL(k1, FitResultCache::Key(generate_anas(), cors, "AllBins"));
+
+    // One between the two does.
+    cors.push_back(generate_cor("s8", "ptrel"));
+    string k2 (FitResultCache::Key(generate_anas(), cors, "AllBins"));
+    CPPUNIT_ASSERT(k1 != k2);
+
+    cors.back().bins[0].statCorrelation = 0.4;
+    CPPUNIT_ASSERT(k2 != FitResultCache::Key(generate_anas(), cors, "AllBins"));
+  }
+
+  void testMiss()
+  {
+    string dir ("ut_FitResultCacheTest_miss");
+    removeCache(dir);
+    FitResultCache cache (dir);
+
+    CalibrationAnalysis r;
+    CPPUNIT_ASSERT(!cache.Lookup("nothere", r));
+    FitResultCache::Stats s (cache.stats());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, s.hits);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, s.misses);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, s.entries);
+
+    removeCache(dir);
+  }
+
+  void testRoundTrip()
+  {
+    string dir ("ut_FitResultCacheTest_roundtrip");
+    removeCache(dir);
+    FitResultCache cache (dir);
+
+    CalibrationAnalysis stored (generate_ana("combined", 1.0/3.0));
+    string key (FitResultCache::Key(generate_anas(), vector<AnalysisCorrelation>(), "AllBins"));
+    cache.Store(key, stored);
+
+    CalibrationAnalysis r;
+    CPPUNIT_ASSERT(cache.Lookup(key, r));
+    CPPUNIT_ASSERT_EQUAL(string("combined"), r.name);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.bins.size());
+    CPPUNIT_ASSERT_EQUAL(1.0/3.0, r.bins[0].centralValue);
+    CPPUNIT_ASSERT_EQUAL(1.5, r.metadata["gchi2"][0]);
+
+    FitResultCache::Stats s (cache.stats());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, s.hits);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, s.misses);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, s.stores);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, s.entries);
+    CPPUNIT_ASSERT(s.bytes > 0);
+
+    ostringstream text;
+    text << s;
+    CPPUNIT_ASSERT(text.str().find("1 hits") != string::npos);
+
+    removeCache(dir);
+  }
+
+  void testSharedDirectory()
+  {
+    string dir ("ut_FitResultCacheTest_shared");
+    removeCache(dir);
+    {
+      FitResultCache cache (dir);
+      cache.Store("akey", generate_ana("combined", 1.0));
+    }
+
+    // A later run sees what an earlier one left.
+    FitResultCache cache (dir);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, cache.stats().entries);
+    CalibrationAnalysis r;
+    CPPUNIT_ASSERT(cache.Lookup("akey", r));
+    CPPUNIT_ASSERT(!cache.Lookup("bkey", r));
+
+    removeCache(dir);
+  }
+
+  void testCorruptEntry()
+  {
+    string dir ("ut_FitResultCacheTest_corrupt");
+    removeCache(dir);
+    FitResultCache cache (dir);
+    cache.Store("akey", generate_ana("a", 1.0));
+    vector<string> files (entryFiles(dir));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, files.size());
+    {
+      ofstream out (files[0].c_str());
+      out << "FTFIT2" << endl << "4" << endl << "akey" << "not a result";
+    }
+
+    CalibrationAnalysis r;
+    CPPUNIT_ASSERT(!cache.Lookup("akey", r));
+
+    removeCache(dir);
+  }
+
+  // If two keys ever hash the same, the entry for one isn't used for the other.
+  void testOtherKeySameFile()
+  {
+    string dir ("ut_FitResultCacheTest_otherkey");
+    removeCache(dir);
+    FitResultCache cache (dir);
+    cache.Store("akey", generate_ana("a", 1.0));
+    string aFile (entryFiles(dir)[0]);
+    cache.Store("bkey", generate_ana("b", 1.0));
+    vector<string> files (entryFiles(dir));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, files.size());
+    string bFile (files[0] == aFile ? files[1] : files[0]);
+    gSystem->Rename(aFile.c_str(), bFile.c_str());
+
+    CalibrationAnalysis r;
+    CPPUNIT_ASSERT(!cache.Lookup("bkey", r));
+    CPPUNIT_ASSERT(!cache.Lookup("akey", r));
+
+    removeCache(dir);
+  }
+
+  // Storing the same key again replaces the entry: the size doesn't grow.
+  void testStoreTwice()
+  {
+    string dir ("ut_FitResultCacheTest_twice");
+    removeCache(dir);
+    FitResultCache cache (dir);
+    cache.Store("akey", generate_ana("a", 1.0));
+    FitResultCache::Stats s1 (cache.stats());
+    cache.Store("akey", generate_ana("a", 2.0));
+    FitResultCache::Stats s2 (cache.stats());
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, s2.entries);
+    CPPUNIT_ASSERT_EQUAL(s1.bytes, s2.bytes);
+
+    CalibrationAnalysis r;
+    CPPUNIT_ASSERT(cache.Lookup("akey", r));
+    CPPUNIT_ASSERT_EQUAL(2.0, r.bins[0].centralValue);
+
+    removeCache(dir);
+  }
+
+  void testEvictByCount()
+  {
+    string dir ("ut_FitResultCacheTest_count");
+    removeCache(dir);
+    FitResultCache cache (dir, 0, 2);
+
+    cache.Store("akey", generate_ana("a", 1.0));
+    cache.Store("bkey", generate_ana("b", 1.0));
+    cache.Store("ckey", generate_ana("c", 1.0));
+
+    FitResultCache::Stats s (cache.stats());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, s.stores);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, s.evictions);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, s.entries);
+
+    CalibrationAnalysis r;
+    size_t found = 0;
+    if (cache.Lookup("akey", r)) found++;
+    if (cache.Lookup("bkey", r)) found++;
+    if (cache.Lookup("ckey", r)) found++;
+    CPPUNIT_ASSERT_EQUAL((size_t)2, found);
+
+    removeCache(dir);
+  }
+
+  void testEvictBySize()
+  {
+    string dir ("ut_FitResultCacheTest_size");
+    removeCache(dir);
+    unsigned long long oneEntry;
+    {
+      FitResultCache cache (dir, 0);
+      cache.Store("akey", generate_ana("a", 1.0));
+      oneEntry = cache.stats().bytes;
+    }
+
+    // Room for just one.
+    FitResultCache cache (dir, oneEntry + oneEntry/2);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, cache.stats().evictions);
+    cache.Store("bkey", generate_ana("b", 1.0));
+
+    FitResultCache::Stats s (cache.stats());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, s.evictions);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, s.entries);
+    CPPUNIT_ASSERT(s.bytes <= oneEntry + oneEntry/2);
+
+    removeCache(dir);
+  }
+
+  // Once over the limit, enough goes that the next few stores don't have to remove any.
+  void testEvictToUnderLimit()
+  {
+    string dir ("ut_FitResultCacheTest_under");
+    removeCache(dir);
+    FitResultCache cache (dir, 0, 20);
+
+    for (int i = 0; i < 21; i++) {
+      ostringstream key;
+      key << "key" << i;
+      cache.Store(key.str(), generate_ana("a", 1.0));
+    }
+    FitResultCache::Stats s (cache.stats());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, s.evictions);
+    CPPUNIT_ASSERT_EQUAL((size_t)18, s.entries);
+    CPPUNIT_ASSERT_EQUAL((size_t)18, entryFiles(dir).size());
+
+    cache.Store("another", generate_ana("a", 1.0));
+    cache.Store("another2", generate_ana("a", 1.0));
+    CPPUNIT_ASSERT_EQUAL((size_t)3, cache.stats().evictions);
+    CPPUNIT_ASSERT_EQUAL((size_t)20, cache.stats().entries);
+
+    removeCache(dir);
+  }
+
+  void testParseMB()
+  {
+    CPPUNIT_ASSERT_EQUAL(0ULL, ParseFitCacheMB("0"));
+    CPPUNIT_ASSERT_EQUAL(2048ULL*1024*1024, ParseFitCacheMB("2048"));
+  }
+
+  void testParseMBNotNumber()
+  {
+    ParseFitCacheMB("lots");
+  }
+
+  void testParseMBUnits()
+  {
+    ParseFitCacheMB("10GB");
+  }
+
+  void testParseMBNegative()
+  {
+    ParseFitCacheMB("-1");
+  }
+
+  void testParseMBEmpty()
+  {
+    ParseFitCacheMB("");
+  }
+
+  void testParseMBTooBig()
+  {
+    ParseFitCacheMB("99999999999999999999");
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FitResultCacheTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
@@ -0,0 +1,242 @@
+///
+/// CppUnit tests for the linear combination and its downdates
+///
+
+#include "Combination/LinearCombination.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  SystematicError makeSys (const string &name, double value, bool uncorrelated)
+  {
+    SystematicError e;
+    e.name = name;
+    e.value = value;
+    e.uncorrelated = uncorrelated;
+    return e;
+  }
+
+  CalibrationBin makeBin (double ptLow, double ptHigh, double value, double stat)
+  {
+    CalibrationBinBoundary b;
+    b.variable = "pt";
+    b.lowvalue = ptLow;
+    b.highvalue = ptHigh;
+
+    CalibrationBin bin;
+    bin.binSpec.push_back(b);
+    bin.centralValue = value;
+    bin.centralValueStatisticalError = stat;
+    return bin;
+  }
+
+  set<CalibrationBinBoundary> binSpec (double ptLow, double ptHigh)
+  {
+    CalibrationBin b (makeBin(ptLow, ptHigh, 0.0, 0.0));
+    return set<CalibrationBinBoundary>(b.binSpec.begin(), b.binSpec.end());
+  }
+
+  CalibrationAnalysis makeAnalysis (const string &name)
+  {
+    CalibrationAnalysis ana;
+    ana.name = name;
+    ana.flavor = "bottom";
+    ana.tagger = "MV1";
+    ana.operatingPoint = "0.5";
+    ana.jetAlgorithm = "AntiKt4Topo";
+    return ana;
+  }
+
+  // Three analyses over three bins, with correlated, uncorrelated and mixed errors, and a
+  // statistical correlation.
+  CalibrationInfo makeInfo ()
+  {
+    CalibrationInfo info;
+    double values[3][3] = { {1.00, 0.95, 1.10}, {1.08, 1.02, 0.97}, {0.93, 1.05, 1.01} };
+    const char *names[3] = { "ptrel", "system8", "s8ptrel" };
+    for (int a = 0; a < 3; a++) {
+      CalibrationAnalysis ana (makeAnalysis(names[a]));
+      for (int b = 0; b < 3; b++) {
+	if (a == 2 && b == 2)
+	  continue;
+	CalibrationBin bin (makeBin(20.0 + 10*b, 30.0 + 10*b, values[a][b], 0.04 + 0.01*a));
+	bin.systematicErrors.push_back(makeSys("jes", 0.03 + 0.01*b, false));
+	bin.systematicErrors.push_back(makeSys("model", 0.02*(a+1), a == 0));
+	bin.systematicErrors.push_back(makeSys("mc", 0.015, true));
+	if (a == 1)
+	  bin.systematicErrors.push_back(makeSys("fit", 0.025, false));
+	ana.bins.push_back(bin);
+      }
+      info.Analyses.push_back(ana);
+    }
+
+    AnalysisCorrelation cor;
+    cor.analysis1Name = "ptrel";
+    cor.analysis2Name = "system8";
+    cor.flavor = "bottom";
+    cor.tagger = "MV1";
+    cor.operatingPoint = "0.5";
+    cor.jetAlgorithm = "AntiKt4Topo";
+    BinCorrelation bc;
+    bc.binSpec = info.Analyses[0].bins[1].binSpec;
+    bc.hasStatCorrelation = true;
+    bc.statCorrelation = 0.3;
+    cor.bins.push_back(bc);
+    info.Correlations.push_back(cor);
+
+    return info;
+  }
+
+  void assertSame (const LinearCombination::Result &expected, const LinearCombination::Result &actual)
+  {
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.chi2, actual.chi2, 1e-8);
+    CPPUNIT_ASSERT_EQUAL(expected.ndof, actual.ndof);
+    CPPUNIT_ASSERT_EQUAL(expected.bins.size(), actual.bins.size());
+    for (map<set<CalibrationBinBoundary>, LinearCombination::BinResult>::const_iterator i = expected.bins.begin(); i != expected.bins.end(); i++) {
+      map<set<CalibrationBinBoundary>, LinearCombination::BinResult>::const_iterator a = actual.bins.find(i->first);
+      CPPUNIT_ASSERT(a != actual.bins.end());
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(i->second.centralValue, a->second.centralValue, 1e-8);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(i->second.error, a->second.error, 1e-8);
+    }
+  }
+}
+
+class LinearCombinationTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( LinearCombinationTest );
+
+  CPPUNIT_TEST( testTwoMeasurements );
+  CPPUNIT_TEST( testCorrelatedSys );
+  CPPUNIT_TEST( testRemoveBins );
+  CPPUNIT_TEST( testRemoveSysErrors );
+  CPPUNIT_TEST( testSysErrorsUncorrelated );
+  CPPUNIT_TEST( testNothingToChange );
+  CPPUNIT_TEST_EXCEPTION( testSingular, std::runtime_error );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  void testTwoMeasurements()
+  {
+    vector<CalibrationAnalysis> anas;
+    anas.push_back(makeAnalysis("ptrel"));
+    anas[0].bins.push_back(makeBin(20.0, 30.0, 1.0, 1.0));
+    anas.push_back(makeAnalysis("system8"));
+    anas[1].bins.push_back(makeBin(20.0, 30.0, 3.0, 1.0));
+
+    LinearCombination::Result r (LinearCombination(CalibrationInfoView(anas)).Solve());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, r.chi2, 1e-10);
+    CPPUNIT_ASSERT_EQUAL(1, r.ndof);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, r.bins.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, r.bins.begin()->second.centralValue, 1e-10);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(0.5), r.bins.begin()->second.error, 1e-10);
+  }
+
+  void testCorrelatedSys()
+  {
+    // A fully correlated error doesn't move the average, and adds to the error in quadrature.
+    vector<CalibrationAnalysis> anas;
+    anas.push_back(makeAnalysis("ptrel"));
+    anas[0].bins.push_back(makeBin(20.0, 30.0, 1.0, 1.0));
+    anas[0].bins[0].systematicErrors.push_back(makeSys("jes", 2.0, false));
+    anas.push_back(makeAnalysis("system8"));
+    anas[1].bins.push_back(makeBin(20.0, 30.0, 3.0, 1.0));
+    anas[1].bins[0].systematicErrors.push_back(makeSys("jes", 2.0, false));
+
+    LinearCombination::Result r (LinearCombination(CalibrationInfoView(anas)).Solve());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, r.chi2, 1e-10);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, r.bins.begin()->second.centralValue, 1e-10);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(4.5), r.bins.begin()->second.error, 1e-10);
+  }
+
+  void testRemoveBins()
+  {
+    CalibrationInfo info (makeInfo());
+    CalibrationInfoView central (info);
+    LinearCombination base (central);
+
+    set<set<CalibrationBinBoundary> > remove;
+    remove.insert(binSpec(30.0, 40.0));
+    CalibrationInfoView v (central);
+    v.removeBin(binSpec(30.0, 40.0));
+    assertSame(LinearCombination(v).Solve(), base.SolveWithoutBins(remove));
+
+    remove.insert(binSpec(20.0, 30.0));
+    v.removeBin(binSpec(20.0, 30.0));
+    assertSame(LinearCombination(v).Solve(), base.SolveWithoutBins(remove));
+  }
+
+  void testRemoveSysErrors()
+  {
+    CalibrationInfo info (makeInfo());
+    CalibrationInfoView central (info);
+    LinearCombination base (central);
+
+    const char *names[] = { "jes", "model", "mc", "fit" };
+    for (int i = 0; i < 4; i++) {
+      set<string> remove;
+      remove.insert(names[i]);
+      CalibrationInfoView v (central);
+      v.removeSysError(names[i]);
+      assertSame(LinearCombination(v).Solve(), base.SolveWithoutSysErrors(remove));
+    }
+
+    set<string> remove;
+    remove.insert("jes");
+    remove.insert("model");
+    CalibrationInfoView v (central);
+    v.removeSysError("jes");
+    v.removeSysError("model");
+    assertSame(LinearCombination(v).Solve(), base.SolveWithoutSysErrors(remove));
+  }
+
+  void testSysErrorsUncorrelated()
+  {
+    CalibrationInfo info (makeInfo());
+    CalibrationInfoView central (info);
+    LinearCombination base (central);
+
+    // "model" is already uncorrelated in one analysis, "mc" in all of them.
+    const char *names[] = { "jes", "model", "mc", "fit" };
+    for (int i = 0; i < 4; i++) {
+      set<string> uncor;
+      uncor.insert(names[i]);
+      CalibrationInfoView v (central);
+      v.makeSysErrorUncorrelated(names[i]);
+      assertSame(LinearCombination(v).Solve(), base.SolveWithSysErrorsUncorrelated(uncor));
+    }
+  }
+
+  void testNothingToChange()
+  {
+    CalibrationInfo info (makeInfo());
+    LinearCombination base ((CalibrationInfoView(info)));
+
+    set<string> names;
+    names.insert("not-there");
+    assertSame(base.Solve(), base.SolveWithoutSysErrors(names));
+    assertSame(base.Solve(), base.SolveWithSysErrorsUncorrelated(names));
+    assertSame(base.Solve(), base.SolveWithoutBins(set<set<CalibrationBinBoundary> >()));
+  }
+
+  void testSingular()
+  {
+    vector<CalibrationAnalysis> anas;
+    anas.push_back(makeAnalysis("ptrel"));
+    anas[0].bins.push_back(makeBin(20.0, 30.0, 1.0, 0.0));
+    LinearCombination l ((CalibrationInfoView(anas)));
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LinearCombinationTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
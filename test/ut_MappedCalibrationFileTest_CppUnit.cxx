@@ -0,0 +1,317 @@
+///
+/// CppUnit tests for reading mapped binary calibration files
+///
+
+#include "Combination/MappedCalibrationFile.h"
+#include "Combination/CalibrationDataModelBinary.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  const char *cFile = "ut_MappedCalibrationFileTest.ftb";
+
+  void writeFile (const string &data)
+  {
+    ofstream out (cFile, ios::out | ios::binary);
+    out.write(data.data(), data.size());
+  }
+
+  void writeFile (const CalibrationInfo &info)
+  {
+    ostringstream out;
+    WriteBinaryInfo(out, info);
+    writeFile(out.str());
+  }
+}
+
+class MappedCalibrationFileTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( MappedCalibrationFileTest );
+
+  CPPUNIT_TEST( testNames );
+  CPPUNIT_TEST( testBins );
+  CPPUNIT_TEST( testHeader );
+  CPPUNIT_TEST( testMaterialize );
+  CPPUNIT_TEST( testFind );
+  CPPUNIT_TEST( testOtherSections );
+  CPPUNIT_TEST( testIsBinaryFile );
+  CPPUNIT_TEST_EXCEPTION( testNotBinary, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testTruncated, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testMissing, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testBadBinIndex, std::runtime_error );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  CalibrationAnalysis generate_ana (const string &name)
+  {
+    CalibrationAnalysis ana;
+    ana.name = name;
+    ana.flavor = "bottom";
+    ana.tagger = "SV0";
+    ana.operatingPoint = "0.50";
+    ana.jetAlgorithm = "AntiKt4Topo";
+
+    CalibrationBin b;
+    CalibrationBinBoundary bb;
+    bb.variable = "pt";
+    bb.lowvalue = 20.0;
+    bb.highvalue = 30.0;
+    b.binSpec.push_back(bb);
+    b.centralValue = 1.1;
+    b.centralValueStatisticalError = 0.1;
+
+    SystematicError e;
+    e.name = "err";
+    e.value = 0.05;
+    e.uncorrelated = false;
+    b.systematicErrors.push_back(e);
+    e.name = "uerr";
+    e.value = 0.02;
+    e.uncorrelated = true;
+    b.systematicErrors.push_back(e);
+    b.metadata["weight"] = make_pair(0.5, 0.1);
+    ana.bins.push_back(b);
+
+    b.binSpec[0].lowvalue = 200.0;
+    b.binSpec[0].highvalue = 300.0;
+    b.isExtended = true;
+    e.name = "reference_err";
+    b.referenceBinSystematicErrors.push_back(e);
+    ana.bins.push_back(b);
+
+    ana.metadata["gchi2"].push_back(3.2);
+    ana.metadata_s["Linage"] = "s8+ptrel";
+    return ana;
+  }
+
+  CalibrationInfo generate_info()
+  {
+    CalibrationInfo info;
+    info.Analyses.push_back(generate_ana("s8"));
+    info.Analyses.push_back(generate_ana("ptrel"));
+
+    // A second part of s8, stored separately.
+    CalibrationAnalysis part (generate_ana("s8"));
+    part.bins.resize(1);
+    part.bins[0].binSpec[0].lowvalue = 30.0;
+    part.bins[0].binSpec[0].highvalue = 40.0;
+    info.Analyses.push_back(part);
+
+    AnalysisCorrelation c;
+    c.analysis1Name = "s8";
+    c.analysis2Name = "ptrel";
+    c.flavor = "bottom";
+    c.tagger = "SV0";
+    c.operatingPoint = "0.50";
+    c.jetAlgorithm = "AntiKt4Topo";
+    BinCorrelation bc;
+    bc.binSpec = part.bins[0].binSpec;
+    bc.hasStatCorrelation = true;
+    bc.statCorrelation = 0.25;
+    c.bins.push_back(bc);
+    info.Correlations.push_back(c);
+
+    DefaultAnalysis d;
+    d.name = "s8";
+    d.flavor = "bottom";
+    d.tagger = "SV0";
+    d.operatingPoint = "0.50";
+    d.jetAlgorithm = "*";
+    info.Defaults.push_back(d);
+
+    AliasAnalysis a;
+    a.name = "s8";
+    a.flavor = "bottom";
+    a.tagger = "SV0";
+    a.operatingPoint = "0.50";
+    a.jetAlgorithm = "AntiKt4Topo";
+    AliasAnalysisCopyTo t;
+    t.name = "s8";
+    t.flavor = "bottom";
+    t.tagger = "SV0";
+    t.operatingPoint = "0.50";
+    t.jetAlgorithm = "AntiKt6Topo";
+    a.CopyTargets.push_back(t);
+    info.Aliases.push_back(a);
+
+    return info;
+  }
+
+  void testNames()
+  {
+    writeFile(generate_info());
+    MappedCalibrationFile f (cFile);
+    CPPUNIT_ASSERT_EQUAL(string(cFile), f.fileName());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, f.nAnalyses());
+    CPPUNIT_ASSERT_EQUAL(string("s8"), f.analysis(0).name());
+    CPPUNIT_ASSERT_EQUAL(string("ptrel"), f.analysis(1).name());
+    CPPUNIT_ASSERT_EQUAL(string("bottom"), f.analysis(1).flavor());
+    CPPUNIT_ASSERT_EQUAL(string("SV0"), f.analysis(1).tagger());
+    CPPUNIT_ASSERT_EQUAL(string("0.50"), f.analysis(1).operatingPoint());
+    CPPUNIT_ASSERT_EQUAL(string("AntiKt4Topo"), f.analysis(1).jetAlgorithm());
+    remove(cFile);
+  }
+
+  void testBins()
+  {
+    writeFile(generate_info());
+    MappedCalibrationFile f (cFile);
+    MappedAnalysis a (f.analysis(1));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, a.nBins());
+
+    MappedBin b0 (a.bin(0));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, b0.nBoundaries());
+    CPPUNIT_ASSERT_EQUAL(string("pt"), b0.boundary(0).variable);
+    CPPUNIT_ASSERT_EQUAL(30.0, b0.boundary(0).highvalue);
+    CPPUNIT_ASSERT_EQUAL(1.1, b0.centralValue());
+    CPPUNIT_ASSERT_EQUAL(0.1, b0.statisticalError());
+    CPPUNIT_ASSERT(!b0.isExtended());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, b0.nSysErrors());
+    CPPUNIT_ASSERT_EQUAL(string("uerr"), b0.sysError(1).name());
+    CPPUNIT_ASSERT_EQUAL(0.02, b0.sysError(1).value());
+    CPPUNIT_ASSERT(b0.sysError(1).uncorrelated());
+    CPPUNIT_ASSERT(!b0.sysError(0).uncorrelated());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, b0.nReferenceSysErrors());
+
+    MappedBin b1 (a.bin(1));
+    CPPUNIT_ASSERT(b1.isExtended());
+    CPPUNIT_ASSERT_EQUAL(200.0, b1.binSpec()[0].lowvalue);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, b1.nReferenceSysErrors());
+    CPPUNIT_ASSERT_EQUAL(string("reference_err"), b1.referenceSysError(0).name());
+
+    CalibrationBin m (b1.materialize());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, m.systematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, m.referenceBinSystematicErrors.size());
+    CPPUNIT_ASSERT_EQUAL(0.1, m.metadata["weight"].second);
+    remove(cFile);
+  }
+
+  void testHeader()
+  {
+    writeFile(generate_info());
+    MappedCalibrationFile f (cFile);
+    CalibrationAnalysis h (f.analysis(1).header());
+    CPPUNIT_ASSERT_EQUAL(string("ptrel"), h.name);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, h.bins.size());
+    CPPUNIT_ASSERT_EQUAL(3.2, h.metadata["gchi2"][0]);
+    CPPUNIT_ASSERT_EQUAL(string("s8+ptrel"), h.metadata_s["Linage"]);
+    remove(cFile);
+  }
+
+  void testMaterialize()
+  {
+    CalibrationInfo info (generate_info());
+    writeFile(info);
+    MappedCalibrationFile f (cFile);
+
+    CalibrationAnalysis a (f.analysis(2).materialize());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, a.bins.size());
+    CPPUNIT_ASSERT_EQUAL(40.0, a.bins[0].binSpec[0].highvalue);
+    CPPUNIT_ASSERT_EQUAL(string("s8+ptrel"), a.metadata_s["Linage"]);
+
+    CalibrationInfo all (f.materialize());
+    CPPUNIT_ASSERT_EQUAL(info.Analyses.size(), all.Analyses.size());
+    CPPUNIT_ASSERT_EQUAL(info.Aliases.size(), all.Aliases.size());
+    remove(cFile);
+  }
+
+  void testFind()
+  {
+    writeFile(generate_info());
+    MappedCalibrationFile f (cFile);
+
+    vector<MappedAnalysis> s8 (f.find("s8", "bottom", "SV0", "0.50", "AntiKt4Topo"));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, s8.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, s8[0].nBins());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, s8[1].nBins());
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, f.find("ptrel", "bottom", "SV0", "0.50", "AntiKt4Topo").size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, f.find("ptrel", "charm", "SV0", "0.50", "AntiKt4Topo").size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, f.find("ptrel", "s8", "SV0", "0.50", "AntiKt4Topo").size());
+    remove(cFile);
+  }
+
+  void testOtherSections()
+  {
+    writeFile(generate_info());
+    MappedCalibrationFile f (cFile);
+
+    vector<AnalysisCorrelation> c (f.correlations());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, c.size());
+    CPPUNIT_ASSERT_EQUAL(string("ptrel"), c[0].analysis2Name);
+    CPPUNIT_ASSERT_EQUAL(0.25, c[0].bins[0].statCorrelation);
+    CPPUNIT_ASSERT_EQUAL(40.0, c[0].bins[0].binSpec[0].highvalue);
+
+    vector<DefaultAnalysis> d (f.defaults());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, d.size());
+    CPPUNIT_ASSERT_EQUAL(string("*"), d[0].jetAlgorithm);
+
+    vector<AliasAnalysis> a (f.aliases());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, a.size());
+    CPPUNIT_ASSERT_EQUAL(string("AntiKt6Topo"), a[0].CopyTargets[0].jetAlgorithm);
+    remove(cFile);
+  }
+
+  void testIsBinaryFile()
+  {
+    writeFile(generate_info());
+    CPPUNIT_ASSERT(MappedCalibrationFile::IsBinaryFile(cFile));
+    writeFile(string("Analysis(s8, bottom, SV0, 0.50, AntiKt4Topo) {}"));
+    CPPUNIT_ASSERT(!MappedCalibrationFile::IsBinaryFile(cFile));
+    remove(cFile);
+    CPPUNIT_ASSERT(!MappedCalibrationFile::IsBinaryFile(cFile));
+  }
+
+  void testNotBinary()
+  {
+    writeFile(string(100, 'x'));
+    try {
+      MappedCalibrationFile f (cFile);
+    } catch (...) {
+      remove(cFile);
+      throw;
+    }
+  }
+
+  void testTruncated()
+  {
+    ostringstream out;
+    WriteBinaryInfo(out, generate_info());
+    writeFile(out.str().substr(0, out.str().size() - 8));
+    try {
+      MappedCalibrationFile f (cFile);
+    } catch (...) {
+      remove(cFile);
+      throw;
+    }
+  }
+
+  void testMissing()
+  {
+    MappedCalibrationFile f ("ut_MappedCalibrationFileTest_not_there.ftb");
+  }
+
+  void testBadBinIndex()
+  {
+    writeFile(generate_info());
+    MappedCalibrationFile f (cFile);
+    remove(cFile);
+    f.analysis(1).bin(2);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MappedCalibrationFileTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
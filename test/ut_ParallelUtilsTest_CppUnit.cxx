@@ -0,0 +1,234 @@
+///
+/// CppUnit tests for the ordered parallel loop and the background consumer
+///
+
+#include "Combination/ParallelUtils.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  // Counts how many are alive.
+  atomic<int> g_alive (0);
+  struct counted {
+    counted() { g_alive++; }
+    ~counted() { g_alive--; }
+  };
+}
+
+class ParallelUtilsTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( ParallelUtilsTest );
+
+  CPPUNIT_TEST( testSerial );
+  CPPUNIT_TEST( testInOrder );
+  CPPUNIT_TEST( testEmpty );
+  CPPUNIT_TEST( testMoreThreadsThanWork );
+  CPPUNIT_TEST( testMaxAhead );
+  CPPUNIT_TEST_EXCEPTION( testWorkThrows, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testConsumeThrows, std::runtime_error );
+  CPPUNIT_TEST( testUnconsumedFreed );
+
+  CPPUNIT_TEST( testBackgroundInOrder );
+  CPPUNIT_TEST( testBackgroundOtherThread );
+  CPPUNIT_TEST( testBackgroundMaxQueued );
+  CPPUNIT_TEST( testBackgroundNotFinished );
+  CPPUNIT_TEST_EXCEPTION( testBackgroundThrowsAtFinish, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testBackgroundThrowsAtPush, std::runtime_error );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  // Square everything, and record the order it came back in.
+  void runSquares (size_t n, unsigned int nThreads, vector<size_t> &order, vector<size_t> &values)
+  {
+    OrderedParallelFor<size_t>(n, nThreads,
+			       [] (size_t i) { return i*i; },
+			       [&] (size_t i, size_t &r) { order.push_back(i); values.push_back(r); });
+  }
+
+  void testSerial()
+  {
+    vector<size_t> order, values;
+    runSquares(10, 1, order, values);
+    CPPUNIT_ASSERT_EQUAL((size_t)10, order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(i, order[i]);
+      CPPUNIT_ASSERT_EQUAL(i*i, values[i]);
+    }
+  }
+
+  void testInOrder()
+  {
+    vector<size_t> order, values;
+    runSquares(500, 4, order, values);
+    CPPUNIT_ASSERT_EQUAL((size_t)500, order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(i, order[i]);
+      CPPUNIT_ASSERT_EQUAL(i*i, values[i]);
+    }
+  }
+
+  void testEmpty()
+  {
+    vector<size_t> order, values;
+    runSquares(0, 4, order, values);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, order.size());
+  }
+
+  void testMoreThreadsThanWork()
+  {
+    vector<size_t> order, values;
+    runSquares(3, 16, order, values);
+    CPPUNIT_ASSERT_EQUAL((size_t)3, order.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)4, values[2]);
+  }
+
+  void testMaxAhead()
+  {
+    // Started work can never get more than maxAhead past what has been consumed.
+    atomic<size_t> started (0);
+    size_t worst = 0;
+    OrderedParallelFor<int>(200, 4,
+			    [&] (size_t) { started++; return 1; },
+			    [&] (size_t i, int &) {
+			      size_t ahead = started - i;
+			      if (ahead > worst)
+				worst = ahead;
+			    },
+			    8);
+    CPPUNIT_ASSERT(worst <= 8);
+  }
+
+  void testWorkThrows()
+  {
+    vector<size_t> consumed;
+    OrderedParallelFor<int>(100, 4,
+			    [] (size_t i) -> int {
+			      if (i == 50)
+				throw runtime_error("bad item");
+			      return 1;
+			    },
+			    [&] (size_t i, int &) { consumed.push_back(i); });
+  }
+
+  void testConsumeThrows()
+  {
+    OrderedParallelFor<int>(100, 4,
+			    [] (size_t) { return 1; },
+			    [] (size_t i, int &) {
+			      if (i == 10)
+				throw runtime_error("can't write");
+			    });
+  }
+
+  // Results made ahead of a failure are owned by the slots, and go with them.
+  void testUnconsumedFreed()
+  {
+    bool thrown = false;
+    try {
+      OrderedParallelFor<unique_ptr<counted> >(100, 4,
+					       [] (size_t) { return unique_ptr<counted>(new counted()); },
+					       [] (size_t i, unique_ptr<counted> &) {
+						 if (i == 10)
+						   throw runtime_error("can't write");
+					       });
+    } catch (runtime_error &) {
+      thrown = true;
+    }
+    CPPUNIT_ASSERT(thrown);
+    CPPUNIT_ASSERT_EQUAL(0, (int) g_alive);
+  }
+
+  void testBackgroundInOrder()
+  {
+    vector<size_t> consumed;
+    BackgroundConsumer<size_t> c ([&] (size_t &i) { consumed.push_back(i*i); });
+    for (size_t i = 0; i < 500; i++)
+      c.Push(i);
+    c.Finish();
+    CPPUNIT_ASSERT_EQUAL((size_t)500, consumed.size());
+    for (size_t i = 0; i < consumed.size(); i++)
+      CPPUNIT_ASSERT_EQUAL(i*i, consumed[i]);
+  }
+
+  void testBackgroundOtherThread()
+  {
+    thread::id consumer;
+    BackgroundConsumer<int> c ([&] (int &) { consumer = this_thread::get_id(); });
+    c.Push(1);
+    c.Finish();
+    CPPUNIT_ASSERT(consumer != thread::id());
+    CPPUNIT_ASSERT(consumer != this_thread::get_id());
+  }
+
+  void testBackgroundMaxQueued()
+  {
+    // Nothing can be pushed more than maxQueued past what has been consumed.
+    atomic<size_t> pushed (0);
+    size_t worst = 0;
+    size_t n = 0;
+    BackgroundConsumer<int> c ([&] (int &) {
+	n++;
+	size_t ahead = pushed - n;
+	if (ahead > worst)
+	  worst = ahead;
+      }, 3);
+    for (size_t i = 0; i < 200; i++) {
+      pushed++;
+      c.Push(1);
+    }
+    c.Finish();
+    CPPUNIT_ASSERT_EQUAL((size_t)200, n);
+    // Counted before the push: one more than can be queued may be waiting to get in.
+    CPPUNIT_ASSERT(worst <= 4);
+  }
+
+  void testBackgroundNotFinished()
+  {
+    // Going away without Finish doesn't wait for, or run, the rest.
+    atomic<size_t> n (0);
+    {
+      BackgroundConsumer<int> c ([&] (int &) { n++; this_thread::sleep_for(chrono::milliseconds(50)); }, 100);
+      for (size_t i = 0; i < 50; i++)
+	c.Push(1);
+    }
+    CPPUNIT_ASSERT(n < 50);
+  }
+
+  void testBackgroundThrowsAtFinish()
+  {
+    BackgroundConsumer<int> c ([] (int &i) {
+	if (i == 3)
+	  throw runtime_error("can't write");
+      });
+    for (int i = 0; i < 5; i++)
+      c.Push(i);
+    c.Finish();
+  }
+
+  void testBackgroundThrowsAtPush()
+  {
+    BackgroundConsumer<int> c ([] (int &) { throw runtime_error("can't write"); }, 1);
+    for (int i = 0; i < 100; i++) {
+      c.Push(i);
+      this_thread::sleep_for(chrono::milliseconds(1));
+    }
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ParallelUtilsTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
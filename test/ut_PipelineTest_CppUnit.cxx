@@ -0,0 +1,428 @@
+///
+/// CppUnit tests for the in-memory pipeline steps
+///
+
+#include "Combination/Pipeline.h"
+#include "Combination/ExtrapolationTools.h"
+#include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/CommonCommandLineUtils.h"
+#include "Combination/ToolMains.h"
+#include "CalibrationDataInterface/CalibrationDataContainer.h"
+
+#include <TFile.h>
+#include <TKey.h>
+#include <TClass.h>
+#include <TList.h>
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  // A one bin analysis, 0-100 in pt.
+  CalibrationAnalysis generate_ana (const string &name = "combined", const string &flavor = "bottom")
+  {
+    CalibrationAnalysis ana;
+    ana.name = name;
+    ana.flavor = flavor;
+    ana.tagger = "SV0";
+    ana.operatingPoint = "0.1";
+    ana.jetAlgorithm = "AntiKt";
+
+    CalibrationBin b1;
+    b1.centralValue = 1.1;
+    b1.centralValueStatisticalError = 0.2;
+    CalibrationBinBoundary bb1;
+    bb1.lowvalue = 0.0;
+    bb1.highvalue = 100.0;
+    bb1.variable = "pt";
+    b1.binSpec.push_back(bb1);
+    bb1.lowvalue = 0.0;
+    bb1.highvalue = 2.5;
+    bb1.variable = "abseta";
+    b1.binSpec.push_back(bb1);
+
+    SystematicError e;
+    e.name = "err";
+    e.value = 0.1;
+    e.uncorrelated = false;
+    b1.systematicErrors.push_back(e);
+
+    ana.bins.push_back(b1);
+    return ana;
+  }
+
+  // An extrapolation for it, out to 200 in pt.
+  CalibrationAnalysis generate_extrap (const string &name = "MCCalib", const string &flavor = "bottom")
+  {
+    CalibrationAnalysis ana (generate_ana(name, flavor));
+    ana.bins[0].centralValue = 1.3;
+    ana.bins[0].centralValueStatisticalError = 0.4;
+    ana.bins[0].systematicErrors[0].name = "extr";
+
+    CalibrationBin b2 (ana.bins[0]);
+    b2.binSpec[0].lowvalue = 100.0;
+    b2.binSpec[0].highvalue = 200.0;
+    b2.systematicErrors[0].value = 0.2;
+    ana.bins.push_back(b2);
+    return ana;
+  }
+
+  string text (const CalibrationAnalysis &ana)
+  {
+    ostringstream out;
+    out << ana;
+    return out.str();
+  }
+
+  DefaultAnalysis generate_default (const string &name, const string &flavor)
+  {
+    DefaultAnalysis d;
+    d.name = name;
+    d.flavor = flavor;
+    d.tagger = "SV0";
+    d.operatingPoint = "0.1";
+    d.jetAlgorithm = "*";
+    return d;
+  }
+
+  void writeText (const string &fname, const CalibrationInfo &info)
+  {
+    ofstream out (fname.c_str());
+    out << info;
+  }
+
+  CalibrationInfo readText (const string &fname)
+  {
+    vector<string> args, unknown;
+    args.push_back(fname);
+    CalibrationInfo info;
+    ParseOPInputArgs(args, info, unknown);
+    return info;
+  }
+
+  int runTool (int (*tool) (int, char **), const vector<string> &args)
+  {
+    vector<char*> argv;
+    for (size_t i = 0; i < args.size(); i++)
+      argv.push_back(const_cast<char*>(args[i].c_str()));
+    argv.push_back(0);
+    return tool(args.size(), &argv[0]);
+  }
+
+  // Every key in a ROOT file, with its class, walking down the directories (sorted).
+  void listKeys (TDirectory *d, const string &path, vector<string> &keys)
+  {
+    TIter i_keys(d->GetListOfKeys());
+    TKey *k;
+    while ((k = static_cast<TKey*>(i_keys()))) {
+      string name (path + k->GetName());
+      keys.push_back(name + " " + k->GetClassName());
+      TClass *c = TClass::GetClass(k->GetClassName());
+      if (c != 0 && c->InheritsFrom(TDirectory::Class()))
+	listKeys(d->GetDirectory(k->GetName()), name + "/", keys);
+    }
+  }
+
+  vector<string> listKeys (const string &fname)
+  {
+    vector<string> keys;
+    TFile *f = TFile::Open(fname.c_str(), "READ");
+    CPPUNIT_ASSERT(f != 0);
+    listKeys(f, "", keys);
+    f->Close();
+    delete f;
+    sort(keys.begin(), keys.end());
+    return keys;
+  }
+
+  // The same analyses, up to the precision lost by going through a text file.
+  void assertSameAnalyses (const vector<CalibrationAnalysis> &expected, const vector<CalibrationAnalysis> &actual)
+  {
+    CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(expected[i].name, actual[i].name);
+      CPPUNIT_ASSERT_EQUAL(expected[i].flavor, actual[i].flavor);
+      CPPUNIT_ASSERT_EQUAL(expected[i].bins.size(), actual[i].bins.size());
+      for (size_t b = 0; b < expected[i].bins.size(); b++) {
+	const CalibrationBin &e (expected[i].bins[b]), &a (actual[i].bins[b]);
+	CPPUNIT_ASSERT_EQUAL(e.isExtended, a.isExtended);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(e.centralValue, a.centralValue, 1.0e-4);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(e.centralValueStatisticalError, a.centralValueStatisticalError, 1.0e-4);
+	CPPUNIT_ASSERT_EQUAL(e.systematicErrors.size(), a.systematicErrors.size());
+	for (size_t s = 0; s < e.systematicErrors.size(); s++) {
+	  CPPUNIT_ASSERT_EQUAL(e.systematicErrors[s].name, a.systematicErrors[s].name);
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(e.systematicErrors[s].value, a.systematicErrors[s].value, 1.0e-4);
+	}
+      }
+    }
+  }
+}
+
+class PipelineTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( PipelineTest );
+
+  CPPUNIT_TEST( testTakeAnalyses );
+  CPPUNIT_TEST( testTakeNothing );
+
+  CPPUNIT_TEST( testExtrapolate );
+  CPPUNIT_TEST( testNoExtrapolation );
+  CPPUNIT_TEST( testExtrapolationOtherGroup );
+  CPPUNIT_TEST_EXCEPTION( testTwoExtrapolations, std::runtime_error );
+
+  CPPUNIT_TEST( testIsDefault );
+  CPPUNIT_TEST( testIsDefaultWildcard );
+  CPPUNIT_TEST( testMakeDefault );
+
+  CPPUNIT_TEST( testSameAsChainedTools );
+  CPPUNIT_TEST( testConvertCopyReadsBack );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  void testTakeAnalyses()
+  {
+    CalibrationInfo info;
+    info.Analyses.push_back(generate_ana("ana1"));
+    info.Analyses.push_back(generate_extrap("MCCalib"));
+    info.Analyses.push_back(generate_ana("ana2"));
+    info.Analyses.push_back(generate_extrap("MCCalib", "charm"));
+
+    vector<string> names;
+    names.push_back("MCCalib");
+    vector<CalibrationAnalysis> taken (TakeAnalyses(info, names));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, taken.size());
+    CPPUNIT_ASSERT_EQUAL(string("bottom"), taken[0].flavor);
+    CPPUNIT_ASSERT_EQUAL(string("charm"), taken[1].flavor);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, info.Analyses.size());
+    CPPUNIT_ASSERT_EQUAL(string("ana1"), info.Analyses[0].name);
+    CPPUNIT_ASSERT_EQUAL(string("ana2"), info.Analyses[1].name);
+  }
+
+  void testTakeNothing()
+  {
+    CalibrationInfo info;
+    info.Analyses.push_back(generate_ana("ana1"));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, TakeAnalyses(info, vector<string>()).size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, info.Analyses.size());
+  }
+
+  // The same as applying it directly.
+  void testExtrapolate()
+  {
+    vector<CalibrationAnalysis> extraps;
+    extraps.push_back(generate_extrap());
+    Extrapolator e (extraps);
+
+    CalibrationAnalysis result (e.Apply(generate_ana()));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, result.bins.size());
+    CPPUNIT_ASSERT_EQUAL(text(addExtrapolation(generate_extrap(), generate_ana())), text(result));
+  }
+
+  void testNoExtrapolation()
+  {
+    Extrapolator e ((vector<CalibrationAnalysis>()));
+    CPPUNIT_ASSERT_EQUAL(text(generate_ana()), text(e.Apply(generate_ana())));
+  }
+
+  void testExtrapolationOtherGroup()
+  {
+    vector<CalibrationAnalysis> extraps;
+    extraps.push_back(generate_extrap("MCCalib", "charm"));
+    Extrapolator e (extraps);
+    CPPUNIT_ASSERT_EQUAL(text(generate_ana()), text(e.Apply(generate_ana())));
+  }
+
+  void testTwoExtrapolations()
+  {
+    vector<CalibrationAnalysis> extraps;
+    extraps.push_back(generate_extrap("MCCalib"));
+    extraps.push_back(generate_extrap("MCCalib2"));
+    Extrapolator e (extraps);
+    e.Apply(generate_ana());
+  }
+
+  void testIsDefault()
+  {
+    vector<DefaultAnalysis> defaults;
+    defaults.push_back(generate_default("combined", "charm"));
+    CPPUNIT_ASSERT(!IsDefaultAnalysis(defaults, generate_ana()));
+    CPPUNIT_ASSERT(IsDefaultAnalysis(defaults, generate_ana("combined", "charm")));
+    CPPUNIT_ASSERT(!IsDefaultAnalysis(defaults, generate_ana("other", "charm")));
+    CPPUNIT_ASSERT(!IsDefaultAnalysis(vector<DefaultAnalysis>(), generate_ana()));
+  }
+
+  void testIsDefaultWildcard()
+  {
+    vector<DefaultAnalysis> defaults;
+    defaults.push_back(generate_default("combined", "*"));
+    CPPUNIT_ASSERT(IsDefaultAnalysis(defaults, generate_ana()));
+    CPPUNIT_ASSERT(IsDefaultAnalysis(defaults, generate_ana("combined", "light")));
+    CPPUNIT_ASSERT(!IsDefaultAnalysis(defaults, generate_ana("other")));
+  }
+
+  void testMakeDefault()
+  {
+    CalibrationAnalysis def (MakeDefaultAnalysis(generate_ana()));
+    CPPUNIT_ASSERT_EQUAL(string("default"), def.name);
+    def.name = "combined";
+    CPPUNIT_ASSERT_EQUAL(text(generate_ana()), text(def));
+  }
+
+  // FTPipeline gives what FTCombine, FTExtrapolateAnalyses, FTCopyDefaults and FTConvertToCDI
+  // do, run one after the other on the same inputs. (FTCopyDefaults isn't in the library: it
+  // is the IsDefaultAnalysis/MakeDefaultAnalysis loop below.)
+  void testSameAsChainedTools()
+  {
+    CalibrationInfo inputs;
+    inputs.Analyses.push_back(generate_ana("ana1"));
+    inputs.Analyses.push_back(generate_ana("ana2"));
+    inputs.Analyses[1].bins[0].centralValue = 0.9;
+    inputs.Analyses[1].bins[0].systematicErrors[0].value = 0.15;
+    writeText("ut_PipelineTest_inputs.txt", inputs);
+
+    CalibrationInfo extrapolation, defaults;
+    extrapolation.Analyses.push_back(generate_extrap());
+    defaults.Defaults.push_back(generate_default("combined", "bottom"));
+    writeText("ut_PipelineTest_extrap.txt", extrapolation);
+    writeText("ut_PipelineTest_defaults.txt", defaults);
+
+    // The tools, one after the other.
+    vector<string> combine;
+    combine.push_back("FTCombine");
+    combine.push_back("ut_PipelineTest_inputs.txt");
+    combine.push_back("ut_PipelineTest_defaults.txt");
+    CPPUNIT_ASSERT_EQUAL(0, runTool(FTCombineMain, combine));
+
+    vector<string> extrapolate;
+    extrapolate.push_back("FTExtrapolateAnalyses");
+    extrapolate.push_back("--output");
+    extrapolate.push_back("ut_PipelineTest_chained.txt");
+    extrapolate.push_back("--extrapolation");
+    extrapolate.push_back("MCCalib");
+    extrapolate.push_back("combined.txt");
+    extrapolate.push_back("ut_PipelineTest_extrap.txt");
+    CPPUNIT_ASSERT_EQUAL(0, runTool(FTExtrapolateAnalysesMain, extrapolate));
+
+    CalibrationInfo chained (readText("ut_PipelineTest_chained.txt"));
+    vector<CalibrationAnalysis> chainedDefaults;
+    for (size_t i = 0; i < chained.Analyses.size(); i++) {
+      if (IsDefaultAnalysis(defaults.Defaults, chained.Analyses[i]))
+	chainedDefaults.push_back(MakeDefaultAnalysis(chained.Analyses[i]));
+    }
+
+    // FTConvertToCDI always writes output.root.
+    vector<string> convert;
+    convert.push_back("FTConvertToCDI");
+    convert.push_back("ut_PipelineTest_chained.txt");
+    convert.push_back("ut_PipelineTest_defaults.txt");
+    CPPUNIT_ASSERT_EQUAL(0, runTool(FTConvertToCDIMain, convert));
+
+    // The pipeline.
+    vector<string> pipeline;
+    pipeline.push_back("FTPipeline");
+    pipeline.push_back("ut_PipelineTest_inputs.txt");
+    pipeline.push_back("ut_PipelineTest_defaults.txt");
+    pipeline.push_back("ut_PipelineTest_extrap.txt");
+    pipeline.push_back("--extrapolation");
+    pipeline.push_back("MCCalib");
+    pipeline.push_back("--output");
+    pipeline.push_back("ut_PipelineTest_pipeline.root");
+    pipeline.push_back("--dumpExtrapolated");
+    pipeline.push_back("ut_PipelineTest_pipeline.txt");
+    pipeline.push_back("--dumpDefaults");
+    pipeline.push_back("ut_PipelineTest_pipelineDefaults.txt");
+    CPPUNIT_ASSERT_EQUAL(0, runTool(FTPipelineMain, pipeline));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, chained.Analyses.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, chained.Analyses[0].bins.size());
+    assertSameAnalyses(chained.Analyses, readText("ut_PipelineTest_pipeline.txt").Analyses);
+    assertSameAnalyses(chainedDefaults, readText("ut_PipelineTest_pipelineDefaults.txt").Analyses);
+
+    vector<string> chainedKeys (listKeys("output.root"));
+    vector<string> pipelineKeys (listKeys("ut_PipelineTest_pipeline.root"));
+    CPPUNIT_ASSERT(chainedKeys.size() > 0);
+    CPPUNIT_ASSERT_EQUAL(chainedKeys.size(), pipelineKeys.size());
+    for (size_t i = 0; i < chainedKeys.size(); i++)
+      CPPUNIT_ASSERT_EQUAL(chainedKeys[i], pipelineKeys[i]);
+
+    const char *files[] = {"ut_PipelineTest_inputs.txt", "ut_PipelineTest_extrap.txt", "ut_PipelineTest_defaults.txt",
+			   "combined.txt", "ut_PipelineTest_chained.txt", "output.root",
+			   "ut_PipelineTest_pipeline.root", "ut_PipelineTest_pipeline.txt",
+			   "ut_PipelineTest_pipelineDefaults.txt"};
+    for (size_t i = 0; i < sizeof(files)/sizeof(files[0]); i++)
+      remove(files[i]);
+  }
+
+  // FTConvertToCDI's --copy moves the keys over without reading the objects. The output
+  // file must still get the streamer info, or the copies can't be read back.
+  void testConvertCopyReadsBack()
+  {
+    CalibrationInfo inputs;
+    inputs.Analyses.push_back(generate_ana("ana1"));
+    writeText("ut_PipelineTest_copyInputs.txt", inputs);
+    writeText("ut_PipelineTest_copyEmpty.txt", CalibrationInfo());
+
+    vector<string> convert;
+    convert.push_back("FTConvertToCDI");
+    convert.push_back("ut_PipelineTest_copyInputs.txt");
+    CPPUNIT_ASSERT_EQUAL(0, runTool(FTConvertToCDIMain, convert));
+    CPPUNIT_ASSERT_EQUAL(0, rename("output.root", "ut_PipelineTest_copySource.root"));
+
+    // Nothing is converted, so the only containers in the output are the copies.
+    vector<string> copy;
+    copy.push_back("FTConvertToCDI");
+    copy.push_back("ut_PipelineTest_copyEmpty.txt");
+    copy.push_back("--copyut_PipelineTest_copySource.root");
+    CPPUNIT_ASSERT_EQUAL(0, runTool(FTConvertToCDIMain, copy));
+
+    const string containerClass ("Analysis::CalibrationDataHistogramContainer");
+    string path;
+    vector<string> keys (listKeys("output.root"));
+    for (size_t i = 0; i < keys.size(); i++) {
+      size_t space = keys[i].find(' ');
+      if (keys[i].substr(space + 1) == containerClass)
+	path = keys[i].substr(0, space);
+    }
+    CPPUNIT_ASSERT(path.find("ana1_SF") != string::npos);
+
+    TFile *f = TFile::Open("output.root", "READ");
+    CPPUNIT_ASSERT(f != 0);
+    TList *infos = f->GetStreamerInfoList();
+    bool hasInfo = infos != 0 && infos->FindObject(containerClass.c_str()) != 0;
+    delete infos;
+
+    TObject *o = f->Get(path.c_str());
+    Analysis::CalibrationDataContainer *c = dynamic_cast<Analysis::CalibrationDataContainer*>(o);
+    bool readBack = c != 0;
+    delete o;
+    f->Close();
+    delete f;
+
+    CPPUNIT_ASSERT(hasInfo);
+    CPPUNIT_ASSERT(readBack);
+
+    const char *files[] = {"ut_PipelineTest_copyInputs.txt", "ut_PipelineTest_copyEmpty.txt",
+			   "ut_PipelineTest_copySource.root", "output.root"};
+    for (size_t i = 0; i < sizeof(files)/sizeof(files[0]); i++)
+      remove(files[i]);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(PipelineTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
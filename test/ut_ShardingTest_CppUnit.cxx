@@ -0,0 +1,281 @@
+///
+/// CppUnit tests for splitting a combination into shards
+///
+
+#include "Combination/Sharding.h"
+#include "Combination/SyntheticInputs.h"
+#include "Combination/CommonCommandLineUtils.h"
+#include "Combination/BinNameUtils.h"
+#include "Combination/CalibrationDataModelStreams.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  // Several groups of several analyses.
+  CalibrationInfo generate_info ()
+  {
+    SyntheticInputSpec spec;
+    spec.taggers.push_back("MV2");
+    spec.taggers.push_back("JetFitter");
+    spec.operatingPoints.push_back("0.8");
+    spec.jetAlgorithms.push_back("AntiKt6Topo");
+    spec.defaults = false;
+    return GenerateSyntheticInputs(spec);
+  }
+
+  // Stand in for a combination: the first analysis of each group, in group order.
+  vector<CalibrationAnalysis> fake_combine (const CalibrationInfo &info)
+  {
+    vector<CalibrationAnalysis> result;
+    map<string, vector<CalibrationAnalysis> > groups (BinAnalysesByJetTagFlavOp(info.Analyses));
+    for (map<string, vector<CalibrationAnalysis> >::const_iterator itr = groups.begin(); itr != groups.end(); itr++)
+      result.push_back(itr->second[0]);
+    return result;
+  }
+
+  string shard_output (const CalibrationInfo &info, size_t index, size_t count, bool balance)
+  {
+    CalibrationInfo mine (info);
+    ShardSpec shard;
+    shard.index = index;
+    shard.count = count;
+    KeepShard(mine, shard, balance);
+
+    ostringstream out;
+    WriteShard(out, shard, fake_combine(mine));
+    return out.str();
+  }
+}
+
+class ShardingTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( ShardingTest );
+
+  CPPUNIT_TEST( testParseShardSpec );
+  CPPUNIT_TEST_EXCEPTION( testParseShardOutOfRange, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testParseShardBadFormat, std::runtime_error );
+
+  CPPUNIT_TEST( testAssignByHash );
+  CPPUNIT_TEST( testAssignBalanced );
+  CPPUNIT_TEST( testEstimateGroupCost );
+  CPPUNIT_TEST( testKeepShard );
+
+  CPPUNIT_TEST( testMergeIsUnsharded );
+  CPPUNIT_TEST( testMergeBalanced );
+  CPPUNIT_TEST( testMergeMoreShardsThanGroups );
+  CPPUNIT_TEST_EXCEPTION( testMergeMissingShard, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testMergeShardTwice, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testMergeDifferentSplits, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testMergeNotAShard, std::runtime_error );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  void testParseShardSpec()
+  {
+    ShardSpec s (ParseShardSpec("2/5"));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, s.index);
+    CPPUNIT_ASSERT_EQUAL((size_t)5, s.count);
+
+    s = ParseShardSpec("0/1");
+    CPPUNIT_ASSERT_EQUAL((size_t)0, s.index);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, s.count);
+  }
+
+  void testParseShardOutOfRange()
+  {
+    ParseShardSpec("5/5");
+  }
+
+  void testParseShardBadFormat()
+  {
+    ParseShardSpec("1-5");
+  }
+
+  void testAssignByHash()
+  {
+    map<string, vector<CalibrationAnalysis> > groups (BinAnalysesByJetTagFlavOp(generate_info().Analyses));
+    CPPUNIT_ASSERT(groups.size() > 4);
+
+    map<string, size_t> assigned (AssignShards(groups, 3));
+    CPPUNIT_ASSERT_EQUAL(groups.size(), assigned.size());
+    for (map<string, size_t>::const_iterator itr = assigned.begin(); itr != assigned.end(); itr++)
+      CPPUNIT_ASSERT(itr->second < 3);
+
+    // A group stays where it was when another goes.
+    map<string, vector<CalibrationAnalysis> > fewer (groups);
+    fewer.erase(fewer.begin());
+    map<string, size_t> assignedFewer (AssignShards(fewer, 3));
+    for (map<string, size_t>::const_iterator itr = assignedFewer.begin(); itr != assignedFewer.end(); itr++)
+      CPPUNIT_ASSERT_EQUAL(assigned[itr->first], itr->second);
+  }
+
+  void testAssignBalanced()
+  {
+    // Groups of 1 to 5 measurements (one systematic error each) - 15 in all, so 3 shards
+    // can have 5 each.
+    map<string, vector<CalibrationAnalysis> > groups;
+    CalibrationAnalysis proto (generate_info().Analyses[0]);
+    for (size_t i = 1; i <= 5; i++) {
+      CalibrationAnalysis a (proto);
+      a.bins.resize(i);
+      for (size_t b = 0; b < a.bins.size(); b++)
+	a.bins[b].systematicErrors.resize(1);
+      ostringstream name;
+      name << "group" << i;
+      groups[name.str()].push_back(a);
+    }
+
+    map<string, size_t> assigned (AssignShards(groups, 3, true));
+    vector<double> load (3, 0.0);
+    for (map<string, size_t>::const_iterator itr = assigned.begin(); itr != assigned.end(); itr++)
+      load[itr->second] += EstimateGroupCost(groups[itr->first]);
+    CPPUNIT_ASSERT_EQUAL(5.0, load[0]);
+    CPPUNIT_ASSERT_EQUAL(5.0, load[1]);
+    CPPUNIT_ASSERT_EQUAL(5.0, load[2]);
+  }
+
+  void testEstimateGroupCost()
+  {
+    vector<CalibrationAnalysis> group (BinAnalysesByJetTagFlavOp(generate_info().Analyses).begin()->second);
+    size_t nBins = 0;
+    set<string> sys;
+    for (size_t i = 0; i < group.size(); i++) {
+      nBins += group[i].bins.size();
+      for (size_t b = 0; b < group[i].bins.size(); b++)
+	for (size_t s = 0; s < group[i].bins[b].systematicErrors.size(); s++)
+	  sys.insert(group[i].bins[b].systematicErrors[s].name);
+    }
+    CPPUNIT_ASSERT_EQUAL(double(nBins * sys.size()), EstimateGroupCost(group));
+    CPPUNIT_ASSERT_EQUAL(0.0, EstimateGroupCost(vector<CalibrationAnalysis>()));
+  }
+
+  // Every analysis is in exactly one shard, with the rest of its group.
+  void testKeepShard()
+  {
+    CalibrationInfo info (generate_info());
+    set<string> seen;
+    for (size_t i = 0; i < 4; i++) {
+      CalibrationInfo mine (info);
+      ShardSpec shard;
+      shard.index = i;
+      shard.count = 4;
+      KeepShard(mine, shard);
+      for (size_t a = 0; a < mine.Analyses.size(); a++) {
+	CPPUNIT_ASSERT(seen.insert(OPFullName(mine.Analyses[a])).second);
+      }
+    }
+    CPPUNIT_ASSERT_EQUAL(info.Analyses.size(), seen.size());
+  }
+
+  void testMergeIsUnsharded()
+  {
+    CalibrationInfo info (generate_info());
+    vector<CalibrationAnalysis> all (fake_combine(info));
+    ostringstream unsharded;
+    for (size_t i = 0; i < all.size(); i++)
+      unsharded << all[i] << endl;
+
+    // Any order.
+    vector<string> shards;
+    shards.push_back(shard_output(info, 2, 3, false));
+    shards.push_back(shard_output(info, 0, 3, false));
+    shards.push_back(shard_output(info, 1, 3, false));
+
+    ostringstream merged;
+    MergeShards(shards, merged);
+    CPPUNIT_ASSERT_EQUAL(unsharded.str(), merged.str());
+  }
+
+  void testMergeBalanced()
+  {
+    CalibrationInfo info (generate_info());
+    vector<CalibrationAnalysis> all (fake_combine(info));
+    ostringstream unsharded;
+    for (size_t i = 0; i < all.size(); i++)
+      unsharded << all[i] << endl;
+
+    vector<string> shards;
+    shards.push_back(shard_output(info, 0, 2, true));
+    shards.push_back(shard_output(info, 1, 2, true));
+
+    ostringstream merged;
+    MergeShards(shards, merged);
+    CPPUNIT_ASSERT_EQUAL(unsharded.str(), merged.str());
+  }
+
+  // Some shards have nothing to do.
+  void testMergeMoreShardsThanGroups()
+  {
+    CalibrationInfo info (generate_info());
+    vector<CalibrationAnalysis> all (fake_combine(info));
+    ostringstream unsharded;
+    for (size_t i = 0; i < all.size(); i++)
+      unsharded << all[i] << endl;
+
+    size_t n = all.size() + 5;
+    vector<string> shards;
+    for (size_t i = 0; i < n; i++)
+      shards.push_back(shard_output(info, i, n, true));
+
+    ostringstream merged;
+    MergeShards(shards, merged);
+    CPPUNIT_ASSERT_EQUAL(unsharded.str(), merged.str());
+  }
+
+  void testMergeMissingShard()
+  {
+    CalibrationInfo info (generate_info());
+    vector<string> shards;
+    shards.push_back(shard_output(info, 0, 3, false));
+    shards.push_back(shard_output(info, 2, 3, false));
+    ostringstream merged;
+    MergeShards(shards, merged);
+  }
+
+  void testMergeShardTwice()
+  {
+    CalibrationInfo info (generate_info());
+    vector<string> shards;
+    shards.push_back(shard_output(info, 0, 2, false));
+    shards.push_back(shard_output(info, 0, 2, false));
+    shards.push_back(shard_output(info, 1, 2, false));
+    ostringstream merged;
+    MergeShards(shards, merged);
+  }
+
+  void testMergeDifferentSplits()
+  {
+    CalibrationInfo info (generate_info());
+    vector<string> shards;
+    shards.push_back(shard_output(info, 0, 2, false));
+    shards.push_back(shard_output(info, 1, 3, false));
+    ostringstream merged;
+    MergeShards(shards, merged);
+  }
+
+  void testMergeNotAShard()
+  {
+    ostringstream text;
+    text << generate_info();
+    vector<string> shards;
+    shards.push_back(text.str());
+    ostringstream merged;
+    MergeShards(shards, merged);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ShardingTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
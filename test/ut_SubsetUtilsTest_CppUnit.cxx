@@ -0,0 +1,113 @@
+///
+/// CppUnit tests for counting and numbering subsets
+///
+
+#include "Combination/SubsetUtils.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <stdexcept>
+#include <set>
+#include <vector>
+
+using namespace std;
+using namespace BTagCombination;
+
+class SubsetUtilsTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( SubsetUtilsTest );
+
+  CPPUNIT_TEST( testCount );
+  CPPUNIT_TEST( testCountEdges );
+  CPPUNIT_TEST( testCountLarge );
+  CPPUNIT_TEST_EXCEPTION( testCountOverflow, std::runtime_error );
+  CPPUNIT_TEST( testFirstAndLast );
+  CPPUNIT_TEST( testEmptySubset );
+  CPPUNIT_TEST( testSameOrderAsSet );
+  CPPUNIT_TEST_EXCEPTION( testRankTooBig, std::runtime_error );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  void testCount()
+  {
+    CPPUNIT_ASSERT_EQUAL(10ULL, nChooseK(5, 2));
+    CPPUNIT_ASSERT_EQUAL(1770ULL, nChooseK(60, 2));
+    CPPUNIT_ASSERT_EQUAL(34220ULL, nChooseK(60, 3));
+  }
+
+  void testCountEdges()
+  {
+    CPPUNIT_ASSERT_EQUAL(1ULL, nChooseK(5, 0));
+    CPPUNIT_ASSERT_EQUAL(1ULL, nChooseK(5, 5));
+    CPPUNIT_ASSERT_EQUAL(0ULL, nChooseK(5, 6));
+    CPPUNIT_ASSERT_EQUAL(1ULL, nChooseK(0, 0));
+  }
+
+  void testCountLarge()
+  {
+    CPPUNIT_ASSERT_EQUAL(2333606220ULL, nChooseK(34, 17));
+    CPPUNIT_ASSERT_EQUAL(61ULL, nChooseK(61, 60));
+  }
+
+  void testCountOverflow()
+  {
+    nChooseK(200, 100);
+  }
+
+  void testFirstAndLast()
+  {
+    vector<size_t> first (NthSubset(5, 3, 0));
+    CPPUNIT_ASSERT_EQUAL((size_t)3, first.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, first[0]);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, first[1]);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, first[2]);
+
+    vector<size_t> last (NthSubset(5, 3, 9));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, last[0]);
+    CPPUNIT_ASSERT_EQUAL((size_t)3, last[1]);
+    CPPUNIT_ASSERT_EQUAL((size_t)4, last[2]);
+  }
+
+  void testEmptySubset()
+  {
+    CPPUNIT_ASSERT_EQUAL((size_t)0, NthSubset(5, 0, 0).size());
+  }
+
+  void testSameOrderAsSet()
+  {
+    // Every subset exactly once, in the order a set of sets puts them.
+    set<vector<size_t> > all;
+    vector<vector<size_t> > inOrder;
+    for (size_t n = 0; n < 7; n++) {
+      for (size_t k = 0; k <= n; k++) {
+	all.clear();
+	inOrder.clear();
+	for (unsigned long long r = 0; r < nChooseK(n, k); r++) {
+	  vector<size_t> s (NthSubset(n, k, r));
+	  CPPUNIT_ASSERT_EQUAL(k, s.size());
+	  for (size_t i = 1; i < s.size(); i++)
+	    CPPUNIT_ASSERT(s[i-1] < s[i]);
+	  if (k > 0)
+	    CPPUNIT_ASSERT(s[k-1] < n);
+	  all.insert(s);
+	  inOrder.push_back(s);
+	}
+	CPPUNIT_ASSERT_EQUAL(inOrder.size(), all.size());
+	CPPUNIT_ASSERT(vector<vector<size_t> >(all.begin(), all.end()) == inOrder);
+      }
+    }
+  }
+
+  void testRankTooBig()
+  {
+    NthSubset(5, 2, 10);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SubsetUtilsTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
@@ -0,0 +1,181 @@
+///
+/// CppUnit tests for the synthetic input generator
+///
+
+#include "Combination/SyntheticInputs.h"
+#include "Combination/Parser.h"
+#include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/CalibrationInfoView.h"
+#include "Combination/LinearCombination.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  string asText (const CalibrationInfo &info)
+  {
+    ostringstream out;
+    out << info;
+    return out.str();
+  }
+}
+
+class SyntheticInputsTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( SyntheticInputsTest );
+
+  CPPUNIT_TEST( testSameSeedSameInputs );
+  CPPUNIT_TEST( testDifferentSeed );
+  CPPUNIT_TEST( testCounts );
+  CPPUNIT_TEST( testSysErrors );
+  CPPUNIT_TEST( testNoEtaBins );
+  CPPUNIT_TEST( testExtendedBins );
+  CPPUNIT_TEST( testParses );
+  CPPUNIT_TEST( testPositiveDefinite );
+  CPPUNIT_TEST_EXCEPTION( testBadFraction, std::runtime_error );
+  CPPUNIT_TEST_EXCEPTION( testNoAnalyses, std::runtime_error );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  void testSameSeedSameInputs()
+  {
+    SyntheticInputSpec spec;
+    spec.seed = 42;
+    CPPUNIT_ASSERT_EQUAL(asText(GenerateSyntheticInputs(spec)), asText(GenerateSyntheticInputs(spec)));
+  }
+
+  void testDifferentSeed()
+  {
+    SyntheticInputSpec spec;
+    string first (asText(GenerateSyntheticInputs(spec)));
+    spec.seed = 2;
+    CPPUNIT_ASSERT(first != asText(GenerateSyntheticInputs(spec)));
+  }
+
+  void testCounts()
+  {
+    SyntheticInputSpec spec;
+    spec.nAnalyses = 4;
+    spec.flavors.push_back("charm");
+    spec.operatingPoints.push_back("0.8");
+    spec.nPtBins = 5;
+    spec.nEtaBins = 2;
+    spec.correlationDensity = 1.0;
+    spec.copies = true;
+    CalibrationInfo info (GenerateSyntheticInputs(spec));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)16, info.Analyses.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)10, info.Analyses[0].bins.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, info.Analyses[0].bins[0].binSpec.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)4, info.Defaults.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)4, info.Aliases.size());
+    CPPUNIT_ASSERT_EQUAL(string("AntiKt4TopoCopy"), info.Aliases[0].CopyTargets[0].jetAlgorithm);
+
+    // 6 pairs of analyses, in each of 4 groups, with every bin correlated.
+    CPPUNIT_ASSERT_EQUAL((size_t)24, info.Correlations.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)10, info.Correlations[0].bins.size());
+  }
+
+  void testSysErrors()
+  {
+    SyntheticInputSpec spec;
+    spec.nSys = 10;
+    spec.sharedSysFraction = 0.4;
+    spec.uncorrelatedSysFraction = 0.5;
+    CalibrationInfo info (GenerateSyntheticInputs(spec));
+
+    const vector<SystematicError> &e0 (info.Analyses[0].bins[0].systematicErrors);
+    const vector<SystematicError> &e1 (info.Analyses[1].bins[0].systematicErrors);
+    CPPUNIT_ASSERT_EQUAL((size_t)10, e0.size());
+
+    int shared = 0, uncorrelated = 0;
+    for (size_t i = 0; i < e0.size(); i++) {
+      if (e0[i].name == e1[i].name)
+	shared++;
+      if (e0[i].uncorrelated)
+	uncorrelated++;
+    }
+    CPPUNIT_ASSERT_EQUAL(4, shared);
+    CPPUNIT_ASSERT_EQUAL(3, uncorrelated);
+  }
+
+  void testNoEtaBins()
+  {
+    SyntheticInputSpec spec;
+    spec.nEtaBins = 0;
+    CalibrationInfo info (GenerateSyntheticInputs(spec));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, info.Analyses[0].bins[0].binSpec.size());
+    CPPUNIT_ASSERT_EQUAL(string("pt"), info.Analyses[0].bins[0].binSpec[0].variable);
+  }
+
+  void testExtendedBins()
+  {
+    SyntheticInputSpec spec;
+    spec.nExtendedBins = 2;
+    CalibrationInfo info (GenerateSyntheticInputs(spec));
+    CPPUNIT_ASSERT_EQUAL((size_t)8, info.Analyses[0].bins.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)6, info.Analyses[1].bins.size());
+    CPPUNIT_ASSERT(info.Analyses[0].bins[7].isExtended);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, info.Analyses[0].bins[7].systematicErrors.size());
+    CPPUNIT_ASSERT(!info.Analyses[0].bins[5].isExtended);
+  }
+
+  void testParses()
+  {
+    SyntheticInputSpec spec;
+    spec.nEtaBins = 3;
+    spec.nExtendedBins = 1;
+    spec.copies = true;
+    CalibrationInfo info (GenerateSyntheticInputs(spec));
+    CalibrationInfo back (Parse(asText(info)));
+
+    CPPUNIT_ASSERT_EQUAL(info.Analyses.size(), back.Analyses.size());
+    CPPUNIT_ASSERT_EQUAL(info.Analyses[0].bins.size(), back.Analyses[0].bins.size());
+    CPPUNIT_ASSERT_EQUAL(info.Correlations.size(), back.Correlations.size());
+    CPPUNIT_ASSERT_EQUAL(info.Defaults.size(), back.Defaults.size());
+    CPPUNIT_ASSERT_EQUAL(info.Aliases.size(), back.Aliases.size());
+  }
+
+  void testPositiveDefinite()
+  {
+    // The linear combination throws if the covariance matrix isn't positive definite. With
+    // no systematic errors, that is down to the statistical correlations.
+    SyntheticInputSpec spec;
+    spec.nAnalyses = 12;
+    spec.nSys = 0;
+    spec.correlationDensity = 0.7;
+    for (unsigned long long seed = 1; seed <= 5; seed++) {
+      spec.seed = seed;
+      CalibrationInfo info (GenerateSyntheticInputs(spec));
+      LinearCombination l ((CalibrationInfoView(info)));
+      CPPUNIT_ASSERT_EQUAL((size_t)72, l.nMeasurements());
+    }
+  }
+
+  void testBadFraction()
+  {
+    SyntheticInputSpec spec;
+    spec.sharedSysFraction = 1.5;
+    GenerateSyntheticInputs(spec);
+  }
+
+  void testNoAnalyses()
+  {
+    SyntheticInputSpec spec;
+    spec.nAnalyses = 0;
+    GenerateSyntheticInputs(spec);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SyntheticInputsTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
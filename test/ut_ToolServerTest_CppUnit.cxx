@@ -0,0 +1,218 @@
+///
+/// CppUnit tests for the tool server
+///
+
+#include "Combination/ToolServer.h"
+#include "Combination/ToolProtocol.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+using namespace std;
+using namespace BTagCombination;
+
+#ifndef _WIN32
+namespace {
+  const char *cSocket = "ut_ToolServerTest.sock";
+  const char *cOutput = "ut_ToolServerTest.txt";
+
+  // Writes its arguments to a file, and returns how many there were.
+  int EchoTool (int argc, char **argv)
+  {
+    ofstream out (cOutput);
+    for (int i = 0; i < argc; i++)
+      out << argv[i] << endl;
+    return argc;
+  }
+
+  int ThrowTool (int, char **)
+  {
+    throw runtime_error("this tool always fails");
+  }
+
+  string readFile (const string &name)
+  {
+    ifstream in (name.c_str());
+    ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+  }
+
+  vector<string> commandLine (const string &a1, const string &a2 = "", const string &a3 = "")
+  {
+    vector<string> args;
+    args.push_back(a1);
+    if (a2 != "")
+      args.push_back(a2);
+    if (a3 != "")
+      args.push_back(a3);
+    return args;
+  }
+
+  map<string, ToolMain> testTools ()
+  {
+    map<string, ToolMain> tools;
+    tools["echo"] = EchoTool;
+    tools["throw"] = ThrowTool;
+    return tools;
+  }
+
+  // Start a server in another process, and wait for it to be listening.
+  pid_t startServer (int requestTimeout = 10)
+  {
+    pid_t pid = fork();
+    if (pid == 0) {
+      int code = 0;
+      try {
+	ServeTools(cSocket, testTools(), requestTimeout);
+      } catch (exception &) {
+	code = 1;
+      }
+      _exit(code);
+    }
+
+    for (int i = 0; i < 500; i++) {
+      try {
+	RunOnToolServer(cSocket, commandLine("echo"));
+	return pid;
+      } catch (exception &) {
+	usleep(10000);
+      }
+    }
+    return pid;
+  }
+
+  int stopServer (pid_t pid)
+  {
+    RunOnToolServer(cSocket, commandLine("--stop"));
+    int status;
+    waitpid(pid, &status, 0);
+    return status;
+  }
+}
+#endif
+
+class ToolServerTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( ToolServerTest );
+
+#ifndef _WIN32
+  CPPUNIT_TEST( testRunTool );
+  CPPUNIT_TEST( testUnknownTool );
+  CPPUNIT_TEST( testToolThrows );
+  CPPUNIT_TEST_EXCEPTION( testNoServer, std::runtime_error );
+  CPPUNIT_TEST( testServerAlreadyRunning );
+  CPPUNIT_TEST( testStaleSocket );
+  CPPUNIT_TEST( testSocketPrivate );
+  CPPUNIT_TEST( testSilentClient );
+#endif
+
+  CPPUNIT_TEST_SUITE_END();
+
+#ifndef _WIN32
+  void testRunTool()
+  {
+    pid_t server = startServer();
+    remove(cOutput);
+
+    CPPUNIT_ASSERT_EQUAL(3, RunOnToolServer(cSocket, commandLine("echo", "one", "two words")));
+    CPPUNIT_ASSERT_EQUAL(string("echo\none\ntwo words\n"), readFile(cOutput));
+
+    // Each run is separate, and can be run again.
+    CPPUNIT_ASSERT_EQUAL(2, RunOnToolServer(cSocket, commandLine("echo", "again")));
+    CPPUNIT_ASSERT_EQUAL(string("echo\nagain\n"), readFile(cOutput));
+
+    CPPUNIT_ASSERT_EQUAL(0, stopServer(server));
+    remove(cOutput);
+  }
+
+  void testUnknownTool()
+  {
+    pid_t server = startServer();
+    CPPUNIT_ASSERT_EQUAL(127, RunOnToolServer(cSocket, commandLine("FTNotATool")));
+    CPPUNIT_ASSERT_EQUAL(0, stopServer(server));
+  }
+
+  // A tool that fails doesn't take the server with it.
+  void testToolThrows()
+  {
+    pid_t server = startServer();
+    remove(cOutput);
+    CPPUNIT_ASSERT_EQUAL(1, RunOnToolServer(cSocket, commandLine("throw")));
+    CPPUNIT_ASSERT_EQUAL(1, RunOnToolServer(cSocket, commandLine("echo")));
+    CPPUNIT_ASSERT_EQUAL(0, stopServer(server));
+    remove(cOutput);
+  }
+
+  void testNoServer()
+  {
+    RunOnToolServer("ut_ToolServerTest_none.sock", commandLine("echo"));
+  }
+
+  // A second server doesn't take the socket from one that is running.
+  void testServerAlreadyRunning()
+  {
+    pid_t server = startServer();
+    CPPUNIT_ASSERT_THROW(ServeTools(cSocket, testTools()), std::runtime_error);
+    CPPUNIT_ASSERT_EQUAL(1, RunOnToolServer(cSocket, commandLine("echo")));
+    CPPUNIT_ASSERT_EQUAL(0, stopServer(server));
+    remove(cOutput);
+  }
+
+  // One left behind by a server that is gone is replaced.
+  void testStaleSocket()
+  {
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr (ToolProtocol::SocketAddress(cSocket));
+    CPPUNIT_ASSERT_EQUAL(0, bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+    close(s);
+
+    pid_t server = startServer();
+    CPPUNIT_ASSERT_EQUAL(1, RunOnToolServer(cSocket, commandLine("echo")));
+    CPPUNIT_ASSERT_EQUAL(0, stopServer(server));
+    remove(cOutput);
+  }
+
+  void testSocketPrivate()
+  {
+    pid_t server = startServer();
+    struct stat info;
+    CPPUNIT_ASSERT_EQUAL(0, stat(cSocket, &info));
+    CPPUNIT_ASSERT_EQUAL((mode_t) (S_IRUSR | S_IWUSR), (mode_t) (info.st_mode & 0777));
+    CPPUNIT_ASSERT_EQUAL(0, stopServer(server));
+    remove(cOutput);
+  }
+
+  // A client that connects and says nothing doesn't hold up the next one for long.
+  void testSilentClient()
+  {
+    pid_t server = startServer(1);
+    int silent = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr (ToolProtocol::SocketAddress(cSocket));
+    CPPUNIT_ASSERT_EQUAL(0, connect(silent, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+
+    CPPUNIT_ASSERT_EQUAL(2, RunOnToolServer(cSocket, commandLine("echo", "next")));
+    close(silent);
+    CPPUNIT_ASSERT_EQUAL(0, stopServer(server));
+    remove(cOutput);
+  }
+#endif
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ToolServerTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
@@ -0,0 +1,88 @@
+///
+/// CppUnit tests for the trace recording
+///
+
+#include "Combination/Tracing.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  string readFile (const string &name)
+  {
+    ifstream in (name.c_str());
+    ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+  }
+
+  size_t count (const string &text, const string &what)
+  {
+    size_t n = 0;
+    for (size_t i = text.find(what); i != string::npos; i = text.find(what, i+1))
+      n++;
+    return n;
+  }
+
+  const char *cTraceFile = "ut_TracingTest_trace.json";
+}
+
+class TracingTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TracingTest );
+
+  CPPUNIT_TEST( testSpans );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  // Tracing can't be turned off again, so it is all done in one test.
+  void testSpans()
+  {
+    {
+      TraceSpan before ("before");
+    }
+    CPPUNIT_ASSERT(!TracingEnabled());
+
+    StartTracing(cTraceFile);
+    CPPUNIT_ASSERT(TracingEnabled());
+    {
+      TraceSpan outer ("outer");
+      TraceSpan inner ("inner", "a \"quoted\" detail");
+      inner.End();
+      inner.End();
+    }
+    FlushTrace();
+
+    string text (readFile(cTraceFile));
+    CPPUNIT_ASSERT_EQUAL(string("[\n"), text.substr(0, 2));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, count(text, "\"before\""));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, count(text, "\"name\":\"outer\""));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, count(text, "\"name\":\"inner\""));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, count(text, "\"detail\":\"a \\\"quoted\\\" detail\""));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, count(text, "\"ph\":\"X\""));
+
+    // The inner span closes first, so it is written first.
+    CPPUNIT_ASSERT(text.find("inner") < text.find("outer"));
+
+    // Nothing new, nothing written.
+    FlushTrace();
+    CPPUNIT_ASSERT_EQUAL(text, readFile(cTraceFile));
+
+    remove(cTraceFile);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TracingTest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
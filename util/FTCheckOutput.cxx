@@ -4,25 +4,83 @@
 ///  Check the CDI output file for any errors that might have crept it. Things like missing
 /// SF or similar...
 ///
+///  The file is walked once, building an index of the keys (names, class names, sizes - what
+/// the key headers tell us, no object is read back). All the checkers then run against that
+/// index, in parallel.
+///
+#include "Combination/ParallelUtils.h"
+#include "Combination/Tracing.h"
+
 #include <TFile.h>
 #include <TList.h>
 #include <TKey.h>
+#include <TClass.h>
 
 #include <iostream>
+#include <fstream>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <map>
 
 using namespace std;
+using namespace BTagCombination;
 
 void usage(void)
 {
-  cout << "FTCheckOutput.exe <outputfile.root>" << endl;
+  cout << "FTCheckOutput.exe <outputfile.root> [--report <report.json>] [--trace <trace.json>]" << endl;
+  cout << "  --report <file> - also write the results, as JSON, to file" << endl;
+  cout << "  --trace <file> - write a Chrome trace of the run to file" << endl;
 }
 
-// Abstract class that will do the checking
+// What we know about a key without reading the object it points to.
+struct KeyInfo {
+  string name;
+  string className;
+  short cycle;
+  int objectSize;
+  int fileSize;
+  bool isDirectory;
+};
+
+// Every key in the file, by the directory it is in ("" is the top of the file).
+class FileIndex {
+public:
+  FileIndex (TDirectory *top)
+    : _nKeys(0), _nBytes(0)
+  { Add(top, ""); }
+
+  // The keys in a directory
+  const vector<KeyInfo> &Keys (const string &dir) const;
+
+  // The full paths of the directories in a directory
+  vector<string> SubDirs (const string &dir) const;
+
+  // Is there a key called name in dir?
+  bool Has (const string &dir, const string &name) const;
+
+  // Full paths of all directories depth levels down (tagger/jetAlg/OP is 3).
+  vector<string> DirsAtDepth (int depth) const;
+
+  size_t NKeys (void) const { return _nKeys; }
+  long long NBytes (void) const { return _nBytes; }
+
+private:
+  void Add (TDirectory *d, const string &path);
+
+  map<string, vector<KeyInfo> > _keys;
+  size_t _nKeys;
+  long long _nBytes;
+};
+
+// Abstract class that will do the checking. The checkers run in parallel, so CheckOutput
+// may only look at the index. Each problem found is added to problems.
 class ICheckTagCut {
 public:
+  virtual ~ICheckTagCut() {}
   virtual string Name (void) const = 0;
-  virtual void CheckOutput (TDirectory *tagCutDir, const string &name) const = 0;
+  virtual void CheckOutput (const FileIndex &index, const string &tagCutDir, vector<string> &problems) const = 0;
 };
 
 // Check to make sure all flavors are present.
@@ -32,7 +90,7 @@ public:
     : _flavor (fname)
   {}
   string Name (void) const { return "Check that a directory exists for flavor " + _flavor; }
-  void CheckOutput (TDirectory *tagCutDir, const string &name) const;
+  void CheckOutput (const FileIndex &index, const string &tagCutDir, vector<string> &problems) const;
 private:
   const string _flavor;
 };
@@ -43,118 +101,230 @@ public:
     : _histName (hname)
   {}
   string Name (void) const { return "Check that each flavor directory contains a histogram " + _histName; }
-  void CheckOutput (TDirectory *t, const string &name) const;
+  void CheckOutput (const FileIndex &index, const string &tagCutDir, vector<string> &problems) const;
 private:
   const string _histName;
 };
 
+namespace {
+  //
+  // All the checkers. Add new ones here.
+  //
+  vector<ICheckTagCut*> allCheckers (void)
+  {
+    vector<ICheckTagCut*> checkers;
+    checkers.push_back (new CheckFlavor("B"));
+    checkers.push_back (new CheckFlavor("C"));
+    checkers.push_back (new CheckFlavor("Light"));
+    checkers.push_back (new CheckFlavor("T"));
+    checkers.push_back (new CheckForHisto("default_SF"));
+    checkers.push_back (new CheckForHisto("default_Eff"));
+    return checkers;
+  }
+
+  string json_string (const string &s)
+  {
+    ostringstream out;
+    out << "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+      char c = s[i];
+      if (c == '"' || c == '\\') {
+	out << '\\' << c;
+      } else if ((unsigned char) c < 0x20) {
+	out << "\\u00" << hex << ((c >> 4) & 0xf) << (c & 0xf) << dec;
+      } else {
+	out << c;
+      }
+    }
+    out << "\"";
+    return out.str();
+  }
+}
+
 int main (int argc, char **argv)
 {
-  if (argc != 2) {
+  string inputName;
+  string reportName;
+  for (int i = 1; i < argc; i++) {
+    string a (argv[i]);
+    if (a == "--report" && i+1 < argc) {
+      reportName = argv[++i];
+    } else if (a == "--trace" && i+1 < argc) {
+      StartTracing(argv[++i]);
+    } else if (inputName == "" && a.find("--") != 0) {
+      inputName = a;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (inputName == "") {
     usage();
     return 1;
   }
 
   //
-  // Open the root file
+  // Open the root file, and index it.
   //
 
-  TFile *f = TFile::Open(argv[1], "READ");
-  if (!f->IsOpen()) {
-    cout << "Error opening the output file " << argv[1] << "." << endl;
+  TFile *f = TFile::Open(inputName.c_str(), "READ");
+  if (f == 0 || !f->IsOpen()) {
+    cout << "Error opening the output file " << inputName << "." << endl;
     return 1;
   }
 
+  TraceSpan indexSpan ("index file", inputName);
+  FileIndex index (f);
+  indexSpan.End();
+
   //
-  // All the checkers
+  // The top level is tagger/jetAlg/Cut... The checks are done on each of those.
   //
 
-  vector<ICheckTagCut*> checkers;
-  checkers.push_back (new CheckFlavor("B"));
-  checkers.push_back (new CheckFlavor("C"));
-  checkers.push_back (new CheckFlavor("Light"));
-  checkers.push_back (new CheckFlavor("T"));
-  checkers.push_back (new CheckForHisto("default_SF"));
-  checkers.push_back (new CheckForHisto("default_Eff"));
+  vector<string> tagCutDirs (index.DirsAtDepth(3));
+  vector<ICheckTagCut*> checkers (allCheckers());
 
-  //
-  // Now, loop down through the first several parts of the root file. The top level is
-  // tagger/jetAlg/Cut... we don't need to do anything but with those guys.
-  //
+  unsigned int nThreads = thread::hardware_concurrency();
+  ostringstream report;
+  report << "{" << endl
+	 << "  \"file\": " << json_string(inputName) << "," << endl
+	 << "  \"keys\": " << index.NKeys() << "," << endl
+	 << "  \"bytes\": " << index.NBytes() << "," << endl
+	 << "  \"checks\": [";
 
-  for (size_t i = 0; i < checkers.size(); i++) {
-    const ICheckTagCut &checker(*checkers[i]);
-    cout << endl << checker.Name() << endl;
-
-    TIter i_tagger(f->GetListOfKeys());
-    TKey *tagKey;
-    while ((tagKey = static_cast<TKey*>(i_tagger()))) {
-      if (tagKey->IsFolder()) {
-	TDirectory *tagger = static_cast<TDirectory*>(tagKey->ReadObj());
-	string taggerName (tagger->GetName());
-
-	TKey *jetAlgKey;
-	TIter i_jetAlg(tagger->GetListOfKeys());
-	while ((jetAlgKey = static_cast<TKey*>(i_jetAlg()))) {
-	  if (jetAlgKey->IsFolder()) {
-	    TDirectory *jetAlg = static_cast<TDirectory*>(jetAlgKey->ReadObj());
-	    string jetAlgName (jetAlg->GetName());
-
-	    TKey *OPKey;
-	    TIter i_OP(jetAlg->GetListOfKeys());
-	    while ((OPKey = static_cast<TKey*>(i_OP()))) {
-	      if (OPKey->IsFolder()) {
-		TDirectory *OP = static_cast<TDirectory*>(OPKey->ReadObj());
-		string OPName (OP->GetName());
-	      
-		//
-		// Ok - now we are down at a unit. Do the checks we need to do.
-		//
-
-		ostringstream name;
-		name << "  " << taggerName << "/" << jetAlgName << "/" << OPName;
-		checker.CheckOutput(OP, name.str());
-	      }
-	    }
-	  }
-	}
-      }
+  OrderedParallelFor<vector<string> >
+    (checkers.size(), nThreads,
+     [&] (size_t i) {
+      TraceSpan span ("check", checkers[i]->Name());
+      vector<string> problems;
+      for (size_t d = 0; d < tagCutDirs.size(); d++)
+	checkers[i]->CheckOutput(index, tagCutDirs[d], problems);
+      return problems;
+    },
+     [&] (size_t i, vector<string> &problems) {
+      cout << endl << checkers[i]->Name() << endl;
+      for (size_t p = 0; p < problems.size(); p++)
+	cout << "    " << problems[p] << endl;
+
+      report << (i == 0 ? "" : ",") << endl
+	     << "    {\"name\": " << json_string(checkers[i]->Name())
+	     << ", \"problems\": [";
+      for (size_t p = 0; p < problems.size(); p++)
+	report << (p == 0 ? "" : ", ") << json_string(problems[p]);
+      report << "]}";
+    });
+
+  report << endl << "  ]" << endl << "}" << endl;
+
+  if (reportName != "") {
+    ofstream out (reportName.c_str());
+    out << report.str();
+    if (!out) {
+      cout << "Error writing the report file " << reportName << "." << endl;
+      return 1;
     }
   }
 
+  for (size_t i = 0; i < checkers.size(); i++)
+    delete checkers[i];
+
   return 0;
 }
 
+//
+// Walk a directory, recording its keys, and then do the same for any sub-directories.
+// Only real directories are walked: other folders (a TMap, like the ConversionHashes that
+// FTConvertToCDI --incremental saves) are keys like any other.
+//
+void FileIndex::Add(TDirectory *d, const string &path)
+{
+  vector<KeyInfo> &keys (_keys[path]);
+  TClass *directory (TDirectory::Class());
+
+  TIter i_keys(d->GetListOfKeys());
+  TKey *k;
+  while ((k = static_cast<TKey*>(i_keys()))) {
+    KeyInfo info;
+    info.name = k->GetName();
+    info.className = k->GetClassName();
+    info.cycle = k->GetCycle();
+    info.objectSize = k->GetObjlen();
+    info.fileSize = k->GetNbytes();
+    TClass *c = TClass::GetClass(k->GetClassName());
+    info.isDirectory = c != 0 && c->InheritsFrom(directory);
+    keys.push_back(info);
+
+    _nKeys++;
+    _nBytes += info.fileSize;
+  }
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i].isDirectory) {
+      TDirectory *sub = d->GetDirectory(keys[i].name.c_str());
+      if (sub != 0)
+	Add(sub, path == "" ? keys[i].name : path + "/" + keys[i].name);
+    }
+  }
+}
+
+const vector<KeyInfo> &FileIndex::Keys(const string &dir) const
+{
+  static const vector<KeyInfo> empty;
+  map<string, vector<KeyInfo> >::const_iterator itr = _keys.find(dir);
+  return itr == _keys.end() ? empty : itr->second;
+}
+
+vector<string> FileIndex::SubDirs(const string &dir) const
+{
+  vector<string> result;
+  const vector<KeyInfo> &keys (Keys(dir));
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i].isDirectory)
+      result.push_back(dir == "" ? keys[i].name : dir + "/" + keys[i].name);
+  }
+  return result;
+}
+
+bool FileIndex::Has(const string &dir, const string &name) const
+{
+  const vector<KeyInfo> &keys (Keys(dir));
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i].name == name)
+      return true;
+  }
+  return false;
+}
+
+vector<string> FileIndex::DirsAtDepth(int depth) const
+{
+  vector<string> result;
+  if (depth <= 0) {
+    result.push_back("");
+    return result;
+  }
+  vector<string> above (DirsAtDepth(depth-1));
+  for (size_t i = 0; i < above.size(); i++) {
+    vector<string> subs (SubDirs(above[i]));
+    result.insert(result.end(), subs.begin(), subs.end());
+  }
+  return result;
+}
+
 //
 // Check to see if a given directory currently exists!
 //
-void CheckFlavor::CheckOutput(TDirectory *d, const string &name) const {
-  TObject *o = d->Get(_flavor.c_str());
-  if (o == 0)
-    cout << "  " << name << endl;
+void CheckFlavor::CheckOutput(const FileIndex &index, const string &d, vector<string> &problems) const {
+  if (!index.Has(d, _flavor))
+    problems.push_back(d);
 }
 
 //
 // Check every sub-dir contains a particular object
 //
-void CheckForHisto::CheckOutput(TDirectory *d, const string &name) const {
-  TKey *flavKey;
-  TIter i_Flav(d->GetListOfKeys());
-  while ((flavKey = static_cast<TKey*>(i_Flav()))) {
-    if (flavKey->IsFolder()) {
-      TDirectory *flav = static_cast<TDirectory*>(flavKey->ReadObj());
-      TIter i_objs(flav->GetListOfKeys());
-      TKey *objKey;
-      bool found = false;
-      while ((objKey = static_cast<TKey*>(i_objs()))) {
-	if (_histName == objKey->GetName()) {
-	  found = true;
-	  break;
-	}
-      }
-      if (!found) {
-	cout << "  " << name << "/" << flav->GetName() << endl;
-      }
-    }
+void CheckForHisto::CheckOutput(const FileIndex &index, const string &d, vector<string> &problems) const {
+  vector<string> flavors (index.SubDirs(d));
+  for (size_t i = 0; i < flavors.size(); i++) {
+    if (!index.Has(flavors[i], _histName))
+      problems.push_back(flavors[i]);
   }
 }
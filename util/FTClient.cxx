@@ -0,0 +1,44 @@
+///
+/// FTClient
+///
+///  Run a tool on an FTServer: "FTClient <socket> FTCombine <args>" does what
+/// "FTCombine <args>" would, in this directory and with this terminal, without loading
+/// ROOT or parsing inputs the server already has. Doesn't link against ROOT.
+///
+
+#include "Combination/ToolProtocol.h"
+
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+using namespace BTagCombination;
+
+void usage (void);
+
+int main (int argc, char **argv)
+{
+  if (argc < 3) {
+    usage();
+    return 1;
+  }
+
+#ifdef _WIN32
+  cerr << "Error: FTClient is not available on Windows." << endl;
+  return 1;
+#else
+  try {
+    vector<string> args (argv + 2, argv + argc);
+    return RunOnToolServer(argv[1], args);
+  } catch (exception &e) {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
+  }
+#endif
+}
+
+void usage (void)
+{
+  cerr << "Usage: FTClient <socket> <tool> <tool arguments>" << endl;
+  cerr << "       FTClient <socket> --stop" << endl;
+}
@@ -0,0 +1,96 @@
+///
+/// FTConvertFormat
+///
+///  Convert calibration inputs between the text and the binary formats. Anything
+/// the standard command line arguments will load (text or binary, with --ignore, etc.)
+/// can be written out in either. The binary format loads much faster, and exactly.
+///
+
+#include "Combination/Parser.h"
+#include "Combination/CommonCommandLineUtils.h"
+#include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/CalibrationDataModelBinary.h"
+#include "Combination/Tracing.h"
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+  string eatArg (char **argv, int &index, const int maxArg)
+  {
+    if (index == (maxArg-1))
+      throw runtime_error ("Not enough arguments.");
+    index++;
+    return argv[index];
+  }
+
+  void usage()
+  {
+    cout << "FTConvertFormat --output <fname> [--text] <normal-inputs>" << endl;
+    cout << "  output  File where the results will be written. Required for binary output." << endl;
+    cout << "  text    Write the text format (the default is binary)." << endl;
+  }
+}
+
+int main (int argc, char **argv)
+{
+  try {
+    vector<string> otherArgs;
+    string outputFile ("");
+    bool asText = false;
+
+    for (int i = 1; i < argc; i++) {
+      string a (argv[i]);
+      if (a == "--output") {
+	outputFile = eatArg(argv, i, argc);
+      } else if (a == "--text") {
+	asText = true;
+      } else {
+	otherArgs.push_back(a);
+      }
+    }
+
+    CalibrationInfo info;
+    vector<string> otherFlags;
+    ParseOPInputArgs(otherArgs, info, otherFlags);
+    if (otherFlags.size() > 0) {
+      cerr << "Unknown flag --" << otherFlags[0] << endl;
+      usage();
+      return 1;
+    }
+
+    if (outputFile == "" && !asText) {
+      cerr << "Binary output needs an --output file" << endl;
+      usage();
+      return 1;
+    }
+
+    TraceSpan span ("write", outputFile);
+    if (outputFile == "") {
+      cout << info;
+    } else {
+      ofstream out (outputFile.c_str(), asText ? ios::out : ios::out | ios::binary);
+      if (asText) {
+	out << info;
+      } else {
+	WriteBinaryInfo(out, info);
+      }
+      out.close();
+      if (!out) {
+	cerr << "Error writing " << outputFile << endl;
+	return 1;
+      }
+    }
+  } catch (exception &e) {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -3,7 +3,7 @@
 //
 
 #include "Combination/Parser.h"
-#include "Combination/CDIConverter.h"
+#include "Combination/Pipeline.h"
 #include "Combination/CommonCommandLineUtils.h"
 #include "Combination/CalibrationDataModelStreams.h"
 
@@ -11,6 +11,7 @@
 #include <vector>
 #include <stdexcept>
 #include <fstream>
+#include <memory>
 
 using namespace std;
 using namespace BTagCombination;
@@ -23,31 +24,6 @@ namespace {
     index++;
     return argv[index];
   }
-
-  // Very simple wild-card matching
-  bool wCompare (const string &s1, const string &s2)
-  {
-    if (s1 == "*" || s2 == "*")
-      return true;
-    return s1 == s2;
-  }
-
-  // Match with some basic wildcard info
-  bool isAMatch (const vector<DefaultAnalysis> &defaults, const CalibrationAnalysis &ana)
-  {
-    for (unsigned int i = 0; i < defaults.size(); i++) {
-      const DefaultAnalysis &d(defaults[i]);
-      if (wCompare(ana.jetAlgorithm, d.jetAlgorithm)
-	  && wCompare(ana.flavor, d.flavor)
-	  && wCompare(ana.tagger, d.tagger)
-	  && wCompare(ana.operatingPoint, d.operatingPoint)
-	  && wCompare(ana.name, d.name)
-	  )
-	return true;
-    }
-    return false;
-  }
-
 }
 
 
@@ -67,23 +43,33 @@ int main(int argc, char **argv)
     }
   }
 
+  // A binary input file is mapped, and only the defaults are read from it.
   CalibrationInfo info;
+  unique_ptr<MappedCalibrationFile> mapped;
+  vector<CalibrationAnalysis> defaultCalibrations;
   try {
     vector<string> otherFlags;
-    ParseOPInputArgs (otherArgs, info, otherFlags);
+    mapped = MapOPInputArgs (otherArgs, otherFlags);
+    if (!mapped)
+      ParseOPInputArgs (otherArgs, info, otherFlags);
+
+    if (mapped) {
+      vector<DefaultAnalysis> defaults (mapped->defaults());
+      vector<MappedInputAnalysis> calibs (MappedInputAnalyses(*mapped));
+      for (unsigned int i = 0; i < calibs.size(); i++) {
+	if (IsDefaultAnalysis(defaults, calibs[i].header))
+	  defaultCalibrations.push_back(MakeDefaultAnalysis(calibs[i].load()));
+      }
+    }
   } catch (exception &e) {
     cerr << "Error parsing input files: " << e.what() << endl;
     return 1;
   }
 
-  vector<CalibrationAnalysis> defaultCalibrations;
   const vector<CalibrationAnalysis> &calibs(info.Analyses);
   for (unsigned int i = 0; i < calibs.size(); i++) {
-    if (isAMatch(info.Defaults, calibs[i])) {
-      CalibrationAnalysis def (calibs[i]);
-      def.name = "default";
-      defaultCalibrations.push_back(def);
-    }
+    if (IsDefaultAnalysis(info.Defaults, calibs[i]))
+      defaultCalibrations.push_back(MakeDefaultAnalysis(calibs[i]));
   }
 
   ostream *output (&cout);
@@ -11,6 +11,7 @@
 #include "Combination/CalibrationDataModelStreams.h"
 #include "Combination/BinNameUtils.h"
 #include "Combination/FitLinage.h"
+#include "Combination/CalibrationColumns.h"
 
 #include <vector>
 #include <set>
@@ -89,23 +90,10 @@ namespace {
 		return;
 	}
 
-	double CalcFullError(const CalibrationBin &b)
-	{
-		double e2 = b.centralValueStatisticalError * b.centralValueStatisticalError;
-		for (size_t e = 0; e < b.systematicErrors.size(); e++) {
-			e2 += b.systematicErrors[e].value*b.systematicErrors[e].value;
-		}
-		return sqrt(e2);
-	}
-
 	// Do the calculation for one bin.
-	void RescaleBin(CalibrationBin &dstar, const CalibrationBin &bSFb)
+	void RescaleBin(CalibrationBin &dstar, double bSF, double bSF_err)
 	{
-		// Extract the info we need from the bSF bin.
-		double bSF = bSFb.centralValue;
-		double bSF_err = CalcFullError(bSFb);
-
-		// And from the D* bin
+		// Extract the info we need from the D* bin
 		double cSF = dstar.centralValue;
 		// The b SF systematic is found if its name contains "b SF" 
 		vector<string> sysNames;
@@ -126,21 +114,27 @@ namespace {
 	}
 
 	// Rescale each D* bin, one at a time.
-	void RescaleBins(vector<CalibrationBin> &dstarBins, const vector<CalibrationBin> &bSFBins)
+	void RescaleBins(vector<CalibrationBin> &dstarBins, const CalibrationAnalysis &bSFAna)
 	{
+		const vector<CalibrationBin> &bSFBins(bSFAna.bins);
+
+		// The full error of every bSF bin, calculated in one go.
+		CalibrationColumns bSFColumns(bSFAna);
+		vector<double> bSFFullError(ColumnTotalError(bSFColumns));
+
 		// Build lookup table to help us with next step.
 
-		map<set<CalibrationBinBoundary>, CalibrationBin> bSFBinLookup;
+		map<set<CalibrationBinBoundary>, size_t> bSFBinLookup;
 		for (size_t i = 0; i < bSFBins.size(); i++) {
 			const vector<CalibrationBinBoundary> &bs(bSFBins[i].binSpec);
-			bSFBinLookup[set<CalibrationBinBoundary>(bs.begin(), bs.end())] = bSFBins[i];
+			bSFBinLookup[set<CalibrationBinBoundary>(bs.begin(), bs.end())] = i;
 		}
 
 		// Loop through the D* bins, rescaling one at a time.
 
 		for (size_t i = 0; i < dstarBins.size(); i++) {
 			set<CalibrationBinBoundary> key(dstarBins[i].binSpec.begin(), dstarBins[i].binSpec.end());
-			map<set<CalibrationBinBoundary>, CalibrationBin>::const_iterator i_bsfBin = bSFBinLookup.find(key);
+			map<set<CalibrationBinBoundary>, size_t>::const_iterator i_bsfBin = bSFBinLookup.find(key);
 			if (i_bsfBin == bSFBinLookup.end()) {
 				cerr << "For bin " << OPBinName(dstarBins[i]) << " in D* template could not find matching bin in bSF:" << endl;
 				for (size_t ib = 0; ib < bSFBins.size(); ib++) {
@@ -149,7 +143,8 @@ namespace {
 				cerr << "  ** Skipping bin" << endl;
 			}
 			else {
-				RescaleBin(dstarBins[i], i_bsfBin->second);
+				size_t row = i_bsfBin->second;
+				RescaleBin(dstarBins[i], bSFColumns.centralValue[row], bSFFullError[row]);
 			}
 		}
 	}
@@ -260,7 +255,7 @@ int main(int argc, char **argv)
 				r.name = stringReplace(outputAnaPattern, "<>", a.name);
 				r.metadata_s["Linage"] = BinaryLinageOp(dstar, a, LBDStar);
 
-				RescaleBins(r.bins, a.bins);
+				RescaleBins(r.bins, a);
 
 				cout << "  -> " << OPFullName(a) << endl;
 				cout << "     " << OPFullName(r) << endl;
@@ -11,6 +11,11 @@
 #include "Combination/BinUtils.h"
 #include "Combination/Plots.h"
 #include "Combination/BinNameUtils.h"
+#include "Combination/CalibrationInfoView.h"
+#include "Combination/SubsetUtils.h"
+#include "Combination/CalibrationDataModelBinary.h"
+#include "Combination/LinearCombination.h"
+#include "Combination/Tracing.h"
 
 #include <RooMsgService.h>
 #include <TFile.h>
@@ -18,7 +23,19 @@
 #include <Compression.h>
 
 #include <algorithm>
+#include <cmath>
 #include <sstream>
+#include <functional>
+#include <memory>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <cerrno>
+#endif
 
 using namespace std;
 using namespace BTagCombination;
@@ -28,13 +45,13 @@ void usage(void);
 namespace {
 
   // 
-  // Dump plots into an output file.
+  // Dump plots into an output file. This is the only place the inputs are copied.
   //
   void DumpPlotResults (TDirectory *outDir,
-			const CalibrationInfo &info,
+			const CalibrationInfoView &info,
 			const vector<CalibrationAnalysis> &r)
   {
-    vector<CalibrationAnalysis> anas (info.Analyses);
+    vector<CalibrationAnalysis> anas (info.materialize());
     anas.insert(anas.end(), r.begin(), r.end());
     DumpPlots (outDir, anas, gcByBin);
   }
@@ -64,13 +81,16 @@ namespace {
     return dir->mkdir(subDirName.c_str());
   }
 
-  // Interface for a fit
+  // Interface for a fit. Each fit is a mask on the central analyses.
   class FitTask {
   public:
     inline virtual ~FitTask (void) {}
     virtual string UserTitle () const = 0;
 
-    virtual CalibrationInfo GetAnalyses (const CalibrationInfo &info) const = 0;
+    virtual CalibrationInfoView GetAnalyses (const CalibrationInfoView &info) const = 0;
+
+    // The same fit, done as a change to the linear combination of the central analyses.
+    virtual LinearCombination::Result Downdate (const LinearCombination &central) const = 0;
 
     virtual string StudyClassDirName() const = 0;
     virtual string StudyDirName() const = 0;
@@ -83,7 +103,8 @@ namespace {
     string UserTitle () const { return _name + " fit"; }
     string StudyClassDirName (void) const { return ""; }
     string StudyDirName (void) const { return _name; }
-    CalibrationInfo GetAnalyses (const CalibrationInfo &info) const { return info; }
+    CalibrationInfoView GetAnalyses (const CalibrationInfoView &info) const { return info; }
+    LinearCombination::Result Downdate (const LinearCombination &central) const { return central.Solve(); }
 
   private:
     const string _name;
@@ -124,14 +145,18 @@ namespace {
     string StudyClassDirName (void) const { return _dirName; }
     string StudyDirName (void) const { return _studyDir; }
 
-    CalibrationInfo GetAnalyses (const CalibrationInfo &info) const {
-      CalibrationInfo missingInfo (info);
+    CalibrationInfoView GetAnalyses (const CalibrationInfoView &info) const {
+      CalibrationInfoView missingInfo (info);
       for (set<set<CalibrationBinBoundary> >::const_iterator itr = _remove.begin(); itr != _remove.end(); itr++) {
-	missingInfo.Analyses = removeBin (missingInfo.Analyses, *itr);
+	missingInfo.removeBin (*itr);
       }
       return missingInfo;
     }
 
+    LinearCombination::Result Downdate (const LinearCombination &central) const {
+      return central.SolveWithoutBins (_remove);
+    }
+
   private:
     const set<set<CalibrationBinBoundary> > _remove;
     string _dirName;
@@ -173,14 +198,18 @@ namespace {
     string StudyClassDirName (void) const { return _dirName; }
     string StudyDirName (void) const { return _studyDir; }
 
-    CalibrationInfo GetAnalyses (const CalibrationInfo &info) const {
-      CalibrationInfo missingInfo (info);
+    CalibrationInfoView GetAnalyses (const CalibrationInfoView &info) const {
+      CalibrationInfoView missingInfo (info);
       for (set<string>::const_iterator itr = _remove.begin(); itr != _remove.end(); itr++) {
-	missingInfo.Analyses = removeSysError (missingInfo.Analyses, *itr);
+	missingInfo.removeSysError (*itr);
       }
       return missingInfo;
     }
 
+    LinearCombination::Result Downdate (const LinearCombination &central) const {
+      return central.SolveWithoutSysErrors (_remove);
+    }
+
   private:
     const set<string> _remove;
     string _dirName;
@@ -224,14 +253,18 @@ namespace {
     string StudyClassDirName (void) const { return _dirName; }
     string StudyDirName (void) const { return _studyDir; }
 
-    CalibrationInfo GetAnalyses (const CalibrationInfo &info) const {
-      CalibrationInfo missingInfo (info);
+    CalibrationInfoView GetAnalyses (const CalibrationInfoView &info) const {
+      CalibrationInfoView missingInfo (info);
       for (set<string>::const_iterator itr = _remove.begin(); itr != _remove.end(); itr++) {
-	missingInfo.Analyses = makeSysErrorUncorrelated (missingInfo.Analyses, *itr);
+	missingInfo.makeSysErrorUncorrelated (*itr);
       }
       return missingInfo;
     }
 
+    LinearCombination::Result Downdate (const LinearCombination &central) const {
+      return central.SolveWithSysErrorsUncorrelated (_remove);
+    }
+
   private:
     const set<string> _remove;
     string _dirName;
@@ -239,37 +272,398 @@ namespace {
     string _studyDir;
   };
 
-  // We are given a set of bin names (or objects, whatever) - as long as they are listed in a
-  // set. We will then will return a list of them to remove, numberToRemove at a time.
-  template <typename ST>
-  set<set<ST> > permutationsWithoutNItems (const set<ST> allBins, int numberToRemove)
+  // All the fits to run on one set of analyses, numbered in the order they are run. Each is
+  // made when it is asked for, from its number - the subsets of bins or errors to remove
+  // are never all listed.
+  class FitList {
+  public:
+    FitList (const CalibrationInfoView &central,
+	     const vector<int> &removeBins, const vector<int> &removeSys, const vector<int> &uncorSys)
+      : _size(1), _restricted(false)
+    {
+      set<set<CalibrationBinBoundary> > allBins (central.listAllBins());
+      _bins.assign(allBins.begin(), allBins.end());
+      set<string> allSysErrors (central.listAllSysErrors());
+      _sysErrors.assign(allSysErrors.begin(), allSysErrors.end());
+
+      AddStudies(kRemoveBins, removeBins, _bins.size());
+      AddStudies(kRemoveSys, removeSys, _sysErrors.size());
+      AddStudies(kUncorrelatedSys, uncorSys, _sysErrors.size());
+    }
+
+    size_t size() const { return _restricted ? _keep.size() : _size; }
+
+    // Drop all but the fits numbered in indices. What is left is numbered from 0, in
+    // the order given.
+    void KeepOnly (const vector<size_t> &indices)
+    {
+      _keep = indices;
+      _restricted = true;
+    }
+
+    // Fit number index. The caller owns it.
+    FitTask *Make (size_t index) const
+    {
+      if (_restricted) {
+	if (index >= _keep.size()) {
+	  ostringstream err;
+	  err << "There is no fit number " << index << " (there are " << _keep.size() << ").";
+	  throw runtime_error(err.str());
+	}
+	index = _keep[index];
+      }
+
+      if (index == 0)
+	return new SimpleFit ("Default");
+
+      unsigned long long rank = index - 1;
+      for (size_t i = 0; i < _studies.size(); i++) {
+	const Study &s (_studies[i]);
+	if (rank >= s.count) {
+	  rank -= s.count;
+	  continue;
+	}
+
+	size_t nItems = s.kind == kRemoveBins ? _bins.size() : _sysErrors.size();
+	vector<size_t> which (NthSubset(nItems, s.n < 0 ? 0 : s.n, rank));
+	if (s.kind == kRemoveBins) {
+	  set<set<CalibrationBinBoundary> > bins;
+	  for (size_t w = 0; w < which.size(); w++)
+	    bins.insert(_bins[which[w]]);
+	  return new RemoveBinFit (s.n, bins);
+	}
+
+	set<string> errors;
+	for (size_t w = 0; w < which.size(); w++)
+	  errors.insert(_sysErrors[which[w]]);
+	if (s.kind == kRemoveSys)
+	  return new RemoveSysFit (s.n, errors);
+	return new MakeSysUncorrelatedFit (s.n, errors);
+      }
+
+      ostringstream err;
+      err << "There is no fit number " << index << " (there are " << _size << ").";
+      throw runtime_error(err.str());
+    }
+
+  private:
+    enum StudyKind { kRemoveBins, kRemoveSys, kUncorrelatedSys };
+    struct Study {
+      StudyKind kind;
+      int n;
+      unsigned long long count;
+    };
+
+    void AddStudies (StudyKind kind, const vector<int> &ns, size_t nItems)
+    {
+      for (size_t i = 0; i < ns.size(); i++) {
+	Study s;
+	s.kind = kind;
+	s.n = ns[i];
+	s.count = nChooseK(nItems, s.n < 0 ? 0 : s.n);
+	_studies.push_back(s);
+	_size += s.count;
+      }
+    }
+
+    vector<set<CalibrationBinBoundary> > _bins;
+    vector<string> _sysErrors;
+    vector<Study> _studies;
+    size_t _size;
+    bool _restricted;
+    vector<size_t> _keep;
+  };
+
+  // Called with each fit's result, in fit order.
+  typedef function<void (size_t, const vector<CalibrationAnalysis> &)> t_fitWriter;
+
+  // Run the fits, one after the other.
+  void RunFits (const FitList &fits, const CalibrationInfoView &central, bool verbose, const t_fitWriter &write)
   {
-    // Recursion end case
+    for (size_t i = 0; i < fits.size(); i++) {
+      unique_ptr<FitTask> fit (fits.Make(i));
+      cout << "Doing fit " << fit->UserTitle() << endl;
+      TraceSpan span ("explore fit", fit->UserTitle());
+      vector<CalibrationAnalysis> result (CombineAnalyses(fit->GetAnalyses(central), verbose));
+      span.End();
+      write(i, result);
+    }
+  }
 
-    set<set<ST> > result;
-    if (numberToRemove <= 0) {
-      set<ST> dummy;
-      result.insert(result.begin(), dummy);
-    } else {
-      
-      // Remove one at a time, and recurse to get the next one.
-
-      for (typename set<ST>::const_iterator itr = allBins.begin(); itr != allBins.end(); itr++) {
-	set<ST> minusOne (allBins);
-	minusOne.erase(*itr);
-
-	set<set<ST> > subResult (permutationsWithoutNItems(minusOne, numberToRemove - 1));
-	for(typename set<set<ST> >::iterator i_r = subResult.begin(); i_r != subResult.end(); i_r++) {
-	  set<ST> sr (*i_r);
-	  sr.insert(*itr);
-	  result.insert(sr);
+#ifndef _WIN32
+  //
+  // Running the fits in parallel. RooFit can't be used from several threads, so each
+  // worker is a forked process. The parent hands out fit numbers one at a time as
+  // workers come free, and gets the results back in the (exact) binary format. Results
+  // are written in fit order; no more than a few per worker are handed out ahead of the
+  // next one to be written.
+  //
+
+  void WriteAll (int fd, const void *buffer, size_t n)
+  {
+    const char *b = static_cast<const char*>(buffer);
+    while (n > 0) {
+      ssize_t w = write(fd, b, n);
+      if (w < 0 && errno == EINTR)
+	continue;
+      if (w <= 0)
+	throw runtime_error("Unable to talk to a fit worker process.");
+      b += w;
+      n -= w;
+    }
+  }
+
+  // Returns false if the other end closed before anything was read.
+  bool ReadAll (int fd, void *buffer, size_t n)
+  {
+    char *b = static_cast<char*>(buffer);
+    size_t total = n;
+    while (n > 0) {
+      ssize_t r = read(fd, b, n);
+      if (r < 0 && errno == EINTR)
+	continue;
+      if (r == 0 && n == total)
+	return false;
+      if (r <= 0)
+	throw runtime_error("Lost contact with a fit worker process.");
+      b += r;
+      n -= r;
+    }
+    return true;
+  }
+
+  // The worker: run each fit we are sent, and send back the result (or what went wrong).
+  void FitWorker (int in, int out, const FitList &fits, const CalibrationInfoView &central, bool verbose)
+  {
+    uint64_t index;
+    while (ReadAll(in, &index, sizeof(index))) {
+      string reply;
+      try {
+	unique_ptr<FitTask> fit (fits.Make(index));
+	TraceSpan span ("explore fit", fit->UserTitle());
+	vector<CalibrationAnalysis> result (CombineAnalyses(fit->GetAnalyses(central), verbose));
+	span.End();
+	ostringstream data;
+	for (size_t i = 0; i < result.size(); i++)
+	  WriteBinary(data, result[i]);
+	reply = "R" + data.str();
+      } catch (exception &e) {
+	reply = string("E") + e.what();
+      }
+
+      uint64_t length = reply.size();
+      WriteAll(out, &index, sizeof(index));
+      WriteAll(out, &length, sizeof(length));
+      WriteAll(out, reply.data(), reply.size());
+    }
+  }
+
+  struct FitWorkerProcess {
+    pid_t pid;
+    int toWorker;
+    int fromWorker;
+    bool busy;
+  };
+
+  void RunFitsInJobs (const FitList &fits, const CalibrationInfoView &central, bool verbose,
+		      unsigned int nJobs, const t_fitWriter &write)
+  {
+    if (nJobs > fits.size())
+      nJobs = fits.size();
+
+    // Anything buffered would be written again by each worker.
+    cout.flush();
+    cerr.flush();
+
+    vector<FitWorkerProcess> workers;
+    for (unsigned int j = 0; j < nJobs; j++) {
+      int toWorker[2], fromWorker[2];
+      if (pipe(toWorker) != 0 || pipe(fromWorker) != 0)
+	throw runtime_error("Unable to create pipes for the fit workers.");
+
+      pid_t pid = fork();
+      if (pid < 0)
+	throw runtime_error("Unable to start a fit worker process.");
+      if (pid == 0) {
+	close(toWorker[1]);
+	close(fromWorker[0]);
+	for (size_t w = 0; w < workers.size(); w++) {
+	  close(workers[w].toWorker);
+	  close(workers[w].fromWorker);
+	}
+	int status = 0;
+	try {
+	  FitWorker(toWorker[0], fromWorker[1], fits, central, verbose);
+	} catch (exception &e) {
+	  cerr << "Fit worker failed: " << e.what() << endl;
+	  status = 1;
+	}
+	// Skip the exit handlers - the output file belongs to the parent.
+	cout.flush();
+	cerr.flush();
+	FlushTrace();
+	_exit(status);
+      }
+
+      close(toWorker[0]);
+      close(fromWorker[1]);
+      FitWorkerProcess p;
+      p.pid = pid;
+      p.toWorker = toWorker[1];
+      p.fromWorker = fromWorker[0];
+      p.busy = false;
+      workers.push_back(p);
+    }
+
+    size_t maxAhead = 4*nJobs;
+    size_t nextToSend = 0;
+    size_t nextToWrite = 0;
+    map<size_t, string> waiting;
+
+    try {
+      while (nextToWrite < fits.size()) {
+
+	// Keep everyone busy
+	for (size_t w = 0; w < workers.size(); w++) {
+	  if (!workers[w].busy && nextToSend < fits.size() && nextToSend < nextToWrite + maxAhead) {
+	    uint64_t index = nextToSend++;
+	    WriteAll(workers[w].toWorker, &index, sizeof(index));
+	    workers[w].busy = true;
+	  }
 	}
+
+	// Wait for someone to finish
+	vector<pollfd> busy;
+	vector<size_t> busyWorker;
+	for (size_t w = 0; w < workers.size(); w++) {
+	  if (workers[w].busy) {
+	    pollfd p;
+	    p.fd = workers[w].fromWorker;
+	    p.events = POLLIN;
+	    p.revents = 0;
+	    busy.push_back(p);
+	    busyWorker.push_back(w);
+	  }
+	}
+	TraceSpan waitSpan ("wait for workers");
+	int nReady = poll(&busy[0], busy.size(), -1);
+	waitSpan.End();
+	if (nReady < 0) {
+	  if (errno == EINTR)
+	    continue;
+	  throw runtime_error("Error waiting for the fit workers.");
+	}
+
+	for (size_t b = 0; b < busy.size(); b++) {
+	  if (busy[b].revents == 0)
+	    continue;
+	  FitWorkerProcess &worker (workers[busyWorker[b]]);
+	  uint64_t index, length;
+	  if (!ReadAll(worker.fromWorker, &index, sizeof(index)))
+	    throw runtime_error("A fit worker process died.");
+	  ReadAll(worker.fromWorker, &length, sizeof(length));
+	  string reply (length, ' ');
+	  if (length > 0)
+	    ReadAll(worker.fromWorker, &reply[0], length);
+	  waiting[index] = reply;
+	  worker.busy = false;
+	}
+
+	// Write out everything that is next in line.
+	map<size_t, string>::iterator next;
+	while ((next = waiting.find(nextToWrite)) != waiting.end()) {
+	  const string &reply (next->second);
+	  if (reply.size() == 0 || reply[0] != 'R') {
+	    unique_ptr<FitTask> fit (fits.Make(nextToWrite));
+	    ostringstream err;
+	    err << "Fit " << fit->UserTitle() << " failed: " << (reply.size() > 0 ? reply.substr(1) : "");
+	    throw runtime_error(err.str());
+	  }
+	  istringstream data (reply.substr(1));
+	  vector<CalibrationAnalysis> result;
+	  while (data.peek() != EOF)
+	    result.push_back(ReadBinaryAnalysis(data));
+	  write(nextToWrite, result);
+	  waiting.erase(next);
+	  nextToWrite++;
+	}
+      }
+    } catch (...) {
+      for (size_t w = 0; w < workers.size(); w++) {
+	kill(workers[w].pid, SIGTERM);
+	close(workers[w].toWorker);
+	close(workers[w].fromWorker);
+	waitpid(workers[w].pid, 0, 0);
       }
+      throw;
     }
 
-    return result;
+    // Closing the pipe tells a worker it is done.
+    for (size_t w = 0; w < workers.size(); w++) {
+      close(workers[w].toWorker);
+      close(workers[w].fromWorker);
+      waitpid(workers[w].pid, 0, 0);
+    }
   }
+#endif
+
+  //
+  // Do all the fits as downdates of the linear combination of the central analyses, and
+  // print out how each differs from the default. Returns the fits that moved the chi2/ndof
+  // by refitAbove or more (along with the default fit, if any did), for a full fit. With
+  // a negative refitAbove nothing is flagged. A fit that leaves no degrees of freedom
+  // (too many measurements left out) has no chi2/ndof: those are listed at the end, and
+  // never flagged.
+  //
+  vector<size_t> DowndateFits (const FitList &fits, const CalibrationInfoView &central, double refitAbove)
+  {
+    LinearCombination linear (central);
+    LinearCombination::Result def (linear.Solve());
+    bool defHasChi2 = def.ndof > 0;
+    double defChi2 = defHasChi2 ? def.chi2/def.ndof : 0.0;
+
+    vector<size_t> flagged;
+    vector<string> noDof;
+    for (size_t i = 0; i < fits.size(); i++) {
+      unique_ptr<FitTask> fit (fits.Make(i));
+      LinearCombination::Result r (i == 0 ? def : fit->Downdate(linear));
+
+      cout << "Downdate " << fit->UserTitle() << endl;
+      bool hasChi2 = r.ndof > 0;
+      double chi2 = hasChi2 ? r.chi2/r.ndof : 0.0;
+      if (hasChi2) {
+	cout << "  chi2/ndof = " << chi2;
+	if (i > 0 && defHasChi2)
+	  cout << " (change " << chi2 - defChi2 << ")";
+      } else {
+	cout << "  chi2/ndof undefined (ndof = " << r.ndof << ")";
+	noDof.push_back(fit->UserTitle());
+      }
+      cout << endl;
+
+      for (map<set<CalibrationBinBoundary>, LinearCombination::BinResult>::const_iterator i_b = r.bins.begin(); i_b != r.bins.end(); i_b++) {
+	cout << "    " << OPBinName(i_b->first) << ": " << i_b->second.centralValue << " +- " << i_b->second.error;
+	map<set<CalibrationBinBoundary>, LinearCombination::BinResult>::const_iterator i_def = def.bins.find(i_b->first);
+	if (i > 0 && i_def != def.bins.end())
+	  cout << " (shift " << i_b->second.centralValue - i_def->second.centralValue
+	       << ", error change " << i_b->second.error - i_def->second.error << ")";
+	cout << endl;
+      }
 
+      if (i > 0 && refitAbove >= 0.0 && hasChi2 && defHasChi2 && fabs(chi2 - defChi2) >= refitAbove)
+	flagged.push_back(i);
+    }
+
+    if (noDof.size() > 0) {
+      cout << "Fits with no degrees of freedom left (chi2/ndof not compared):" << endl;
+      for (size_t i = 0; i < noDof.size(); i++)
+	cout << "  " << noDof[i] << endl;
+    }
+
+    if (flagged.size() > 0)
+      flagged.insert(flagged.begin(), 0);
+    return flagged;
+  }
 }
 
 int main (int argc, char **argv)
@@ -281,6 +675,9 @@ int main (int argc, char **argv)
   vector<int> removeSys;
   vector<int> uncorSys;
   bool verbose = false;
+  unsigned int nJobs = 1;
+  bool downdate = false;
+  double refitAbove = -1.0;
 
   try {
     vector<string> otherFlags;
@@ -302,6 +699,23 @@ int main (int argc, char **argv)
 	int r;
 	buf >> r;
 	uncorSys.push_back(r);
+      } else if (itr->find("jobs-") == 0) {
+	istringstream buf (itr->substr(5).c_str());
+	int r = 0;
+	buf >> r;
+	if (r < 1)
+	  throw runtime_error("--jobs needs a number of processes of 1 or more");
+	nJobs = r;
+      } else if (*itr == "downdate") {
+	downdate = true;
+      } else if (itr->find("refit-above-") == 0) {
+	istringstream buf (itr->substr(12).c_str());
+	double r = -1.0;
+	buf >> r;
+	if (buf.fail() || r < 0.0)
+	  throw runtime_error("--refit-above needs a change in chi2/ndof of 0 or more");
+	refitAbove = r;
+	downdate = true;
       } else if (*itr == "verbose") {
 	verbose = true;
       } else {
@@ -333,14 +747,14 @@ int main (int argc, char **argv)
   // What we do can only be done by looking at one fit at a time. So we
   // have to split everything by flavor, tagger, op, and jet algorithm.
 
-  typedef map<string, vector<CalibrationAnalysis> > t_anaMap;
-  t_anaMap binnedAnalyses (BinAnalysesByJetTagFlavOp(allInfo.Analyses));
+  typedef map<string, CalibrationInfoView> t_anaMap;
+  t_anaMap binnedAnalyses (CalibrationInfoView(allInfo).splitByJetTagFlavOp());
 
   for(t_anaMap::const_iterator i_ana = binnedAnalyses.begin(); i_ana != binnedAnalyses.end(); i_ana++) {
 
     // Make sure this is worth our time...
 
-    if (i_ana->second.size() == 1) {
+    if (i_ana->second.nAnalyses() == 1) {
       cout << "Can't explore fits that have only one input" << endl;
       continue;
     }
@@ -348,71 +762,38 @@ int main (int argc, char **argv)
     // Put each set of analyses in a seperate guy.
     TDirectory *outDir = outputPlots->mkdir(Normalize(i_ana->first).c_str());
 
-    // Next, build up a new Calibration Info as the central guy - this will have just one fit. This
-    // will be the template we build all the other fits off of.
+    // The view of just this fit is the central guy. This will be the template we build all the
+    // other fits off of (they only add masks, nothing is copied).
 
-    CalibrationInfo centralInfo (allInfo);
-    centralInfo.Analyses = i_ana->second;
+    const CalibrationInfoView &centralInfo (i_ana->second);
 
-    vector<FitTask*> fits;
-    fits.push_back (new SimpleFit ("Default"));
+    FitList fits (centralInfo, removeBins, removeSys, uncorSys);
 
-    //
-    // Next, if we are doing it by removing bins.
-    //
-
-    for (vector<int>::const_iterator i_bins = removeBins.begin(); i_bins != removeBins.end(); i_bins++) {
-      
-      // Get a list of all bins that we know about
-      set<set<CalibrationBinBoundary> > allBins (listAllBins(centralInfo.Analyses));
-
-      set<set<set<CalibrationBinBoundary> > > binPerm (permutationsWithoutNItems (allBins, *i_bins));
-      for (set<set<set<CalibrationBinBoundary> > >::const_iterator i_p = binPerm.begin(); i_p != binPerm.end(); i_p++) {
-	fits.push_back (new RemoveBinFit (*i_bins, *i_p));
-      }
-    }
-
-    //
-    // Systematic errors?
-    //
-
-    set<string> allSysErrors (listAllSysErrors(centralInfo.Analyses));
-    for (vector<int>::const_iterator i_sys = removeSys.begin(); i_sys != removeSys.end(); i_sys++) {
-
-      // Get the remove list for this one.
-      set<set<string> > binPerm (permutationsWithoutNItems (allSysErrors, *i_sys));
-      for (set<set<string> >::const_iterator i_p = binPerm.begin(); i_p != binPerm.end(); i_p++) {
-	fits.push_back (new RemoveSysFit (*i_sys, *i_p));
-      }
-    }
+    // In downdate mode the full fits are only done for the flagged ones.
+    if (downdate)
+      fits.KeepOnly(DowndateFits(fits, centralInfo, refitAbove));
+    if (fits.size() == 0)
+      continue;
 
     //
-    // Systematic errors uncorrelated?
+    // Write each result out as it comes back (they come back in order).
     //
 
-    for (vector<int>::const_iterator i_sys = uncorSys.begin(); i_sys != uncorSys.end(); i_sys++) {
-
-      // Get the remove list for this one.
-      set<set<string> > binPerm (permutationsWithoutNItems (allSysErrors, *i_sys));
-      for (set<set<string> >::const_iterator i_p = binPerm.begin(); i_p != binPerm.end(); i_p++) {
-	fits.push_back (new MakeSysUncorrelatedFit (*i_sys, *i_p));
+    t_fitWriter write = [&] (size_t index, const vector<CalibrationAnalysis> &result) {
+      unique_ptr<FitTask> fit (fits.Make(index));
+      if (nJobs > 1)
+	cout << "Done fit " << fit->UserTitle() << endl;
+
+      if (result.size() > 0) {
+	map<string, vector<double> >::const_iterator i_chi2 = result[0].metadata.find("gchi2");
+	map<string, vector<double> >::const_iterator i_ndof = result[0].metadata.find("gndof");
+	if (i_chi2 != result[0].metadata.end() && i_ndof != result[0].metadata.end()
+	    && i_chi2->second.size() > 0 && i_ndof->second.size() > 0) {
+	  cout << "  chi2/ndof = " << i_chi2->second[0]/i_ndof->second[0] << endl;
+	} else {
+	  cout << "  chi2/ndof not available" << endl;
+	}
       }
-    }
-
-    //
-    // Now that all the fits are queued up, time to run them!
-    //
-
-    for (vector<FitTask*>::const_iterator itr = fits.begin(); itr != fits.end(); itr++) {
-      const FitTask *fit (*itr);
-      
-      CalibrationInfo info (fit->GetAnalyses(centralInfo));
-
-      cout << "Doing fit " << fit->UserTitle() << endl;
-      vector<CalibrationAnalysis> result (CombineAnalyses(info, verbose));
-
-      double chi2 = result[0].metadata["gchi2"][0]/result[0].metadata["gndof"][0];
-      cout << "  chi2/ndof = " << chi2 << endl;
 
       // Analysis directory. There are two levels, one, what we are investigating,
       // and one if there is a name under that. If the investigation is empty, don't
@@ -423,7 +804,23 @@ int main (int argc, char **argv)
       if (rootClassDir.size() > 0)
 	outClassDir = FindRootSubDir (outDir, rootClassDir);
 
-      DumpPlotResults (outClassDir->mkdir(fit->StudyDirName().c_str()), info, result);
+      DumpPlotResults (outClassDir->mkdir(fit->StudyDirName().c_str()), fit->GetAnalyses(centralInfo), result);
+    };
+
+    //
+    // Now, time to run them!
+    //
+
+    if (nJobs <= 1) {
+      RunFits (fits, centralInfo, verbose, write);
+    } else {
+#ifdef _WIN32
+      cout << "--jobs isn't supported on Windows - running the fits one at a time." << endl;
+      RunFits (fits, centralInfo, verbose, write);
+#else
+      cout << "Running " << fits.size() << " fits in " << nJobs << " processes" << endl;
+      RunFitsInJobs (fits, centralInfo, verbose, nJobs, write);
+#endif
     }
   }
 
@@ -431,6 +828,7 @@ int main (int argc, char **argv)
   // Make sure all plot get written out.
   //
 
+  TraceSpan writeSpan ("write plots");
   outputPlots->Write();
   outputPlots->Close();
 
@@ -439,7 +837,10 @@ int main (int argc, char **argv)
 
 void usage(void)
 {
-  cout << "FTExploreFit <std-cmd-line-argsw> --remove-bin-NN --remove-sys-NN --verbose" << endl;
+  cout << "FTExploreFit <std-cmd-line-argsw> --remove-bin-NN --remove-sys-NN --uncorrelated-sys-NN --jobs-NN --downdate --refit-above-XX --verbose" << endl;
   cout << "  NN is a number - how many to remove or run on each iteration" << endl;
+  cout << "  jobs - run the fits in NN processes at once (default is 1)" << endl;
+  cout << "  downdate - don't fit, work out each variation from the linear combination of the default fit" << endl;
+  cout << "  refit-above - with downdate, do the full fit for variations that change chi2/ndof by XX or more" << endl;
   cout << "  verbose - print out all the usual fit messages from a full blown filt" << endl;
 }
@@ -0,0 +1,167 @@
+///
+/// FTGenerateSynthetic
+///
+///  Write out a made up, but valid, input file of any size - for finding out where
+/// the other tools stop scaling. The same arguments always give the same file.
+///
+
+#include "Combination/SyntheticInputs.h"
+#include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/Tracing.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+
+using namespace std;
+using namespace BTagCombination;
+
+void usage (void);
+
+namespace {
+  vector<string> SplitList (const string &list)
+  {
+    vector<string> result;
+    istringstream in (list);
+    string item;
+    while (getline(in, item, ',')) {
+      if (item.size() > 0)
+	result.push_back(item);
+    }
+    return result;
+  }
+
+  size_t AsCount (const string &flag, const string &value)
+  {
+    istringstream in (value);
+    long long n = -1;
+    in >> n;
+    if (in.fail() || !in.eof() || n < 0)
+      throw runtime_error("--" + flag + " needs a number of 0 or more, not '" + value + "'");
+    return (size_t) n;
+  }
+
+  double AsFraction (const string &flag, const string &value)
+  {
+    istringstream in (value);
+    double f = -1.0;
+    in >> f;
+    if (in.fail() || !in.eof())
+      throw runtime_error("--" + flag + " needs a number, not '" + value + "'");
+    return f;
+  }
+}
+
+int main (int argc, char **argv)
+{
+  try {
+    SyntheticInputSpec spec;
+    string outputName;
+
+    for (int i = 1; i < argc; i++) {
+      string a (argv[i]);
+      if (a.substr(0, 2) != "--") {
+	usage();
+	return 1;
+      }
+      string flag (a.substr(2));
+
+      if (flag == "no-defaults") {
+	spec.defaults = false;
+	continue;
+      } else if (flag == "copies") {
+	spec.copies = true;
+	continue;
+      }
+
+      if (i+1 >= argc) {
+	cerr << "Error: --" << flag << " needs a value" << endl;
+	usage();
+	return 1;
+      }
+      string value (argv[++i]);
+
+      if (flag == "output") {
+	outputName = value;
+      } else if (flag == "trace") {
+	StartTracing(value);
+      } else if (flag == "seed") {
+	spec.seed = AsCount(flag, value);
+      } else if (flag == "analyses") {
+	spec.nAnalyses = AsCount(flag, value);
+      } else if (flag == "flavors") {
+	spec.flavors = SplitList(value);
+      } else if (flag == "taggers") {
+	spec.taggers = SplitList(value);
+      } else if (flag == "operatingPoints") {
+	spec.operatingPoints = SplitList(value);
+      } else if (flag == "jetAlgorithms") {
+	spec.jetAlgorithms = SplitList(value);
+      } else if (flag == "ptBins") {
+	spec.nPtBins = AsCount(flag, value);
+      } else if (flag == "etaBins") {
+	spec.nEtaBins = AsCount(flag, value);
+      } else if (flag == "extendedBins") {
+	spec.nExtendedBins = AsCount(flag, value);
+      } else if (flag == "sys") {
+	spec.nSys = AsCount(flag, value);
+      } else if (flag == "sharedSys") {
+	spec.sharedSysFraction = AsFraction(flag, value);
+      } else if (flag == "uncorrelatedSys") {
+	spec.uncorrelatedSysFraction = AsFraction(flag, value);
+      } else if (flag == "correlations") {
+	spec.correlationDensity = AsFraction(flag, value);
+      } else {
+	cerr << "Error: Unknown flag: --" << flag << endl;
+	usage();
+	return 1;
+      }
+    }
+
+    TraceSpan generateSpan ("generate");
+    CalibrationInfo info (GenerateSyntheticInputs(spec));
+    generateSpan.End();
+
+    TraceSpan writeSpan ("write");
+
+    if (outputName == "") {
+      cout << info;
+    } else {
+      ofstream out (outputName.c_str());
+      out << info;
+      if (!out) {
+	cerr << "Error writing " << outputName << endl;
+	return 1;
+      }
+    }
+  } catch (exception &e) {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+void usage (void)
+{
+  SyntheticInputSpec d;
+  cerr << "FTGenerateSynthetic [--output <file>] [options]" << endl
+       << "  --seed N              Random number seed (" << d.seed << ")" << endl
+       << "  --analyses N          Analyses per flavor/tagger/op/jet (" << d.nAnalyses << ")" << endl
+       << "  --flavors a,b,...     Flavors (bottom)" << endl
+       << "  --taggers a,b,...     Taggers (MV1)" << endl
+       << "  --operatingPoints ... Operating points (0.7)" << endl
+       << "  --jetAlgorithms ...   Jet algorithms (AntiKt4Topo)" << endl
+       << "  --ptBins N            pt bins (" << d.nPtBins << ")" << endl
+       << "  --etaBins N           abseta bins, 0 for pt only binning (" << d.nEtaBins << ")" << endl
+       << "  --extendedBins N      Extended pt bins in the first analysis (" << d.nExtendedBins << ")" << endl
+       << "  --sys N               Systematic errors per analysis (" << d.nSys << ")" << endl
+       << "  --sharedSys F         Fraction shared between analyses (" << d.sharedSysFraction << ")" << endl
+       << "  --uncorrelatedSys F   Fraction of the rest uncorrelated between bins (" << d.uncorrelatedSysFraction << ")" << endl
+       << "  --correlations F      Fraction of analysis pairs and bins with a stat correlation (" << d.correlationDensity << ")" << endl
+       << "  --no-defaults         Don't write Default lines" << endl
+       << "  --copies              Write a Copy of each default to <jetAlgorithm>Copy" << endl
+       << "  --trace <file>        Write a Chrome trace of the run to file" << endl;
+}
@@ -11,6 +11,7 @@
 #include "Combination/BinBoundaryUtils.h"
 #include "Combination/CalibrationDataModelStreams.h"
 #include "Combination/FitLinage.h"
+#include "Combination/CalibrationColumns.h"
 
 #include <vector>
 #include <set>
@@ -150,7 +151,8 @@ int main(int argc, char **argv)
       for (size_t i = 0; i < info.Analyses.size(); i++) {
         CalibrationAnalysis newAna(info.Analyses[i]);
 
-        // Loop through all the bins and add what we need to add.
+        // Loop through all the bins and add what we need to add. This is always a new
+        // error, even if the bin already has one with this name (so not a column edit).
         for (size_t ib = 0; ib < newAna.bins.size(); ib++) {
           CalibrationBin &b(newAna.bins[ib]);
           SystematicError err;
@@ -172,15 +174,9 @@ int main(int argc, char **argv)
         CalibrationAnalysis ana(info.Analyses[i]);
 
         // Remove the sys error if there.
-        for (size_t ib = 0; ib < ana.bins.size(); ib++) {
-          CalibrationBin &b(ana.bins[ib]);
-          for (vector<SystematicError>::iterator is = b.systematicErrors.begin(); is != b.systematicErrors.end(); is++) {
-            if (is->name == dropSysError) {
-              b.systematicErrors.erase(is);
-              break;
-            }
-          }
-        }
+        CalibrationColumns columns(ana);
+        columns.drop_systematic(dropSysError);
+        columns.write_back(ana);
 
         results.push_back(ana);
       }
@@ -0,0 +1,73 @@
+///
+/// FTMergeShards
+///
+///  Put the outputs of a sharded FTCombine run (FTCombine --shard i/N) back together,
+/// into the combined.txt a single FTCombine run would have written.
+///
+
+#include "Combination/Sharding.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace BTagCombination;
+
+void usage (void);
+
+int main (int argc, char **argv)
+{
+  try {
+    string output ("combined.txt");
+    vector<string> shards;
+    for (int i = 1; i < argc; i++) {
+      string a (argv[i]);
+      if (a == "--output") {
+	if (i+1 == argc)
+	  throw runtime_error("--output must be followed by a file name");
+	i++;
+	output = argv[i];
+      } else if (a.size() > 0 && a[0] == '-') {
+	cerr << "Error: Unknown flag: " << a << endl;
+	usage();
+	return 1;
+      } else {
+	ifstream in (a.c_str());
+	if (!in)
+	  throw runtime_error("Unable to open shard file '" + a + "'");
+	ostringstream text;
+	text << in.rdbuf();
+	shards.push_back(text.str());
+      }
+    }
+
+    if (shards.size() == 0) {
+      usage();
+      return 1;
+    }
+
+    // Merge before opening the output, so a bad set of shards leaves it alone.
+    ostringstream merged;
+    MergeShards(shards, merged);
+
+    ofstream out (output.c_str());
+    out << merged.str();
+    out.close();
+    if (!out)
+      throw runtime_error("Unable to write '" + output + "'");
+
+  } catch (exception &e) {
+    cerr << "Error merging the shards: " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
+
+void usage (void)
+{
+  cerr << "Usage: FTMergeShards <shard files> [--output <file>]" << endl;
+  cerr << "  Merge the combined-shard-<i>-of-<N>.txt files from \"FTCombine --shard i/N\" (all N" << endl;
+  cerr << "  of them) into the output (default combined.txt)." << endl;
+}
@@ -0,0 +1,13 @@
+///
+/// FTPipeline
+///
+///  Combine, extrapolate, and write the CDI file in one process. The tool itself is
+/// FTPipelineMain (see ToolMains.h), so FTServer can run it as well.
+///
+
+#include "Combination/ToolMains.h"
+
+int main (int argc, char **argv)
+{
+  return BTagCombination::FTPipelineMain(argc, argv);
+}
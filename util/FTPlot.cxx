@@ -8,6 +8,7 @@
 #include "Combination/CommonCommandLineUtils.h"
 #include "Combination/Plots.h"
 #include "Combination/AtlasStyle.h"
+#include "Combination/Tracing.h"
 
 #include "TROOT.h"
 
@@ -75,6 +76,7 @@ int main (int argc, char **argv)
     SetAtlasStyle();
     DumpPlots (f, calibs, grouping, whatToPlot);
 
+    TraceSpan writeSpan ("write plots");
     f->Write();
     f->Close();
 
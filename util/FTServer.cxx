@@ -0,0 +1,103 @@
+///
+/// FTServer
+///
+///  Keep the combination tools loaded, with RooFit warmed up and the inputs they have
+/// read already parsed, and run them when FTClient asks. Each run happens in its own
+/// forked process, so it behaves exactly as running the tool would (see ToolServer.h).
+///
+
+#include "Combination/ToolServer.h"
+#include "Combination/ToolMains.h"
+#include "Combination/Combiner.h"
+
+#include <RooMsgService.h>
+
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+using namespace BTagCombination;
+
+void usage (void);
+
+namespace {
+  CalibrationAnalysis WarmUpAnalysis (const string &name, double value)
+  {
+    CalibrationAnalysis ana;
+    ana.name = name;
+    ana.flavor = "bottom";
+    ana.tagger = "SV0";
+    ana.operatingPoint = "0.50";
+    ana.jetAlgorithm = "AntiKt4Topo";
+
+    CalibrationBin b;
+    CalibrationBinBoundary bb;
+    bb.variable = "pt";
+    bb.lowvalue = 20.0;
+    bb.highvalue = 30.0;
+    b.binSpec.push_back(bb);
+    b.centralValue = value;
+    b.centralValueStatisticalError = 0.1;
+    b.isExtended = false;
+
+    SystematicError e;
+    e.name = "err";
+    e.value = 0.05;
+    e.uncorrelated = false;
+    b.systematicErrors.push_back(e);
+    ana.bins.push_back(b);
+    return ana;
+  }
+
+  // Do a small fit, so the first real request doesn't pay for setting up RooFit and
+  // MINUIT. The message settings are put back, as the tools set their own.
+  void WarmUp ()
+  {
+    RooMsgService &msg (RooMsgService::instance());
+    bool silent = msg.silentMode();
+    RooFit::MsgLevel killBelow = msg.globalKillBelow();
+    msg.setSilentMode(true);
+    msg.setGlobalKillBelow(RooFit::ERROR);
+
+    CalibrationInfo info;
+    info.Analyses.push_back(WarmUpAnalysis("warm1", 1.0));
+    info.Analyses.push_back(WarmUpAnalysis("warm2", 1.1));
+    info.CombinationAnalysisName = "warm";
+    CombineAnalyses(info, false);
+
+    msg.setSilentMode(silent);
+    msg.setGlobalKillBelow(killBelow);
+  }
+}
+
+int main (int argc, char **argv)
+{
+  if (argc != 2) {
+    usage();
+    return 1;
+  }
+
+  try {
+    map<string, ToolMain> tools;
+    tools["FTCombine"] = FTCombineMain;
+    tools["FTCombineBins"] = FTCombineBinsMain;
+    tools["FTExtrapolateAnalyses"] = FTExtrapolateAnalysesMain;
+    tools["FTDump"] = FTDumpMain;
+    tools["FTConvertToCDI"] = FTConvertToCDIMain;
+    tools["FTPipeline"] = FTPipelineMain;
+
+    WarmUp();
+    ServeTools(argv[1], tools);
+  } catch (exception &e) {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
+
+void usage (void)
+{
+  cerr << "Usage: FTServer <socket>" << endl;
+  cerr << "  Run FTCombine, FTCombineBins, FTExtrapolateAnalyses, FTDump, FTConvertToCDI and FTPipeline" << endl;
+  cerr << "  for FTClient, until \"FTClient <socket> --stop\"." << endl;
+}